@@ -41,6 +41,9 @@
 
 static m_view *default_view = NULL;
 
+/* size of the chunks read to compute the digest of a physical file */
+#define _FS_DIGEST_CHUNK 65536
+
 static int _fs_refcount_lock(m_file *ref)
 {
     int ret = 0;
@@ -812,6 +815,57 @@ public int fs_remap(m_view *v, const char *p, size_t l, m_string *s)
 
 /* -------------------------------------------------------------------------- */
 
+public int fs_digest(m_file *f, m_string_digest *d)
+{
+    /** @brief feeds the contents of a file to a digest context */
+
+    char *buffer = NULL;
+    ssize_t r = 0;
+    off_t offset = 0;
+    int ret = 0;
+
+    if (! f || ! d) {
+        debug("fs_digest(): bad parameters.\n");
+        return -1;
+    }
+
+    pthread_rwlock_rdlock(f->_rwlock);
+
+    if (f->data) {
+        ret = string_digest_update(d, f->data);
+    } else if (f->fd != -1) {
+        /* physical files are read by chunks so that they can be of any size */
+        if (! (buffer = malloc(_FS_DIGEST_CHUNK)) ) {
+            perror(ERR(fs_digest, malloc));
+            pthread_rwlock_unlock(f->_rwlock);
+            return -1;
+        }
+
+        for (;;) {
+            #ifdef WIN32
+            if (lseek(f->fd, offset, SEEK_SET) == -1) r = -1;
+            else r = read(f->fd, buffer, _FS_DIGEST_CHUNK);
+            #else
+            r = pread(f->fd, buffer, _FS_DIGEST_CHUNK, offset);
+            #endif
+            if (r == -1 && errno == EINTR) continue;
+            if (r <= 0) break;
+            if ( (ret = string_digest_write(d, buffer, r)) == -1) break;
+            offset += r;
+        }
+
+        if (r == -1) { perror(ERR(fs_digest, read)); ret = -1; }
+
+        free(buffer);
+    }
+
+    pthread_rwlock_unlock(f->_rwlock);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public int fs_onevent(m_view *v, unsigned int event, void (*function)())
 {
     return 0;
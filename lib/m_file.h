@@ -143,6 +143,10 @@ public int fs_remap(m_view *v, const char *p, size_t l, m_string *s);
 
 /* -------------------------------------------------------------------------- */
 
+public int fs_digest(m_file *f, m_string_digest *d);
+
+/* -------------------------------------------------------------------------- */
+
 public int fs_rename(m_view *v, const char *old, size_t oldlen,
                      const char *new, size_t newlen);
 
@@ -787,7 +787,7 @@ public m_string *http_get_request(int *r, m_string **buf, m_string *input)
     case  0: *buf = _http_split_pipeline(*buf, input, r); break;
 
     /* processing a pipeline */
-    default: if (http_requests > PARTS(input)) {
+    default: if (http_requests > (int) PARTS(input)) {
                 if (PARTS(input) && IS_FRAG(TOKEN(input, 0)))
                     *buf = string_free(input);
                 return NULL;
@@ -895,7 +895,9 @@ static void *_http_find_contentlength(m_string *header)
         for (idx = 0; idx < PARTS(header); idx ++) {
             if (TOKEN_SIZE(header, idx) < 14) continue;
 
-            if (! memcmp(TOKEN_DATA(header, idx), "Content-Length", 14)) {
+            /* header names are case insensitive */
+            if (! string_casecmpn(TOKEN_DATA(header, idx), "Content-Length",
+                                  14)) {
                 /* found the header */
                 *((char *) TOKEN_END(header, 0) + 1) = idx;
                 buf = TOKEN_DATA(header, idx) + 14;
@@ -949,15 +951,19 @@ public const char *http_get_header(m_string *buffer, const char *name)
 
     data = DATA(header);
 
-    if ( (len = strlen(name)) == 14 && ! memcmp(name, "Content-Length", 14)) {
+    len = strlen(name);
+
+    if (len == 14 && ! string_casecmpn(name, "Content-Length", 14)) {
         const char *ptr = NULL;
         if (! (ptr = _http_find_contentlength(header)) )
             return NULL;
         pos = ptr - data;
     } else {
+        /* the name must be followed by a colon, whatever its case */
         for (i = 0; i < PARTS(header); i ++) {
-            if (TOKEN_SIZE(header, i) < len) continue;
-            if (! memcmp(TOKEN_DATA(header, i), name, len)) {
+            if (TOKEN_SIZE(header, i) <= len) continue;
+            if (TOKEN_DATA(header, i)[len] == ':' &&
+                ! string_casecmpn(TOKEN_DATA(header, i), name, len)) {
                 pos = TOKEN_DATA(header, i) - data; break;
             }
         }
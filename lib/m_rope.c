@@ -0,0 +1,541 @@
+/*******************************************************************************
+ *  Concrete Server                                                            *
+ *  Copyright (c) 2005-2024 Raphael Prevost <raph@el.bzh>                      *
+ *                                                                             *
+ *  This software is a computer program whose purpose is to provide a          *
+ *  framework for developing and prototyping network services.                 *
+ *                                                                             *
+ *  This software is governed by the CeCILL  license under French law and      *
+ *  abiding by the rules of distribution of free software.  You can  use,      *
+ *  modify and/ or redistribute the software under the terms of the CeCILL     *
+ *  license as circulated by CEA, CNRS and INRIA at the following URL          *
+ *  "http://www.cecill.info".                                                  *
+ *                                                                             *
+ *  As a counterpart to the access to the source code and  rights to copy,     *
+ *  modify and redistribute granted by the license, users are provided only    *
+ *  with a limited warranty  and the software's author,  the holder of the     *
+ *  economic rights,  and the successive licensors  have only  limited         *
+ *  liability.                                                                 *
+ *                                                                             *
+ *  In this respect, the user's attention is drawn to the risks associated     *
+ *  with loading,  using,  modifying and/or developing or reproducing the      *
+ *  software by the user in light of its specific status of free software,     *
+ *  that may mean  that it is complicated to manipulate,  and  that  also      *
+ *  therefore means  that it is reserved for developers  and  experienced      *
+ *  professionals having in-depth computer knowledge. Users are therefore      *
+ *  encouraged to load and test the software's suitability as regards their    *
+ *  requirements in conditions enabling the security of their systems and/or   *
+ *  data to be ensured and,  more generally, to use and operate it in the      *
+ *  same conditions as regards security.                                       *
+ *                                                                             *
+ *  The fact that you are presently reading this means that you have had       *
+ *  knowledge of the CeCILL license and that you accept its terms.             *
+ *                                                                             *
+ ******************************************************************************/
+
+#include "m_rope.h"
+#include "m_socket.h"
+
+/* segment types */
+#define _ROPE_STRING 0x1
+#define _ROPE_BUFFER 0x2
+#define _ROPE_FILE   0x3
+
+/* maximum number of segments gathered in a single write */
+#define _ROPE_IOV 64
+
+/* strings and files are shared by the slices through a counted reference */
+typedef struct _m_rope_ref {
+    void *ptr;
+    unsigned int refs;
+} _m_rope_ref;
+
+typedef struct _m_rope_seg {
+    int type;
+    _m_rope_ref *ref;
+    const char *data;
+    off_t off;
+    size_t len;
+} _m_rope_seg;
+
+#define _SEG(r, i) (& (r)->_seg[((r)->_head + (i)) % (r)->_alloc])
+
+#ifndef __GNUC__
+static pthread_mutex_t _rope_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Segments */
+/* -------------------------------------------------------------------------- */
+
+static unsigned int _rope_ref(_m_rope_ref *ref, int n)
+{
+    #ifdef __GNUC__
+    return __sync_add_and_fetch(& ref->refs, n);
+    #else
+    unsigned int ret = 0;
+
+    pthread_mutex_lock(& _rope_lock);
+        ret = (ref->refs += n);
+    pthread_mutex_unlock(& _rope_lock);
+
+    return ret;
+    #endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _rope_release(int type, void *ptr)
+{
+    if (type == _ROPE_STRING) string_free(ptr);
+    #ifdef _ENABLE_FILE
+    else if (type == _ROPE_FILE) fs_closefile(ptr);
+    #endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _rope_unref(_m_rope_seg *seg)
+{
+    if (! seg->ref || _rope_ref(seg->ref, -1)) return;
+
+    _rope_release(seg->type, seg->ref->ptr);
+    free(seg->ref);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static const char *_rope_memory(const _m_rope_seg *seg)
+{
+    /* returns the address of the data if the segment lies in memory */
+    #ifdef _ENABLE_FILE
+    m_file *f = NULL;
+
+    if (seg->type == _ROPE_FILE) {
+        f = seg->ref->ptr;
+        /* virtual files live in memory, like socket_sendfile() expects */
+        if (f->fd == -1 && f->data && seg->off + seg->len <= SIZE(f->data))
+            return DATA(f->data) + seg->off;
+        return NULL;
+    }
+    #endif
+
+    return seg->data;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _rope_grow(m_rope *r, size_t count)
+{
+    _m_rope_seg *seg = NULL;
+    size_t alloc = 0, i = 0;
+
+    if (r->_count + count <= r->_alloc) return 0;
+
+    for (alloc = (r->_alloc) ? r->_alloc : 8; alloc < r->_count + count; )
+        alloc *= 2;
+
+    if (! (seg = malloc(alloc * sizeof(*seg))) ) {
+        perror(ERR(_rope_grow, malloc));
+        return -1;
+    }
+
+    /* unwrap the circular array */
+    for (i = 0; i < r->_count; i ++) seg[i] = *_SEG(r, i);
+
+    free(r->_seg);
+    r->_seg = seg;
+    r->_alloc = alloc;
+    r->_head = 0;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _rope_push(m_rope *r, const _m_rope_seg *seg, int front)
+{
+    /* the caller already made room for the segment */
+    if (front) {
+        r->_head = (r->_head + r->_alloc - 1) % r->_alloc;
+        *_SEG(r, 0) = *seg;
+    } else *_SEG(r, r->_count) = *seg;
+
+    r->_count ++;
+    r->_len += seg->len;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _rope_add(m_rope *r, int type, void *ptr, const char *data,
+                     off_t off, size_t len, int front)
+{
+    _m_rope_seg seg;
+
+    seg.type = type;
+    seg.ref = NULL;
+    seg.data = data;
+    seg.off = off;
+    seg.len = len;
+
+    if (_rope_grow(r, 1) == -1) goto _err_grow;
+
+    if (type != _ROPE_BUFFER) {
+        if (! (seg.ref = malloc(sizeof(*seg.ref))) ) {
+            perror(ERR(_rope_add, malloc));
+            goto _err_grow;
+        }
+        seg.ref->ptr = ptr;
+        seg.ref->refs = 1;
+    }
+
+    _rope_push(r, & seg, front);
+
+    return 0;
+
+_err_grow:
+    _rope_release(type, ptr);
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _rope_consume(m_rope *r, size_t len)
+{
+    _m_rope_seg *seg = NULL;
+
+    r->_len -= len;
+
+    while (len) {
+        seg = _SEG(r, 0);
+
+        if (len < seg->len) {
+            if (seg->type == _ROPE_FILE) seg->off += len;
+            else seg->data += len;
+            seg->len -= len;
+            return;
+        }
+
+        len -= seg->len;
+        _rope_unref(seg);
+        r->_head = (r->_head + 1) % r->_alloc;
+        r->_count --;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API */
+/* -------------------------------------------------------------------------- */
+
+public m_rope *rope_alloc(void)
+{
+    m_rope *new = NULL;
+
+    if (! (new = malloc(sizeof(*new))) ) {
+        perror(ERR(rope_alloc, malloc));
+        return NULL;
+    }
+
+    new->_seg = NULL;
+    new->_head = new->_count = new->_alloc = 0;
+    new->_len = 0;
+
+    return new;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_rope *rope_free(m_rope *rope)
+{
+    size_t i = 0;
+
+    if (! rope) return NULL;
+
+    for (i = 0; i < rope->_count; i ++) _rope_unref(_SEG(rope, i));
+
+    free(rope->_seg);
+    free(rope);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _rope_string(m_rope *rope, m_string *string, int front)
+{
+    if (! rope || ! string) {
+        debug("_rope_string(): bad parameters.\n");
+        string_free(string);
+        return -1;
+    }
+
+    if (! SIZE(string)) { string_free(string); return 0; }
+
+    /* the rope outlives the arena of the request, if any */
+    if (! (string = string_arena_escape(string)) ) return -1;
+
+    return _rope_add(rope, _ROPE_STRING, string, DATA(string), 0,
+                     SIZE(string), front);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_append(m_rope *rope, m_string *string)
+{
+    return _rope_string(rope, string, 0);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_prepend(m_rope *rope, m_string *string)
+{
+    return _rope_string(rope, string, 1);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_append_buffer(m_rope *rope, const char *data, size_t len)
+{
+    if (! rope || (! data && len)) {
+        debug("rope_append_buffer(): bad parameters.\n");
+        return -1;
+    }
+
+    if (! len) return 0;
+
+    return _rope_add(rope, _ROPE_BUFFER, NULL, data, 0, len, 0);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_prepend_buffer(m_rope *rope, const char *data, size_t len)
+{
+    if (! rope || (! data && len)) {
+        debug("rope_prepend_buffer(): bad parameters.\n");
+        return -1;
+    }
+
+    if (! len) return 0;
+
+    return _rope_add(rope, _ROPE_BUFFER, NULL, data, 0, len, 1);
+}
+
+/* -------------------------------------------------------------------------- */
+#ifdef _ENABLE_FILE
+/* -------------------------------------------------------------------------- */
+
+static int _rope_file(m_rope *rope, m_file *f, off_t off, size_t len, int front)
+{
+    if (! rope || ! f || off < 0 || (size_t) off > f->len) {
+        debug("_rope_file(): bad parameters.\n");
+        if (f) fs_closefile(f);
+        return -1;
+    }
+
+    if (! len) len = f->len - off;
+
+    if (! len) { fs_closefile(f); return 0; }
+
+    return _rope_add(rope, _ROPE_FILE, f, NULL, off, len, front);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_append_file(m_rope *rope, m_file *f, off_t off, size_t len)
+{
+    return _rope_file(rope, f, off, len, 0);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_prepend_file(m_rope *rope, m_file *f, off_t off, size_t len)
+{
+    return _rope_file(rope, f, off, len, 1);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+public int rope_cat(m_rope *rope, m_rope *tail)
+{
+    size_t i = 0;
+
+    if (! rope || ! tail || rope == tail) {
+        debug("rope_cat(): bad parameters.\n");
+        return -1;
+    }
+
+    if (_rope_grow(rope, tail->_count) == -1) return -1;
+
+    /* the references are moved along with the segments */
+    for (i = 0; i < tail->_count; i ++) _rope_push(rope, _SEG(tail, i), 0);
+
+    tail->_count = 0;
+    rope_free(tail);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_rope *rope_slice(const m_rope *rope, size_t off, size_t len)
+{
+    m_rope *new = NULL;
+    _m_rope_seg seg;
+    size_t i = 0, skip = 0;
+
+    if (! rope || off > rope->_len) {
+        debug("rope_slice(): bad parameters.\n");
+        return NULL;
+    }
+
+    if (! len || len > rope->_len - off) len = rope->_len - off;
+
+    if (! (new = rope_alloc()) ) return NULL;
+
+    for (i = 0; i < rope->_count && len; i ++) {
+        seg = *_SEG(rope, i);
+
+        /* skip the segments before the slice */
+        if (off >= seg.len) { off -= seg.len; continue; }
+
+        skip = off; off = 0;
+        if (seg.type == _ROPE_FILE) seg.off += skip;
+        else seg.data += skip;
+        seg.len -= skip;
+        if (seg.len > len) seg.len = len;
+        len -= seg.len;
+
+        if (_rope_grow(new, 1) == -1) return rope_free(new);
+
+        if (seg.ref) _rope_ref(seg.ref, 1);
+        _rope_push(new, & seg, 0);
+    }
+
+    return new;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public size_t rope_size(const m_rope *rope)
+{
+    return (rope) ? rope->_len : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *rope_flatten(const m_rope *rope)
+{
+    m_string *ret = NULL;
+    const _m_rope_seg *seg = NULL;
+    const char *data = NULL;
+    size_t i = 0;
+    #ifdef _ENABLE_FILE
+    char buffer[65536];
+    m_file *f = NULL;
+    size_t done = 0;
+    ssize_t r = 0;
+    #endif
+
+    if (! rope) {
+        debug("rope_flatten(): bad parameters.\n");
+        return NULL;
+    }
+
+    if (! (ret = string_prealloc(NULL, 0, rope->_len)) ) return NULL;
+
+    for (i = 0; i < rope->_count; i ++) {
+        seg = _SEG(rope, i);
+
+        if ( (data = _rope_memory(seg)) ) {
+            string_cats(ret, data, seg->len);
+            continue;
+        }
+
+        #ifdef _ENABLE_FILE
+        /* physical files are read by chunks, like fs_digest() does */
+        f = seg->ref->ptr;
+
+        pthread_rwlock_rdlock(f->_rwlock);
+
+        for (done = 0; done < seg->len; done += r) {
+            r = seg->len - done;
+            if (r > (ssize_t) sizeof(buffer)) r = sizeof(buffer);
+            #ifdef WIN32
+            if (lseek(f->fd, seg->off + done, SEEK_SET) == -1) r = -1;
+            else r = read(f->fd, buffer, r);
+            #else
+            r = pread(f->fd, buffer, r, seg->off + done);
+            #endif
+            if (r == -1 && errno == EINTR) { r = 0; continue; }
+            if (r <= 0) break;
+            string_cats(ret, buffer, r);
+        }
+
+        pthread_rwlock_unlock(f->_rwlock);
+
+        if (done < seg->len) {
+            perror(ERR(rope_flatten, read));
+            return string_free(ret);
+        }
+        #endif
+    }
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public ssize_t rope_write(m_rope *rope, m_socket *s)
+{
+    struct iovec iov[_ROPE_IOV];
+    const _m_rope_seg *seg = NULL;
+    const char *data = NULL;
+    ssize_t total = 0, w = 0;
+    size_t want = 0;
+    int n = 0;
+    #ifdef _ENABLE_FILE
+    off_t off = 0;
+    #endif
+
+    if (! rope || ! s) {
+        debug("rope_write(): bad parameters.\n");
+        return SOCKET_EPARAM;
+    }
+
+    while (rope->_count) {
+        /* gather the consecutive segments which lie in memory */
+        for (n = 0, want = 0; n < _ROPE_IOV && (size_t) n < rope->_count; n ++) {
+            seg = _SEG(rope, n);
+            if (! (data = _rope_memory(seg)) ) break;
+            iov[n].iov_base = (void *) data;
+            iov[n].iov_len = seg->len;
+            want += seg->len;
+        }
+
+        if (n) w = socket_writev(s, iov, n);
+        #ifdef _ENABLE_FILE
+        else {
+            seg = _SEG(rope, 0);
+            off = seg->off;
+            want = seg->len;
+            /* the file may have been truncated behind our back */
+            if (! (w = socket_sendfile(s, seg->ref->ptr, & off, want)) )
+                w = SOCKET_EFATAL;
+        }
+        #endif
+
+        if (w <= 0) return (total) ? total : w;
+
+        _rope_consume(rope, w);
+        total += w;
+
+        /* the socket is full, let the caller poll it */
+        if ((size_t) w < want) break;
+    }
+
+    return total;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,319 @@
+/*******************************************************************************
+ *  Concrete Server                                                            *
+ *  Copyright (c) 2005-2024 Raphael Prevost <raph@el.bzh>                      *
+ *                                                                             *
+ *  This software is a computer program whose purpose is to provide a          *
+ *  framework for developing and prototyping network services.                 *
+ *                                                                             *
+ *  This software is governed by the CeCILL  license under French law and      *
+ *  abiding by the rules of distribution of free software.  You can  use,      *
+ *  modify and/ or redistribute the software under the terms of the CeCILL     *
+ *  license as circulated by CEA, CNRS and INRIA at the following URL          *
+ *  "http://www.cecill.info".                                                  *
+ *                                                                             *
+ *  As a counterpart to the access to the source code and  rights to copy,     *
+ *  modify and redistribute granted by the license, users are provided only    *
+ *  with a limited warranty  and the software's author,  the holder of the     *
+ *  economic rights,  and the successive licensors  have only  limited         *
+ *  liability.                                                                 *
+ *                                                                             *
+ *  In this respect, the user's attention is drawn to the risks associated     *
+ *  with loading,  using,  modifying and/or developing or reproducing the      *
+ *  software by the user in light of its specific status of free software,     *
+ *  that may mean  that it is complicated to manipulate,  and  that  also      *
+ *  therefore means  that it is reserved for developers  and  experienced      *
+ *  professionals having in-depth computer knowledge. Users are therefore      *
+ *  encouraged to load and test the software's suitability as regards their    *
+ *  requirements in conditions enabling the security of their systems and/or   *
+ *  data to be ensured and,  more generally, to use and operate it in the      *
+ *  same conditions as regards security.                                       *
+ *                                                                             *
+ *  The fact that you are presently reading this means that you have had       *
+ *  knowledge of the CeCILL license and that you accept its terms.             *
+ *                                                                             *
+ ******************************************************************************/
+
+#ifndef M_ROPE_H
+
+#define M_ROPE_H
+
+#include "m_core_def.h"
+#include "m_string.h"
+#include "m_file.h"
+
+/* m_socket.h may include this header through m_config.h and m_server.h */
+struct m_socket;
+
+/** @defgroup rope core::rope */
+
+typedef struct m_rope {
+    /* private */
+    struct _m_rope_seg *_seg;
+    size_t _head;
+    size_t _count;
+    size_t _alloc;
+    size_t _len;
+} m_rope;
+
+/**
+ * @ingroup rope
+ * @struct m_rope
+ *
+ * This structure holds an ordered list of segments, which are transmitted
+ * one after the other without ever being copied into a single buffer.
+ *
+ * Its fields are private and should not be directly accessed.
+ *
+ * @b private @ref _seg is a circular array of segments.
+ * @b private @ref _head is the index of the first segment in the array.
+ * @b private @ref _count is the number of segments.
+ * @b private @ref _alloc is the capacity of the array.
+ * @b private @ref _len is the total length of the rope, in bytes.
+ *
+ * Since the array is circular, both ends can grow in amortized constant time.
+ * A segment is either a string owned by the rope, a buffer owned by the
+ * caller or a region of a file; strings and files are reference counted so
+ * that slices of a rope share them instead of copying their data.
+ *
+ * A rope is not thread safe, but distinct slices of the same rope can be
+ * used by different threads.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_rope *rope_alloc(void);
+
+/**
+ * @ingroup rope
+ * @fn m_rope *rope_alloc(void)
+ * @param void
+ * @return a pointer to a new empty m_rope, or NULL.
+ *
+ * This function allocates a new empty rope.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_rope *rope_free(m_rope *rope);
+
+/**
+ * @ingroup rope
+ * @fn m_rope *rope_free(m_rope *rope)
+ * @param rope a pointer to a rope
+ * @return always NULL
+ *
+ * This function destroys a rope and releases its segments. Strings and files
+ * are freed or closed once no other slice references them anymore.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_append(m_rope *rope, m_string *string);
+
+/**
+ * @ingroup rope
+ * @fn int rope_append(m_rope *rope, m_string *string)
+ * @param rope a pointer to a rope
+ * @param string the string to append
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function appends a string at the end of the rope. The rope takes the
+ * ownership of the string, which must not be used by the caller anymore,
+ * even if the call fails. Strings allocated in an arena are moved to the
+ * heap first, since the rope usually outlives the request.
+ *
+ * If the same data must be transmitted on several sockets, append a
+ * different string returned by @ref string_share() to each rope.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_prepend(m_rope *rope, m_string *string);
+
+/**
+ * @ingroup rope
+ * @fn int rope_prepend(m_rope *rope, m_string *string)
+ * @param rope a pointer to a rope
+ * @param string the string to prepend
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function is identical to @ref rope_append(), except that the string
+ * is inserted at the beginning of the rope. It is typically used to add
+ * the headers of a response once its body is complete.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_append_buffer(m_rope *rope, const char *data, size_t len);
+
+/**
+ * @ingroup rope
+ * @fn int rope_append_buffer(m_rope *rope, const char *data, size_t len)
+ * @param rope a pointer to a rope
+ * @param data the buffer to append
+ * @param len the length of the buffer
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function appends a buffer at the end of the rope, without copying it.
+ * The buffer remains owned by the caller and must stay valid and unmodified
+ * until the rope and all its slices are destroyed; it is meant for static
+ * data and for buffers shared by a plugin for its whole lifetime.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_prepend_buffer(m_rope *rope, const char *data, size_t len);
+
+/**
+ * @ingroup rope
+ * @fn int rope_prepend_buffer(m_rope *rope, const char *data, size_t len)
+ * @param rope a pointer to a rope
+ * @param data the buffer to prepend
+ * @param len the length of the buffer
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function is identical to @ref rope_append_buffer(), except that the
+ * buffer is inserted at the beginning of the rope.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+#ifdef _ENABLE_FILE
+/* -------------------------------------------------------------------------- */
+
+public int rope_append_file(m_rope *rope, m_file *f, off_t off, size_t len);
+
+/**
+ * @ingroup rope
+ * @fn int rope_append_file(m_rope *rope, m_file *f, off_t off, size_t len)
+ * @param rope a pointer to a rope
+ * @param f the file to append
+ * @param off the offset of the region in the file
+ * @param len the length of the region, or 0 up to the end of the file
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function appends a region of a file at the end of the rope. Like
+ * @ref server_reply_setfile(), the rope takes the ownership of the file and
+ * closes it when it is not referenced anymore, even if the call fails.
+ *
+ * The file is transmitted with @ref socket_sendfile() when the rope is sent.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int rope_prepend_file(m_rope *rope, m_file *f, off_t off, size_t len);
+
+/**
+ * @ingroup rope
+ * @fn int rope_prepend_file(m_rope *rope, m_file *f, off_t off, size_t len)
+ * @param rope a pointer to a rope
+ * @param f the file to prepend
+ * @param off the offset of the region in the file
+ * @param len the length of the region, or 0 up to the end of the file
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function is identical to @ref rope_append_file(), except that the
+ * region is inserted at the beginning of the rope.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+public int rope_cat(m_rope *rope, m_rope *tail);
+
+/**
+ * @ingroup rope
+ * @fn int rope_cat(m_rope *rope, m_rope *tail)
+ * @param rope a pointer to a rope
+ * @param tail the rope to append
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function moves all the segments of @ref tail at the end of @ref rope
+ * and destroys @ref tail. No data is copied. If the call fails, both ropes
+ * are left untouched.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_rope *rope_slice(const m_rope *rope, size_t off, size_t len);
+
+/**
+ * @ingroup rope
+ * @fn m_rope *rope_slice(const m_rope *rope, size_t off, size_t len)
+ * @param rope a pointer to a rope
+ * @param off the offset of the slice
+ * @param len the length of the slice, or 0 up to the end of the rope
+ * @return a new rope, or NULL if an error occurs
+ *
+ * This function returns a new rope covering a part of the given rope. The
+ * slice only references the segments of the original rope, so the cost of
+ * this call depends on the number of segments and not on their size. Both
+ * ropes can then be modified, sent and destroyed independently.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public size_t rope_size(const m_rope *rope);
+
+/**
+ * @ingroup rope
+ * @fn size_t rope_size(const m_rope *rope)
+ * @param rope a pointer to a rope
+ * @return the length of the rope in bytes
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *rope_flatten(const m_rope *rope);
+
+/**
+ * @ingroup rope
+ * @fn m_string *rope_flatten(const m_rope *rope)
+ * @param rope a pointer to a rope
+ * @return a new string holding the contents of the rope, or NULL
+ *
+ * This function copies all the segments of the rope into a single string.
+ * It should not be needed to send a rope, and is provided for the code which
+ * needs to parse or hash the whole data.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public ssize_t rope_write(m_rope *rope, struct m_socket *s);
+
+/**
+ * @ingroup rope
+ * @fn ssize_t rope_write(m_rope *rope, m_socket *s)
+ * @param rope a pointer to a rope
+ * @param s the socket
+ * @return the number of bytes written, 0 if the rope is empty, or an error
+ *
+ * @note This is a private function, it should not be called from a plugin.
+ *
+ * This function sends the rope over the socket, with a single
+ * @ref socket_writev() call for consecutive memory segments and with
+ * @ref socket_sendfile() for file segments. The bytes written are removed
+ * from the head of the rope, so that the call can be retried until the rope
+ * is empty.
+ *
+ * It returns the number of bytes written if any, or the error code of the
+ * underlying socket call (see @ref socket_write()).
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+#endif
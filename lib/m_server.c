@@ -34,6 +34,7 @@
  ******************************************************************************/
 
 #include "m_server.h"
+#include "ports/m_port_bitops.c"
 
 /* -------------------------------------------------------------------------- */
 #ifdef _ENABLE_SERVER
@@ -86,6 +87,24 @@ static m_queue *_work[SOCKET_MAX];
 /* sockets fragmentation cache */
 static m_string *_frag[SOCKET_MAX];
 
+/* metrics shared with the monitoring tools */
+static m_server_metrics *_metrics = NULL;
+static size_t _metrics_size = 0;
+static char _metrics_name[32];
+static pthread_key_t _metrics_key;
+
+static uint64_t _server_clock(void);
+
+/* latency histograms, allocated on first use */
+static m_server_latency *_latency[PLUGIN_MAX + 1][INGRESS_MAX + 1];
+static pthread_mutex_t _latency_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef __GNUC__
+#define _latency_add(v, n) __sync_fetch_and_add(& (v), (n))
+#else
+#define _latency_add(v, n) ((v) += (n))
+#endif
+
 #ifdef _ENABLE_PRIVILEGE_SEPARATION
 #define _OP_LEN 4
 static pthread_mutex_t _priv_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -114,7 +133,9 @@ public m_reply *server_reply_init(uint16_t flags, uint32_t token)
     new->timer = 0; new->delay = 0;
     new->op = flags;
     new->token = token;
+    new->queued = 0;
     new->header = new->footer = NULL;
+    new->rope = NULL;
     #ifdef _ENABLE_FILE
     new->file = NULL;
     new->off = new->len = 0;
@@ -135,6 +156,7 @@ public m_reply *server_reply_free(m_reply *r)
 
     string_free(r->header);
     string_free(r->footer);
+    rope_free(r->rope);
 
     free(r);
 
@@ -153,7 +175,10 @@ public int server_reply_setheader(m_reply *reply, m_string *data)
     if (reply->header) {
         string_cat(reply->header, data);
         string_free(data);
-    } else reply->header = data;
+    } else {
+        /* the reply outlives the arena of the request, if any */
+        if (! (reply->header = string_arena_escape(data)) ) return -1;
+    }
 
     return 0;
 }
@@ -170,7 +195,10 @@ public int server_reply_setfooter(m_reply *reply, m_string *data)
     if (reply->footer) {
         string_cat(reply->footer, data);
         string_free(data);
-    } else reply->footer = data;
+    } else {
+        /* the reply outlives the arena of the request, if any */
+        if (! (reply->footer = string_arena_escape(data)) ) return -1;
+    }
 
     return 0;
 }
@@ -203,6 +231,27 @@ public int server_reply_setfile(m_reply *reply, m_file *f, off_t o, size_t len)
 #endif
 /* -------------------------------------------------------------------------- */
 
+public int server_reply_setrope(m_reply *reply, m_rope *rope)
+{
+    if (! reply || ! rope) {
+        debug("server_reply_setrope(): bad parameters.\n");
+        return -1;
+    }
+
+    if (reply->op & SERVER_TRANS_OOB) {
+        debug("server_reply_setrope(): cannot send rope out of band.\n");
+        return -1;
+    }
+
+    if (reply->rope) return rope_cat(reply->rope, rope);
+
+    reply->rope = rope;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public int server_reply_setdelay(m_reply *reply, unsigned int nsec)
 {
     struct timespec ts;
@@ -249,6 +298,7 @@ public m_reply *server_send_reply(uint16_t sockid, m_reply *r)
     }
 
     /* queue the task */
+    r->queued = _server_clock();
     queue_add(_work[sockid], (void *) r);
 
     return NULL;
@@ -296,6 +346,18 @@ static int server_reply_process(m_reply *r, m_socket *s)
 
     r->header = string_free(r->header);
 
+    /* rope */
+    if (r->rope) {
+        if ( (w = rope_write(r->rope, s)) < 0) {
+            return (w == SOCKET_EAGAIN) ? SOCKET_EAGAIN : SOCKET_EFATAL;
+        } else if (rope_size(r->rope)) {
+            debug("server_reply_process(): partial rope write.\n");
+            return SOCKET_EAGAIN;
+        }
+    }
+
+    r->rope = rope_free(r->rope);
+
     #ifdef _ENABLE_FILE
     /* file */
     if (r->file) {
@@ -326,6 +388,170 @@ static int server_reply_process(m_reply *r, m_socket *s)
     return 0;
 }
 
+/* -------------------------------------------------------------------------- */
+/* Server metrics */
+/* -------------------------------------------------------------------------- */
+
+static unsigned long _server_pid(void)
+{
+    #ifdef WIN32
+    return GetCurrentProcessId();
+    #else
+    return getpid();
+    #endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+static uint64_t _server_clock(void)
+{
+    struct timespec ts;
+
+    monotonic_timer(& ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static m_server_counters *_server_counters(void)
+{
+    /* only the server threads have counters */
+    return (_metrics) ? pthread_getspecific(_metrics_key) : NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _server_metrics_init(void)
+{
+    _metrics_size = sizeof(*_metrics) +
+                    _concurrency * sizeof(*_metrics->thread);
+
+    snprintf(_metrics_name, sizeof(_metrics_name), SERVER_METRICS_NAME,
+             _server_pid());
+
+    if (pthread_key_create(& _metrics_key, NULL) != 0) {
+        perror(ERR(_server_metrics_init, pthread_key_create));
+        return -1;
+    }
+
+    #ifndef WIN32
+    /* a segment with our pid can only be a leftover of a crashed server */
+    shm_unlink(_metrics_name);
+    #endif
+
+    if (! (_metrics = shm_alloc(_metrics_name, _metrics_size)) ) {
+        pthread_key_delete(_metrics_key);
+        return -1;
+    }
+
+    memset(_metrics, 0, _metrics_size);
+
+    _metrics->version = SERVER_METRICS_VERSION;
+    _metrics->size = _metrics_size;
+    _metrics->threads = _concurrency;
+    _metrics->started = time(NULL);
+    _metrics->magic = SERVER_METRICS_MAGIC;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _server_metrics_fini(void)
+{
+    if (! _metrics) return;
+
+    shm_free(_metrics_name, _metrics, _metrics_size);
+    pthread_key_delete(_metrics_key);
+
+    _metrics = NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Server latency histograms */
+/* -------------------------------------------------------------------------- */
+
+public unsigned int server_latency_bucket(uint64_t usec)
+{
+    unsigned int msb = 0;
+
+    /* the first 4 buckets are linear */
+    if (usec < 4) return usec;
+
+    /* more than an hour */
+    if (usec >> 32) return SERVER_LATENCY_BUCKETS - 1;
+
+    msb = 31 - __clz((uint32_t) usec);
+
+    return ((msb - 1) << 2) | ((usec >> (msb - 2)) & 3);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public uint64_t server_latency_bound(unsigned int bucket)
+{
+    unsigned int msb = (bucket >> 2) + 1;
+
+    if (bucket < 4) return bucket;
+
+    if (bucket >= SERVER_LATENCY_BUCKETS - 4) return UINT64_MAX;
+
+    return ((uint64_t) (4 + (bucket & 3) + 1) << (msb - 2)) - 1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _server_latency(int kind, m_socket *s, uint64_t usec)
+{
+    m_server_latency *h = NULL;
+    uint64_t max = 0;
+    unsigned int plugin = PLUGIN_ID(s), ingress = INGRESS_ID(s);
+
+    if (! (h = _latency[plugin][ingress]) ) {
+        pthread_mutex_lock(& _latency_lock);
+            if (! (h = _latency[plugin][ingress]) ) {
+                h = calloc(SERVER_LATENCY_KINDS, sizeof(*h));
+                /* the zeroed histograms must be visible before the pointer,
+                   which is read without the lock */
+                #ifdef __GNUC__
+                __sync_synchronize();
+                #endif
+                _latency[plugin][ingress] = h;
+            }
+        pthread_mutex_unlock(& _latency_lock);
+
+        if (! h) return;
+    }
+
+    h += kind;
+
+    _latency_add(h->count, 1);
+    _latency_add(h->sum, usec);
+    _latency_add(h->bucket[server_latency_bucket(usec)], 1);
+
+    while ( (max = h->max) < usec) {
+        #ifdef __GNUC__
+        if (__sync_bool_compare_and_swap(& h->max, max, usec)) break;
+        #else
+        h->max = usec; break;
+        #endif
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _server_latency_fini(void)
+{
+    unsigned int i = 0, j = 0;
+
+    for (i = 0; i <= PLUGIN_MAX; i ++) {
+        for (j = 0; j <= INGRESS_MAX; j ++) {
+            free(_latency[i][j]); _latency[i][j] = NULL;
+        }
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 /* Server polling routines */
 /* -------------------------------------------------------------------------- */
@@ -402,6 +628,13 @@ _wait:
     hashtable_foreach(_UDP, _server_poll_udp);
     #endif
 
+    if (_metrics) {
+        _metrics->readable = socket_queue_length(_readable);
+        _metrics->writable = socket_queue_length(_writable);
+        _metrics->blocking = socket_queue_length(_blocking);
+        _metrics->incoming = socket_queue_length(_incoming);
+    }
+
     socket_queue_wait(_readable, 10000);
 }
 
@@ -420,6 +653,8 @@ static m_socket *_server_receive(m_string *buffer)
     m_string *input = NULL;
     #endif
     m_plugin *p = NULL;
+    m_server_counters *c = _server_counters();
+    uint64_t received = 0, start = 0, end = 0;
     int ret = 0;
 
     /* try to get a readable socket */
@@ -457,6 +692,10 @@ static m_socket *_server_receive(m_string *buffer)
         } else ret = 0;
     }
 
+    if (c) c->rx += ret;
+
+    received = _server_clock();
+
     /* prepare the input buffer */
     #ifdef _ENABLE_HTTP
     if (sockbuf == DATA(buffer)) {
@@ -550,10 +789,22 @@ static m_socket *_server_receive(m_string *buffer)
             return NULL;
         }
 
-        /* call the plugin or the socket callback */
+        start = _server_clock();
+        _server_latency(SERVER_LATENCY_DISPATCH, s, start - received);
+
+        /* call the plugin or the socket callback; there is no string arena
+           around the call since the plugins may keep the strings they get */
         if (s->callback) s->callback(SOCKET_ID(s), INGRESS_ID(s), request);
         else p->plugin_main(SOCKET_ID(s), INGRESS_ID(s), request);
 
+        end = _server_clock();
+        _server_latency(SERVER_LATENCY_HANDLER, s, end - start);
+
+        if (c) {
+            c->requests ++; c->plugin_calls ++;
+            c->plugin_usec += end - start;
+        }
+
         /* release the plugin */
         p = plugin_release(p);
 
@@ -591,6 +842,8 @@ static int _server_respond(m_socket *s)
     uint16_t socket_id = 0;
     m_plugin *p = NULL;
     m_reply *r = NULL;
+    m_server_counters *c = _server_counters();
+    uint64_t sent = 0, start = 0;
     int ret = 0;
 
     if (! s) {
@@ -604,8 +857,14 @@ static int _server_respond(m_socket *s)
         /* get a task */
         if (! (r = queue_get(_work[SOCKET_ID(s)])) ) goto _release;
 
+        sent = s->_tx;
+
         /* process it */
-        switch (server_reply_process(r, s)) {
+        ret = server_reply_process(r, s);
+
+        if (c) c->tx += s->_tx - sent;
+
+        switch (ret) {
         case SOCKET_EPARAM:
             server_reply_free(r);
             goto _release;
@@ -626,12 +885,23 @@ static int _server_respond(m_socket *s)
             goto _release;
         }
 
+        /* delayed tasks would only measure their own delay */
+        if (! r->delay)
+            _server_latency(SERVER_LATENCY_RESPONSE, s,
+                            _server_clock() - r->queued);
+
         /* the task was completed, notify the plugin if necessary */
         if ( (r->op & SERVER_TRANS_ACK) && (p = plugin_acquire(PLUGIN_ID(s))) ) {
             /* TODO allow request tagging ? */
-            if (p->plugin_intr)
+            if (p->plugin_intr) {
+                if (c) start = _server_clock();
                 p->plugin_intr(SOCKET_ID(s), INGRESS_ID(s),
                                PLUGIN_EVENT_REQUEST_TRANSMITTED, NULL);
+                if (c) {
+                    c->plugin_calls ++;
+                    c->plugin_usec += _server_clock() - start;
+                }
+            }
             plugin_release(p);
         }
 
@@ -664,7 +934,7 @@ _continue:
 
 /* -------------------------------------------------------------------------- */
 
-static void *_server_loop(UNUSED void *dummy)
+static void *_server_loop(void *counters)
 {
     m_socket *s = NULL;
     char data[SOCKET_BUFFER];
@@ -674,6 +944,9 @@ static void *_server_loop(UNUSED void *dummy)
     signal(SIGPIPE, SIG_IGN);
     #endif
 
+    /* each thread updates its own counters */
+    if (_metrics) pthread_setspecific(_metrics_key, counters);
+
     /* wait for it... */
     pthread_mutex_lock(& start_lock);
         while (! server_running) pthread_cond_wait(& start, & start_lock);
@@ -722,6 +995,9 @@ static int _server_listen_cb(m_socket *s)
 static int _server_accept_cb(m_socket *s)
 {
     m_plugin *p = NULL;
+    m_server_counters *c = _server_counters();
+
+    if (c) c->accepted ++;
 
     /* notify the plugin that a new client has been accepted */
     if ( (p = plugin_acquire(PLUGIN_ID(s))) ) {
@@ -823,6 +1099,9 @@ static int _server_closed_cb(m_socket *s)
 {
     m_plugin *p = NULL;
     m_reply *r = NULL;
+    m_server_counters *c = _server_counters();
+
+    if (c) c->closed ++;
 
     if ( (p = plugin_acquire(PLUGIN_ID(s))) ) {
         /* notify the plugin that the socket is about to be closed */
@@ -940,8 +1219,13 @@ public int server_init(void)
 
     pthread_attr_setstacksize(& attr, SERVER_STACKSIZE);
 
+    /* the server can run without publishing its metrics */
+    if (_server_metrics_init() == -1)
+        fprintf(stderr, "Concrete: server metrics are not available.\n");
+
     for (i = 0; i < _concurrency; i ++) {
-        if (pthread_create(& _thread[i], & attr, _server_loop, NULL) == -1) {
+        if (pthread_create(& _thread[i], & attr, _server_loop,
+                           (_metrics) ? & _metrics->thread[i] : NULL) == -1) {
             perror(ERR(server_init, pthread_create));
             goto _err_start;
         }
@@ -967,6 +1251,7 @@ public int server_init(void)
     return 0;
 
 _err_start:
+    _server_metrics_fini();
     free(_thread);
     fprintf(stderr, "server_init(): failed to start server threads.\n");
 _err_config:
@@ -1581,6 +1866,23 @@ public int server_set_socket_callback(uint32_t token, uint16_t sockid,
 
 /* -------------------------------------------------------------------------- */
 
+public int server_suspend_socket(uint32_t token, uint16_t sockid, int suspend)
+{
+    if (! token || ! sockid) {
+        debug("server_suspend_socket(): bad parameters.\n");
+        return -1;
+    }
+
+    if ((token >> _SOCKET_RSS) > PLUGIN_MAX) {
+        debug("server_suspend_socket(): bad token.\n");
+        return -1;
+    }
+
+    return socket_suspend(sockid, token & _SOCKET_RSV, suspend);
+}
+
+/* -------------------------------------------------------------------------- */
+
 public int server_send_response(uint32_t token, uint16_t sockid, uint16_t flags,
                                 const char *format, ...)
 {
@@ -1629,6 +1931,54 @@ _err_rep:
 
 /* -------------------------------------------------------------------------- */
 
+public int server_send_compiled(uint32_t token, uint16_t sockid, uint16_t flags,
+                                const m_fmt *fmt, ...)
+{
+    m_reply *reply = NULL;
+    m_string *string = NULL;
+    va_list args;
+
+    if (! token || ! sockid || ! fmt) {
+        debug("server_send_compiled(): bad parameters.\n");
+        return -1;
+    }
+
+    va_start(args, fmt);
+
+    /* generate the packet */
+    if (! (reply = server_reply_init(flags, token)) ) {
+        debug("server_send_compiled(): cannot allocate reply.\n");
+        goto _err_rep;
+    }
+
+    if (! (string = string_vfmt_compiled(NULL, fmt, args)) ) {
+        debug("server_send_compiled(): cannot allocate header.\n");
+        goto _err_fmt;
+    }
+
+    if (server_reply_setheader(reply, string) == -1) {
+        debug("server_send_compiled(): cannot allocate task data.\n");
+        goto _err_set;
+    }
+
+    va_end(args);
+
+    /* store the new task */
+    reply = server_send_reply(sockid, reply);
+
+    return 0;
+
+_err_set:
+    string_free(string);
+_err_fmt:
+    reply = server_reply_free(reply);
+_err_rep:
+    va_end(args);
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public int server_send_string(uint32_t token, uint16_t sockid, uint16_t flags,
                               m_string *string)
 {
@@ -1659,6 +2009,36 @@ public int server_send_string(uint32_t token, uint16_t sockid, uint16_t flags,
 
 /* -------------------------------------------------------------------------- */
 
+public int server_send_rope(uint32_t token, uint16_t sockid, uint16_t flags,
+                            m_rope *rope)
+{
+    m_reply *reply = NULL;
+
+    if (! token || ! sockid || ! rope) {
+        debug("server_send_rope(): bad parameters.\n");
+        return -1;
+    }
+
+    /* generate the packet */
+    if (! (reply = server_reply_init(flags, token)) ) {
+        debug("server_send_rope(): cannot allocate reply.\n");
+        return -1;
+    }
+
+    if (server_reply_setrope(reply, rope) == -1) {
+        debug("server_send_rope(): cannot set reply rope.\n");
+        reply = server_reply_free(reply);
+        return -1;
+    }
+
+    /* store the new task */
+    reply = server_send_reply(sockid, reply);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public int server_send_buffer(uint32_t token, uint16_t sockid, uint16_t flags,
                               const char *data, size_t len)
 {
@@ -1695,6 +2075,59 @@ public int server_send_buffer(uint32_t token, uint16_t sockid, uint16_t flags,
     return 0;
 }
 
+public int server_send_compressed(uint32_t token, uint16_t sockid,
+                                  uint16_t flags, m_string_zstream *z,
+                                  const char *data, size_t len)
+{
+    m_reply *reply = NULL;
+    m_string *string = NULL;
+    int r = 0;
+
+    if (! token || ! sockid || ! z || (len && ! data)) {
+        debug("server_send_compressed(): bad parameters.\n");
+        return -1;
+    }
+
+    if (! (string = string_prealloc(NULL, 0, len / 2 + 64)) ) {
+        debug("server_send_compressed(): cannot allocate header.\n");
+        return -1;
+    }
+
+    /* the peer must be able to decode everything sent so far */
+    if (string_zstream_write(z, data, len, string) == -1 ||
+        (r = (flags & SERVER_TRANS_END) ? string_zstream_end(z, string) :
+                                          string_zstream_flush(z, string))) {
+        debug("server_send_compressed(): cannot compress the payload.\n");
+        string = string_free(string);
+        return -1;
+    }
+
+    /* nothing to send yet */
+    if (! SIZE(string) && ! flags) {
+        string = string_free(string);
+        return 0;
+    }
+
+    /* generate the packet */
+    if (! (reply = server_reply_init(flags, token)) ) {
+        debug("server_send_compressed(): cannot allocate reply.\n");
+        string = string_free(string);
+        return -1;
+    }
+
+    if (server_reply_setheader(reply, string) == -1) {
+        debug("server_send_compressed(): cannot set reply header.\n");
+        reply = server_reply_free(reply);
+        string = string_free(string);
+        return -1;
+    }
+
+    /* store the new task */
+    reply = server_send_reply(sockid, reply);
+
+    return 0;
+}
+
 /* -------------------------------------------------------------------------- */
 #ifdef _ENABLE_HTTP
 /* -------------------------------------------------------------------------- */
@@ -1808,6 +2241,164 @@ public int server_send_http(uint32_t token, uint16_t sockid, uint16_t flags,
 #endif
 /* -------------------------------------------------------------------------- */
 
+public const m_server_metrics *server_metrics_attach(unsigned long pid)
+{
+    const m_server_metrics *metrics = NULL;
+    char name[sizeof(_metrics_name)];
+    size_t size = 0;
+
+    snprintf(name, sizeof(name), SERVER_METRICS_NAME, pid);
+
+    /* map the header first to get the actual size of the segment */
+    if (! (metrics = shm_attach_readonly(name, sizeof(*metrics))) ) return NULL;
+
+    if (metrics->magic != SERVER_METRICS_MAGIC ||
+        metrics->version != SERVER_METRICS_VERSION) {
+        debug("server_metrics_attach(): unsupported metrics segment.\n");
+        shm_detach((void *) metrics, sizeof(*metrics));
+        return NULL;
+    }
+
+    size = metrics->size;
+
+    shm_detach((void *) metrics, sizeof(*metrics));
+
+    return shm_attach_readonly(name, size);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public void server_metrics_detach(const m_server_metrics *metrics)
+{
+    if (! metrics) return;
+
+    shm_detach((void *) metrics, metrics->size);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int server_latency_snapshot(int kind, int plugin_id, int ingress_id,
+                                   m_server_latency *snapshot)
+{
+    const m_server_latency *h = NULL;
+    int i = 0, j = 0, k = 0;
+
+    if (kind < 0 || kind >= SERVER_LATENCY_KINDS ||
+        plugin_id < -1 || plugin_id > PLUGIN_MAX ||
+        ingress_id < -1 || ingress_id > INGRESS_MAX || ! snapshot) {
+        debug("server_latency_snapshot(): bad parameters.\n");
+        return -1;
+    }
+
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    for (i = 0; i <= PLUGIN_MAX; i ++) {
+        if (plugin_id != -1 && plugin_id != i) continue;
+
+        for (j = 0; j <= INGRESS_MAX; j ++) {
+            if (ingress_id != -1 && ingress_id != j) continue;
+
+            if (! (h = _latency[i][j]) ) continue;
+
+            h += kind;
+
+            snapshot->count += h->count;
+            snapshot->sum += h->sum;
+            if (h->max > snapshot->max) snapshot->max = h->max;
+
+            for (k = 0; k < SERVER_LATENCY_BUCKETS; k ++)
+                snapshot->bucket[k] += h->bucket[k];
+        }
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public uint64_t server_latency_percentile(const m_server_latency *snapshot,
+                                          double percentile)
+{
+    uint64_t count = 0, rank = 0, bound = 0;
+    unsigned int i = 0;
+
+    if (! snapshot || percentile < 0 || percentile > 100) {
+        debug("server_latency_percentile(): bad parameters.\n");
+        return 0;
+    }
+
+    /* the buckets may not add up exactly to the sample count */
+    for (i = 0; i < SERVER_LATENCY_BUCKETS; i ++)
+        count += snapshot->bucket[i];
+
+    if (! count) return 0;
+
+    if ( (rank = count * percentile / 100) < count * percentile / 100)
+        rank ++;
+
+    if (! rank) rank = 1;
+
+    for (i = 0, count = 0; i < SERVER_LATENCY_BUCKETS; i ++) {
+        if ( (count += snapshot->bucket[i]) >= rank) {
+            bound = server_latency_bound(i);
+            return (bound < snapshot->max) ? bound : snapshot->max;
+        }
+    }
+
+    return snapshot->max;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public void server_latency_dump(FILE *out)
+{
+    static const char *kind[] = { "handler", "dispatch", "response" };
+    m_server_latency h;
+    m_plugin *p = NULL;
+    char ingress[8];
+    int i = 0, j = 0, k = 0;
+
+    if (! out) {
+        debug("server_latency_dump(): bad parameters.\n");
+        return;
+    }
+
+    fprintf(out, "%-16s %-7s %-8s %10s %8s %8s %8s %8s %8s\n",
+            "plugin", "ingress", "latency", "count", "mean",
+            "p50", "p90", "p99", "max");
+
+    for (i = 0; i <= PLUGIN_MAX; i ++) {
+        p = plugin_acquire(i);
+
+        /* the first line of each plugin sums up all its ingresses */
+        for (j = -1; j <= INGRESS_MAX; j ++) {
+            if (j != -1 && ! _latency[i][j]) continue;
+
+            if (j == -1) strcpy(ingress, "*");
+            else snprintf(ingress, sizeof(ingress), "%i", j);
+
+            for (k = 0; k < SERVER_LATENCY_KINDS; k ++) {
+                server_latency_snapshot(k, i, j, & h);
+
+                if (! h.count) continue;
+
+                fprintf(out, "%-16.16s %-7s %-8s %10"PRIu64" %8"PRIu64" "
+                        "%8"PRIu64" %8"PRIu64" %8"PRIu64" %8"PRIu64"\n",
+                        (p) ? p->name : "-", ingress, kind[k], h.count, h.sum / h.count,
+                        server_latency_percentile(& h, 50),
+                        server_latency_percentile(& h, 90),
+                        server_latency_percentile(& h, 99), h.max);
+            }
+        }
+
+        if (p) plugin_release(p);
+    }
+
+    fflush(out);
+}
+
+/* -------------------------------------------------------------------------- */
+
 public void server_fini(void)
 {
     unsigned int i = 0;
@@ -1825,6 +2416,10 @@ public void server_fini(void)
         pthread_join(_thread[i], NULL);
     free(_thread);
 
+    /* withdraw the metrics */
+    _server_metrics_fini();
+    _server_latency_fini();
+
     /* close plugins and sockets left open */
     socket_api_cleanup();
     plugin_api_cleanup();
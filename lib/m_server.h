@@ -51,6 +51,7 @@
 #include "m_plugin.h"
 #include "m_hashtable.h"
 #include "m_file.h"
+#include "m_rope.h"
 #include "m_config.h"
 #ifdef _ENABLE_HTTP
 #include "m_http.h"
@@ -83,6 +84,62 @@
 /* in server context, the reserved bits of the socket id hold the plugin id */
 #define PLUGIN_ID(s) _RESERVED(s)
 
+/* the metrics segment of a running server is named after its process id */
+#define SERVER_METRICS_NAME    "/concrete.%lu"
+#define SERVER_METRICS_MAGIC   0x434D5452
+#define SERVER_METRICS_VERSION 1
+
+/* counters of a server thread; each thread only ever writes its own counters,
+   so they can be read at any time without any kind of locking */
+
+typedef struct m_server_counters {
+    uint64_t requests;       /* requests processed by the plugins */
+    uint64_t rx;             /* bytes received */
+    uint64_t tx;             /* bytes sent */
+    uint64_t accepted;       /* incoming connections accepted */
+    uint64_t closed;         /* connections closed */
+    uint64_t plugin_calls;   /* calls to plugin_main() and plugin_intr() */
+    uint64_t plugin_usec;    /* time spent in these calls */
+    uint64_t _reserved;      /* pad to a cache line */
+} m_server_counters;
+
+/* shared memory segment published by a running server */
+
+typedef struct m_server_metrics {
+    uint32_t magic;
+    uint32_t version;        /* layout revision */
+    uint32_t size;           /* total size of the segment */
+    uint32_t threads;        /* number of server threads */
+    uint64_t started;        /* server start time (UNIX time) */
+
+    /* depth of the server queues, sampled while polling */
+    uint32_t readable;
+    uint32_t writable;
+    uint32_t blocking;
+    uint32_t incoming;
+
+    uint64_t _reserved[3];   /* pad to a cache line */
+
+    m_server_counters thread[];
+} m_server_metrics;
+
+/* latency histograms, recorded per plugin and per ingress; the buckets are
+   log-linear: 4 sub-buckets per power of two, in microseconds */
+
+#define SERVER_LATENCY_HANDLER   0  /* time spent in plugin_main() */
+#define SERVER_LATENCY_DISPATCH  1  /* time from the read to the handler */
+#define SERVER_LATENCY_RESPONSE  2  /* time from the enqueue to the write */
+#define SERVER_LATENCY_KINDS     3
+
+#define SERVER_LATENCY_BUCKETS   128
+
+typedef struct m_server_latency {
+    uint64_t count;          /* number of samples */
+    uint64_t sum;            /* sum of the samples */
+    uint64_t max;            /* slowest sample */
+    uint64_t bucket[SERVER_LATENCY_BUCKETS];
+} m_server_latency;
+
 /* the reply stucture is used to store informations about packets to process
    and queue them if they can not be sent immediately */
 
@@ -95,9 +152,13 @@ typedef struct m_reply {
 
     uint32_t token;
 
+    uint64_t queued;
+
     m_string *header;
     m_string *footer;
 
+    m_rope *rope;
+
     #ifdef _ENABLE_FILE
     m_file *file;
     off_t off;
@@ -244,6 +305,27 @@ public int server_set_socket_callback(uint32_t token, uint16_t sockid,
 
 /* -------------------------------------------------------------------------- */
 
+public int server_suspend_socket(uint32_t token, uint16_t sockid, int suspend);
+
+/**
+ * @ingroup server
+ * @fn int server_suspend_socket(uint32_t token, uint16_t sockid, int suspend)
+ * @param token the token given at plugin initialization
+ * @param sockid the socket identifier
+ * @param suspend 1 to stop reading from the socket, 0 to resume reading
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function lets a plugin apply back pressure on a connection: while the
+ * socket is suspended, the server stops reading from it and the incoming data
+ * are left in the kernel buffers, so the remote end will eventually have to
+ * slow down. The replies queued for the socket are still sent.
+ *
+ * It can be called from plugin_main() for the socket being processed.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public m_reply *server_reply_init(uint16_t flags, uint32_t token);
 
 /* -------------------------------------------------------------------------- */
@@ -264,6 +346,10 @@ public int server_reply_setfile(m_reply *reply, m_file *f, off_t o, size_t len);
 #endif
 /* -------------------------------------------------------------------------- */
 
+public int server_reply_setrope(m_reply *reply, m_rope *rope);
+
+/* -------------------------------------------------------------------------- */
+
 public int server_reply_setdelay(m_reply *reply, unsigned int nsec);
 
 /* -------------------------------------------------------------------------- */
@@ -301,6 +387,28 @@ public int server_send_response(uint32_t token, uint16_t sockid, uint16_t flags,
 
 /* -------------------------------------------------------------------------- */
 
+public int server_send_compiled(uint32_t token, uint16_t sockid, uint16_t flags,
+                                const m_fmt *fmt, ...);
+
+/**
+ * @ingroup server
+ * @fn int server_send_compiled(uint32_t token, uint16_t sockid, uint16_t flags,
+ *                              const m_fmt *fmt, ...)
+ * @param token the plugin token (@see @ref plugin_main())
+ * @param sockid the 16 bit socket identifier for the output socket
+ * @param flags specific commands to execute after sending the payload
+ * @param fmt format of the payload, compiled with @ref fmt_compile()
+ * @param ... the payload elements
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function is identical to @ref server_send_response() in its working,
+ * except that the format is compiled beforehand. Plugins sending the same
+ * kind of payload over and over should compile its format once at load time.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public int server_send_string(uint32_t token, uint16_t sockid, uint16_t flags,
                               m_string *string);
 
@@ -324,14 +432,35 @@ public int server_send_string(uint32_t token, uint16_t sockid, uint16_t flags,
  * server_send_string(token, sockid, 0x0, string);
  * instead for better performances.
  *
- * @note if you send repeatedly the same data, you can use the @ref string_use()
- * function on the given string before calling this function; then, the server
- * will be able to use the string data without copying them. @ref string_use()
- * is more efficient if you keep the original string in a cache, and destroy
- * it when the data it contains will never be sent again.
+ * @note if you send the same data to several sockets, pass each of them a
+ * string returned by @ref string_share(); the server then writes all of them
+ * from a single buffer, which is released once the last write completed.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int server_send_rope(uint32_t token, uint16_t sockid, uint16_t flags,
+                            m_rope *rope);
+
+/**
+ * @ingroup server
+ * @fn int server_send_rope(uint32_t token, uint16_t sockid, uint16_t flags,
+ *                          m_rope *rope);
+ * @param token the plugin token (@see @ref plugin_main())
+ * @param sockid the 16 bit socket identifier for the output socket
+ * @param flags specific commands to execute after sending the payload
+ * @param rope the payload
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function is identical to @ref server_send_string() in its working,
+ * except that the payload is a rope (@see @ref rope_alloc()). The server
+ * takes the ownership of the rope and writes its segments with gathering
+ * writes, so large responses assembled from many pieces never have to be
+ * copied into a single buffer.
  *
- * @warning using @ref string_use() incurs a small memory overhead, so it is
- * better to use it for long strings which are sent frequently.
+ * Ropes cannot be sent out of band. If an error occurs, the rope still
+ * belongs to the caller.
  *
  */
 
@@ -363,6 +492,34 @@ public int server_send_buffer(uint32_t token, uint16_t sockid, uint16_t flags,
  *
  */
 
+public int server_send_compressed(uint32_t token, uint16_t sockid,
+                                  uint16_t flags, m_string_zstream *z,
+                                  const char *data, size_t len);
+
+/**
+ * @ingroup server
+ * @fn int server_send_compressed(uint32_t token, uint16_t sockid,
+ *                                uint16_t flags, m_string_zstream *z,
+ *                                const char *data, size_t len)
+ * @param token the plugin token (@see @ref plugin_main())
+ * @param sockid the 16 bit socket identifier for the output socket
+ * @param flags specific commands to execute after sending the payload
+ * @param z a context from @ref string_compressor_alloc()
+ * @param data the next chunk of the payload
+ * @param len the length of the chunk
+ * @return -1 if an error occurs, 0 otherwise
+ *
+ * This function is identical to @ref server_send_buffer() in its working,
+ * except that the payload is compressed while it is sent. A response can
+ * be sent in several chunks with the same context; each one is flushed so
+ * that the peer can decode it right away.
+ *
+ * The @ref SERVER_TRANS_END flag terminates the compressed stream before
+ * the connection is closed. The context remains owned by the caller.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
 /* -------------------------------------------------------------------------- */
 #ifdef _ENABLE_HTTP
 /* -------------------------------------------------------------------------- */
@@ -394,6 +551,123 @@ public int server_send_http(uint32_t token, uint16_t sockid, uint16_t flags,
 #endif
 /* -------------------------------------------------------------------------- */
 
+public const m_server_metrics *server_metrics_attach(unsigned long pid);
+
+/**
+ * @ingroup server
+ * @fn const m_server_metrics *server_metrics_attach(unsigned long pid)
+ * @param pid the process identifier of a running server
+ * @return the metrics segment of the server, or NULL
+ *
+ * This function maps the metrics published by the server running with the
+ * given process identifier, so another process can monitor it without any
+ * syscall or interaction with the server. The counters are updated live.
+ * The segment is mapped read only, so a monitor never needs (nor gets) write
+ * access to the server memory.
+ *
+ * The returned segment must be released with @ref server_metrics_detach().
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public void server_metrics_detach(const m_server_metrics *metrics);
+
+/**
+ * @ingroup server
+ * @fn void server_metrics_detach(const m_server_metrics *metrics)
+ * @param metrics a metrics segment
+ *
+ * This function unmaps a segment obtained with @ref server_metrics_attach().
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public unsigned int server_latency_bucket(uint64_t usec);
+
+/**
+ * @ingroup server
+ * @fn unsigned int server_latency_bucket(uint64_t usec)
+ * @param usec a latency in microseconds
+ * @return the index of the histogram bucket counting this latency
+ *
+ * This function returns the bucket a latency is recorded in. The first 4
+ * buckets hold a single value, then each power of two is split in 4 buckets
+ * of equal width. The latencies above 2^32 us all go to the last bucket.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public uint64_t server_latency_bound(unsigned int bucket);
+
+/**
+ * @ingroup server
+ * @fn uint64_t server_latency_bound(unsigned int bucket)
+ * @param bucket a histogram bucket index
+ * @return the highest latency counted by the bucket, in microseconds
+ *
+ * This function returns the upper bound of a bucket, which is at most 25%
+ * above any latency it counts. The last buckets are unbounded.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int server_latency_snapshot(int kind, int plugin_id, int ingress_id,
+                                   m_server_latency *snapshot);
+
+/**
+ * @ingroup server
+ * @fn int server_latency_snapshot(int kind, int plugin_id, int ingress_id,
+ *                                 m_server_latency *snapshot)
+ * @param kind SERVER_LATENCY_HANDLER, SERVER_LATENCY_DISPATCH or
+ *             SERVER_LATENCY_RESPONSE
+ * @param plugin_id a plugin identifier, or -1 for all the plugins
+ * @param ingress_id an ingress identifier, or -1 for all the ingresses
+ * @param snapshot the histogram to fill
+ * @return 0 if successful, -1 otherwise
+ *
+ * This function copies the latency histogram of the given plugin and ingress
+ * into @p snapshot. The histograms are updated while they are being copied,
+ * so the snapshot is only consistent within a few samples.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public uint64_t server_latency_percentile(const m_server_latency *snapshot,
+                                          double percentile);
+
+/**
+ * @ingroup server
+ * @fn uint64_t server_latency_percentile(const m_server_latency *snapshot,
+ *                                        double percentile)
+ * @param snapshot a latency histogram
+ * @param percentile the percentile to compute, between 0 and 100
+ * @return the latency in microseconds
+ *
+ * This function returns the upper bound of the bucket holding the requested
+ * percentile, which overestimates the latency by at most 25%.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public void server_latency_dump(FILE *out);
+
+/**
+ * @ingroup server
+ * @fn void server_latency_dump(FILE *out)
+ * @param out the output stream
+ *
+ * This function prints the percentiles of every non empty latency histogram.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public void server_fini(void);
 
 /**
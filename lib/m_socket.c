@@ -528,6 +528,31 @@ public int socket_exists(int id)
 
 /* -------------------------------------------------------------------------- */
 
+public int socket_suspend(int id, uint32_t owner, int suspend)
+{
+    m_socket *s = NULL;
+    int ret = -1;
+
+    if (id < 1 || id >= SOCKET_MAX) {
+        debug("socket_suspend(): bad parameters.\n");
+        return -1;
+    }
+
+    pthread_rwlock_rdlock(& _socket_lock);
+
+        /* the socket cannot be freed while the array is locked */
+        if ( (s = _socket[id]) && (s->_flags & _SOCKET_RSV) == owner) {
+            s->_suspended = (suspend) ? 1 : 0;
+            ret = 0;
+        }
+
+    pthread_rwlock_unlock(& _socket_lock);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public m_socket *socket_acquire(int id)
 {
     m_socket *s = NULL;
@@ -734,7 +759,7 @@ _skip_fd:
     new->_lockstate = 1; new->_fd = sockfd; new->info = info;
 
     /* it is assumed the socket is writable by default */
-    new->_state = _SOCKET_W;
+    new->_state = _SOCKET_W; new->_suspended = 0;
 
     /* no callback by default */
     new->callback = NULL;
@@ -1071,6 +1096,73 @@ public ssize_t socket_oob_write(m_socket *s, const char *data, size_t len)
     return _socket_write(s, data, len, MSG_OOB);
 }
 
+/* -------------------------------------------------------------------------- */
+
+public ssize_t socket_writev(m_socket *s, const struct iovec *iov, int count)
+{
+    ssize_t ret = 0, w = 0;
+    #if ! defined(WIN32)
+    struct msghdr msg;
+    #endif
+    int i = 0;
+
+    if (! s || ! iov || count <= 0) {
+        debug("socket_writev(): bad parameters.\n");
+        return SOCKET_EPARAM;
+    }
+
+    #if ! defined(WIN32)
+    #ifdef _ENABLE_SSL
+    if (~s->_flags & SOCKET_SSL) {
+    #endif
+        /* check for a pending connection */
+        if (s->_state & _SOCKET_C && ( (ret = socket_connect(s)) != 0) )
+            return ret;
+
+        memset(& msg, 0, sizeof(msg));
+        msg.msg_iov = (struct iovec *) iov;
+        msg.msg_iovlen = count;
+
+        #ifdef __APPLE__
+        /* same as _socket_write(), connected UDP sockets reject addresses */
+        if (~s->_flags & SOCKET_UDP || ~s->_state & _SOCKET_O)
+        #endif
+        {
+            msg.msg_name = s->info->ai_addr;
+            msg.msg_namelen = s->info->ai_addrlen;
+        }
+
+        if ( (ret = sendmsg(s->_fd, & msg, 0x0)) == -1) {
+            if (ERRNO == EINTR || ERRNO == EAGAIN) {
+                s->_state &= ~_SOCKET_W;
+                ret = SOCKET_EAGAIN;
+            } else ret = SOCKET_EFATAL;
+
+            serror(ERR(socket_writev, sendmsg));
+
+            return ret;
+        } else if (ret == 0) return SOCKET_ECLOSE;
+
+        s->_tx += ret;
+
+        return ret;
+    #ifdef _ENABLE_SSL
+    }
+    #endif
+    #endif
+
+    /* no gathering write on this transport, send the buffers one by one */
+    for (i = 0, ret = 0; i < count; i ++) {
+        if (! iov[i].iov_len) continue;
+        w = socket_write(s, iov[i].iov_base, iov[i].iov_len);
+        if (w < 0) return (ret) ? ret : w;
+        ret += w;
+        if ((size_t) w < iov[i].iov_len) break;
+    }
+
+    return ret;
+}
+
 /* -------------------------------------------------------------------------- */
 #ifdef _ENABLE_FILE
 /* -------------------------------------------------------------------------- */
@@ -1438,6 +1530,24 @@ public int socket_queue_empty(m_socket_queue *q)
 
 /* -------------------------------------------------------------------------- */
 
+public unsigned int socket_queue_length(const m_socket_queue *q)
+{
+    unsigned int head = 0, tail = 0;
+
+    if (! q) {
+        debug("socket_queue_length(): bad parameters.\n");
+        return 0;
+    }
+
+    /* the head index is only wrapped on the next read */
+    head = q->_head_index % SOCKET_MAX;
+    tail = q->_tail_index;
+
+    return (tail >= head) ? tail - head : SOCKET_MAX - head + tail;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public void socket_queue_wait(m_socket_queue *q, unsigned int duration)
 {
     struct timespec ts = { 0, 0 };
@@ -1533,11 +1643,13 @@ private int socket_queue_poll(m_socket_queue *q, m_socket **s,
             continue;
         }
 
-        FD_SET(s[i]->_fd, & r); FD_SET(s[i]->_fd, & e);
+        if (! s[i]->_suspended) FD_SET(s[i]->_fd, & r);
+        FD_SET(s[i]->_fd, & e);
         if (~s[i]->_state & _SOCKET_W) FD_SET(s[i]->_fd, & w);
         fdmax = (fdmax < s[i]->_fd) ? s[i]->_fd : fdmax;
         #else
-        set[i].fd = s[i]->_fd; set[i].events = POLLIN | POLLERR | POLLPRI;
+        set[i].fd = s[i]->_fd; set[i].events = POLLERR | POLLPRI;
+        if (! s[i]->_suspended) set[i].events |= POLLIN;
         if (~s[i]->_state & _SOCKET_W) set[i].events |= POLLOUT;
         #endif
     }
@@ -1571,7 +1683,8 @@ private int socket_queue_poll(m_socket_queue *q, m_socket **s,
         if (FD_ISSET(s[i]->_fd, & e))
         #else
         if (set[i].revents & POLLERR) s[i]->_state |= _SOCKET_E;
-        if (set[i].revents & POLLIN)  s[i]->_state |= _SOCKET_R;
+        /* a hang up is always reported, even for suspended sockets */
+        if (set[i].revents & (POLLIN | POLLHUP)) s[i]->_state |= _SOCKET_R;
         if (set[i].revents & POLLOUT) s[i]->_state |= _SOCKET_W;
         if (set[i].revents & POLLPRI)
         #endif
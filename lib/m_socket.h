@@ -173,6 +173,9 @@ typedef struct m_socket {
     /* private, internal state */
     uint16_t _state;
 
+    /* private, the socket is not polled for reading */
+    volatile int _suspended;
+
     /* private, how much data was transmitted over this socket? */
     uint64_t _tx;
     uint64_t _rx;
@@ -315,6 +318,27 @@ public uint64_t socket_recvbytes(int id);
 
 /* -------------------------------------------------------------------------- */
 
+public int socket_suspend(int id, uint32_t owner, int suspend);
+
+/**
+ * @ingroup socket
+ * @fn int socket_suspend(int id, uint32_t owner, int suspend)
+ * @param id socket identifier
+ * @param owner reserved bits the socket must carry
+ * @param suspend 1 to stop reading from the socket, 0 to resume reading
+ * @return 0 if the socket state was changed, -1 otherwise
+ *
+ * This function stops polling a socket for incoming data, or resumes it. The
+ * socket is still polled for writing and errors while it is suspended, so the
+ * pending data can still be sent.
+ *
+ * The socket is not locked, so this function can be called by the thread
+ * which currently holds it.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public int socket_exists(int id);
 
 /**
@@ -521,6 +545,27 @@ public ssize_t socket_oob_write(m_socket *s, const char *data, size_t len);
  *
  */
 
+/* -------------------------------------------------------------------------- */
+
+public ssize_t socket_writev(m_socket *s, const struct iovec *iov, int count);
+
+/**
+ * @ingroup socket
+ * @fn ssize_t socket_writev(m_socket *s, const struct iovec *iov, int count)
+ * @param s the socket
+ * @param iov the buffers to send
+ * @param count the number of buffers, up to IOV_MAX
+ * @return specific error codes, see @ref socket_write()
+ *
+ * @note This is a private function, it should not be called from a plugin.
+ *
+ * This function sends several buffers in order with a single system call.
+ * On transports which cannot gather the buffers, like SSL, they are written
+ * one by one until a write is incomplete. Like @ref socket_write(), it may
+ * write less than the total length of the buffers.
+ *
+ */
+
 /* -------------------------------------------------------------------------- */
 #ifdef _ENABLE_FILE
 /* -------------------------------------------------------------------------- */
@@ -733,6 +778,22 @@ public int socket_queue_empty(m_socket_queue *q);
 
 /* -------------------------------------------------------------------------- */
 
+public unsigned int socket_queue_length(const m_socket_queue *q);
+
+/**
+ * @ingroup socket
+ * @fn unsigned int socket_queue_length(const m_socket_queue *q)
+ * @param q a socket queue
+ * @return the number of queued socket identifiers
+ *
+ * This function returns the number of socket identifiers in the queue. It
+ * does not lock the queue, so the result is only an estimate if the queue
+ * is being used concurrently.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public void socket_queue_wait(m_socket_queue *q, unsigned int duration);
 
 /**
@@ -37,6 +37,9 @@
 
 #define _UINT(c) ((unsigned int) ((unsigned char) c))
 
+/* strings up to this size share a single allocation with their struct */
+#define _STRING_INLINE 32
+
 /* -- hexadecimal digits -- */
 static const char _hex[] = "0123456789abcdef";
 
@@ -46,6 +49,9 @@ static const char _hex[] = "0123456789abcdef";
 static const char _b58[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZ"
                            "abcdefghijkmnopqrstuvwxyz";
 
+/* 58^5, numbers are converted five base58 digits at a time */
+#define _B58_LIMB 656356768
+
 /* decoding lookup table */
 static const char _d58[] = {
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /*  12 */
@@ -62,7 +68,7 @@ static const char _d58[] = {
 };
 
 /* macro to ease the use of the decode table and prevent out of bound access */
-#define _D58(c) (_d58[(c) & 0x7f])
+#define _D58(c) (((unsigned char) (c) < 0x80) ? _d58[(unsigned char) (c)] : -1)
 
 /* -- base64 encoding/decoding -- */
 
@@ -87,7 +93,7 @@ static const char _d64[] = {
 };
 
 /* macro to ease the use of the decode table and prevent out of bound access */
-#define _D64(c) (_d64[(c) & 0x7f])
+#define _D64(c) (((unsigned char) (c) < 0x80) ? _d64[(unsigned char) (c)] : -1)
 
 #ifdef _ENABLE_JSON
 static const unsigned char _j[] = {
@@ -134,13 +140,16 @@ static const unsigned char _j[] = {
 #define EXT_ASCII  16 /* Extended ASCII */
 #endif
 
-/* -- sha1 private context -- */
-typedef struct {
-    uint32_t h0, h1, h2, h3, h4;
-    uint32_t nblocks;
-    unsigned char buf[64];
-    int count;
-} SHA1_CONTEXT;
+/* -- digest private context -- */
+struct m_string_digest {
+    int algorithm;
+    uint32_t h[8];                /* SHA chaining values, or the CRC32C */
+    uint64_t v[4];                /* 64 bit hash accumulators */
+    uint64_t seed;
+    uint64_t total;               /* bytes hashed so far */
+    unsigned char buf[64];        /* pending partial block */
+    unsigned int count;
+};
 
 /* -- rawurlencode special chars -- */
 
@@ -175,6 +184,194 @@ static const char _unsafe[256] = {
 /* -------------------------------------------------------------------------- */
 
 #include "ports/m_port_bitops.c"
+#include "ports/m_port_simd.c"
+
+/* substring search engine, detected on first use */
+static int _search_engine = -1;
+
+/* strings allocated in an arena are preceded by this header */
+typedef struct _string_arena_hdr {
+    m_string_arena *arena;
+    m_string *next;
+} _string_arena_hdr;
+
+#define _ARENA_ALIGN 16
+#define _ARENA_ROUND(x) (((x) + _ARENA_ALIGN - 1) & ~((size_t) _ARENA_ALIGN - 1))
+#define _ARENA_HDR(s) ((_string_arena_hdr *) (s) - 1)
+
+/* current arena of each thread */
+static pthread_key_t _arena_key;
+static pthread_once_t _arena_once = PTHREAD_ONCE_INIT;
+static int _arena_used = 0;
+
+/* reference counted buffer of the shared strings */
+typedef struct _string_block {
+    volatile unsigned int refs;
+} _string_block;
+
+/* shared strings store a pointer to their buffer right after the struct */
+#define _SHARED_BLOCK(s) (*(_string_block **) ((s) + 1))
+
+#ifndef __GNUC__
+static pthread_mutex_t _shared_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void _string_rebase_token(m_string *s, char *oldbase, char *newbase);
+static int _string_reserve(m_string *s, size_t n);
+static char *_string_u64toa(uint64_t u, char *end);
+static size_t _string_i64toa(int64_t i, char *out);
+
+/* -------------------------------------------------------------------------- */
+
+static void _string_arena_key(void)
+{
+    if (pthread_key_create(& _arena_key, NULL) != 0)
+        perror(ERR(_string_arena_key, pthread_key_create));
+    else _arena_used = 1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static m_string_arena *_string_arena_current(void)
+{
+    /* avoid the lookup as long as no arena was ever created */
+    return (_arena_used) ? pthread_getspecific(_arena_key) : NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void *_string_arena_alloc(m_string_arena *a, size_t size)
+{
+    void **block = NULL;
+    size_t blocksize = 0;
+    char *ret = NULL;
+
+    size = _ARENA_ROUND(size);
+
+    if ((size_t) (a->_end - a->_ptr) < size) {
+        /* chain a new block, large enough for this allocation */
+        blocksize = _ARENA_ROUND(sizeof(*block)) +
+                    ((size > a->_size) ? size : a->_size);
+
+        if (! (block = malloc(blocksize)) ) {
+            perror(ERR(_string_arena_alloc, malloc));
+            return NULL;
+        }
+
+        *block = a->_block; a->_block = block;
+        a->_ptr = (char *) block + _ARENA_ROUND(sizeof(*block));
+        a->_end = (char *) block + blocksize;
+    }
+
+    ret = a->_ptr; a->_ptr += size;
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void *_string_arena_realloc(m_string_arena *a, char *ptr,
+                                   size_t old, size_t size)
+{
+    char *ret = NULL;
+
+    /* the last allocation of the block grows in place */
+    if (ptr && ptr + _ARENA_ROUND(old) == a->_ptr &&
+        (size_t) (a->_end - ptr) >= _ARENA_ROUND(size)) {
+        a->_ptr = ptr + _ARENA_ROUND(size);
+        return ptr;
+    }
+
+    if (! (ret = _string_arena_alloc(a, size)) ) return NULL;
+
+    if (ptr) memcpy(ret, ptr, old);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static m_string *_string_arena_new(m_string_arena *a, size_t size)
+{
+    _string_arena_hdr *h = NULL;
+    m_string *new = NULL;
+
+    if (! (h = _string_arena_alloc(a, sizeof(*h) + sizeof(*new) + size)) )
+        return NULL;
+
+    /* remember the string so that the arena can release its tokens */
+    new = (m_string *) (h + 1);
+    h->arena = a; h->next = a->_strings; a->_strings = new;
+
+    return new;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static unsigned int _string_block_ref(_string_block *b, int n)
+{
+    #ifdef __GNUC__
+    return __sync_add_and_fetch(& b->refs, n);
+    #else
+    unsigned int ret = 0;
+
+    pthread_mutex_lock(& _shared_lock);
+        ret = (b->refs += n);
+    pthread_mutex_unlock(& _shared_lock);
+
+    return ret;
+    #endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _string_unshare_tokens(m_string *s)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < PARTS(s); i ++) {
+        s->token[i]._flags &= ~(_STRING_FLAG_ENCAPS | _STRING_FLAG_SHARED);
+        _string_unshare_tokens(& s->token[i]);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _string_unshare(m_string *s)
+{
+    char *data = NULL, *base = NULL;
+
+    /* the data of the tokens belong to the parent string */
+    while (s->parent) s = s->parent;
+
+    if (~s->_flags & _STRING_FLAG_SHARED) return 0;
+
+    /* copy the data before writing to them */
+    if (! (data = malloc(SIZE(s) + sizeof(wchar_t))) ) {
+        perror(ERR(_string_unshare, malloc));
+        return -1;
+    }
+
+    memcpy(data, DATA(s), SIZE(s));
+    memset(data + SIZE(s), 0, sizeof(wchar_t));
+
+    base = s->_data; s->_data = data; s->_alloc = SIZE(s);
+    s->_flags &= ~(_STRING_FLAG_ENCAPS | _STRING_FLAG_SHARED);
+    _string_rebase_token(s, base, data);
+    _string_unshare_tokens(s);
+
+    if (! _string_block_ref(_SHARED_BLOCK(s), -1)) free(_SHARED_BLOCK(s));
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _string_cow(m_string *s)
+{
+    /* a shared string gets its own copy of the data before any write */
+    return (s->_flags & _STRING_FLAG_SHARED) ? _string_unshare(s) : 0;
+}
 
 /* -------------------------------------------------------------------------- */
 /* 0. Initialization */
@@ -182,6 +379,8 @@ static const char _unsafe[256] = {
 
 public int string_api_setup(void)
 {
+    if (_search_engine == -1) _search_engine = __simd_level();
+
     return 0;
 }
 
@@ -194,6 +393,7 @@ public m_string *string_prealloc(const char *string, size_t len, size_t total)
     /** @brief allocate a m_string and initialize it with the given data */
 
     m_string *new = NULL;
+    m_string_arena *arena = _string_arena_current();
     int32_t allocsize = 0;
 
     if (total < len) {
@@ -201,40 +401,71 @@ public m_string *string_prealloc(const char *string, size_t len, size_t total)
         total = len;
     }
 
+    /* the internal buffer must be on wchar_t boundary */
+    allocsize = (total + sizeof(wchar_t)) * sizeof(*new->_data);
+
+    if ((size_t) allocsize < total) {
+        debug("string_prealloc(): integer overflow.\n");
+        return NULL;
+    }
+
+    /* inside an arena, the string is carved out of the current block */
+    if (arena) {
+        if (! (new = _string_arena_new(arena, (total) ? allocsize : 0)) )
+            return NULL;
+
+        new->_flags = _STRING_FLAG_ARENA | _STRING_FLAG_INLINE;
+        if (! total) goto _empty;
+
+        new->_data = (char *) (new + 1);
+        new->_alloc = total * sizeof(*new->_data);
+        goto _init;
+    }
+
+    /* short strings are stored right after the struct, in a single block */
+    if (total && total <= _STRING_INLINE) {
+        if (! (new = malloc(sizeof(*new) + allocsize)) ) {
+            perror(ERR(string_prealloc, malloc));
+            return NULL;
+        }
+
+        new->_data = (char *) (new + 1);
+        new->_alloc = total * sizeof(*new->_data);
+        new->_flags = _STRING_FLAG_INLINE;
+        goto _init;
+    }
+
     if (! (new = malloc(sizeof(*new))) ) {
         perror(ERR(string_prealloc, malloc));
         return NULL;
     }
 
-    /* allocate the internal buffer, ensure it is on wchar_t boundary */
+    /* allocate the internal buffer */
     if (! total) {
-        new->_data = NULL; new->_len = new->_alloc = 0; new->_flags = 0;
+        new->_flags = 0;
+    _empty:
+        new->_data = NULL; new->_len = new->_alloc = 0;
         new->parent = NULL; new->_parts_alloc = new->parts = 0;
         new->token = NULL;
         return new;
     }
 
-    allocsize = (total + sizeof(wchar_t)) * sizeof(*new->_data);
-
-    if ((size_t) allocsize < total) {
-        debug("string_prealloc(): integer overflow.\n");
-        free(new);
-        return NULL;
-    }
-
     if (! (new->_data = malloc(allocsize)) ) {
         perror(ERR(string_prealloc, malloc));
         free(new);
         return NULL;
     }
     new->_alloc = total * sizeof(*new->_data);
+    new->_flags = 0;
+
+_init:
 
     /* copy the given data in the internal buffer */
     if (string) memcpy(new->_data, string, len);
 
     memset(new->_data + len, 0, sizeof(wchar_t));
 
-    new->_len = len; new->_flags = 0;
+    new->_len = len;
     new->parent = NULL; new->token = NULL;
     new->_parts_alloc = new->parts = 0;
 
@@ -265,7 +496,7 @@ public m_string *string_encaps(const char *string, size_t len)
 
     new->_data = (char *) string;
     new->_len = len; new->_alloc = len;
-    new->_flags = _STRING_FLAG_ENCAPS;
+    new->_flags = _STRING_FLAG_ENCAPS | (new->_flags & _STRING_FLAG_ARENA);
     new->parent = NULL;
     new->_parts_alloc = new->parts = 0;
     new->token = NULL;
@@ -275,6 +506,158 @@ public m_string *string_encaps(const char *string, size_t len)
 
 /* -------------------------------------------------------------------------- */
 
+public m_string *string_share(const m_string *string)
+{
+    /** @brief share the data of a string between several m_strings */
+
+    const m_string *root = string;
+    _string_block *b = NULL;
+    m_string *new = NULL;
+
+    if (! string || ! DATA(string)) {
+        debug("string_share(): bad parameters.\n");
+        return NULL;
+    }
+
+    while (root->parent) root = root->parent;
+
+    /* the shared strings are never part of an arena */
+    if (! (new = malloc(sizeof(*new) + sizeof(b))) ) {
+        perror(ERR(string_share, malloc));
+        return NULL;
+    }
+
+    if (root->_flags & _STRING_FLAG_SHARED) {
+        b = _SHARED_BLOCK(root);
+        _string_block_ref(b, 1);
+    } else {
+        /* copy the data once in a reference counted buffer */
+        if (! (b = malloc(sizeof(*b) + SIZE(string) + sizeof(wchar_t))) ) {
+            perror(ERR(string_share, malloc));
+            free(new);
+            return NULL;
+        }
+
+        b->refs = 1;
+        memcpy(b + 1, DATA(string), SIZE(string));
+        memset((char *) (b + 1) + SIZE(string), 0, sizeof(wchar_t));
+    }
+
+    new->_data = (root->_flags & _STRING_FLAG_SHARED) ? string->_data :
+                                                        (char *) (b + 1);
+    new->_len = new->_alloc = SIZE(string);
+    new->_flags = _STRING_FLAG_ENCAPS | _STRING_FLAG_SHARED;
+    new->parent = NULL; new->token = NULL;
+    new->_parts_alloc = new->parts = 0;
+    _SHARED_BLOCK(new) = b;
+
+    return new;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_arena *string_arena_begin(size_t size)
+{
+    /** @brief start an allocation arena for the calling thread */
+
+    m_string_arena *a = NULL;
+    size_t head = _ARENA_ROUND(sizeof(*a));
+
+    if (! size) size = STRING_ARENA_BLOCK;
+    size = _ARENA_ROUND(size);
+
+    if (head + size < size) {
+        debug("string_arena_begin(): integer overflow.\n");
+        return NULL;
+    }
+
+    pthread_once(& _arena_once, _string_arena_key);
+
+    if (! _arena_used) return NULL;
+
+    /* the arena lives at the beginning of its first block */
+    if (! (a = malloc(head + size)) ) {
+        perror(ERR(string_arena_begin, malloc));
+        return NULL;
+    }
+
+    a->_block = NULL; a->_strings = NULL; a->_size = size;
+    a->_ptr = (char *) a + head; a->_end = a->_ptr + size;
+
+    a->_prev = pthread_getspecific(_arena_key);
+
+    if (pthread_setspecific(_arena_key, a) != 0) {
+        perror(ERR(string_arena_begin, pthread_setspecific));
+        free(a);
+        return NULL;
+    }
+
+    return a;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_arena *string_arena_end(m_string_arena *arena)
+{
+    /** @brief destroy an arena and all its strings */
+
+    m_string *s = NULL, *next = NULL;
+    void **block = NULL, **b = NULL;
+
+    if (! arena) return NULL;
+
+    if (pthread_getspecific(_arena_key) == arena)
+        pthread_setspecific(_arena_key, arena->_prev);
+    #ifdef DEBUG
+    else debug("string_arena_end(): warning: not the current arena.\n");
+    #endif
+
+    /* the tokens and the buffers moved out of the arena are on the heap */
+    for (s = arena->_strings; s; s = next) {
+        next = _ARENA_HDR(s)->next;
+        string_free_token(s);
+        if (! (s->_flags & (_STRING_FLAG_NOFREE | _STRING_FLAG_INLINE)))
+            free(s->_data);
+    }
+
+    for (block = arena->_block; block; block = b) {
+        b = *block; free(block);
+    }
+
+    free(arena);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_arena_escape(m_string *string)
+{
+    /** @brief copy an arena string to the heap */
+
+    m_string_arena *arena = NULL;
+    m_string *ret = NULL;
+
+    if (! string) {
+        debug("string_arena_escape(): bad parameters.\n");
+        return NULL;
+    }
+
+    if (~string->_flags & _STRING_FLAG_ARENA) return string;
+
+    /* suspend the current arena during the copy */
+    arena = pthread_getspecific(_arena_key);
+    pthread_setspecific(_arena_key, NULL);
+
+    ret = string_dup(string);
+
+    pthread_setspecific(_arena_key, arena);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public m_string *string_vfmt(m_string *str, const char *fmt, va_list args)
 {
     int ret = 0;
@@ -286,7 +669,7 @@ public m_string *string_vfmt(m_string *str, const char *fmt, va_list args)
         return NULL;
     }
 
-    if (str && str->_flags & _STRING_FLAG_RDONLY) {
+    if (str && (_string_cow(str) == -1 || str->_flags & _STRING_FLAG_RDONLY)) {
         debug("string_vfmt(): illegal write attempt.\n");
         return NULL;
     }
@@ -353,7 +736,7 @@ public m_string *string_catfmt(m_string *str, const char *fmt, ...)
         return NULL;
     }
 
-    if (str && str->_flags & _STRING_FLAG_RDONLY) {
+    if (str && (_string_cow(str) == -1 || str->_flags & _STRING_FLAG_RDONLY)) {
         debug("string_catfmt(): illegal write attempt.\n");
         va_end(args);
         return NULL;
@@ -395,50 +778,252 @@ public m_string *string_catfmt(m_string *str, const char *fmt, ...)
 
 /* -------------------------------------------------------------------------- */
 
-public m_string *string_from_uint8(uint8_t u8)
+static int _string_fmt_spec(char *out, size_t size, const m_fmt_op *op,
+                            const char *spec, const int *star, va_list *ap)
 {
-    /** @brief create a string from an integer */
+    /* the value is fetched with its own type and formatted alone */
+    #define _FMT_SPEC(type) do { \
+        type v = va_arg(*ap, type); \
+        return (op->stars == 0) ? m_snprintf(out, size, spec, v) : \
+               (op->stars == 1) ? m_snprintf(out, size, spec, star[0], v) : \
+               m_snprintf(out, size, spec, star[0], star[1], v); \
+    } while (0)
 
-    return string_alloc((char *) & u8, sizeof(u8));
+    switch (op->arg) {
+    case FMT_ARG_LONG: _FMT_SPEC(long);
+    case FMT_ARG_LLONG: _FMT_SPEC(long long);
+    case FMT_ARG_SIZE: _FMT_SPEC(size_t);
+    case FMT_ARG_INTMAX: _FMT_SPEC(intmax_t);
+    case FMT_ARG_PTRDIFF: _FMT_SPEC(ptrdiff_t);
+    case FMT_ARG_DOUBLE: _FMT_SPEC(double);
+    case FMT_ARG_PTR: _FMT_SPEC(void *);
+    default: _FMT_SPEC(int);
+    }
+
+    #undef _FMT_SPEC
 }
 
 /* -------------------------------------------------------------------------- */
 
-public int string_to_uint8s(const char *string, uint8_t *out)
+static int _string_fmt_run(m_string *str, const m_fmt *fmt, va_list *ap)
 {
-    if (! string || ! out) {
-        debug("string_to_uint8s: bad parameters.\n");
-        return -1;
+    const m_fmt_op *op = NULL, *end = fmt->_op + fmt->_count;
+    char number[24], *p = NULL;
+    const char *s = NULL, *nul = NULL;
+    int star[2] = { 0, 0 }, n = 0;
+    int64_t i = 0;
+    uint64_t u = 0;
+    va_list copy;
+
+    if (fmt->_fallback) {
+        va_copy(copy, *ap);
+        if ( (n = m_vsnprintf(NULL, 0, fmt->_text, *ap)) < 0 ||
+             _string_reserve(str, n + 1) == -1) {
+            va_end(copy);
+            return -1;
+        }
+        m_vsnprintf(str->_data + str->_len, n + 1, fmt->_text, copy);
+        str->_len += n;
+        va_end(copy);
+        return 0;
     }
 
-    memcpy(out, string, sizeof(*out));
+    for (op = fmt->_op; op < end; op ++) {
+        switch (op->type) {
+        case FMT_LITERAL:
+            s = fmt->_text + op->off; n = op->len;
+            break;
 
-    return 0;
-}
+        case FMT_INT:
+            i = (op->arg == FMT_ARG_LONG) ? va_arg(*ap, long) :
+                (op->arg == FMT_ARG_LLONG) ? va_arg(*ap, long long) :
+                (op->arg == FMT_ARG_SIZE) ? (int64_t) va_arg(*ap, ssize_t) :
+                va_arg(*ap, int);
+            n = _string_i64toa(i, number); s = number;
+            break;
 
-/* -------------------------------------------------------------------------- */
+        case FMT_UINT:
+            u = (op->arg == FMT_ARG_LONG) ? va_arg(*ap, unsigned long) :
+                (op->arg == FMT_ARG_LLONG) ? va_arg(*ap, unsigned long long) :
+                (op->arg == FMT_ARG_SIZE) ? va_arg(*ap, size_t) :
+                va_arg(*ap, unsigned int);
+            p = _string_u64toa(u, number + sizeof(number));
+            n = number + sizeof(number) - p; s = p;
+            break;
 
-public int string_to_uint8(const m_string *string, uint8_t *out)
-{
-    /** @brief convert a binary string to an integer */
+        case FMT_STR:
+            if (! (s = va_arg(*ap, const char *)) ) s = "(null)";
+            n = strlen(s);
+            break;
 
-    if (! string || ! out || ! DATA(string) || SIZE(string) < sizeof(*out)) {
-        debug("string_to_uint8(): bad parameters.\n");
-        return -1;
+        case FMT_STRN:
+            n = va_arg(*ap, int);
+            if (! (s = va_arg(*ap, const char *)) ) s = "(null)";
+            if (n < 0) n = strlen(s);
+            else if ( (nul = memchr(s, 0, n)) ) n = nul - s;
+            break;
+
+        case FMT_SPEC:
+            s = fmt->_text + op->off;
+            if (op->stars > 0) star[0] = va_arg(*ap, int);
+            if (op->stars > 1) star[1] = va_arg(*ap, int);
+
+            /* measure with a copy, the value is fetched twice */
+            va_copy(copy, *ap);
+            n = _string_fmt_spec(NULL, 0, op, s, star, & copy);
+            va_end(copy);
+
+            if (n < 0 || _string_reserve(str, n + 1) == -1) return -1;
+
+            _string_fmt_spec(str->_data + str->_len, n + 1, op, s, star, ap);
+            str->_len += n;
+            continue;
+        }
+
+        if (_string_reserve(str, n + 1) == -1) return -1;
+
+        memcpy(str->_data + str->_len, s, n);
+        str->_len += n;
     }
 
-    memcpy(out, string->_data, sizeof(*out));
+    if (_string_reserve(str, 1) == -1) return -1;
+
+    str->_data[str->_len] = '\0';
 
     return 0;
 }
 
 /* -------------------------------------------------------------------------- */
 
-public uint8_t string_peek_uint8(const m_string *string)
+static m_string *_string_vfmt_compiled(m_string *str, int append,
+                                       const m_fmt *fmt, va_list *ap)
 {
-    uint8_t ret = 0;
-
-    string_to_uint8(string, & ret);
+    m_string *new = NULL;
+    size_t len = 0;
+
+    if (! fmt || (str && str->parent)) {
+        debug("string_fmt_compiled(): bad parameters.\n");
+        return NULL;
+    }
+
+    if (str && (_string_cow(str) == -1 || str->_flags & _STRING_FLAG_RDONLY)) {
+        debug("string_fmt_compiled(): illegal write attempt.\n");
+        return NULL;
+    }
+
+    if (! str && ! (str = new = string_alloc(NULL, 0)) ) {
+        debug("string_fmt_compiled(): allocation failure.\n");
+        return NULL;
+    }
+
+    len = (append) ? str->_len : 0;
+    str->_len = len;
+
+    /* the output is written in place, the previous contents are lost when
+       overwriting the string */
+    if (_string_fmt_run(str, fmt, ap) == -1) {
+        debug("string_fmt_compiled(): wrong format or resize failure.\n");
+        str->_len = len;
+        if (str->_data) str->_data[len] = '\0';
+        string_free(new);
+        return NULL;
+    }
+
+    return str;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_vfmt_compiled(m_string *str, const m_fmt *fmt,
+                                      va_list args)
+{
+    /** @brief overwrite a string with a compiled format or allocate it */
+
+    va_list copy;
+
+    va_copy(copy, args);
+    str = _string_vfmt_compiled(str, 0, fmt, & copy);
+    va_end(copy);
+
+    return str;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_fmt_compiled(m_string *str, const m_fmt *fmt, ...)
+{
+    /** @brief overwrite a string with a compiled format or allocate it */
+
+    va_list args;
+
+    va_start(args, fmt);
+    str = _string_vfmt_compiled(str, 0, fmt, & args);
+    va_end(args);
+
+    return str;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_catfmt_compiled(m_string *str, const m_fmt *fmt, ...)
+{
+    /** @brief append a compiled format to a string */
+
+    va_list args;
+
+    va_start(args, fmt);
+    str = _string_vfmt_compiled(str, 1, fmt, & args);
+    va_end(args);
+
+    return str;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_from_uint8(uint8_t u8)
+{
+    /** @brief create a string from an integer */
+
+    return string_alloc((char *) & u8, sizeof(u8));
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_to_uint8s(const char *string, uint8_t *out)
+{
+    if (! string || ! out) {
+        debug("string_to_uint8s: bad parameters.\n");
+        return -1;
+    }
+
+    memcpy(out, string, sizeof(*out));
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_to_uint8(const m_string *string, uint8_t *out)
+{
+    /** @brief convert a binary string to an integer */
+
+    if (! string || ! out || ! DATA(string) || SIZE(string) < sizeof(*out)) {
+        debug("string_to_uint8(): bad parameters.\n");
+        return -1;
+    }
+
+    memcpy(out, string->_data, sizeof(*out));
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public uint8_t string_peek_uint8(const m_string *string)
+{
+    uint8_t ret = 0;
+
+    string_to_uint8(string, & ret);
 
     return ret;
 }
@@ -654,13 +1239,15 @@ public int string_peek_fmt(m_string *string, const char *fmt, ...)
 
     va_start(args, fmt);
 
-    if (! (ret = m_vsnscanf(DATA(string), SIZE(string), fmt, args)) ) {
+    ret = m_vsnscanf(DATA(string), SIZE(string), fmt, args);
+
+    va_end(args);
+
+    if (ret <= 0) {
         debug("string_peek_fmt(): wrong format or vsnscanf() error.\n");
         return -1;
     }
 
-    va_end(args);
-
     return 0;
 }
 
@@ -677,15 +1264,191 @@ public int string_fetch_fmt(m_string *string, const char *fmt, ...)
 
     va_start(args, fmt);
 
-    if (! (ret = m_vsnscanf(DATA(string), SIZE(string), fmt, args)) ) {
+    ret = m_vsnscanf(DATA(string), SIZE(string), fmt, args);
+
+    va_end(args);
+
+    if (ret <= 0) {
         debug("string_fetch_fmt(): wrong format or vsnscanf() error.\n");
         return -1;
     }
 
     string_suppr(string, 0, ret);
 
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#define _BSWAP32(x) ((x) >> 24 | ((x) >> 8 & 0xff00) | \
+                     ((x) << 8 & 0xff0000) | (x) << 24)
+
+static uint64_t _string_scan_int(const unsigned char *p, const m_scan_op *op)
+{
+    static const uint16_t one = 1;
+    int little = (op->order) ? op->order == FLOAT_LITTLE :
+                 *(const char *) & one;
+    int swap = (little != *(const char *) & one);
+    uint64_t u64 = 0;
+    uint32_t u32 = 0;
+    uint16_t u16 = 0;
+    size_t i = 0;
+
+    switch (op->width) {
+    case 1:
+        return *p;
+    case 2:
+        memcpy(& u16, p, sizeof(u16));
+        return (swap) ? (uint16_t) (u16 >> 8 | u16 << 8) : u16;
+    case 4:
+        memcpy(& u32, p, sizeof(u32));
+        return (swap) ? _BSWAP32(u32) : u32;
+    case 8:
+        memcpy(& u64, p, sizeof(u64));
+        if (! swap) return u64;
+        u32 = u64; u64 >>= 32;
+        return (uint64_t) _BSWAP32(u32) << 32 | _BSWAP32((uint32_t) u64);
+    }
+
+    /* odd widths, one byte at a time */
+    if (little) for (i = op->width; i --; ) u64 = u64 << 8 | p[i];
+    else for (i = 0; i < op->width; i ++) u64 = u64 << 8 | p[i];
+
+    return u64;
+}
+
+#undef _BSWAP32
+
+/* -------------------------------------------------------------------------- */
+
+static int _string_scan_run(const char *data, size_t size,
+                            const m_scan *scan, va_list *ap)
+{
+    const m_scan_op *op = NULL, *end = scan->_op + scan->_count;
+    const unsigned char *p = (const unsigned char *) data, *last = p + size;
+    size_t max = 0;
+    uint64_t u = 0;
+    char *out = NULL;
+
+    if (scan->_fallback) return m_vsnscanf(data, size, scan->_text, *ap);
+
+    /* a single check for all the fixed size fields */
+    if (size < scan->_fixed) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (op = scan->_op; op < end; op ++) {
+        switch (op->type) {
+        case SCAN_LITERAL:
+            if (memcmp(p, scan->_text + op->off, op->len)) {
+                errno = EAGAIN;
+                return -1;
+            }
+            p += op->len;
+            continue;
+
+        case SCAN_CHARS:
+            if (op->arg) memcpy(va_arg(*ap, char *), p, op->len);
+            p += op->len;
+            continue;
+
+        case SCAN_FLOAT:
+            if (op->arg == SCAN_ARG_DOUBLE)
+                *va_arg(*ap, double *) = float_read_double((const char *) p,
+                                                           op->order);
+            else if (op->arg)
+                *va_arg(*ap, float *) = float_read_single((const char *) p,
+                                                          op->order);
+            p += op->width;
+            continue;
+
+        case SCAN_STR:
+            if (op->arg) {
+                max = va_arg(*ap, size_t);
+                out = va_arg(*ap, char *);
+            }
+
+            u = _string_scan_int(p, op); p += op->width;
+
+            /* the following fields must still fit */
+            if (u > (size_t) (last - p) - op->len) {
+                errno = ENOMEM;
+                return -1;
+            }
+
+            if (op->arg) {
+                if (u >= max) {
+                    if (max) *out = '\0';
+                    errno = ENOMEM;
+                    return -1;
+                }
+                memcpy(out, p, u); out[u] = '\0';
+            }
+
+            p += u;
+            continue;
+        }
+
+        u = _string_scan_int(p, op); p += op->width;
+
+        switch (op->arg) {
+        case SCAN_ARG_CHAR: *va_arg(*ap, char *) = (char) u; break;
+        case SCAN_ARG_SHORT: *va_arg(*ap, short *) = (short) u; break;
+        case SCAN_ARG_INT: *va_arg(*ap, int *) = (int) u; break;
+        case SCAN_ARG_LONG: *va_arg(*ap, long *) = (long) u; break;
+        case SCAN_ARG_QUAD: *va_arg(*ap, int64_t *) = u; break;
+        case SCAN_ARG_SIZE: *va_arg(*ap, ssize_t *) = (ssize_t) u; break;
+        case SCAN_ARG_PTR: *va_arg(*ap, void **) = (void *) (long) u; break;
+        }
+    }
+
+    return p - (const unsigned char *) data;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_peek_compiled(m_string *string, const m_scan *scan, ...)
+{
+    /** @brief copy data from the string according to a compiled layout */
+
+    int ret = 0;
+    va_list args;
+
+    if (! string || ! DATA(string) || ! scan) {
+        debug("string_peek_compiled(): bad parameters.\n");
+        return -1;
+    }
+
+    va_start(args, scan);
+    ret = _string_scan_run(DATA(string), SIZE(string), scan, & args);
+    va_end(args);
+
+    return (ret < 0) ? -1 : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_fetch_compiled(m_string *string, const m_scan *scan, ...)
+{
+    /** @brief move data from the string according to a compiled layout */
+
+    int ret = 0;
+    va_list args;
+
+    if (! string || ! DATA(string) || ! scan) {
+        debug("string_fetch_compiled(): bad parameters.\n");
+        return -1;
+    }
+
+    va_start(args, scan);
+    ret = _string_scan_run(DATA(string), SIZE(string), scan, & args);
     va_end(args);
 
+    if (ret < 0) return -1;
+
+    if (ret) string_suppr(string, 0, ret);
+
     return 0;
 }
 
@@ -777,7 +1540,8 @@ public int string_wchar(m_string *string)
     if (! string || ! DATA(string)) return -1;
 
     /* check if writing and resizing the string is allowed */
-    if (string->_flags & _STRING_FLAG_STATIC) return -1;
+    if (_string_cow(string) == -1 || string->_flags & _STRING_FLAG_STATIC)
+        return -1;
 
     /* find the size of the wchar string */
     if ( (bufsize = mbstowcs(NULL, DATA(string), 0)) != (size_t) -1) {
@@ -796,7 +1560,8 @@ public int string_wchar(m_string *string)
         }
 
         /* update the string */
-        free(string->_data); string->_data = buffer;
+        if (~string->_flags & _STRING_FLAG_INLINE) free(string->_data);
+        string->_data = buffer; string->_flags &= ~_STRING_FLAG_INLINE;
         string->_len = bufsize * sizeof(wchar_t);
         string->_alloc = (bufsize + 1) * sizeof(wchar_t);
     } else {
@@ -818,7 +1583,8 @@ public int string_mbyte(m_string *string)
     if (! string || ! DATA(string)) return -1;
 
     /* check if writing and resizing the string is allowed */
-    if (string->_flags & _STRING_FLAG_STATIC) return -1;
+    if (_string_cow(string) == -1 || string->_flags & _STRING_FLAG_STATIC)
+        return -1;
 
     /* find the size of the multibyte buffer */
     if ( (l = wcstombs(NULL, (wchar_t *) DATA(string), 0)) != (size_t) -1) {
@@ -835,7 +1601,8 @@ public int string_mbyte(m_string *string)
         }
 
         /* update the string */
-        free(string->_data); string->_data = buffer;
+        if (~string->_flags & _STRING_FLAG_INLINE) free(string->_data);
+        string->_data = buffer; string->_flags &= ~_STRING_FLAG_INLINE;
         string->_len = l; string->_alloc = l + 1;
     } else {
         perror(ERR(string_mbyte, wcstombs)); return -1;
@@ -844,126 +1611,483 @@ public int string_mbyte(m_string *string)
     return 0;
 }
 
-/* -------------------------------------------------------------------------- */
-#ifdef HAS_ICONV
 /* -------------------------------------------------------------------------- */
 
-public size_t string_convs(const char *src, size_t srclen, const char *src_enc,
-                           char *dst, size_t dstlen, const char *dst_enc)
+static int _string_utf8_decode(const uint8_t *s, size_t n, uint32_t *cp)
 {
-    char buffer[BUFSIZ], *out = dst;
-    size_t inlen = srclen, outlen = dstlen;
-    #ifdef __APPLE__
-    #if ! defined(MAC_OS_X_VERSION_10_5) && ! defined(__MAC_10_5)
-    const /* SUSv2 definition */
-    #endif
-    #endif
-    char *in = (char *) src;
-    iconv_t conv;
-    size_t allocsize = 0;
-
-    if (! src || ! srclen) {
-        debug("string_convs(): bad parameters.\n");
-        return -1;
+    /* decodes a character, returns its length, 0 if it is invalid or -1 if
+       it is cut by the end of the buffer */
+    uint8_t c = s[0], lo = 0x80, hi = 0xbf;
+    int len = 0, i = 0;
+    uint32_t v = 0;
+
+    if (c < 0x80) { *cp = c; return 1; }
+
+    /* overlong forms, surrogates and values above U+10FFFF are rejected by
+       narrowing the range of the second byte */
+    if (c < 0xc2 || c > 0xf4) return 0;
+    else if (c < 0xe0) { len = 2; v = c & 0x1f; }
+    else if (c < 0xf0) {
+        len = 3; v = c & 0x0f;
+        if (c == 0xe0) lo = 0xa0; else if (c == 0xed) hi = 0x9f;
+    } else {
+        len = 4; v = c & 0x07;
+        if (c == 0xf0) lo = 0x90; else if (c == 0xf4) hi = 0x8f;
     }
 
-    if (! (conv = iconv_open(dst_enc, src_enc)) ) {
-        perror(ERR(string_convs, iconv_open)); return -1;
+    for (i = 1; i < len; i ++, lo = 0x80, hi = 0xbf) {
+        if ((size_t) i >= n) return -1;
+        if (s[i] < lo || s[i] > hi) return 0;
+        v = (v << 6) | (s[i] & 0x3f);
     }
 
-    /* dry run: use a static buffer for output */
-    if (! dst) { out = buffer; outlen = sizeof(buffer); }
+    *cp = v;
 
-    while (iconv(conv, & in, & inlen, & out, & outlen) == (size_t) -1) {
-        if (errno == E2BIG && ! dst) {
-            allocsize += sizeof(buffer) - outlen;
-            out = buffer; outlen = sizeof(buffer);
-            continue;
-        }
-        /* conversion failure */
-        perror(ERR(string_convs, iconv));
-        goto _err_conv;
-    }
+    return len;
+}
 
-    /* dry run: evaluate the size required for the output */
-    if (! dst) allocsize += sizeof(buffer) - outlen;
+/* -------------------------------------------------------------------------- */
 
-    iconv_close(conv);
+public size_t string_utf8_check(const char *data, size_t len)
+{
+    /** @brief returns the length of the valid UTF-8 prefix of the data */
 
-    return allocsize;
+    const uint8_t *s = (const uint8_t *) data;
+    uint32_t cp = 0;
+    size_t i = 0;
+    int r = 0;
 
-_err_conv:
-    iconv_close(conv);
+    if (! data) return 0;
 
-    return -1;
+    if (_search_engine == -1) string_api_setup();
+
+    /* the vector code stops before the first error, if any */
+    i = __simd_utf8_valid(_search_engine, s, len);
+
+    while (i < len) {
+        if ( (i += __simd_skip_ascii(_search_engine, s + i, len - i)) == len)
+            break;
+        if ( (r = _string_utf8_decode(s + i, len - i, & cp)) <= 0) break;
+        i += r;
+    }
+
+    return i;
 }
 
+/* -------------------------------------------------------------------------- */
+#ifdef HAS_ICONV
 /* -------------------------------------------------------------------------- */
 
-public int string_conv(m_string *s, const char *src_enc, const char *dst_enc)
+/* encodings converted without iconv */
+#define _ENC_OTHER   0
+#define _ENC_UTF8    1
+#define _ENC_UTF16LE 2
+#define _ENC_UTF16BE 3
+#define _ENC_LATIN1  4
+
+static int _string_encoding(const char *name)
 {
-    char buffer[BUFSIZ], *out = buffer;
-    size_t inlen = 0, outlen = sizeof(buffer);
-    #ifdef __APPLE__
-    #if ! defined(MAC_OS_X_VERSION_10_5) && ! defined(__MAC_10_5)
-    const /* SUSv2 definition */
-    #endif
-    #endif
-    char *in = NULL;
-    iconv_t conv;
-    size_t allocsize = 0;
+    static const struct { const char *name; int id; } known[] = {
+        { "UTF-8", _ENC_UTF8 }, { "UTF8", _ENC_UTF8 },
+        { "UTF-16LE", _ENC_UTF16LE }, { "UTF16LE", _ENC_UTF16LE },
+        { "UTF-16BE", _ENC_UTF16BE }, { "UTF16BE", _ENC_UTF16BE },
+        { "ISO-8859-1", _ENC_LATIN1 }, { "ISO8859-1", _ENC_LATIN1 },
+        { "ISO_8859-1", _ENC_LATIN1 }, { "LATIN1", _ENC_LATIN1 },
+        { "L1", _ENC_LATIN1 }
+    };
+    const char *a = NULL, *b = NULL;
+    unsigned int i = 0;
 
-    if (! s) {
-        debug("string_conv(): bad parameters.\n");
-        return -1;
-    }
+    if (! name) return _ENC_OTHER;
 
-    if (! (conv = iconv_open(dst_enc, src_enc)) ) {
-        perror(ERR(string_conv, iconv_open)); return -1;
+    /* case insensitive, the suffixes like //TRANSLIT are left to iconv */
+    for (i = 0; i < sizeof(known) / sizeof(*known); i ++) {
+        for (a = name, b = known[i].name;
+             *a && toupper((unsigned char) *a) == *b; a ++, b ++);
+        if (! *a && ! *b) return known[i].id;
     }
 
-    in = s->_data; inlen = SIZE(s);
+    return _ENC_OTHER;
+}
 
-    while (iconv(conv, & in, & inlen, & out, & outlen) == (size_t) -1) {
-        if (errno == E2BIG) {
-            allocsize += sizeof(buffer) - outlen;
-            out = buffer; outlen = sizeof(buffer);
-            continue;
-        }
-        /* incomplete input or invalid multibyte sequence */
-        perror(ERR(string_conv, iconv));
-        goto _err_conv;
-    }
+/* -------------------------------------------------------------------------- */
 
-    allocsize += sizeof(buffer) - outlen;
+static inline void _string_put16(uint8_t *p, uint32_t u, int be)
+{
+    p[be ^ 1] = u >> 8; p[be] = u & 0xff;
+}
 
-    if (allocsize != SIZE(s)) {
-        if (allocsize > SIZE(s)) {
-            /* extend the string */
-            if (string_extend(s, allocsize) == -1)
-                goto _err_conv;
+/* -------------------------------------------------------------------------- */
+
+static size_t _string_transcode(int from, int to, const uint8_t *in, size_t n,
+                                uint8_t *out, size_t outlen)
+{
+    /* converts between the encodings known natively, in a single pass which
+       also validates the input; without output buffer only the size of the
+       result is computed. On failure, returns -1 and sets errno like iconv()
+       does. */
+
+    size_t i = 0, j = 0, k = 0, size = 0;
+    uint32_t cp = 0, low = 0;
+    int r = 0, be = (to == _ENC_UTF16BE);
+
+    while (i < n) {
+        /* the runs of ASCII characters are only copied, or widened */
+        if (from == _ENC_UTF8 || from == _ENC_LATIN1) {
+            size = __simd_skip_ascii(_search_engine, in + i, n - i);
+
+            if (size) {
+                if (to == _ENC_UTF16LE || to == _ENC_UTF16BE) {
+                    if (out && j + size * 2 > outlen) goto _e2big;
+                    if (out) for (k = 0; k < size; k ++)
+                        _string_put16(out + j + k * 2, in[i + k], be);
+                    j += size * 2;
+                } else {
+                    if (out && j + size > outlen) goto _e2big;
+                    if (out) memcpy(out + j, in + i, size);
+                    j += size;
+                }
+                if ( (i += size) == n) break;
+            }
         }
-        string_free_token(s);
+
+        switch (from) {
+        case _ENC_UTF8:
+            if ( (r = _string_utf8_decode(in + i, n - i, & cp)) <= 0) {
+                errno = (r) ? EINVAL : EILSEQ; return -1;
+            }
+            i += r;
+            break;
+
+        case _ENC_LATIN1: cp = in[i ++]; break;
+
+        default:
+            /* UTF-16, surrogates must come in pairs */
+            if (i + 2 > n) { errno = EINVAL; return -1; }
+            cp = (from == _ENC_UTF16LE) ? in[i] | (in[i + 1] << 8) :
+                                          (in[i] << 8) | in[i + 1];
+            i += 2;
+            if (cp >= 0xdc00 && cp <= 0xdfff) { errno = EILSEQ; return -1; }
+            if (cp >= 0xd800 && cp <= 0xdbff) {
+                if (i + 2 > n) { errno = EINVAL; return -1; }
+                low = (from == _ENC_UTF16LE) ? in[i] | (in[i + 1] << 8) :
+                                               (in[i] << 8) | in[i + 1];
+                if (low < 0xdc00 || low > 0xdfff) {
+                    errno = EILSEQ; return -1;
+                }
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                i += 2;
+            }
+        }
+
+        switch (to) {
+        case _ENC_UTF8:
+            size = (cp < 0x80) ? 1 : (cp < 0x800) ? 2 : (cp < 0x10000) ? 3 : 4;
+            if (! out) break;
+            if (j + size > outlen) goto _e2big;
+            if (size == 1) out[j] = cp;
+            else {
+                for (k = size - 1; k; k --, cp >>= 6)
+                    out[j + k] = 0x80 | (cp & 0x3f);
+                out[j] = (0xf00 >> size) | cp;
+            }
+            break;
+
+        case _ENC_LATIN1:
+            if (cp > 0xff) { errno = EILSEQ; return -1; }
+            size = 1;
+            if (! out) break;
+            if (j + size > outlen) goto _e2big;
+            out[j] = cp;
+            break;
+
+        default:
+            size = (cp < 0x10000) ? 2 : 4;
+            if (! out) break;
+            if (j + size > outlen) goto _e2big;
+            if (size == 2) _string_put16(out + j, cp, be);
+            else {
+                cp -= 0x10000;
+                _string_put16(out + j, 0xd800 | (cp >> 10), be);
+                _string_put16(out + j + 2, 0xdc00 | (cp & 0x3ff), be);
+            }
+        }
+
+        j += size;
+    }
+
+    return j;
+
+_e2big:
+    errno = E2BIG;
+
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* longest encoding name kept in the cache */
+#define _ICONV_NAME 32
+
+typedef struct _string_iconv_slot {
+    char from[_ICONV_NAME];
+    char to[_ICONV_NAME];
+    iconv_t cd;
+    int idle;
+} _string_iconv_slot;
+
+/* idle conversion descriptors; since they carry a conversion state, they
+   are taken out of the cache while they are in use */
+static _string_iconv_slot _iconv_cache[STRING_ICONV_CACHE];
+static unsigned int _iconv_evict = 0;
+static pthread_mutex_t _iconv_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* -------------------------------------------------------------------------- */
+
+static iconv_t _string_iconv_open(const char *from, const char *to)
+{
+    iconv_t ret = (iconv_t) -1;
+    unsigned int i = 0;
+
+    pthread_mutex_lock(& _iconv_lock);
+        for (i = 0; i < STRING_ICONV_CACHE; i ++) {
+            if (_iconv_cache[i].idle && ! strcmp(_iconv_cache[i].from, from) &&
+                ! strcmp(_iconv_cache[i].to, to)) {
+                ret = _iconv_cache[i].cd; _iconv_cache[i].idle = 0;
+                break;
+            }
+        }
+    pthread_mutex_unlock(& _iconv_lock);
+
+    if (ret == (iconv_t) -1 && (ret = iconv_open(to, from)) == (iconv_t) -1)
+        perror(ERR(_string_iconv_open, iconv_open));
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _string_iconv_close(const char *from, const char *to, iconv_t cd)
+{
+    _string_iconv_slot *slot = NULL;
+    iconv_t old = (iconv_t) -1;
+    unsigned int i = 0;
+
+    if (strlen(from) >= _ICONV_NAME || strlen(to) >= _ICONV_NAME) {
+        iconv_close(cd);
+        return;
+    }
+
+    /* back to the initial shift state for the next user */
+    iconv(cd, NULL, NULL, NULL, NULL);
+
+    pthread_mutex_lock(& _iconv_lock);
+        for (i = 0; i < STRING_ICONV_CACHE && _iconv_cache[i].idle; i ++);
+        if (i == STRING_ICONV_CACHE) {
+            i = _iconv_evict ++ % STRING_ICONV_CACHE;
+            old = _iconv_cache[i].cd;
+        }
+        slot = & _iconv_cache[i];
+        strcpy(slot->from, from); strcpy(slot->to, to);
+        slot->cd = cd; slot->idle = 1;
+    pthread_mutex_unlock(& _iconv_lock);
+
+    if (old != (iconv_t) -1) iconv_close(old);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public size_t string_convs(const char *src, size_t srclen, const char *src_enc,
+                           char *dst, size_t dstlen, const char *dst_enc)
+{
+    char buffer[BUFSIZ], *out = dst;
+    size_t inlen = srclen, outlen = dstlen;
+    #ifdef __APPLE__
+    #if ! defined(MAC_OS_X_VERSION_10_5) && ! defined(__MAC_10_5)
+    const /* SUSv2 definition */
+    #endif
+    #endif
+    char *in = (char *) src;
+    iconv_t conv;
+    size_t allocsize = 0;
+    int from = 0, to = 0;
+
+    if (! src || ! srclen || ! src_enc || ! dst_enc) {
+        debug("string_convs(): bad parameters.\n");
+        return -1;
+    }
+
+    if (_search_engine == -1) string_api_setup();
+
+    /* the common Unicode conversions do not need iconv */
+    from = _string_encoding(src_enc); to = _string_encoding(dst_enc);
+
+    if (from && to) {
+        allocsize = _string_transcode(from, to, (const uint8_t *) src, srclen,
+                                      (uint8_t *) dst, dstlen);
+        if (allocsize == (size_t) -1) {
+            perror(ERR(string_convs, _string_transcode));
+            return -1;
+        }
+        return (dst) ? 0 : allocsize;
+    }
+
+    if ( (conv = _string_iconv_open(src_enc, dst_enc)) == (iconv_t) -1)
+        return -1;
+
+    /* dry run: use a static buffer for output */
+    if (! dst) { out = buffer; outlen = sizeof(buffer); }
+
+    while (iconv(conv, & in, & inlen, & out, & outlen) == (size_t) -1) {
+        if (errno == E2BIG && ! dst) {
+            allocsize += sizeof(buffer) - outlen;
+            out = buffer; outlen = sizeof(buffer);
+            continue;
+        }
+        /* conversion failure */
+        perror(ERR(string_convs, iconv));
+        goto _err_conv;
+    }
+
+    /* dry run: evaluate the size required for the output */
+    if (! dst) allocsize += sizeof(buffer) - outlen;
+
+    _string_iconv_close(src_enc, dst_enc, conv);
+
+    return allocsize;
+
+_err_conv:
+    _string_iconv_close(src_enc, dst_enc, conv);
+
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static char *_string_iconv(const char *src_enc, const char *dst_enc,
+                           const char *src, size_t len, size_t *outlen)
+{
+    /* converts the whole input in one pass, the output buffer is grown
+       in the unlikely case the first estimate was too small */
+
+    #ifdef __APPLE__
+    #if ! defined(MAC_OS_X_VERSION_10_5) && ! defined(__MAC_10_5)
+    const /* SUSv2 definition */
+    #endif
+    #endif
+    char *in = (char *) src;
+    char *buffer = NULL, *out = NULL, *tmp = NULL;
+    size_t inlen = len, left = 0, alloc = len + len / 2 + 16, r = 0;
+    iconv_t conv;
+
+    if ( (conv = _string_iconv_open(src_enc, dst_enc)) == (iconv_t) -1)
+        return NULL;
+
+    if (! (buffer = malloc(alloc)) ) {
+        perror(ERR(_string_iconv, malloc));
+        goto _err_conv;
+    }
+
+    out = buffer; left = alloc;
+
+    for (;;) {
+        /* once the input is consumed, the shift sequences of the stateful
+           encodings are flushed */
+        if (inlen) r = iconv(conv, & in, & inlen, & out, & left);
+        else r = iconv(conv, NULL, NULL, & out, & left);
+
+        if (r != (size_t) -1) {
+            if (inlen) continue;
+            break;
+        }
+
+        if (errno != E2BIG || alloc * 2 < alloc) {
+            /* incomplete input or invalid multibyte sequence */
+            perror(ERR(_string_iconv, iconv));
+            goto _err_conv;
+        }
+        if (! (tmp = realloc(buffer, alloc * 2)) ) {
+            perror(ERR(_string_iconv, realloc));
+            goto _err_conv;
+        }
+        out = tmp + (alloc - left); left += alloc;
+        buffer = tmp; alloc *= 2;
+    }
+
+    *outlen = alloc - left;
+
+    _string_iconv_close(src_enc, dst_enc, conv);
+
+    return buffer;
+
+_err_conv:
+    free(buffer);
+    _string_iconv_close(src_enc, dst_enc, conv);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_conv(m_string *s, const char *src_enc, const char *dst_enc)
+{
+    char *buffer = NULL;
+    size_t len = 0;
+    int from = 0, to = 0;
+
+    if (! s || ! src_enc || ! dst_enc) {
+        debug("string_conv(): bad parameters.\n");
+        return -1;
+    }
+
+    if (_search_engine == -1) string_api_setup();
+
+    from = _string_encoding(src_enc); to = _string_encoding(dst_enc);
+
+    /* UTF-8 to UTF-8 only needs a validation */
+    if (from == _ENC_UTF8 && to == _ENC_UTF8) {
+        if (string_utf8_check(DATA(s), SIZE(s)) == SIZE(s)) return 0;
+        debug("string_conv(): invalid UTF-8 sequence.\n");
+        return -1;
     }
 
-    if (allocsize > sizeof(buffer)) {
-        in = s->_data; inlen = SIZE(s);
-        out = s->_data; outlen = allocsize;
-        /* convert again */
-        if (iconv(conv, & in, & inlen, & out, & outlen) == (size_t) -1) {
-            perror(ERR(string_conv, iconv));
+    if (from && to) {
+        /* the native conversions at most double the size of the data */
+        if (SIZE(s) > SIZE_MAX / 2 - 1 ||
+            ! (buffer = malloc(SIZE(s) * 2 + 1)) ) {
+            perror(ERR(string_conv, malloc));
+            return -1;
+        }
+        len = _string_transcode(from, to, (const uint8_t *) DATA(s), SIZE(s),
+                                (uint8_t *) buffer, SIZE(s) * 2);
+        if (len == (size_t) -1) {
+            perror(ERR(string_conv, _string_transcode));
             goto _err_conv;
         }
-    } else memcpy(s->_data, buffer, allocsize);
+    } else if (! (buffer = _string_iconv(src_enc, dst_enc, DATA(s), SIZE(s),
+                                         & len)) )
+        return -1;
+
+    if (len != SIZE(s)) {
+        if (len > SIZE(s)) {
+            /* extend the string */
+            if (string_extend(s, len) == -1)
+                goto _err_conv;
+        }
+        string_free_token(s);
+    }
 
-    s->_len = allocsize;
+    if (_string_cow(s) == -1) goto _err_conv;
 
-    iconv_close(conv);
+    memcpy(s->_data, buffer, len);
+    s->_len = len;
+
+    free(buffer);
 
     return 0;
 
 _err_conv:
-    iconv_close(conv);
+    free(buffer);
 
     return -1;
 }
@@ -984,7 +2108,7 @@ public int string_swap(m_string *string)
         return -1;
     }
 
-    if (string->_flags & _STRING_FLAG_RDONLY) {
+    if (_string_cow(string) == -1 || string->_flags & _STRING_FLAG_RDONLY) {
         debug("string_swap(): illegal write attempt.\n");
         return -1;
     }
@@ -1100,8 +2224,20 @@ public m_string *string_free(m_string *string)
 
     if (string->_flags & _STRING_FLAG_NALLOC) return NULL;
 
-    if (~string->_flags & _STRING_FLAG_NOFREE)
+    if (! (string->_flags & (_STRING_FLAG_NOFREE | _STRING_FLAG_INLINE)))
         free(string->_data);
+
+    /* the last shared string releases the buffer */
+    if (string->_flags & _STRING_FLAG_SHARED &&
+        ! _string_block_ref(_SHARED_BLOCK(string), -1))
+        free(_SHARED_BLOCK(string));
+
+    /* the arena releases the struct, do not free the data twice */
+    if (string->_flags & _STRING_FLAG_ARENA) {
+        string->_flags |= _STRING_FLAG_INLINE;
+        return NULL;
+    }
+
     free(string);
 
     return NULL;
@@ -1245,6 +2381,8 @@ public int string_dim(m_string *string, size_t size)
         return -1;
     }
 
+    if (_string_cow(string) == -1) return -1;
+
     if (string->_alloc == size) return 0;
 
     /* XXX "need" is the number of bytes that should be added or removed
@@ -1285,7 +2423,21 @@ public int string_dim(m_string *string, size_t size)
 
         base = string->_data;
 
-        if (! (data = realloc(string->_data, allocsize)) ) {
+        if (string->_flags & _STRING_FLAG_ARENA &&
+            string->_flags & _STRING_FLAG_INLINE) {
+            /* grow the data within its arena */
+            data = _string_arena_realloc(_ARENA_HDR(string)->arena, base,
+                                         (base) ? string->_alloc +
+                                         sizeof(wchar_t) : 0, allocsize);
+            if (! data) return -1;
+        } else if (string->_flags & _STRING_FLAG_INLINE) {
+            /* move the data out of the struct */
+            if (! (data = malloc(allocsize)) ) {
+                perror(ERR(string_dim, malloc)); return -1;
+            }
+            memcpy(data, base, string->_alloc + sizeof(wchar_t));
+            string->_flags &= ~_STRING_FLAG_INLINE;
+        } else if (! (data = realloc(string->_data, allocsize)) ) {
             perror(ERR(string_dim, realloc)); return -1;
         }
 
@@ -1328,6 +2480,8 @@ public int string_extend(m_string *string, size_t size)
         return -1;
     }
 
+    if (_string_cow(string) == -1) return -1;
+
     return (size > string->_alloc) ? string_dim(string, size) : 0;
 }
 
@@ -1449,6 +2603,9 @@ public int string_suppr(m_string *string, off_t o, size_t l)
     while (parent->parent) parent = parent->parent;
     o += DATA(string) - DATA(parent); i = o + l;
 
+    /* removing the head of a shared string does not need a copy */
+    if (o && _string_cow(parent) == -1) return -1;
+
     if (parent->_flags & _STRING_FLAG_ENCAPS && ! o) {
         /* shortcut if a static buffer is used and offset is 0 */
         parent->_data += l;
@@ -1591,11 +2748,60 @@ public int string_cmp(const m_string *a, const m_string *b)
 
 /* -------------------------------------------------------------------------- */
 
+public int string_casecmpn(const char *a, const char *b, size_t len)
+{
+    /** @brief compare two buffers, ignoring the ASCII case */
+
+    const uint8_t *x = (const uint8_t *) a, *y = (const uint8_t *) b;
+    size_t i = 0;
+
+    if (! a || ! b) {
+        debug("string_casecmpn(): bad parameters.\n");
+        return 2;
+    }
+
+    if (_search_engine == -1) string_api_setup();
+
+    if ( (i = __simd_casecmp(_search_engine, x, y, len)) == len) return 0;
+
+    /* order the bytes as lower case */
+    return (x[i] | ((uint8_t) (x[i] - 'A') < 26) << 5) -
+           (y[i] | ((uint8_t) (y[i] - 'A') < 26) << 5);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_casecmps(const m_string *a, const char *b, size_t len)
+{
+    /** @brief compare a m_string and a C string, ignoring the ASCII case */
+
+    if (! a || ! DATA(a) || ! b || ! len) {
+        debug("string_casecmps(): bad parameters.\n");
+        return 2;
+    }
+
+    return string_casecmpn(DATA(a), b, MIN(SIZE(a), len));
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_casecmp(const m_string *a, const m_string *b)
+{
+    /** @brief compare two strings, ignoring the ASCII case */
+
+    if (! b) return 2;
+
+    return string_casecmps(a, DATA(b), SIZE(b));
+}
+
+/* -------------------------------------------------------------------------- */
+
 public int string_upper(m_string *string)
 {
     /** @brief convert an ASCII string to upper case */
 
-    unsigned int i = 0;
+    const char *nul = NULL;
+    size_t len = 0;
 
     if (! string || ! DATA(string)) {
         debug("string_upper(): bad parameters.\n");
@@ -1603,13 +2809,20 @@ public int string_upper(m_string *string)
     }
 
     /* check if writing to the string is allowed */
-    if (string->_flags & _STRING_FLAG_RDONLY) {
+    if (_string_cow(string) == -1 || string->_flags & _STRING_FLAG_RDONLY) {
         debug("string_upper(): illegal write attempt.\n");
         return -1;
     }
 
-    for (i = 0; i < SIZE(string) && string->_data[i]; i ++)
-        string->_data[i] = toupper(string->_data[i]);
+    if (_search_engine == -1) string_api_setup();
+
+    /* the conversion stops at the first NUL */
+    if ( (nul = memchr(string->_data, 0, SIZE(string))) )
+        len = nul - string->_data;
+    else len = SIZE(string);
+
+    __simd_fold(_search_engine, (uint8_t *) string->_data,
+                (const uint8_t *) string->_data, len, 1);
 
     /* since it is an in place transformation, keep existings tokens */
 
@@ -1622,7 +2835,8 @@ public int string_lower(m_string *string)
 {
     /** @brief convert an ASCII string to lower case */
 
-    unsigned int i = 0;
+    const char *nul = NULL;
+    size_t len = 0;
 
     if (! string || ! DATA(string)) {
         debug("string_lower(): bad parameters.\n");
@@ -1630,13 +2844,20 @@ public int string_lower(m_string *string)
     }
 
     /* check if writing to the string is allowed */
-    if (string->_flags & _STRING_FLAG_RDONLY) {
+    if (_string_cow(string) == -1 || string->_flags & _STRING_FLAG_RDONLY) {
         debug("string_lower(): illegal write attempt.\n");
         return -1;
     }
 
-    for (i = 0; i < SIZE(string) && string->_data[i]; i ++)
-        string->_data[i] = tolower(string->_data[i]);
+    if (_search_engine == -1) string_api_setup();
+
+    /* the conversion stops at the first NUL */
+    if ( (nul = memchr(string->_data, 0, SIZE(string))) )
+        len = nul - string->_data;
+    else len = SIZE(string);
+
+    __simd_fold(_search_engine, (uint8_t *) string->_data,
+                (const uint8_t *) string->_data, len, 0);
 
     /* since it is an in place transformation, keep existings tokens */
 
@@ -1652,21 +2873,23 @@ public int string_compile_searchstring(m_search_string *c,
 {
     /** @brief compute the Boyer-Moore lookup table for the given substring */
 
-    unsigned int i = 0;
+    size_t i = 0;
 
-    if (! c || ! s || ! len || len > 255) {
+    if (! c || ! s || ! len) {
         debug("string_compile_searchstring(): bad parameters.\n");
         return -1;
     }
 
     /* register the distance between each possible byte and the last byte
-       of the substring in a lookup table */
-    memset(c->_lut, len, UCHAR_MAX + 1);
+       of the substring in a lookup table; the distances of long needles
+       are capped, which only makes some skips shorter than they could be */
+    memset(c->_lut, (len > UCHAR_MAX) ? UCHAR_MAX : len, UCHAR_MAX + 1);
 
     /*  fix the length */
     len --;
 
-    for (i = 0; i < len; i ++) c->_lut[_UINT(s[i])] = len - i;
+    for (i = 0; i < len; i ++)
+        c->_lut[_UINT(s[i])] = (len - i > UCHAR_MAX) ? UCHAR_MAX : len - i;
 
     /* get the shift length and set up the guard char */
     c->_shift = c->_lut[_UINT(s[len])];
@@ -1691,12 +2914,20 @@ public off_t string_compile_find(const char *s, size_t len, size_t o,
     }
 
     if (o + c->_len < len) {
+        if (_search_engine == -1) string_api_setup();
+
+        if (_search_engine != SIMD_NONE) {
+            /* vectorized search, for all haystack and needle lengths */
+            ptr = __simd_find(_search_engine, s + o, len - o, sub, c->_len + 1);
+            return (ptr) ? ptr - s : -1;
+        }
+
         if (len < UCHAR_MAX) {
             /* naive search algorithm is faster for short strings */
             while ( (ptr = memchr(s + o, sub[0], len - (o + c->_len))) ) {
                 if (! c->_len || ! memcmp(ptr + 1, sub + 1, c->_len))
                     return ptr - s;
-                if ( (o = (ptr - s) + c->_len) > len) break;
+                if ( (o = (ptr - s) + 1) + c->_len >= len) break;
             }
             /* not found */
             return -1;
@@ -1721,40 +2952,277 @@ public off_t string_compile_find(const char *s, size_t len, size_t o,
 
 /* -------------------------------------------------------------------------- */
 
-public off_t string_sfinds(const char *str, size_t slen, size_t o,
-                           const char *sub, size_t len            )
+public int string_search_engine(int engine)
 {
-    /** @brief find a C susbstring within a string */
-
-    m_search_string c;
-
-    /* sanity checks */
-    if (! str || ! slen || ! sub || ! len) {
-        debug("string_sfinds(): bad parameters.\n");
-        return -1;
-    }
-
-    if ( (len > slen) || (o > slen) ) {
-        debug("string_sfinds(): search string out of bound.\n");
+    if (_search_engine == -1) string_api_setup();
+
+    switch (engine) {
+    case STRING_SEARCH_AUTO: _search_engine = __simd_level(); break;
+    case STRING_SEARCH_SCALAR: _search_engine = SIMD_NONE; break;
+    case STRING_SEARCH_SSE2:
+    case STRING_SEARCH_AVX2:
+        /* only select a supported engine */
+        if (__simd_level() < engine - STRING_SEARCH_SCALAR) return -1;
+        _search_engine = engine - STRING_SEARCH_SCALAR; break;
+    default:
+        debug("string_search_engine(): bad parameters.\n");
         return -1;
     }
 
-    if (string_compile_searchstring(& c, sub, len) == -1) return -1;
-
-    return string_compile_find(str, slen, o, sub, & c);
+    return _search_engine + STRING_SEARCH_SCALAR;
 }
 
 /* -------------------------------------------------------------------------- */
 
-public off_t string_finds(const m_string *str, size_t o, const char *sub,
-                          size_t len)
+public m_search_set *string_search_set_alloc(const char **patterns,
+                                             const size_t *len,
+                                             unsigned int count)
 {
-    if (! str || ! DATA(str) || ! sub || ! len) return -1;
+    /** @brief compile a set of patterns into an Aho-Corasick automaton */
 
-    return string_sfinds(DATA(str), SIZE(str), o, sub, len);
-}
+    m_search_set *set = NULL;
+    uint32_t *fail = NULL, *queue = NULL, *next = NULL;
+    uint32_t state = 0, child = 0, head = 0, tail = 0;
+    unsigned int i = 0, j = 0, k = 0;
+    size_t total = 0;
+    char *copy = NULL;
 
-/* -------------------------------------------------------------------------- */
+    if (! patterns || ! len || ! count) {
+        debug("string_search_set_alloc(): bad parameters.\n");
+        return NULL;
+    }
+
+    for (i = 0; i < count; i ++) {
+        if (! patterns[i] || ! len[i]) {
+            debug("string_search_set_alloc(): bad parameters.\n");
+            return NULL;
+        }
+        total += len[i];
+    }
+
+    if (! (set = calloc(1, sizeof(*set))) ) {
+        perror(ERR(string_search_set_alloc, calloc));
+        return NULL;
+    }
+
+    /* the patterns are copied right after the array of pointers */
+    set->_pattern = malloc(count * sizeof(*set->_pattern) + total);
+    set->_len = malloc(count * sizeof(*set->_len));
+    set->_id = malloc(count * sizeof(*set->_id));
+
+    /* the automaton has at most one state per pattern byte, plus the root */
+    set->_next = calloc((total + 1) * (UCHAR_MAX + 1), sizeof(*set->_next));
+    set->_match = malloc((total + 1) * sizeof(*set->_match));
+    fail = malloc((total + 1) * sizeof(*fail));
+    queue = malloc((total + 1) * sizeof(*queue));
+
+    if (! set->_pattern || ! set->_len || ! set->_id || ! set->_next ||
+        ! set->_match || ! fail || ! queue) {
+        perror(ERR(string_search_set_alloc, malloc));
+        goto _err_alloc;
+    }
+
+    /* sort the patterns from the longest to the shortest, so the first
+       pattern matching at a given position is the longest one */
+    for (i = 0; i < count; i ++) {
+        for (j = i; j && len[set->_id[j - 1]] < len[i]; j --)
+            set->_id[j] = set->_id[j - 1];
+        set->_id[j] = i;
+    }
+
+    copy = (char *) (set->_pattern + count);
+
+    for (i = 0; i < count; i ++) {
+        k = set->_id[i];
+        memcpy(copy, patterns[k], len[k]);
+        set->_pattern[i] = copy; copy += len[k];
+        set->_len[i] = len[k];
+    }
+
+    set->_count = count;
+    set->_max = set->_len[0];
+    set->_min = set->_len[count - 1];
+
+    /* build the trie */
+    memset(set->_match, 0xFF, (total + 1) * sizeof(*set->_match));
+    set->_states = 1;
+
+    for (i = 0; i < count; i ++) {
+        for (j = 0, state = 0; j < set->_len[i]; j ++) {
+            next = & set->_next[(state << 8) | _UINT(set->_pattern[i][j])];
+            if (! *next) *next = set->_states ++;
+            state = *next;
+        }
+        /* keep the first of identical patterns */
+        if (set->_match[state] == -1) set->_match[state] = i;
+    }
+
+    /* compute the failure links breadth first and turn the trie into a
+       deterministic automaton */
+    for (j = 0; j <= UCHAR_MAX; j ++) {
+        if ( (child = set->_next[j]) ) { fail[child] = 0; queue[tail ++] = child; }
+    }
+
+    while (head < tail) {
+        state = queue[head ++];
+
+        /* the longest pattern ending in this state */
+        if (set->_match[state] == -1)
+            set->_match[state] = set->_match[fail[state]];
+
+        for (j = 0; j <= UCHAR_MAX; j ++) {
+            next = & set->_next[(state << 8) | j];
+            if ( (child = *next) ) {
+                fail[child] = set->_next[(fail[state] << 8) | j];
+                queue[tail ++] = child;
+            } else *next = set->_next[(fail[state] << 8) | j];
+        }
+    }
+
+    free(fail); free(queue);
+
+    /* small sets starting with a few distinct bytes use the vector engine */
+    for (i = 0; i < count && count <= 16; i ++) {
+        for (j = 0; j < set->_first; j ++)
+            if (set->_byte[j] == _UINT(set->_pattern[i][0])) break;
+
+        if (j < set->_first) continue;
+
+        if (set->_first == sizeof(set->_byte)) { set->_first = 0; break; }
+
+        set->_byte[set->_first ++] = set->_pattern[i][0];
+    }
+
+    return set;
+
+_err_alloc:
+    free(fail); free(queue);
+    return string_search_set_free(set);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_search_set *string_search_set_free(m_search_set *set)
+{
+    if (! set) return NULL;
+
+    free(set->_pattern);
+    free(set->_len);
+    free(set->_id);
+    free(set->_next);
+    free(set->_match);
+    free(set);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public off_t string_search_set_find(const m_search_set *set, const char *s,
+                                    size_t len, size_t o,
+                                    unsigned int *which, size_t *match_len)
+{
+    /** @brief find the earliest match of any pattern of a set */
+
+    const char *p = NULL, *end = NULL;
+    size_t i = 0, limit = 0, start = 0;
+    uint32_t state = 0;
+    int32_t m = -1, k = 0;
+    off_t best = -1;
+
+    if (! set || ! s) {
+        debug("string_search_set_find(): bad parameters.\n");
+        return -1;
+    }
+
+    if (o >= len || len - o < set->_min) return -1;
+
+    if (_search_engine == -1) string_api_setup();
+
+    if (set->_first && _search_engine != SIMD_NONE) {
+        /* locate the candidates with the vector engine and check them */
+        for (p = s + o, end = s + len - set->_min + 1; p < end; p ++) {
+            p = __simd_find_any(_search_engine, p, end - p,
+                                set->_byte, set->_first);
+            if (! p) return -1;
+
+            for (k = 0; k < (int32_t) set->_count; k ++) {
+                if (set->_len[k] <= (size_t) (s + len - p) &&
+                    *p == set->_pattern[k][0] &&
+                    ! memcmp(p, set->_pattern[k], set->_len[k])) {
+                    m = k; best = p - s; goto _found;
+                }
+            }
+        }
+
+        return -1;
+    }
+
+    /* run the automaton; once a match is found, a match starting earlier
+       can only end within the length of the longest pattern */
+    for (i = o, limit = len; i < limit; i ++) {
+        state = set->_next[(state << 8) | _UINT(s[i])];
+
+        if ( (k = set->_match[state]) == -1) continue;
+
+        start = i + 1 - set->_len[k];
+
+        if (best == -1 || (off_t) start < best ||
+            ((off_t) start == best && set->_len[k] > set->_len[m])) {
+            best = start; m = k;
+            if (start + set->_max < len) limit = start + set->_max;
+        }
+    }
+
+    if (best == -1) return -1;
+
+_found:
+    if (which) *which = set->_id[m];
+    if (match_len) *match_len = set->_len[m];
+
+    return best;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public off_t string_sfinds(const char *str, size_t slen, size_t o,
+                           const char *sub, size_t len            )
+{
+    /** @brief find a C susbstring within a string */
+
+    m_search_string c;
+
+    /* sanity checks */
+    if (! str || ! slen || ! sub || ! len) {
+        debug("string_sfinds(): bad parameters.\n");
+        return -1;
+    }
+
+    if ( (len > slen) || (o > slen) ) {
+        debug("string_sfinds(): search string out of bound.\n");
+        return -1;
+    }
+
+    if (_search_engine == -1) string_api_setup();
+
+    /* the lookup table is only used by the scalar engine */
+    if (_search_engine != SIMD_NONE || slen < UCHAR_MAX) c._len = len - 1;
+    else if (string_compile_searchstring(& c, sub, len) == -1) return -1;
+
+    return string_compile_find(str, slen, o, sub, & c);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public off_t string_finds(const m_string *str, size_t o, const char *sub,
+                          size_t len)
+{
+    if (! str || ! DATA(str) || ! sub || ! len) return -1;
+
+    return string_sfinds(DATA(str), SIZE(str), o, sub, len);
+}
+
+/* -------------------------------------------------------------------------- */
 
 public off_t string_find(const m_string *string, size_t o, const m_string *sub)
 {
@@ -1776,15 +3244,109 @@ public off_t string_pos(const m_string *string, const char *sub)
 
 /* -------------------------------------------------------------------------- */
 
-public int string_splits(m_string *s, const char *pattern, size_t len)
+static int _string_compile_split(m_search_string *c, size_t size,
+                                 const char *pattern, size_t len)
 {
-    /** @brief split the string into multiple tokens using a separator */
+    if (_search_engine == -1) string_api_setup();
 
-    off_t offset[16] = { -1 }, off = 0, prev = 0, o = 0, p = 0;
-    unsigned int i = 0, j = 0;
+    /* only the scalar engine needs the lookup table, on long strings */
+    if (size >= UCHAR_MAX && _search_engine == SIMD_NONE)
+        return string_compile_searchstring(c, pattern, len);
+
+    c->_len = len - 1;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static off_t _string_split_next(const char *data, size_t size, off_t o,
+                                const char *pattern, size_t len,
+                                m_search_string *c, const m_search_set *set,
+                                size_t *delim)
+{
+    /** @brief find the next separator and its length */
+
+    if (set) return string_search_set_find(set, data, size, o, NULL, delim);
+
+    *delim = len;
+
+    return (size) ? string_compile_find(data, size, o, pattern, c) : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _string_splits(m_string *s, const char *pattern, size_t len,
+                          const m_search_set *set)
+{
+    /** @brief split the string into multiple tokens using separators */
+
+    off_t off = 0, prev = 0;
+    size_t delim = 0;
+    uint32_t i = 0, alloc = 0;
     m_string *t = NULL;
     m_search_string compiled_pattern;
 
+    if (! set && _string_compile_split(& compiled_pattern, SIZE(s),
+                                       pattern, len) == -1)
+        return -1;
+
+    if (s->_parts_alloc) {
+        /* try to reuse existing tokens */
+        for (i = 0; i < s->parts; i ++)
+            string_free_token(& s->token[i]);
+        s->parts = 0;
+    }
+
+    do {
+        off = _string_split_next(DATA(s), SIZE(s), prev, pattern, len,
+                                 & compiled_pattern, set, & delim);
+
+        if (s->parts == s->_parts_alloc) {
+            if (s->parts == UINT32_MAX) goto _err_range;
+
+            /* grow geometrically so that splitting stays linear */
+            if (s->_parts_alloc > UINT32_MAX / 2) alloc = UINT32_MAX;
+            else alloc = (s->_parts_alloc) ? s->_parts_alloc * 2 : 16;
+
+            if (! (t = realloc(s->token, (size_t) alloc * sizeof(*t))) )
+                goto _err_realloc;
+
+            s->token = t; s->_parts_alloc = alloc;
+        }
+
+        /* the token inherit parent's flags and set the "no free" bit */
+        t = & s->token[s->parts ++];
+        t->parent = s;
+        t->_flags = s->_flags | _STRING_FLAG_NOFREE;
+        t->_data = s->_data + prev;
+        t->_len = ((off != -1) ? (size_t) off : SIZE(s)) - prev;
+        t->_alloc = t->_len;
+        t->_parts_alloc = t->parts = 0;
+        t->token = NULL;
+
+        prev = off + delim;
+    } while (off != -1);
+
+    return 0;
+
+_err_range:
+    debug("string_splits(): too many tokens.\n");
+    string_free_token(s);
+    return -1;
+
+_err_realloc:
+    perror(ERR(string_splits, realloc));
+    string_free_token(s);
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_splits(m_string *s, const char *pattern, size_t len)
+{
+    /** @brief split the string into multiple tokens using a separator */
+
     if (! s || ! DATA(s) || ! pattern || ! len) {
         debug("string_splits(): bad parameters.\n");
         return -1;
@@ -1796,60 +3358,100 @@ public int string_splits(m_string *s, const char *pattern, size_t len)
         return -1;
     }
 
-    if (SIZE(s) >= UCHAR_MAX) {
-        /* compile the search string */
-        if (string_compile_searchstring(& compiled_pattern, pattern, len) == -1)
-            return -1;
-    } else compiled_pattern._len = len - 1;
+    return _string_splits(s, pattern, len, NULL);
+}
 
-    if (s->_parts_alloc) {
-        /* try to reuse existing tokens */
-        for (i = 0; i < s->parts; i ++)
-            string_free_token(& s->token[i]);
-        s->parts = 0; t = s->token;
+/* -------------------------------------------------------------------------- */
+
+public int string_splits_set(m_string *s, const m_search_set *set)
+{
+    /** @brief split the string into multiple tokens using a set of separators */
+
+    if (! s || ! DATA(s) || ! set) {
+        debug("string_splits_set(): bad parameters.\n");
+        return -1;
+    }
+
+    /* the shortest delimiter cannot be longer than the source */
+    if (SIZE(s) <= set->_min + 1) {
+        debug("string_splits_set(): delimiter out of bound.\n");
+        return -1;
     }
 
-    /* fill the offsets array with the locations of the pattern */
-    while (off != -1) {
-        off = string_compile_find(DATA(s), SIZE(s), prev,
-                                  pattern, & compiled_pattern);
+    return _string_splits(s, NULL, 0, set);
+}
 
-        offset[j ++] = prev = off; prev += len;
+/* -------------------------------------------------------------------------- */
 
-        if (off == -1 || j >= 16) {
-            /* allocate enough room for new tokens */
-            if (s->_parts_alloc < s->parts + j) {
-                if (! (t = realloc(s->token, (s->parts + j) * sizeof(*t))) )
-                    goto _err_realloc;
-                s->token = t; s->_parts_alloc = s->parts + j;
-            }
+public int string_cursor_init(m_string_cursor *c, const m_string *s,
+                              const char *pattern, size_t len)
+{
+    /** @brief prepare to walk the tokens of a string lazily */
 
-            if (s->parts) p = t[s->parts - 1]._data - s->_data;
-
-            /* write the tokens */
-            for (i = s->parts; i < s->parts + j; i ++, p = o + len) {
-                /* the token inherit parent's flags and set the "no free" bit */
-                o = offset[i - s->parts];
-                t[i].parent = s;
-                t[i]._flags = s->_flags | _STRING_FLAG_NOFREE;
-                t[i]._data = s->_data + p;
-                t[i]._len = (o != -1) ? (size_t) o : SIZE(s);
-                t[i]._len -= p;
-                t[i]._alloc = t[i]._len;
-                t[i]._parts_alloc = t[i].parts = 0;
-                t[i].token = NULL;
-            }
+    if (! c || ! s || ! DATA(s) || ! pattern || ! len) {
+        debug("string_cursor_init(): bad parameters.\n");
+        return -1;
+    }
 
-            j = 0; s->parts = i;
-        }
+    if (_string_compile_split(& c->_compiled, SIZE(s), pattern, len) == -1)
+        return -1;
+
+    c->_data = DATA(s); c->_len = SIZE(s); c->_off = 0;
+    c->_pattern = pattern; c->_plen = len; c->_set = NULL;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_cursor_init_set(m_string_cursor *c, const m_string *s,
+                                  const m_search_set *set)
+{
+    /** @brief prepare to walk the tokens of a string lazily */
+
+    if (! c || ! s || ! DATA(s) || ! set) {
+        debug("string_cursor_init_set(): bad parameters.\n");
+        return -1;
     }
 
+    c->_data = DATA(s); c->_len = SIZE(s); c->_off = 0;
+    c->_pattern = NULL; c->_plen = 0; c->_set = set;
+
     return 0;
+}
 
-_err_realloc:
-    perror(ERR(string_splits, realloc));
-    string_free_token(s);
-    return -1;
+/* -------------------------------------------------------------------------- */
+
+public const m_string *string_cursor_next(m_string_cursor *c)
+{
+    /** @brief return the next token of a string */
+
+    off_t off = 0;
+    size_t delim = 0;
+
+    if (! c) {
+        debug("string_cursor_next(): bad parameters.\n");
+        return NULL;
+    }
+
+    /* the last token was already returned */
+    if (c->_off == -1) return NULL;
+
+    off = _string_split_next(c->_data, c->_len, c->_off, c->_pattern,
+                             c->_plen, & c->_compiled, c->_set, & delim);
+
+    /* the token is a read only view of the string */
+    c->_token._data = (char *) c->_data + c->_off;
+    c->_token._len = ((off != -1) ? (size_t) off : c->_len) - c->_off;
+    c->_token._alloc = c->_token._len;
+    c->_token._flags = _STRING_FLAG_STATIC | _STRING_FLAG_ENCAPS |
+                       _STRING_FLAG_NALLOC;
+    c->_token.parent = NULL; c->_token.token = NULL;
+    c->_token._parts_alloc = c->_token.parts = 0;
+
+    c->_off = (off != -1) ? (off_t) (off + delim) : -1;
+
+    return & c->_token;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -1909,7 +3511,7 @@ public int string_merges(m_string *string, const char *pattern, size_t len)
     }
 
     /* get the size difference with the previous delimiter length */
-    for (i = 0; i < PARTS(string) - 1; i ++) {
+    for (i = 0; i < (int) PARTS(string) - 1; i ++) {
         diff = len - (TOKEN_DATA(string, i + 1) - TOKEN_END(string, i));
         if (! (p += diff) && ! diff) {
             known_good = i + 1;
@@ -1944,7 +3546,7 @@ public int string_merges(m_string *string, const char *pattern, size_t len)
         _string_update_size(string, new_size - SIZE(string));
     } else {
         /* move every token from the start */
-        for (i = known_good; i < PARTS(string) - 1; i ++) {
+        for (i = known_good; i < (int) PARTS(string) - 1; i ++) {
             diff = len - (TOKEN_DATA(string, i + 1) - TOKEN_END(string, i));
 
             memmove((char *) TOKEN_DATA(string, i + 1) + diff,
@@ -1974,13 +3576,79 @@ public int string_merge(m_string *string, const m_string *pattern)
 
 /* -------------------------------------------------------------------------- */
 
+static m_string *_string_replace(m_string *string, const off_t *offset,
+                                 const size_t *len, size_t slen, size_t count,
+                                 const char *rep, size_t rlen)
+{
+    /** @brief replace the given sections of a string */
+
+    size_t size = SIZE(string), l = 0;
+    off_t src = 0, dst = 0;
+    unsigned int i = 0;
+
+    /* compute the size of the result */
+    for (i = 0; i < count; i ++) size += rlen - ((len) ? len[i] : slen);
+
+    /* XXX ensure the string has enough room for the replacement
+       we could rely on string_movs for the resizing, but we really don't
+       want subsequent calls to string_movs() to fail with a possible
+       out-of-memory error and end up with a garbled string */
+    if (string_extend(string, size) == -1) {
+        debug("string_reps(): resize failure.\n");
+        return NULL;
+    }
+
+    if (size > SIZE(string)) {
+        /* the string grows, perform the replacement backward so the data
+           is moved before being overwritten */
+        src = SIZE(string); dst = size;
+
+        for (i = count; i --; ) {
+            l = src - (offset[i] + ((len) ? len[i] : slen));
+            dst -= l; memmove(string->_data + dst, DATA(string) + src - l, l);
+            dst -= rlen; memcpy(string->_data + dst, rep, rlen);
+            src = offset[i];
+        }
+
+        string_free_token(string);
+    } else {
+        for (i = 0; i < count; i ++) {
+            /* copy the data between the strings that are going to be replaced */
+            if (! string_movs(string, dst, DATA(string) + src, offset[i] - src))
+                goto _err_move;
+            dst += offset[i] - src; src = offset[i] + ((len) ? len[i] : slen);
+
+            /* loop no further without proper replacement string */
+            if (! rep || ! rlen) continue;
+
+            /* replace the string */
+            if (! string_movs(string, dst, rep, rlen)) goto _err_move;
+            dst += rlen;
+        }
+    }
+
+    /* update the size */
+    _string_update_size(string, size - SIZE(string));
+
+    /* ensure the string is NUL terminated */
+    if (! string->parent) string->_data[string->_len] = '\0';
+
+    return string;
+
+_err_move: /* this should never happen */
+    debug("string_reps(): string_movs() failed !\n");
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public m_string *string_reps(m_string *string, const char *search, size_t slen,
                              const char *rep, size_t rlen                      )
 {
     /** @brief replace all occurences of a C substring in a string */
 
     size_t count = 0;
-    off_t *offset = NULL, off = 0, src = 0, dst = 0;
+    off_t *offset = NULL, off = 0;
     unsigned int i = 0;
 
     /* a NULL replacement string is allowed (deletion) */
@@ -2010,48 +3678,73 @@ public m_string *string_reps(m_string *string, const char *search, size_t slen,
 
     if ( (count = i) == 0) {
         debug("string_reps(): search string not found.\n");
-        goto _err_nfnd;
+        free(offset);
+        return NULL;
     }
 
-    /* XXX ensure the string has enough room for the replacement
-       we could rely on string_movs for the resizing, but we really don't
-       want subsequent calls to string_movs() to fail with a possible
-       out-of-memory error and end up with a garbled string */
-    if (string_extend(string, SIZE(string) + count * (rlen - slen)) == -1) {
-        debug("string_reps(): resize failure.\n");
-        goto _err_size;
+    if (! rep) rlen = 0;
+
+    string = _string_replace(string, offset, NULL, slen, count, rep, rlen);
+
+    free(offset);
+
+    return string;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_reps_set(m_string *string, const m_search_set *set,
+                                 const char *rep, size_t rlen)
+{
+    /** @brief replace all the matches of a set of patterns in a string */
+
+    size_t count = 0, size = 16, *len = NULL;
+    off_t *offset = NULL, off = 0;
+    void *ptr = NULL;
+
+    /* a NULL replacement string is allowed (deletion) */
+    if (! string || ! DATA(string) || ! set) {
+        debug("string_reps_set(): bad parameters.\n");
+        return NULL;
     }
 
-    /* perform the replacement */
-    for (i = 0; i < count; i ++) {
-        /* copy the data between the strings that are going to be replaced */
-        if (! string_movs(string, dst, DATA(string) + src, offset[i] - src))
-            goto _err_move;
-        dst += offset[i] - src; src = offset[i] + slen;
+    if (! (offset = malloc(size * sizeof(*offset))) ||
+        ! (len = malloc(size * sizeof(*len))) ) {
+        perror(ERR(string_reps_set, malloc));
+        goto _err_alloc;
+    }
 
-        /* loop no further without proper replacement string */
-        if (! rep || ! rlen) continue;
+    /* fill the offset array with the location of the matches */
+    while ( (off = string_search_set_find(set, DATA(string), SIZE(string), off,
+                                          NULL, & len[count])) >= 0) {
+        offset[count] = off; off += len[count];
 
-        /* replace the string */
-        if (! string_movs(string, dst, rep, rlen)) goto _err_move;
-        dst += rlen;
+        if (++ count == size) {
+            size *= 2;
+            if (! (ptr = realloc(offset, size * sizeof(*offset))) ) goto _err_realloc;
+            offset = ptr;
+            if (! (ptr = realloc(len, size * sizeof(*len))) ) goto _err_realloc;
+            len = ptr;
+        }
     }
 
-    /* update the size */
-    _string_update_size(string, count * (rlen - slen));
+    if (! count) {
+        debug("string_reps_set(): search string not found.\n");
+        goto _err_alloc;
+    }
 
-    /* ensure the string is NUL terminated */
-    if (! string->parent) string->_data[string->_len] = '\0';
+    if (! rep) rlen = 0;
 
-    free(offset);
+    string = _string_replace(string, offset, len, 0, count, rep, rlen);
+
+    free(offset); free(len);
 
     return string;
 
-_err_move: /* this should never happen */
-    debug("string_reps(): string_movs() failed !\n");
-_err_size: /* string_extend() failure */
-_err_nfnd: /* not found */
-    free(offset);
+_err_realloc:
+    perror(ERR(string_reps_set, realloc));
+_err_alloc:
+    free(offset); free(len);
     return NULL;
 }
 
@@ -2118,7 +3811,7 @@ public m_string *string_add_token(m_string *s, off_t start, off_t end)
     unsigned int i = 0, j = 0;
     int p = 0;
 
-    if (unlikely(! s || s->parts == 65535)) {
+    if (unlikely(! s || s->parts == STRING_TOKEN_MAX)) {
         debug("string_add_token(): cannot add token.\n");
         return NULL;
     }
@@ -2134,7 +3827,7 @@ public m_string *string_add_token(m_string *s, off_t start, off_t end)
         /* 1.5 growth factor */
         if (s->_parts_alloc < 43690)
             p = (s->_parts_alloc >> 1) + ! (s->_parts_alloc >> 1);
-        else p = 65535 - s->_parts_alloc;
+        else p = STRING_TOKEN_MAX - s->_parts_alloc;
 
         tokens = realloc(s->token, (s->_parts_alloc + p) * sizeof(*tokens));
         if (unlikely(! tokens)) {
@@ -2270,55 +3963,188 @@ public m_string *string_dequeue_token(m_string *s)
 #ifdef HAS_PCRE
 /* -------------------------------------------------------------------------- */
 
-public int string_parse(m_string *string, const char *pattern, size_t len)
+/* capturing pairs matched without allocating the offsets */
+#define _REGEX_OVECTOR 16
+
+/* compiled patterns of string_parse(), shared by all the threads */
+static m_regex *_regex_cache[STRING_REGEX_CACHE];
+static pthread_rwlock_t _regex_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* -------------------------------------------------------------------------- */
+
+static uint32_t _string_regex_hash(const char *pattern, size_t len, int options)
 {
-    /** @brief parses a string into multiple tokens matching a regex */
+    /* FNV-1a of the pattern, seeded with the options */
+    uint32_t h = 2166136261U ^ (uint32_t) options;
 
-    int *off = NULL;
-    unsigned int i = 0, j = 0, k = 0, last = 0, size = 0;
-    m_string *token = NULL, *new_token = NULL;
-    pcre *regex = NULL;
-    int erroff = 0;
-    int r = 0;
+    while (len --) { h ^= (uint8_t) *pattern ++; h *= 16777619U; }
+
+    return h;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static unsigned int _string_regex_ref(m_regex *r, int n)
+{
+    #ifdef __GNUC__
+    return __sync_add_and_fetch(& r->_refs, n);
+    #else
+    unsigned int ret = 0;
+
+    pthread_mutex_lock(& _shared_lock);
+        ret = (r->_refs += n);
+    pthread_mutex_unlock(& _shared_lock);
+
+    return ret;
+    #endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_regex *string_regex_alloc(const char *pattern, size_t len, int options)
+{
+    /** @brief compile a regular expression */
+
+    m_regex *ret = NULL;
     const char *err = NULL;
+    int erroff = 0;
 
-    if (! string || ! DATA(string) || ! pattern || ! len) {
-        debug("string_parse(): bad parameters.\n");
-        return -1;
+    if (! pattern || ! len || len + 1 < len) {
+        debug("string_regex_alloc(): bad parameters.\n");
+        return NULL;
     }
 
-    if (! (regex = pcre_compile(pattern, PCRE_DOTALL, & err, & erroff, NULL)) ) {
-        debug("string_parse(): %s\n", err);
-        return -1;
+    /* PCRE expects a C string, the pattern is copied after the struct */
+    if (! (ret = malloc(sizeof(*ret) + len + 1)) ) {
+        perror(ERR(string_regex_alloc, malloc));
+        return NULL;
+    }
+
+    ret->_pattern = (char *) (ret + 1);
+    memcpy(ret->_pattern, pattern, len); ret->_pattern[len] = '\0';
+    ret->_len = len;
+    ret->_options = options;
+    ret->_hash = _string_regex_hash(pattern, len, options);
+    ret->_refs = 1;
+    ret->_captures = 0;
+    ret->_extra = NULL;
+
+    if (! (ret->_regex = pcre_compile(ret->_pattern, options, & err,
+                                      & erroff, NULL)) ) {
+        debug("string_regex_alloc(): %s at offset %i.\n", err, erroff);
+        free(ret);
+        return NULL;
     }
 
-    size = SIZE(string);
+    /* the pattern is matched many times, spend some time optimizing it */
+    #ifdef PCRE_STUDY_JIT_COMPILE
+    ret->_extra = pcre_study(ret->_regex, PCRE_STUDY_JIT_COMPILE, & err);
+    #else
+    ret->_extra = pcre_study(ret->_regex, 0, & err);
+    #endif
+    if (err) debug("string_regex_alloc(): %s\n", err);
+
+    pcre_fullinfo(ret->_regex, ret->_extra, PCRE_INFO_CAPTURECOUNT,
+                  & ret->_captures);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_regex *string_regex_free(m_regex *regex)
+{
+    /** @brief release a compiled regular expression */
+
+    if (! regex || _string_regex_ref(regex, -1)) return NULL;
+
+    #ifdef PCRE_STUDY_JIT_COMPILE
+    if (regex->_extra) pcre_free_study(regex->_extra);
+    #else
+    if (regex->_extra) pcre_free(regex->_extra);
+    #endif
+
+    pcre_free(regex->_regex);
+    free(regex);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static m_regex *_string_regex_cached(const char *pattern, size_t len,
+                                     int options)
+{
+    uint32_t hash = _string_regex_hash(pattern, len, options);
+    m_regex **slot = & _regex_cache[hash % STRING_REGEX_CACHE];
+    m_regex *ret = NULL, *old = NULL;
+
+    /* the lookup only takes a reference, readers do not block each other */
+    pthread_rwlock_rdlock(& _regex_lock);
+        if ( (ret = *slot) && ret->_hash == hash && ret->_len == len &&
+             ret->_options == options && ! memcmp(ret->_pattern, pattern, len) )
+            _string_regex_ref(ret, 1);
+        else ret = NULL;
+    pthread_rwlock_unlock(& _regex_lock);
+
+    if (ret) return ret;
+
+    /* compile outside of the lock, the cache keeps the last pattern seen */
+    if (! (ret = string_regex_alloc(pattern, len, options)) ) return NULL;
+
+    _string_regex_ref(ret, 1);
 
-    if (size * sizeof(*off) < size) {
-        debug("string_parse(): integer overflow.\n");
+    pthread_rwlock_wrlock(& _regex_lock);
+        old = *slot; *slot = ret;
+    pthread_rwlock_unlock(& _regex_lock);
+
+    string_regex_free(old);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_parse_regex(m_string *string, const m_regex *regex)
+{
+    /** @brief parses a string into multiple tokens matching a compiled regex */
+
+    int local[_REGEX_OVECTOR * 3], *off = local;
+    unsigned int i = 0, j = 0, k = 0, last = 0, size = 0;
+    m_string *token = NULL, *new_token = NULL;
+    int r = 0;
+
+    if (! string || ! DATA(string) || ! regex) {
+        debug("string_parse_regex(): bad parameters.\n");
         return -1;
     }
 
-    if (! (off = malloc(size * sizeof(*off))) ) {
-        perror(ERR(string_parse, malloc));
-        goto _err_malloc;
+    /* whole match and captured substrings, plus PCRE workspace */
+    size = (regex->_captures + 1) * 3;
+
+    if (size > _REGEX_OVECTOR * 3 && ! (off = malloc(size * sizeof(*off))) ) {
+        perror(ERR(string_parse_regex, malloc));
+        return -1;
     }
 
-    for (i = 0, last = 0; ; last = off[1], i ++) {
+    for (i = 0, last = 0; last <= SIZE(string);
+         last = off[1] + (off[0] == off[1]), i ++) {
         /* match the pattern */
-        r = pcre_exec(regex, NULL, DATA(string), SIZE(string), last, 0x0, off, size);
+        r = pcre_exec(regex->_regex, regex->_extra, DATA(string), SIZE(string),
+                      last, 0x0, off, size);
 
         if (r <= 0) {
             if (i) break;
-            debug("string_parse(): error matching pattern %s\n", pattern);
+            debug("string_parse_regex(): error matching pattern %s\n",
+                  regex->_pattern);
             goto _err_exec;
         }
 
         /* found something, add a token and possibly subtokens */
         if (! (new_token = realloc(token, (i + 1) * sizeof(*token))) ) {
-            perror(ERR(string_parse, realloc));
+            perror(ERR(string_parse_regex, realloc));
             if (token) while (i --) free(token[i].token); free(token);
-            goto _err_token;
+            goto _err_exec;
         }
 
         token = new_token;
@@ -2337,7 +4163,7 @@ public int string_parse(m_string *string, const char *pattern, size_t len)
         token[i]._parts_alloc = token[i].parts = r - 1;
 
         if (! (token[i].token = malloc(token[i].parts * sizeof(token[i]))) ) {
-            perror(ERR(string_parse, malloc));
+            perror(ERR(string_parse_regex, malloc));
             goto _err_token;
         }
 
@@ -2352,9 +4178,7 @@ public int string_parse(m_string *string, const char *pattern, size_t len)
         }
     }
 
-    pcre_free(regex);
-
-    free(off);
+    if (off != local) free(off);
 
     string_free_token(string); string->parts = i; string->token = token;
 
@@ -2363,13 +4187,35 @@ public int string_parse(m_string *string, const char *pattern, size_t len)
 _err_token:
     if (token) while (i --) free(token[i].token); free(token);
 _err_exec:
-    free(off);
-_err_malloc:
-    pcre_free(regex);
+    if (off != local) free(off);
 
     return -1;
 }
 
+/* -------------------------------------------------------------------------- */
+
+public int string_parse(m_string *string, const char *pattern, size_t len)
+{
+    /** @brief parses a string into multiple tokens matching a regex */
+
+    m_regex *regex = NULL;
+    int ret = 0;
+
+    if (! string || ! DATA(string) || ! pattern || ! len) {
+        debug("string_parse(): bad parameters.\n");
+        return -1;
+    }
+
+    if (! (regex = _string_regex_cached(pattern, len, PCRE_DOTALL)) )
+        return -1;
+
+    ret = string_parse_regex(string, regex);
+
+    string_regex_free(regex);
+
+    return ret;
+}
+
 /* -------------------------------------------------------------------------- */
 #endif
 /* -------------------------------------------------------------------------- */
@@ -2378,11 +4224,12 @@ public m_string *string_b58s(const char *s, size_t size)
 {
     /** @brief convert a C string to base58 encoding */
 
-    size_t i = 0, zcount = 0;
-    int j = 0, high = 0, carry = 0;
-    int32_t b58size = 0;
-    uint8_t *buffer = NULL;
+    size_t i = 0, k = 0, zcount = 0, used = 0, limbs = 0, take = 0;
+    uint32_t *limb = NULL;
+    uint64_t carry = 0, mul = 0;
+    char digits[5];
     m_string *ret = NULL;
+    int d = 0, first = 1;
 
     if (! s || ! size) {
         debug("string_b58s(): bad parameters.\n");
@@ -2392,41 +4239,53 @@ public m_string *string_b58s(const char *s, size_t size)
     /* get the number of leading NUL chars */
     while (zcount < size && ! s[zcount]) zcount ++;
 
-    /* compute the size of the base58 encoded string, with a trailing NUL */
-    b58size = (size - zcount) * 138 / 100 + 1;
-
-    if ((size_t) b58size < size) {
+    if (size > INT32_MAX / 3) {
         debug("string_b58s(): integer overflow.\n");
         return NULL;
     }
 
-    if (! (buffer = calloc(b58size, sizeof(*buffer))) ) {
+    /* log(256) / log(58^5) < 0.274 */
+    limbs = (size - zcount) * 274 / 1000 + 1;
+
+    if (! (limb = calloc(limbs, sizeof(*limb))) ) {
         perror(ERR(string_b58s, calloc));
         return NULL;
     }
 
-    for (i = zcount, high = b58size - 1; i < size; i ++, high = j) {
-        for (carry = (uint8_t) s[i], j = b58size - 1; j > high || carry; j --) {
-            carry += 256 * buffer[j];
-            buffer[j] = carry % 58;
-            carry /= 58;
+    /* each pass over the limbs absorbs 3 bytes */
+    for (i = zcount; i < size; ) {
+        take = (size - i < 3) ? size - i : 3;
+        mul = (uint64_t) 1 << (8 * take);
+
+        for (carry = 0, k = 0; k < take; k ++)
+            carry = (carry << 8) | (uint8_t) s[i ++];
+
+        for (k = 0; k < used; k ++) {
+            carry += (uint64_t) limb[k] * mul;
+            limb[k] = carry % _B58_LIMB;
+            carry /= _B58_LIMB;
         }
-    }
 
-    for (j = 0; j < b58size && ! buffer[j]; j ++);
+        while (carry) { limb[used ++] = carry % _B58_LIMB; carry /= _B58_LIMB; }
+    }
 
-    if (! (ret = string_alloc(NULL, zcount + b58size - j)) )
+    if (! (ret = string_alloc(NULL, zcount + used * 5)) )
         goto _err_alloc;
 
     if (zcount) memset(ret->_data, '1', zcount);
 
-    for (i = zcount; j < b58size; i ++, j ++)
-        ret->_data[i] = _b58[buffer[j]];
+    /* most significant limb first, without its leading zeros */
+    for (i = zcount, k = used; k --; first = 0) {
+        for (carry = limb[k], d = 5; d --; carry /= 58)
+            digits[d] = _b58[carry % 58];
+        for (d = 0; first && d < 4 && digits[d] == _b58[0]; d ++);
+        memcpy(ret->_data + i, digits + d, 5 - d); i += 5 - d;
+    }
 
     ret->_data[i] = '\0'; ret->_len = i;
 
 _err_alloc:
-    free(buffer);
+    free(limb);
 
     return ret;
 }
@@ -2446,84 +4305,68 @@ public m_string *string_deb58s(const char *s, size_t size)
 {
     /** @brief convert a base58 encoded C string to plain text */
 
-    uint32_t *r = NULL;
-    size_t i = 0, zcount = 0, remain = 0;
-    int j = 0, outlen = 0;
-    uint64_t b = 0;
-    uint32_t c = 0, mask = 0;
+    size_t i = 0, k = 0, zcount = 0, used = 0, limbs = 0;
+    uint32_t *limb = NULL;
+    uint64_t carry = 0, mul = 0;
     m_string *ret = NULL;
+    int d = 0, first = 1;
 
     if (! s || ! size) {
         debug("string_deb58s(): bad parameters.\n");
         return NULL;
     }
 
-    /* output buffer */
-    if (! (r = calloc( (outlen = (size + 3) / 4) + 1, sizeof(*r))) ) {
-        perror(ERR(string_deb58s, calloc));
-        return NULL;
-    }
-
-    /* string wrapper */
-    if (! (ret = string_alloc(NULL, 0)) ) {
-        debug("string_deb58s(): out of memory.\n");
-        free(r);
+    if (size > INT32_MAX / 2) {
+        debug("string_deb58s(): integer overflow.\n");
         return NULL;
     }
 
     /* legitimate leading 0s */
     while (zcount < size && s[zcount] == '1') zcount ++;
 
-    if ( (remain = size & 3) ) mask = 0xffffffff << (remain * 8);
+    /* log(58) / log(2^32) < 0.184 */
+    limbs = (size - zcount) * 184 / 1000 + 1;
 
-    for (i = zcount; i < size; i ++) {
-        if ((int) (c = _D58(s[i])) == -1) goto _panic;
+    if (! (limb = calloc(limbs, sizeof(*limb))) ) {
+        perror(ERR(string_deb58s, calloc));
+        return NULL;
+    }
 
-        for (j = outlen - 1; j; j --) {
-            b = ((uint64_t) r[j]) * 58 + c;
-            c = (b & 0x3f00000000) >> 32;
-            r[j] = b & 0xffffffff;
+    /* each pass over the 32 bit limbs absorbs 5 digits */
+    for (i = zcount; i < size; ) {
+        for (carry = 0, mul = 1, k = 0; k < 5 && i < size; k ++, i ++) {
+            if ((d = _D58(s[i])) == -1) goto _panic;
+            carry = carry * 58 + d; mul *= 58;
         }
 
-        /* output was too large */
-        if (c || r[0] & mask) goto _panic;
-    }
-
-    c = r[(i = 0)]; ret->_data = (char *) r;
+        for (k = 0; k < used; k ++) {
+            carry += (uint64_t) limb[k] * mul;
+            limb[k] = carry & 0xffffffff;
+            carry >>= 32;
+        }
 
-    switch (remain) {
-    case 3: { ret->_data[i ++] = (c & 0xff0000) >> 16; }
-    case 2: { ret->_data[i ++] = (c & 0xff00) >> 8; }
-    case 1: { ret->_data[i ++] = (c & 0xff); j = 1; goto _loop; }
+        if (carry) limb[used ++] = (uint32_t) carry;
     }
 
-    for (j = 0; j < outlen; j ++) {
-_loop:  c = r[j];
-        ret->_data[i ++] = (c >> 0x18) & 0xff;
-        ret->_data[i ++] = (c >> 0x10) & 0xff;
-        ret->_data[i ++] = (c >> 0x08) & 0xff;
-        ret->_data[i ++] = (c & 0xff);
-    }
+    if (! (ret = string_alloc(NULL, zcount + used * 4)) )
+        goto _panic;
 
-    /* check if there is spurious remaining 0s */
-    for (remain = 0; remain < i && ! ret->_data[remain]; remain ++);
-    if (zcount > remain) goto _panic;
+    if (zcount) memset(ret->_data, 0, zcount);
 
-    /* real length */
-    ret->_len = i - (remain - zcount);
+    /* most significant limb first, without its leading zeros */
+    for (i = zcount, k = used; k --; first = 0) {
+        for (d = 24; first && d && ! (limb[k] >> d); d -= 8);
+        for ( ; d >= 0; d -= 8) ret->_data[i ++] = (limb[k] >> d) & 0xff;
+    }
 
-    /* remove spurious leading 0s */
-    memmove(ret->_data, ret->_data + remain - zcount, ret->_len);
-    ret->_data[ret->_len] = '\0';
+    ret->_data[i] = '\0'; ret->_len = i;
 
-    /* package the buffer */
-    ret->_flags = 0; ret->_alloc = outlen * sizeof(*r);
-    ret->_parts_alloc = ret->parts = 0; ret->token = NULL;
+    free(limb);
 
     return ret;
 
 _panic:
-    free(r); string_free(ret);
+    free(limb);
     return NULL;
 }
 
@@ -2538,14 +4381,82 @@ public m_string *string_deb58(const m_string *s)
 
 /* -------------------------------------------------------------------------- */
 
+static size_t _string_b64_encode(const uint8_t *s, size_t size, char *r)
+{
+    /* whole blocks are vectorized, the rest goes through the table */
+    size_t i = 0, j = 0;
+
+    if (_search_engine == -1) string_api_setup();
+
+    i = __simd_b64_encode(_search_engine, s, size, r); j = i / 3 * 4;
+
+    for ( ; i + 3 <= size; i += 3, j += 4) {
+        r[j] = _b64[s[i] >> 2];
+        r[j + 1] = _b64[(s[i] & 0x03) << 4 | s[i + 1] >> 4];
+        r[j + 2] = _b64[(s[i + 1] & 0x0f) << 2 | s[i + 2] >> 6];
+        r[j + 3] = _b64[s[i + 2] & 0x3f];
+    }
+
+    if (i < size) {
+        /* add some padding */
+        r[j] = _b64[s[i] >> 2]; r[j + 3] = '=';
+
+        if (i + 1 < size) {
+            r[j + 1] = _b64[(s[i] & 0x03) << 4 | s[i + 1] >> 4];
+            r[j + 2] = _b64[(s[i + 1] & 0x0f) << 2];
+        } else {
+            r[j + 1] = _b64[(s[i] & 0x03) << 4]; r[j + 2] = '=';
+        }
+
+        j += 4;
+    }
+
+    return j;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static size_t _string_b64_decode(const char *s, size_t size, char *r)
+{
+    /* characters outside of the alphabet, like CRLF or the padding, are
+       skipped; r may be s since the output never catches up with the input */
+
+    size_t i = 0, j = 0, used = 0;
+    int c[4], k = 0;
+
+    if (_search_engine == -1) string_api_setup();
+
+    while (i < size) {
+        j += __simd_b64_decode(_search_engine, s + i, size - i,
+                               (uint8_t *) r + j, & used);
+        i += used;
+
+        /* one quantum at a time around the noise */
+        for (k = 0; k < 4 && i < size; i ++)
+            if ((c[k] = _D64(s[i])) != -1) k ++;
+
+        if (k < 4) {
+            if (k > 1) r[j ++] = c[0] << 2 | c[1] >> 4;
+            if (k > 2) r[j ++] = c[1] << 4 | c[2] >> 2;
+            break;
+        }
+
+        r[j] = c[0] << 2 | c[1] >> 4;
+        r[j + 1] = c[1] << 4 | c[2] >> 2;
+        r[j + 2] = c[2] << 6 | c[3];
+        j += 3;
+    }
+
+    return j;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public m_string *string_b64s(const char *s, size_t size, size_t linesize)
 {
     /** @brief convert a C string to base64 encoding */
 
-    size_t i = 0;
-    int j = 0, crlf = 0;
-    int32_t b64size = 0;
-    char *r = NULL;
+    size_t i = 0, j = 0, n = 0, len = 0, line = 0;
     m_string *ret = NULL;
 
     if (! s || ! size) {
@@ -2559,78 +4470,36 @@ public m_string *string_b64s(const char *s, size_t size, size_t linesize)
         return NULL;
     }
 
-    /* compute the size of the base64 encoded string, with a trailing NUL */
-    b64size = (((size + 3 - (size % 3)) / 3) * 4) + 1;
-
-    /* add some room for CRLF depending on the linesize */
-    if (linesize) b64size += ((b64size / linesize) * 2) + 2;
-
-    if ((size_t) b64size < size) {
+    if (size > INT32_MAX / 6) {
         debug("string_b64s(): integer overflow.\n");
         return NULL;
     }
 
-    if (! (r = calloc(b64size, sizeof(*r))) ) {
-        perror(ERR(string_b64s, calloc));
-        return NULL;
-    }
-
-    while (i + 3 < size) {
+    /* compute the size of the base64 encoded string */
+    len = (size + 2) / 3 * 4;
 
-        if (j + 4 < b64size) {
-            /* convert three bytes in ASCII characters */
-            r[j ++] = _b64[(s[i] & 0xfc) >> 2];
-            r[j ++] = _b64[((s[i] & 0x03) << 4) | ((s[i + 1] & 0xf0) >> 4)];
-            r[j ++] = _b64[((s[i + 1] & 0x0f) << 2) | ((s[i + 2] & 0xc0) >> 6)];
-            r[j ++] = _b64[s[i + 2] & 0x3f]; i += 3;
-        } else goto _panic;
+    /* add some room for CRLF depending on the linesize */
+    if (linesize) len += (len + linesize - 1) / linesize * 2;
 
-        /* if a linesize was given, check if we should insert a CRLF */
-        if (linesize && ((j - crlf) % linesize == 0) ) {
-            if (j + 2 < b64size) {
-                r[j ++] = '\r'; r[j ++] = '\n'; crlf += 2;
-            } else goto _panic;
-        }
+    if (! (ret = string_alloc(NULL, len)) ) {
+        debug("string_b64s(): out of memory.\n");
+        return NULL;
     }
 
-    if ((size + 1 - i) && j + 4 < b64size) {
-        /* add some padding */
-        memset(r + j, '=', 4);
-
-        /* process the remaining */
-        switch (size + 1 - i) {
-        case 4:
-        r[j + 3] = _b64[s[i + 2] & 0x3f];
-        case 3:
-        r[j + 2] = _b64[(s[i + 1] & 0x0f) << 2 | (s[i + 2] & 0xc0) >> 6];
-        case 2:
-        r[j + 1] = _b64[(s[i] & 0x03) << 4 | (s[i + 1] & 0xf0) >> 4];
-        case 1:
-        r[j] = _b64[(s[i] & 0xfc) >> 2]; j += 4;
+    if (! linesize) {
+        j = _string_b64_encode((const uint8_t *) s, size, ret->_data);
+    } else {
+        /* each line, the last one included, ends with a CRLF */
+        for (line = linesize / 4 * 3; i < size; i += n) {
+            n = (size - i < line) ? size - i : line;
+            j += _string_b64_encode((const uint8_t *) s + i, n, ret->_data + j);
+            ret->_data[j ++] = '\r'; ret->_data[j ++] = '\n';
         }
     }
 
-    /* add the last CRLF if a linesize was provided */
-    if ( (linesize) && j + 2 < b64size) {
-        r[j] = '\r'; r[j + 1] = '\n';
-    }
-
-    /* package the buffer in a string_m */
-    if (! (ret = string_alloc(NULL, 0)) ) {
-        free(r);
-    } else {
-        ret->_flags = 0; ret->_data = r;
-        ret->_len = b64size - 1; ret->_alloc = b64size -1;
-        ret->_parts_alloc = ret->parts = 0;
-        ret->token = NULL;
-    }
+    ret->_data[j] = '\0'; ret->_len = j;
 
     return ret;
-
-_panic:
-    debug("string_b64s(): base64 encoding failed.\n");
-    free(r);
-    return NULL;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -2648,8 +4517,6 @@ public m_string *string_deb64s(const char *s, size_t size)
 {
     /** @brief convert a base64 encoded C string to plain text */
 
-    char *r = NULL;
-    size_t i = 0, j = 0;
     m_string *ret = NULL;
 
     if (! s || ! size) {
@@ -2657,50 +4524,14 @@ public m_string *string_deb64s(const char *s, size_t size)
         return NULL;
     }
 
-    /* the number of CRLF or other trailing characters is unknown,
-       so allocate the same size to be safe */
-    if (! (r = calloc(size + 1, sizeof(*r))) ) {
-        perror(ERR(string_deb64s, calloc));
-        return NULL;
-    }
-
-    if (! (ret = string_alloc(NULL, 0)) ) {
+    /* the vectorized decoder needs as much room as the input */
+    if (! (ret = string_alloc(NULL, size)) ) {
         debug("string_deb64s(): out of memory.\n");
-        free(r);
         return NULL;
     }
 
-    /* discard trailing characters */
-    while (-- size && _D64(s[size]) == -1);
-
-    while (i + 4 < size) {
-        if (_D64(s[i]) != -1) {
-            /* take four ASCII chars and convert them in three bytes */
-            r[j ++] = _D64(s[i]) << 2 | _D64(s[i + 1]) >> 4;
-            r[j ++] = _D64(s[i + 1]) << 4 | _D64(s[i + 2]) >> 2;
-            r[j ++] = ((_D64(s[i + 2]) << 6) & 0xc0) | _D64(s[i + 3]);
-            i += 4;
-        } else i ++; /* drop CRLF and other noise */
-    }
-
-    /* skip garbage between the last processed piece and the remaining */
-    while (_D64(s[i]) == -1 && i ++ < size);
-
-    /* process the remaining */
-    switch (size - i) {
-    case 3:
-    r[j + 2] = ((_D64(s[i + 2]) << 6) & 0xc0) | _D64(s[i + 3]);
-    case 2:
-    r[j + 1] = _D64(s[i + 1]) << 4 | _D64(s[i + 2]) >> 2;
-    case 1:
-    r[j] = _D64(s[i]) << 2 | _D64(s[i + 1]) >> 4; j += 3;
-    }
-
-    /* package the buffer */
-    ret->_flags = 0; ret->_data = r;
-    ret->_len = j; ret->_alloc = i;
-    ret->_parts_alloc = ret->parts = 0;
-    ret->token = NULL;
+    ret->_len = _string_b64_decode(s, size, ret->_data);
+    ret->_data[ret->_len] = '\0';
 
     return ret;
 }
@@ -2714,6 +4545,32 @@ public m_string *string_deb64(const m_string *s)
     return string_deb64s(DATA(s), SIZE(s));
 }
 
+/* -------------------------------------------------------------------------- */
+
+public int string_deb64_inplace(m_string *s)
+{
+    /** @brief decode a base64 encoded string over itself */
+
+    size_t len = 0;
+
+    if (! s || (! DATA(s) && SIZE(s))) {
+        debug("string_deb64_inplace(): bad parameters.\n");
+        return -1;
+    }
+
+    if (! SIZE(s)) return 0;
+
+    /* check if writing to the string is allowed */
+    if (_string_cow(s) == -1 || s->_flags & _STRING_FLAG_RDONLY) {
+        debug("string_deb64_inplace(): illegal write attempt.\n");
+        return -1;
+    }
+
+    len = _string_b64_decode(s->_data, SIZE(s), s->_data);
+
+    return string_suppr(s, len, SIZE(s) - len);
+}
+
 /* -------------------------------------------------------------------------- */
 #ifdef HAS_ZLIB
 /* -------------------------------------------------------------------------- */
@@ -2726,7 +4583,7 @@ public m_string *string_compress(m_string *s)
 
     if (! s || ! s->_data || ! SIZE(s)) return NULL;
 
-    if (! (z = string_alloc(NULL, ((SIZE(s) * 11)/10 + 12))) ) {
+    if (! (z = string_alloc(NULL, compressBound(SIZE(s)))) ) {
         debug("string_compress(): cannot allocate string.\n");
         return NULL;
     }
@@ -2747,12 +4604,28 @@ public m_string *string_compress(m_string *s)
 
 public m_string *string_uncompress(m_string *s, size_t original_size)
 {
+    m_string_zstream *d = NULL;
     m_string *z = NULL;
     Bytef *dest = NULL;
     uLongf dlen = 0;
 
     if (! s || ! s->_data || ! SIZE(s)) return NULL;
 
+    /* without the original size, let the output grow while inflating */
+    if (! original_size) {
+        if (! (d = string_decompressor_alloc(STRING_CODEC_DEFLATE)) ||
+            ! (z = string_prealloc(NULL, 0, SIZE(s) * 2)) ||
+            string_zstream_write(d, DATA(s), SIZE(s), z) == -1 ||
+            string_zstream_end(d, z) == -1) {
+            debug("string_uncompress(): error uncompressing data.\n");
+            z = string_free(z);
+        }
+
+        string_zstream_free(d);
+
+        return z;
+    }
+
     if (! (z = string_alloc(NULL, original_size)) ) {
         debug("string_uncompress(): cannot allocate string.\n");
         return NULL;
@@ -2775,414 +4648,348 @@ public m_string *string_uncompress(m_string *s, size_t original_size)
 #endif
 /* -------------------------------------------------------------------------- */
 
-/* -------------------------------------------------------------------------- */
-/* SHA1 */
+/* the LZ codec works on independent blocks of this size */
+#define _LZ_BLOCK 65536
+#define _LZ_HASH 12
+#define _LZ_MINMATCH 4
+#define _LZ_STORED 0x80000000U
+
+/* output space requested from zlib on each round */
+#define _ZSTREAM_CHUNK 16384
+
+/* the context is opaque since its layout depends on zlib */
+struct m_string_zstream {
+    int codec;
+    int level;
+    int inflate;
+    int state;                    /* 0 running, 1 finished, -1 failed */
+    #ifdef HAS_ZLIB
+    z_stream z;
+    #endif
+    char *buf;                    /* pending LZ block or header + payload */
+    size_t pending;
+};
+
 /* -------------------------------------------------------------------------- */
 
-#if defined(__GNUC__) && defined(__i386__)
-static inline uint32_t rol(uint32_t x, int n)
+static int _string_reserve(m_string *s, size_t n)
 {
-    __asm__("roll %%cl,%0" :"=r" (x) :"0" (x),"c" (n));
-    return x;
-}
-#else
-#define rol(x,n) ( ((x) << (n)) | ((x) >> (32 - (n))) )
-#endif
+    size_t size = 0;
 
-/* -------------------------------------------------------------------------- */
+    if (s->_len + n <= s->_alloc) return 0;
 
-static void _sha1_init(SHA1_CONTEXT *hd)
-{
-    hd->h0 = 0x67452301;
-    hd->h1 = 0xefcdab89;
-    hd->h2 = 0x98badcfe;
-    hd->h3 = 0x10325476;
-    hd->h4 = 0xc3d2e1f0;
-    hd->nblocks = 0;
-    hd->count = 0;
+    /* grow geometrically so that appending stays linear */
+    for (size = (s->_alloc < 64) ? 64 : s->_alloc; size < s->_len + n; )
+        size *= 2;
+
+    return string_dim(s, size);
 }
 
 /* -------------------------------------------------------------------------- */
 
-static void _sha1_transform(SHA1_CONTEXT *hd, unsigned char *data)
+static inline uint32_t _lz_read32(const char *p)
 {
-    /* transform the message X which consists of 16 32-bit-words */
+    uint32_t v = 0;
 
-    uint32_t a, b, c, d, e, tm;
-    uint32_t x[16];
+    memcpy(& v, p, sizeof(v));
 
-    /* get values from the chaining vars */
-    a = hd->h0;
-    b = hd->h1;
-    c = hd->h2;
-    d = hd->h3;
-    e = hd->h4;
+    return v;
+}
 
-    #ifdef BIG_ENDIAN_HOST
-    memcpy(x, data, 64);
-    #else /* little endian */
-    {
-        int i;
-        unsigned char *p2;
+/* -------------------------------------------------------------------------- */
 
-        for (i = 0, p2 = (unsigned char *) x; i < 16; i ++, p2 += 4) {
-            p2[3] = *data ++;
-            p2[2] = *data ++;
-            p2[1] = *data ++;
-            p2[0] = *data ++;
-        }
-    }
-    #endif
+static inline void _lz_write_le32(char *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
 
-    #define K1 0x5a827999L
-    #define K2 0x6ed9eba1L
-    #define K3 0x8f1bbcdcL
-    #define K4 0xca62c1d6L
-    #define F1(x, y, z) (z ^ (x & (y ^ z)))
-    #define F2(x, y, z) (x ^ y ^ z)
-    #define F3(x, y, z) ( (x & y) | (z & (x | y)) )
-    #define F4(x, y, z) (x ^ y ^ z)
+/* -------------------------------------------------------------------------- */
 
-    #define M(i) (tm = x[i & 0xf] ^ x[(i - 14) & 0xf]   \
-                  ^ x[(i - 8) & 0xf] ^ x[(i - 3) & 0xf] \
-                  , (x[i & 0xf] = rol(tm, 1)) )
+static inline uint32_t _lz_read_le32(const char *p)
+{
+    const uint8_t *u = (const uint8_t *) p;
 
-    #define R(a,b,c,d,e,f,k,m)               \
-    do {                                     \
-        e += rol(a, 5) + f(b, c, d) + k + m; \
-        b = rol(b, 30);                      \
-    } while (0)
+    return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t) u[3] << 24);
+}
 
-    R(a, b, c, d, e, F1, K1, x[ 0]);
-    R(e, a, b, c, d, F1, K1, x[ 1]);
-    R(d, e, a, b, c, F1, K1, x[ 2]);
-    R(c, d, e, a, b, F1, K1, x[ 3]);
-    R(b, c, d, e, a, F1, K1, x[ 4]);
-    R(a, b, c, d, e, F1, K1, x[ 5]);
-    R(e, a, b, c, d, F1, K1, x[ 6]);
-    R(d, e, a, b, c, F1, K1, x[ 7]);
-    R(c, d, e, a, b, F1, K1, x[ 8]);
-    R(b, c, d, e, a, F1, K1, x[ 9]);
-    R(a, b, c, d, e, F1, K1, x[10]);
-    R(e, a, b, c, d, F1, K1, x[11]);
-    R(d, e, a, b, c, F1, K1, x[12]);
-    R(c, d, e, a, b, F1, K1, x[13]);
-    R(b, c, d, e, a, F1, K1, x[14]);
-    R(a, b, c, d, e, F1, K1, x[15]);
-    R(e, a, b, c, d, F1, K1, M(16));
-    R(d, e, a, b, c, F1, K1, M(17));
-    R(c, d, e, a, b, F1, K1, M(18));
-    R(b, c, d, e, a, F1, K1, M(19));
-    R(a, b, c, d, e, F2, K2, M(20));
-    R(e, a, b, c, d, F2, K2, M(21));
-    R(d, e, a, b, c, F2, K2, M(22));
-    R(c, d, e, a, b, F2, K2, M(23));
-    R(b, c, d, e, a, F2, K2, M(24));
-    R(a, b, c, d, e, F2, K2, M(25));
-    R(e, a, b, c, d, F2, K2, M(26));
-    R(d, e, a, b, c, F2, K2, M(27));
-    R(c, d, e, a, b, F2, K2, M(28));
-    R(b, c, d, e, a, F2, K2, M(29));
-    R(a, b, c, d, e, F2, K2, M(30));
-    R(e, a, b, c, d, F2, K2, M(31));
-    R(d, e, a, b, c, F2, K2, M(32));
-    R(c, d, e, a, b, F2, K2, M(33));
-    R(b, c, d, e, a, F2, K2, M(34));
-    R(a, b, c, d, e, F2, K2, M(35));
-    R(e, a, b, c, d, F2, K2, M(36));
-    R(d, e, a, b, c, F2, K2, M(37));
-    R(c, d, e, a, b, F2, K2, M(38));
-    R(b, c, d, e, a, F2, K2, M(39));
-    R(a, b, c, d, e, F3, K3, M(40));
-    R(e, a, b, c, d, F3, K3, M(41));
-    R(d, e, a, b, c, F3, K3, M(42));
-    R(c, d, e, a, b, F3, K3, M(43));
-    R(b, c, d, e, a, F3, K3, M(44));
-    R(a, b, c, d, e, F3, K3, M(45));
-    R(e, a, b, c, d, F3, K3, M(46));
-    R(d, e, a, b, c, F3, K3, M(47));
-    R(c, d, e, a, b, F3, K3, M(48));
-    R(b, c, d, e, a, F3, K3, M(49));
-    R(a, b, c, d, e, F3, K3, M(50));
-    R(e, a, b, c, d, F3, K3, M(51));
-    R(d, e, a, b, c, F3, K3, M(52));
-    R(c, d, e, a, b, F3, K3, M(53));
-    R(b, c, d, e, a, F3, K3, M(54));
-    R(a, b, c, d, e, F3, K3, M(55));
-    R(e, a, b, c, d, F3, K3, M(56));
-    R(d, e, a, b, c, F3, K3, M(57));
-    R(c, d, e, a, b, F3, K3, M(58));
-    R(b, c, d, e, a, F3, K3, M(59));
-    R(a, b, c, d, e, F4, K4, M(60));
-    R(e, a, b, c, d, F4, K4, M(61));
-    R(d, e, a, b, c, F4, K4, M(62));
-    R(c, d, e, a, b, F4, K4, M(63));
-    R(b, c, d, e, a, F4, K4, M(64));
-    R(a, b, c, d, e, F4, K4, M(65));
-    R(e, a, b, c, d, F4, K4, M(66));
-    R(d, e, a, b, c, F4, K4, M(67));
-    R(c, d, e, a, b, F4, K4, M(68));
-    R(b, c, d, e, a, F4, K4, M(69));
-    R(a, b, c, d, e, F4, K4, M(70));
-    R(e, a, b, c, d, F4, K4, M(71));
-    R(d, e, a, b, c, F4, K4, M(72));
-    R(c, d, e, a, b, F4, K4, M(73));
-    R(b, c, d, e, a, F4, K4, M(74));
-    R(a, b, c, d, e, F4, K4, M(75));
-    R(e, a, b, c, d, F4, K4, M(76));
-    R(d, e, a, b, c, F4, K4, M(77));
-    R(c, d, e, a, b, F4, K4, M(78));
-    R(b, c, d, e, a, F4, K4, M(79));
+/* -------------------------------------------------------------------------- */
 
-    /* update chaining vars */
-    hd->h0 += a;
-    hd->h1 += b;
-    hd->h2 += c;
-    hd->h3 += d;
-    hd->h4 += e;
+static char *_lz_length(char *op, size_t len)
+{
+    /* lengths beyond the nibble of the token continue on 255 steps */
+    for (; len >= 255; len -= 255) *op ++ = (char) 255;
+    *op ++ = (char) len;
+
+    return op;
 }
 
 /* -------------------------------------------------------------------------- */
 
-static void _sha1_write(SHA1_CONTEXT *hd, const char *inbuf, size_t inlen)
+static size_t _lz_compress(const char *src, size_t len, char *dst)
 {
-    /* update the message digest with the contents of INBUF with length INLEN */
+    /* LZ77 with 4 bytes hashed matches and 64KB offsets. A sequence is a
+       token (literal length << 4 | match length - 4), the literals, then
+       the offset on 2 bytes; the last sequence only holds literals */
 
-    if (hd->count == 64) {
-        /* flush the buffer */
-        _sha1_transform(hd, hd->buf);
-        hd->count = 0;
-        hd->nblocks ++;
-    }
+    uint16_t table[1 << _LZ_HASH];
+    const char *ip = src, *anchor = src, *ref = NULL, *mend = NULL;
+    const char *iend = src + len, *ilimit = iend - _LZ_MINMATCH;
+    char *op = dst, *token = NULL;
+    size_t lit = 0, mlen = 0;
+    uint32_t h = 0;
 
-    if (! inbuf) return;
+    if (len < _LZ_MINMATCH + 1) goto _last;
 
-    if (hd->count) {
-        for ( ; inlen && hd->count < 64; inlen --)
-            hd->buf[hd->count ++] = *inbuf ++;
+    memset(table, 0, sizeof(table));
 
-        _sha1_write(hd, NULL, 0);
+    for (ip ++; ip < ilimit; ) {
+        h = (_lz_read32(ip) * 2654435761U) >> (32 - _LZ_HASH);
+        ref = src + table[h]; table[h] = ip - src;
 
-        if (! inlen) return;
-    }
+        if (_lz_read32(ref) != _lz_read32(ip) || ref >= ip) {
+            /* skip faster through data which does not compress */
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
 
-    while (inlen >= 64) {
-        _sha1_transform(hd, (unsigned char *) inbuf);
-        hd->count = 0;
-        hd->nblocks ++;
-        inlen -= 64;
-        inbuf += 64;
+        /* extend the match backwards then forwards */
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) { ip --; ref --; }
+        for (mend = ip + _LZ_MINMATCH, ref += _LZ_MINMATCH;
+             mend < iend && *mend == *ref; mend ++, ref ++);
+
+        lit = ip - anchor; mlen = mend - ip - _LZ_MINMATCH;
+
+        token = op ++;
+        *token = (char) (((lit < 15) ? lit : 15) << 4);
+        if (lit >= 15) op = _lz_length(op, lit - 15);
+        memcpy(op, anchor, lit); op += lit;
+
+        *op ++ = (char) (mend - ref); *op ++ = (char) ((mend - ref) >> 8);
+
+        *token |= (char) ((mlen < 15) ? mlen : 15);
+        if (mlen >= 15) op = _lz_length(op, mlen - 15);
+
+        anchor = ip = mend;
     }
 
-    for ( ; inlen && hd->count < 64; inlen --)
-        hd->buf[hd->count ++] = *inbuf ++;
+_last:
+    lit = iend - anchor;
+    *op ++ = (char) (((lit < 15) ? lit : 15) << 4);
+    if (lit >= 15) op = _lz_length(op, lit - 15);
+    memcpy(op, anchor, lit); op += lit;
+
+    return op - dst;
 }
 
 /* -------------------------------------------------------------------------- */
 
-static void _sha1_final(SHA1_CONTEXT *hd)
+static int _lz_decompress(const char *src, size_t len, char *dst, size_t *out)
 {
-    /* the routine final terminates the computation and returns the digest.
-       the handle is prepared for a new cycle, but adding bytes to the handle
-       will destroy the returned buffer.
-       returns: 20 bytes representing the digest. */
+    const uint8_t *ip = (const uint8_t *) src, *iend = ip + len;
+    char *op = dst, *oend = dst + *out;
+    const char *ref = NULL;
+    size_t lit = 0, mlen = 0, n = 0, off = 0;
+    unsigned int token = 0;
 
-    uint32_t t, msb, lsb;
-    unsigned char *p;
+    while (ip < iend) {
+        token = *ip ++;
 
-    /* flush */
-    _sha1_write(hd, NULL, 0);
+        if ( (lit = token >> 4) == 15)
+            do { if (ip == iend) return -1; lit += (n = *ip ++); } while (n == 255);
 
-    t = hd->nblocks;
+        if (lit > (size_t) (iend - ip) || lit > (size_t) (oend - op)) return -1;
 
-    /* multiply by 64 to make a byte count */
-    lsb = t << 6;
-    msb = t >> 26;
+        memcpy(op, ip, lit); op += lit; ip += lit;
 
-    /* add the count */
-    t = lsb;
-    if ( (lsb += hd->count) < t)
-    msb ++;
+        if (ip == iend) break;
 
-    /* multiply by 8 to make a bit count */
-    t = lsb;
-    lsb <<= 3;
-    msb <<= 3;
-    msb |= t >> 29;
+        if (iend - ip < 2) return -1;
+        off = ip[0] | (ip[1] << 8); ip += 2;
+        if (! off || off > (size_t) (op - dst)) return -1;
+        ref = op - off;
 
-    if (hd->count < 56) {
-        /* enough room, add some padding */
-        hd->buf[hd->count ++] = 0x80;
-        while (hd->count < 56) hd->buf[hd->count ++] = 0;
-    } else {
-        /* need one extra block */
-        hd->buf[hd->count ++] = 0x80; /* pad character */
-        while (hd->count < 64) hd->buf[hd->count ++] = 0;
-        /* flush */
-        _sha1_write(hd, NULL, 0);
-        /* fill next block with zeroes */
-        memset(hd->buf, 0, 56);
-    }
-
-    /* append the 64 bit count */
-    hd->buf[56] = msb >> 24;
-    hd->buf[57] = msb >> 16;
-    hd->buf[58] = msb >>  8;
-    hd->buf[59] = msb      ;
-    hd->buf[60] = lsb >> 24;
-    hd->buf[61] = lsb >> 16;
-    hd->buf[62] = lsb >>  8;
-    hd->buf[63] = lsb      ;
-    _sha1_transform(hd, hd->buf);
-
-    p = hd->buf;
+        if ( (mlen = token & 15) == 15)
+            do { if (ip == iend) return -1; mlen += (n = *ip ++); } while (n == 255);
 
-    #ifdef BIG_ENDIAN_HOST
-    #define X(a) do { *(uint32_t *) p = hd->h##a ; p += 4; } while(0)
-    #else /* little endian */
-    #define X(a)                                        \
-    do {                                                \
-        *p ++ = hd->h##a >> 24; *p ++ = hd->h##a >> 16; \
-        *p ++ = hd->h##a >> 8; *p ++ = hd->h##a;        \
-    } while(0)
-    #endif
+        if ( (mlen += _LZ_MINMATCH) > (size_t) (oend - op)) return -1;
+
+        /* the match may overlap the output */
+        if (op - ref >= (ptrdiff_t) mlen) { memcpy(op, ref, mlen); op += mlen; }
+        else while (mlen --) *op ++ = *ref ++;
+    }
 
-    X(0);
-    X(1);
-    X(2);
-    X(3);
-    X(4);
+    *out = op - dst;
 
-    #undef X
+    return 0;
 }
 
 /* -------------------------------------------------------------------------- */
 
-public m_string *string_sha1s(const char *string, size_t len)
+static int _lz_emit(const char *data, size_t len, m_string *out)
 {
-    /** @brief returns the sha1 sum of the given string */
+    size_t n = 0;
 
-    SHA1_CONTEXT ctx;
-    char *buf = NULL;
-    unsigned int i = 0;
-    m_string *ret = NULL;
+    /* a block is stored as is when it does not shrink */
+    if (_string_reserve(out, 4 + len + len / 255 + 16) == -1) return -1;
 
-    if (! string || ! len) return NULL;
+    n = _lz_compress(data, len, out->_data + out->_len + 4);
 
-    if (! (buf = malloc(41 * sizeof(*ret))) ) {
-        perror(ERR(string_sha1s, malloc));
-        return NULL;
+    if (n >= len) {
+        memcpy(out->_data + out->_len + 4, data, len);
+        n = len | _LZ_STORED;
     }
 
-    _sha1_init(& ctx);
-    _sha1_write(& ctx, (const char *) string, len);
-    _sha1_final(& ctx);
+    _lz_write_le32(out->_data + out->_len, n);
+    out->_len += 4 + (n & ~_LZ_STORED);
+    out->_data[out->_len] = '\0';
 
-    for (i = 0; i < 20; i ++) {
-        buf[i * 2] = _hex[(ctx.buf[i] >> 4) & 0xf];
-        buf[(i * 2) + 1] = _hex[ctx.buf[i] & 0xf];
-    }
-    buf[40] = 0;
+    return 0;
+}
 
-    /* package the buffer in a string_m */
-    if (! (ret = string_alloc(NULL, 0)) ) {
-        free(buf);
-    } else {
-        ret->_flags = 0; ret->_data = buf;
-        ret->_len = 40; ret->_alloc = 41;
-        ret->_parts_alloc = ret->parts = 0;
-        ret->token = NULL;
+/* -------------------------------------------------------------------------- */
+
+static int _lz_write(m_string_zstream *z, const char *data, size_t len,
+                     m_string *out)
+{
+    size_t n = 0;
+
+    while (len) {
+        /* whole blocks are compressed straight from the input */
+        if (! z->pending && len >= _LZ_BLOCK) {
+            if (_lz_emit(data, _LZ_BLOCK, out) == -1) return -1;
+            data += _LZ_BLOCK; len -= _LZ_BLOCK;
+            continue;
+        }
+
+        n = (len < _LZ_BLOCK - z->pending) ? len : _LZ_BLOCK - z->pending;
+        memcpy(z->buf + z->pending, data, n);
+        z->pending += n; data += n; len -= n;
+
+        if (z->pending == _LZ_BLOCK) {
+            if (_lz_emit(z->buf, _LZ_BLOCK, out) == -1) return -1;
+            z->pending = 0;
+        }
     }
 
-    return ret;
+    return 0;
 }
 
 /* -------------------------------------------------------------------------- */
 
-public m_string *string_sha1(m_string *s)
+static int _lz_block(m_string_zstream *z, const char *block, m_string *out)
 {
-    return string_sha1s(DATA(s), SIZE(s));
-}
+    uint32_t head = _lz_read_le32(block);
+    size_t size = head & ~_LZ_STORED, n = _LZ_BLOCK;
 
-/* -------------------------------------------------------------------------- */
-/* -- end of SHA1 implementation */
-/* -------------------------------------------------------------------------- */
+    /* an empty block ends the stream */
+    if (! head) { z->state = 1; return 0; }
+
+    if (_string_reserve(out, _LZ_BLOCK) == -1) return -1;
+
+    if (head & _LZ_STORED) {
+        memcpy(out->_data + out->_len, block + 4, size);
+        n = size;
+    } else if (_lz_decompress(block + 4, size, out->_data + out->_len,
+                              & n) == -1) {
+        debug("string_zstream_write(): corrupted LZ block.\n");
+        return -1;
+    }
+
+    out->_len += n;
+    out->_data[out->_len] = '\0';
+
+    return 0;
+}
 
-/* -------------------------------------------------------------------------- */
-#ifdef _ENABLE_HTTP
 /* -------------------------------------------------------------------------- */
 
-public char *string_rawurlencode(const char *url, size_t len, int flags)
+static int _lz_read(m_string_zstream *z, const char *data, size_t len,
+                    m_string *out)
 {
-    char *buf = NULL;
-    int32_t bufsize = 0;
-    const char *p = url;
-    char *q = NULL;
+    size_t need = 0, n = 0;
 
-    bufsize = (len * 3) + 1;
+    while (len && z->state == 0) {
+        /* whole blocks are decoded straight from the input */
+        if (! z->pending && len >= 4) {
+            if ( (need = 4 + (_lz_read_le32(data) & ~_LZ_STORED)) >
+                 4 + _LZ_BLOCK) goto _corrupted;
 
-    if (bufsize * sizeof(*buf) < len) {
-        debug("string_rawurlencode(): integer overflow.\n");
-        return NULL;
-    }
+            if (len >= need) {
+                if (_lz_block(z, data, out) == -1) return -1;
+                data += need; len -= need;
+                continue;
+            }
+        }
 
-    if (! (q = buf = malloc(bufsize * sizeof(*buf))) ) {
-        perror(ERR(string_rawurlencode, malloc));
-        return NULL;
-    }
+        /* otherwise the block is buffered until it is complete */
+        n = (z->pending < 4) ? 4 - z->pending :
+            4 + (_lz_read_le32(z->buf) & ~_LZ_STORED) - z->pending;
+        if (n > len) n = len;
 
-    do {
-        switch (_unsafe[(int) *p]) {
-        case 1: /* unsafe chars */
-        case 2: /* control chars */
-        case 3: /* 0x7f */
-        case 4: /* non US-ASCII */
-                goto _encode;
-        case 5: /* reserved chars */
-                if (flags & RFC1738_ESCAPE_RESERVED) goto _encode;
-        case 6: /* escape char (%) */
-                if (~flags & RFC1738_ESCAPE_UNESCAPED) goto _encode;
-        default:
-                /* copy the char unencoded */
-                *q ++ = *p ++;
-                continue;
+        memcpy(z->buf + z->pending, data, n);
+        z->pending += n; data += n; len -= n;
+
+        if (z->pending < 4) break;
+
+        if ( (need = 4 + (_lz_read_le32(z->buf) & ~_LZ_STORED)) >
+             4 + _LZ_BLOCK) goto _corrupted;
+
+        if (z->pending == need) {
+            if (_lz_block(z, z->buf, out) == -1) return -1;
+            z->pending = 0;
         }
+    }
 
-_encode:
-        *q ++ = '%';
-        *q ++ = _hex[(*p >> 4) & 0xf];
-        *q ++ = _hex[*p ++ & 0xf];
-    } while (p < url + len && q < buf + bufsize);
+    if (len) {
+        debug("string_zstream_write(): data after the end of the stream.\n");
+        return -1;
+    }
 
-    *q = '\0';
+    return 0;
 
-    return buf;
+_corrupted:
+    debug("string_zstream_write(): corrupted LZ stream.\n");
+    return -1;
 }
 
+/* -------------------------------------------------------------------------- */
+#ifdef HAS_ZLIB
 /* -------------------------------------------------------------------------- */
 
-public int string_urlencode(m_string *url, int flags)
+static int _zlib_run(m_string_zstream *z, const char *data, size_t len,
+                     int flush, m_string *out)
 {
-    char *encoded = NULL;
-    size_t len = 0;
+    int ret = Z_OK;
 
-    if (! url || ! DATA(url)) return -1;
+    z->z.next_in = (Bytef *) data; z->z.avail_in = len;
 
-    if (! (encoded = string_rawurlencode(DATA(url), SIZE(url), flags)) )
-        return -1;
+    do {
+        if (_string_reserve(out, _ZSTREAM_CHUNK) == -1) return -1;
 
-    len = strlen(encoded);
+        z->z.next_out = (Bytef *) out->_data + out->_len;
+        z->z.avail_out = out->_alloc - out->_len;
 
-    /* replace the original data */
-    if (string_extend(url, len) == -1) {
-        debug("string_urlencode(): cannot resize the string.\n");
-        free(encoded);
-        return -1;
-    }
+        ret = (z->inflate) ? inflate(& z->z, flush) : deflate(& z->z, flush);
 
-    memcpy((void *) DATA(url), encoded, len);
+        out->_len = (char *) z->z.next_out - out->_data;
+        out->_data[out->_len] = '\0';
 
-    free(encoded);
+        if (ret == Z_STREAM_END) { z->state = 1; break; }
+
+        /* no progress is only an error if more output was possible */
+        if (ret == Z_BUF_ERROR && z->z.avail_out) break;
+
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            debug("string_zstream_write(): %s.\n",
+                  (z->z.msg) ? z->z.msg : "zlib error");
+            return -1;
+        }
+    } while (z->z.avail_in || ! z->z.avail_out);
+
+    if (z->z.avail_in) {
+        debug("string_zstream_write(): data after the end of the stream.\n");
+        return -1;
+    }
 
     return 0;
 }
@@ -3191,695 +4998,3730 @@ public int string_urlencode(m_string *url, int flags)
 #endif
 /* -------------------------------------------------------------------------- */
 
-/* -------------------------------------------------------------------------- */
-#ifdef _ENABLE_JSON
+static m_string_zstream *_string_zstream_alloc(int codec, int level,
+                                               int inflate)
+{
+    m_string_zstream *ret = NULL;
+    #ifdef HAS_ZLIB
+    int bits = 0, r = 0;
+    #endif
+
+    if (! (ret = calloc(1, sizeof(*ret))) ) {
+        perror(ERR(_string_zstream_alloc, calloc));
+        return NULL;
+    }
+
+    ret->codec = codec; ret->level = level; ret->inflate = inflate;
+
+    switch (codec) {
+    case STRING_CODEC_LZ:
+        if (! (ret->buf = malloc(4 + _LZ_BLOCK)) ) {
+            perror(ERR(_string_zstream_alloc, malloc));
+            goto _err;
+        }
+        return ret;
+    #ifdef HAS_ZLIB
+    case STRING_CODEC_DEFLATE: bits = MAX_WBITS; break;
+    case STRING_CODEC_GZIP: bits = MAX_WBITS + 16; break;
+    case STRING_CODEC_RAW: bits = - MAX_WBITS; break;
+    #endif
+    default:
+        debug("_string_zstream_alloc(): unsupported codec %i.\n", codec);
+        goto _err;
+    }
+
+    #ifdef HAS_ZLIB
+    r = (inflate) ? inflateInit2(& ret->z, bits) :
+                    deflateInit2(& ret->z, level, Z_DEFLATED, bits, 8,
+                                 Z_DEFAULT_STRATEGY);
+    if (r != Z_OK) {
+        debug("_string_zstream_alloc(): cannot initialize zlib.\n");
+        goto _err;
+    }
+
+    return ret;
+    #endif
+
+_err:
+    free(ret->buf);
+    free(ret);
+
+    return NULL;
+}
+
 /* -------------------------------------------------------------------------- */
 
-/* tokenizer states */
-#define _KEY 0x01   /* key expected */
-#define _VAL 0x02   /* value expected */
-#define _SIG 0x04   /* '+' or '-' sign found */
-#define _RAD 0x08   /* '.' decimal separator (radix point) found */
-#define _EXP 0x10   /* 'e' or 'E' exponent found */
-#define _BUG 0x20   /* only used in quirks mode */
+public m_string_zstream *string_compressor_alloc(int codec, int level)
+{
+    /** @brief prepare a streaming compression */
 
-public int string_parse_json(m_string *s, char strict, m_json_parser *ctx)
+    if (level < -1 || level > 9) {
+        debug("string_compressor_alloc(): bad parameters.\n");
+        return NULL;
+    }
+
+    return _string_zstream_alloc(codec, level, 0);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_zstream *string_decompressor_alloc(int codec)
 {
-    unsigned int pos = 0;
-    unsigned char class = 0;
-    char *p = NULL, state = 0, leading_digit = 0;
-    m_string *json = s, *parent = NULL;
-    int callback = 0, prealloc = 2;
+    /** @brief prepare a streaming decompression */
 
-    if (! json) {
-        debug("string_parse_json(): bad parameters.\n");
+    return _string_zstream_alloc(codec, 0, 1);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _string_zstream_run(m_string_zstream *z, const char *data,
+                               size_t len, int flush, m_string *out)
+{
+    int ret = 0;
+
+    if (! z || ! out || out->parent || (len && ! data)) {
+        debug("string_zstream_write(): bad parameters.\n");
         return -1;
     }
 
-    /* check if we should resume parsing */
-    if (PARTS(json) && IS_TYPE(LAST_TOKEN(json), JSON_TYPE)) {
-        if (IS_BUFFER(s)) {
-            /* the maximum amount of tokens was reached */
-            for (json = LAST_TOKEN(s); PARTS(json); json = LAST_TOKEN(json)) {
-                if (PARTS(LAST_TOKEN(json)) == 65535) {
-                    int i = 0;
+    if (_string_cow(out) == -1 || out->_flags & _STRING_FLAG_RDONLY) {
+        debug("string_zstream_write(): illegal write attempt.\n");
+        return -1;
+    }
 
-                    json = LAST_TOKEN(json);
+    if (z->state == -1 || (z->state == 1 && (len || ! z->inflate))) {
+        debug("string_zstream_write(): the stream is over.\n");
+        return -1;
+    }
 
-                    pos = DATA(LAST_TOKEN(json)) - DATA(json) +
-                          SIZE(LAST_TOKEN(json)) + 1;
+    if (z->codec == STRING_CODEC_LZ && z->inflate)
+        ret = _lz_read(z, data, len, out);
+    else if (z->codec == STRING_CODEC_LZ) {
+        ret = _lz_write(z, data, len, out);
 
-                    for (i = 0; i < 65535; i ++)
-                        string_free_token(json->token + i);
-                    json->parts = 0;
+        /* a partial block is emitted when flushing */
+        if (ret == 0 && flush && z->pending) {
+            ret = _lz_emit(z->buf, z->pending, out);
+            z->pending = 0;
+        }
 
-                    s->_flags &= ~_STRING_FLAG_BUFFER;
-                    break;
-                }
-            }
-        } else if (HAS_ERROR(LAST_TOKEN(json))) {
-            /* input was incomplete */
-            if (PARTS(LAST_TOKEN(json))) json = LAST_TOKEN(json);
+        /* and an empty block ends the stream */
+        if (ret == 0 && flush == 2 && (ret = _string_reserve(out, 4)) == 0) {
+            _lz_write_le32(out->_data + out->_len, 0);
+            out->_len += 4; out->_data[out->_len] = '\0';
+            z->state = 1;
+        }
+    }
+    #ifdef HAS_ZLIB
+    else ret = _zlib_run(z, data, len, (flush == 2) ? Z_FINISH :
+                         (flush) ? Z_SYNC_FLUSH : Z_NO_FLUSH, out);
+    #endif
 
-            pos = DATA(LAST_TOKEN(json)) - DATA(json);
-            /* XXX make sure the opening quotation mark is accounted for */
-            if (IS_STRING(LAST_TOKEN(json))) pos --;
+    if (ret == -1) z->state = -1;
 
-            string_free_token(LAST_TOKEN(json)); json->parts --;
+    return ret;
+}
 
-            state = -(IS_OBJECT(json) && ! IS_STRING(LAST_TOKEN(json))) & _KEY;
-            state |= _VAL;
-        } else string_free_token(json);
-    } else {
-        /* skip UTF-8 BOM if present */
-        if (! memcmp(DATA(json), "\xef\xbb\xbf", MIN(SIZE(json), 3)))
-            pos += 3;
-        string_free_token(json);
+/* -------------------------------------------------------------------------- */
+
+public int string_zstream_write(m_string_zstream *z, const char *data,
+                                size_t len, m_string *out)
+{
+    /** @brief feed a chunk to a compression or decompression context */
+
+    return _string_zstream_run(z, data, len, 0, out);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_zstream_flush(m_string_zstream *z, m_string *out)
+{
+    /** @brief output everything fed so far */
+
+    return _string_zstream_run(z, NULL, 0, 1, out);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_zstream_end(m_string_zstream *z, m_string *out)
+{
+    /** @brief terminate the compressed stream */
+
+    if (z && z->inflate) {
+        if (_string_zstream_run(z, NULL, 0, 1, out) == -1) return -1;
+
+        if (z->state != 1) {
+            debug("string_zstream_end(): truncated stream.\n");
+            return -1;
+        }
+
+        return 0;
     }
 
-    for ( ; pos < SIZE(json); pos ++) {
+    return _string_zstream_run(z, NULL, 0, 2, out);
+}
 
-        class = _j[(uint8_t) json->_data[pos]];
+/* -------------------------------------------------------------------------- */
 
-        if (likely(class >> 2) && unlikely(IS_STRING(json))) continue;
+public m_string_zstream *string_zstream_free(m_string_zstream *z)
+{
+    /** @brief release a compression or decompression context */
 
-        p = (char *) DATA(json) + pos;
+    if (! z) return NULL;
 
-        switch (class) {
+    #ifdef HAS_ZLIB
+    if (z->codec != STRING_CODEC_LZ) {
+        if (z->inflate) inflateEnd(& z->z);
+        else deflateEnd(& z->z);
+    }
+    #endif
 
-        /* ', " */
-        case QUOTE: {
-            if (IS_STRING(json)) {
-                /* check if the quotes are matching */
-                if (json->_data[-1] != json->_data[pos])
-                    break;
-                json->_len = json->_alloc = pos;
-                goto _delim;
-            } else if (unlikely(IS_PRIMITIVE(json))) {
-                debug("string_parse_json(): unexpected quotation mark.\n");
-                goto _error;
-            }
+    free(z->buf);
+    free(z);
 
-            if (strict) {
-                if (unlikely(json->_data[pos] == '\'')) {
-                    debug("string_parse_json(): strings must be enclosed "
-                          "in double-quotes.\n");
-                    goto _error;
-                }
+    return NULL;
+}
 
-                if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
-                    if ((state & _VAL) == 0) {
-                        debug("string_parse_json(): unexpected string.\n");
-                        goto _error;
-                    }
-                }
-            }
+/* -------------------------------------------------------------------------- */
+/* DIGESTS */
+/* -------------------------------------------------------------------------- */
 
-            if (likely(pos + 1 < SIZE(json))) {
-                json = string_add_token(json, pos + 1, SIZE(json));
-                if (unlikely(! json)) goto _nomem;
+#if defined(__GNUC__) && defined(__i386__)
+static inline uint32_t rol(uint32_t x, int n)
+{
+    __asm__("roll %%cl,%0" :"=r" (x) :"0" (x),"c" (n));
+    return x;
+}
+#else
+#define rol(x,n) ( ((x) << (n)) | ((x) >> (32 - (n))) )
+#endif
 
-                json->_flags &= ~JSON_TYPE;
-                json->_flags |= (JSON_STRING | _STRING_FLAG_ERRORS);
-                state &= ~_VAL; pos = -1;
-            } else return 0; /* EOF */
+/* -------------------------------------------------------------------------- */
 
-            {   /* optimize for long strings */
-                uint32_t prefetch;
-                if (likely(pos + sizeof(prefetch) < SIZE(json))) {
-                    memcpy(& prefetch, json->_data, sizeof(prefetch));
-                    if (__zero(prefetch ^ (~0U / 255 * json->_data[-1])))
-                        break; /* " or ' */
-                    if (unlikely(__less(prefetch, ' ')))
-                        break; /* unescaped special char */
-                    if (likely(! (prefetch = __zero(prefetch ^ 0x5c5c5c5cU)))) {
-                        pos += sizeof(prefetch); break;
-                    } else pos += __zero_idx(prefetch); /* \ */
-                } else break;
-            }
-        } /* FALLTHRU */
+static void _sha1_transform(uint32_t *h, const unsigned char *data)
+{
+    /* transform the message X which consists of 16 32-bit-words */
 
-        /* \ */
-        case ESCAPESEQ: { /* escape sequence */
-            int z = 0;
+    uint32_t a, b, c, d, e, tm;
+    uint32_t x[16];
 
-            if (! IS_STRING(json)) {
-                debug("string_parse_json(): escape sequences are only "
-                      "allowed in strings.\n");
-                goto _error;
-            }
+    /* get values from the chaining vars */
+    a = h[0];
+    b = h[1];
+    c = h[2];
+    d = h[3];
+    e = h[4];
 
-            switch (json->_data[++ pos]) {
-            case '\"': break;
+    #ifdef BIG_ENDIAN_HOST
+    memcpy(x, data, 64);
+    #else /* little endian */
+    {
+        int i;
+        unsigned char *p2;
 
-            /* QUIRK escaped single quotes, CRLF and capital U
-                     unicode escape sequences */
-            case '\r':
-            case '\n':
-            case '\'': z = 1;
-            case  'U': if (strict) goto _error; if (z)
+        for (i = 0, p2 = (unsigned char *) x; i < 16; i ++, p2 += 4) {
+            p2[3] = *data ++;
+            p2[2] = *data ++;
+            p2[1] = *data ++;
+            p2[0] = *data ++;
+        }
+    }
+    #endif
 
-            case  '/':
-            case '\\':
-            case  'b':
-            case  'f':
-            case  'n':
-            case  'r':
-            case  't': break;
+    #define K1 0x5a827999L
+    #define K2 0x6ed9eba1L
+    #define K3 0x8f1bbcdcL
+    #define K4 0xca62c1d6L
+    #define F1(x, y, z) (z ^ (x & (y ^ z)))
+    #define F2(x, y, z) (x ^ y ^ z)
+    #define F3(x, y, z) ( (x & y) | (z & (x | y)) )
+    #define F4(x, y, z) (x ^ y ^ z)
 
-            case  'u': { /* unicode escape sequence */
-                uint32_t prefetch;
-                if (likely(pos + 1 + sizeof(prefetch) < SIZE(json))) {
-                    memcpy(& prefetch, json->_data + pos + 1, sizeof(prefetch));
-                    if (! __less(prefetch, '0') && ! __more(prefetch, 'f'))
-                    if (likely(! __between(prefetch, '9', 'A')))
-                    if (likely(! __between(prefetch, 'F', 'a'))) {
-                        pos += sizeof(prefetch); break;
-                    }
-                } else break;
-            }
+    #define M(i) (tm = x[i & 0xf] ^ x[(i - 14) & 0xf]   \
+                  ^ x[(i - 8) & 0xf] ^ x[(i - 3) & 0xf] \
+                  , (x[i & 0xf] = rol(tm, 1)) )
+
+    #define R(a,b,c,d,e,f,k,m)               \
+    do {                                     \
+        e += rol(a, 5) + f(b, c, d) + k + m; \
+        b = rol(b, 30);                      \
+    } while (0)
+
+    R(a, b, c, d, e, F1, K1, x[ 0]);
+    R(e, a, b, c, d, F1, K1, x[ 1]);
+    R(d, e, a, b, c, F1, K1, x[ 2]);
+    R(c, d, e, a, b, F1, K1, x[ 3]);
+    R(b, c, d, e, a, F1, K1, x[ 4]);
+    R(a, b, c, d, e, F1, K1, x[ 5]);
+    R(e, a, b, c, d, F1, K1, x[ 6]);
+    R(d, e, a, b, c, F1, K1, x[ 7]);
+    R(c, d, e, a, b, F1, K1, x[ 8]);
+    R(b, c, d, e, a, F1, K1, x[ 9]);
+    R(a, b, c, d, e, F1, K1, x[10]);
+    R(e, a, b, c, d, F1, K1, x[11]);
+    R(d, e, a, b, c, F1, K1, x[12]);
+    R(c, d, e, a, b, F1, K1, x[13]);
+    R(b, c, d, e, a, F1, K1, x[14]);
+    R(a, b, c, d, e, F1, K1, x[15]);
+    R(e, a, b, c, d, F1, K1, M(16));
+    R(d, e, a, b, c, F1, K1, M(17));
+    R(c, d, e, a, b, F1, K1, M(18));
+    R(b, c, d, e, a, F1, K1, M(19));
+    R(a, b, c, d, e, F2, K2, M(20));
+    R(e, a, b, c, d, F2, K2, M(21));
+    R(d, e, a, b, c, F2, K2, M(22));
+    R(c, d, e, a, b, F2, K2, M(23));
+    R(b, c, d, e, a, F2, K2, M(24));
+    R(a, b, c, d, e, F2, K2, M(25));
+    R(e, a, b, c, d, F2, K2, M(26));
+    R(d, e, a, b, c, F2, K2, M(27));
+    R(c, d, e, a, b, F2, K2, M(28));
+    R(b, c, d, e, a, F2, K2, M(29));
+    R(a, b, c, d, e, F2, K2, M(30));
+    R(e, a, b, c, d, F2, K2, M(31));
+    R(d, e, a, b, c, F2, K2, M(32));
+    R(c, d, e, a, b, F2, K2, M(33));
+    R(b, c, d, e, a, F2, K2, M(34));
+    R(a, b, c, d, e, F2, K2, M(35));
+    R(e, a, b, c, d, F2, K2, M(36));
+    R(d, e, a, b, c, F2, K2, M(37));
+    R(c, d, e, a, b, F2, K2, M(38));
+    R(b, c, d, e, a, F2, K2, M(39));
+    R(a, b, c, d, e, F3, K3, M(40));
+    R(e, a, b, c, d, F3, K3, M(41));
+    R(d, e, a, b, c, F3, K3, M(42));
+    R(c, d, e, a, b, F3, K3, M(43));
+    R(b, c, d, e, a, F3, K3, M(44));
+    R(a, b, c, d, e, F3, K3, M(45));
+    R(e, a, b, c, d, F3, K3, M(46));
+    R(d, e, a, b, c, F3, K3, M(47));
+    R(c, d, e, a, b, F3, K3, M(48));
+    R(b, c, d, e, a, F3, K3, M(49));
+    R(a, b, c, d, e, F3, K3, M(50));
+    R(e, a, b, c, d, F3, K3, M(51));
+    R(d, e, a, b, c, F3, K3, M(52));
+    R(c, d, e, a, b, F3, K3, M(53));
+    R(b, c, d, e, a, F3, K3, M(54));
+    R(a, b, c, d, e, F3, K3, M(55));
+    R(e, a, b, c, d, F3, K3, M(56));
+    R(d, e, a, b, c, F3, K3, M(57));
+    R(c, d, e, a, b, F3, K3, M(58));
+    R(b, c, d, e, a, F3, K3, M(59));
+    R(a, b, c, d, e, F4, K4, M(60));
+    R(e, a, b, c, d, F4, K4, M(61));
+    R(d, e, a, b, c, F4, K4, M(62));
+    R(c, d, e, a, b, F4, K4, M(63));
+    R(b, c, d, e, a, F4, K4, M(64));
+    R(a, b, c, d, e, F4, K4, M(65));
+    R(e, a, b, c, d, F4, K4, M(66));
+    R(d, e, a, b, c, F4, K4, M(67));
+    R(c, d, e, a, b, F4, K4, M(68));
+    R(b, c, d, e, a, F4, K4, M(69));
+    R(a, b, c, d, e, F4, K4, M(70));
+    R(e, a, b, c, d, F4, K4, M(71));
+    R(d, e, a, b, c, F4, K4, M(72));
+    R(c, d, e, a, b, F4, K4, M(73));
+    R(b, c, d, e, a, F4, K4, M(74));
+    R(a, b, c, d, e, F4, K4, M(75));
+    R(e, a, b, c, d, F4, K4, M(76));
+    R(d, e, a, b, c, F4, K4, M(77));
+    R(c, d, e, a, b, F4, K4, M(78));
+    R(b, c, d, e, a, F4, K4, M(79));
+
+    /* update chaining vars */
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static const uint32_t _sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* -------------------------------------------------------------------------- */
+
+static void _sha256_transform(uint32_t *h, const unsigned char *data)
+{
+    uint32_t w[64], s[8], t1 = 0, t2 = 0;
+    unsigned int i = 0;
+
+    #define ROR(x, n) ( ((x) >> (n)) | ((x) << (32 - (n))) )
+
+    for (i = 0; i < 16; i ++, data += 4)
+        w[i] = ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) |
+               ((uint32_t) data[2] << 8) | data[3];
+
+    for (i = 16; i < 64; i ++)
+        w[i] = w[i - 16] + w[i - 7] +
+               (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+               (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+    memcpy(s, h, sizeof(s));
+
+    for (i = 0; i < 64; i ++) {
+        t1 = s[7] + (ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25)) +
+             (s[6] ^ (s[4] & (s[5] ^ s[6]))) + _sha256_k[i] + w[i];
+        t2 = (ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22)) +
+             ((s[0] & s[1]) | (s[2] & (s[0] | s[1])));
+        s[7] = s[6]; s[6] = s[5]; s[5] = s[4]; s[4] = s[3] + t1;
+        s[3] = s[2]; s[2] = s[1]; s[1] = s[0]; s[0] = t1 + t2;
+    }
+
+    #undef ROR
+
+    for (i = 0; i < 8; i ++) h[i] += s[i];
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* CRC32C (Castagnoli) lookup table, reflected polynomial 0x82f63b78 */
+static const uint32_t _crc32c_lut[256] = {
+    0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+    0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+    0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+    0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+    0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+    0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+    0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+    0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+    0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+    0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+    0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+    0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+    0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+    0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+    0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+    0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+    0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+    0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+    0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+    0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+    0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+    0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+    0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+    0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+    0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+    0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+    0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+    0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+    0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+    0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+    0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+    0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+    0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+    0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+    0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+    0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+    0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+    0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+    0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+    0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+    0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+    0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+    0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351
+};
+
+/* -------------------------------------------------------------------------- */
+
+static uint32_t _crc32c(uint32_t crc, const unsigned char *data, size_t len)
+{
+    /* the state is kept inverted between calls */
+    if (__simd_crc32c(_search_engine, & crc, data, len)) return crc;
+
+    while (len --) crc = _crc32c_lut[(crc ^ *data ++) & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* the 64 bit hash is XXH64, so that the values can be checked by other
+   implementations */
+#define _H64_P1 0x9e3779b185ebca87ULL
+#define _H64_P2 0xc2b2ae3d27d4eb4fULL
+#define _H64_P3 0x165667b19e3779f9ULL
+#define _H64_P4 0x85ebca77c2b2ae63ULL
+#define _H64_P5 0x27d4eb2f165667c5ULL
+
+#define _ROL64(x, n) ( ((x) << (n)) | ((x) >> (64 - (n))) )
+
+static inline uint64_t _h64_read(const unsigned char *p)
+{
+    return (uint64_t) p[0] | ((uint64_t) p[1] << 8) |
+           ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24) |
+           ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40) |
+           ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline uint64_t _h64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * _H64_P2;
+    return _ROL64(acc, 31) * _H64_P1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _h64_stripes(uint64_t *v, const unsigned char *data, size_t n)
+{
+    /* four independent lanes of 8 bytes per 32 byte stripe */
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+
+    for ( ; n; n --, data += 32) {
+        v0 = _h64_round(v0, _h64_read(data));
+        v1 = _h64_round(v1, _h64_read(data + 8));
+        v2 = _h64_round(v2, _h64_read(data + 16));
+        v3 = _h64_round(v3, _h64_read(data + 24));
+    }
+
+    v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static uint64_t _h64_final(const uint64_t *v, uint64_t seed, uint64_t total,
+                           const unsigned char *p, size_t len)
+{
+    /* fold the lanes, then mix the last bytes that did not fill a stripe */
+    uint64_t h = 0;
+    unsigned int i = 0;
+
+    if (total >= 32) {
+        h = _ROL64(v[0], 1) + _ROL64(v[1], 7) +
+            _ROL64(v[2], 12) + _ROL64(v[3], 18);
+        for (i = 0; i < 4; i ++)
+            h = (h ^ _h64_round(0, v[i])) * _H64_P1 + _H64_P4;
+    } else h = seed + _H64_P5;
+
+    h += total;
+
+    for ( ; len >= 8; len -= 8, p += 8) {
+        h ^= _h64_round(0, _h64_read(p));
+        h = _ROL64(h, 27) * _H64_P1 + _H64_P4;
+    }
+
+    if (len >= 4) {
+        h ^= (uint64_t) ((uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+                         ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24))
+             * _H64_P1;
+        h = _ROL64(h, 23) * _H64_P2 + _H64_P3;
+        len -= 4; p += 4;
+    }
+
+    for ( ; len; len --, p ++) {
+        h ^= *p * _H64_P5;
+        h = _ROL64(h, 11) * _H64_P1;
+    }
+
+    h ^= h >> 33; h *= _H64_P2;
+    h ^= h >> 29; h *= _H64_P3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _digest_init(m_string_digest *d, int algorithm, uint64_t seed)
+{
+    static const uint32_t sha1[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+    static const uint32_t sha256[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    d->algorithm = algorithm;
+    d->seed = seed;
+    d->total = 0;
+    d->count = 0;
+
+    switch (algorithm) {
+    case STRING_DIGEST_SHA1: memcpy(d->h, sha1, sizeof(sha1)); break;
+    case STRING_DIGEST_SHA256: memcpy(d->h, sha256, sizeof(sha256)); break;
+    case STRING_DIGEST_CRC32C: d->h[0] = 0xffffffff; break;
+    case STRING_DIGEST_HASH64:
+        d->v[0] = seed + _H64_P1 + _H64_P2; d->v[1] = seed + _H64_P2;
+        d->v[2] = seed; d->v[3] = seed - _H64_P1;
+        break;
+    default: return -1;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _digest_blocks(m_string_digest *d, const unsigned char *data,
+                           size_t blocks)
+{
+    /* consume whole 64 byte blocks, with the SHA extensions if possible */
+    switch (d->algorithm) {
+    case STRING_DIGEST_SHA1:
+        if (__simd_sha1(_search_engine, d->h, data, blocks) == 0) break;
+        for ( ; blocks; blocks --, data += 64) _sha1_transform(d->h, data);
+        break;
+    case STRING_DIGEST_SHA256:
+        if (__simd_sha256(_search_engine, d->h, data, blocks) == 0) break;
+        for ( ; blocks; blocks --, data += 64) _sha256_transform(d->h, data);
+        break;
+    case STRING_DIGEST_HASH64: _h64_stripes(d->v, data, blocks * 2); break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _digest_write(m_string_digest *d, const char *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    size_t n = 0;
+
+    d->total += len;
+
+    /* the CRC does not work on blocks */
+    if (d->algorithm == STRING_DIGEST_CRC32C) {
+        d->h[0] = _crc32c(d->h[0], p, len);
+        return;
+    }
+
+    if (d->count) {
+        n = MIN(sizeof(d->buf) - d->count, len);
+        memcpy(d->buf + d->count, p, n);
+        d->count += n; p += n; len -= n;
+        if (d->count < sizeof(d->buf)) return;
+        _digest_blocks(d, d->buf, 1);
+        d->count = 0;
+    }
+
+    if (len >= 64) {
+        _digest_blocks(d, p, len / 64);
+        p += len & ~ (size_t) 63; len &= 63;
+    }
+
+    memcpy(d->buf, p, len);
+    d->count = len;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static size_t _digest_final(m_string_digest *d, unsigned char *out)
+{
+    /* terminate the computation, store the digest in out (big endian) and
+       return its size; the context is ready for a new message */
+
+    uint64_t bits = d->total << 3, h = 0;
+    size_t i = 0, words = 5;
+
+    switch (d->algorithm) {
+    case STRING_DIGEST_CRC32C:
+        h = ~ d->h[0] & 0xffffffff;
+        for (i = 0; i < 4; i ++) out[i] = h >> (24 - i * 8);
+        _digest_init(d, d->algorithm, d->seed);
+        return 4;
+
+    case STRING_DIGEST_HASH64:
+        i = d->count & ~ (size_t) 31;
+        if (i) _h64_stripes(d->v, d->buf, 1);
+        h = _h64_final(d->v, d->seed, d->total, d->buf + i, d->count - i);
+        for (i = 0; i < 8; i ++) out[i] = h >> (56 - i * 8);
+        _digest_init(d, d->algorithm, d->seed);
+        return 8;
+
+    case STRING_DIGEST_SHA256: words = 8; break;
+    }
+
+    /* SHA padding: 0x80, zeroes, then the message size in bits */
+    d->buf[d->count ++] = 0x80;
+
+    if (d->count > 56) {
+        memset(d->buf + d->count, 0, sizeof(d->buf) - d->count);
+        _digest_blocks(d, d->buf, 1);
+        d->count = 0;
+    }
+
+    memset(d->buf + d->count, 0, 56 - d->count);
+    for (i = 0; i < 8; i ++) d->buf[56 + i] = bits >> (56 - i * 8);
+    _digest_blocks(d, d->buf, 1);
+
+    for (i = 0; i < words; i ++) {
+        out[i * 4] = d->h[i] >> 24; out[i * 4 + 1] = d->h[i] >> 16;
+        out[i * 4 + 2] = d->h[i] >> 8; out[i * 4 + 3] = d->h[i];
+    }
+
+    _digest_init(d, d->algorithm, d->seed);
+
+    return words * 4;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static m_string *_digest_hex(const unsigned char *digest, size_t len)
+{
+    m_string *ret = NULL;
+    size_t i = 0;
+
+    if (! (ret = string_alloc(NULL, len * 2)) ) return NULL;
+
+    for (i = 0; i < len; i ++) {
+        ret->_data[i * 2] = _hex[(digest[i] >> 4) & 0xf];
+        ret->_data[(i * 2) + 1] = _hex[digest[i] & 0xf];
+    }
+    ret->_data[len * 2] = 0; ret->_len = len * 2;
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_digest *string_digest_alloc(int algorithm)
+{
+    m_string_digest *d = NULL;
+
+    if (algorithm < STRING_DIGEST_SHA1 || algorithm > STRING_DIGEST_HASH64) {
+        debug("string_digest_alloc(): bad parameters.\n");
+        return NULL;
+    }
+
+    if (_search_engine == -1) string_api_setup();
+
+    if (! (d = malloc(sizeof(*d))) ) {
+        perror(ERR(string_digest_alloc, malloc));
+        return NULL;
+    }
+
+    _digest_init(d, algorithm, 0);
+
+    return d;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_digest_write(m_string_digest *d, const char *data,
+                               size_t len)
+{
+    if (! d || (! data && len)) {
+        debug("string_digest_write(): bad parameters.\n");
+        return -1;
+    }
+
+    _digest_write(d, data, len);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_digest_update(m_string_digest *d, m_string *s)
+{
+    if (! d || ! s) {
+        debug("string_digest_update(): bad parameters.\n");
+        return -1;
+    }
+
+    _digest_write(d, DATA(s), SIZE(s));
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_digest_end(m_string_digest *d, m_string *out)
+{
+    unsigned char digest[32];
+    char hex[sizeof(digest) * 2];
+    size_t len = 0, i = 0;
+
+    if (! d || ! out) {
+        debug("string_digest_end(): bad parameters.\n");
+        return -1;
+    }
+
+    len = _digest_final(d, digest);
+
+    for (i = 0; i < len; i ++) {
+        hex[i * 2] = _hex[(digest[i] >> 4) & 0xf];
+        hex[(i * 2) + 1] = _hex[digest[i] & 0xf];
+    }
+
+    return (string_cats(out, hex, len * 2)) ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_digest *string_digest_free(m_string_digest *d)
+{
+    free(d);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_sha1s(const char *string, size_t len)
+{
+    /** @brief returns the sha1 sum of the given string */
+
+    m_string_digest ctx;
+    unsigned char digest[20];
+
+    if (! string || ! len) return NULL;
+
+    if (_search_engine == -1) string_api_setup();
+
+    _digest_init(& ctx, STRING_DIGEST_SHA1, 0);
+    _digest_write(& ctx, string, len);
+    _digest_final(& ctx, digest);
+
+    return _digest_hex(digest, sizeof(digest));
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_sha1(m_string *s)
+{
+    return string_sha1s(DATA(s), SIZE(s));
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_sha256s(const char *string, size_t len)
+{
+    m_string_digest ctx;
+    unsigned char digest[32];
+
+    if (! string && len) {
+        debug("string_sha256s(): bad parameters.\n");
+        return NULL;
+    }
+
+    if (_search_engine == -1) string_api_setup();
+
+    _digest_init(& ctx, STRING_DIGEST_SHA256, 0);
+    _digest_write(& ctx, string, len);
+    _digest_final(& ctx, digest);
+
+    return _digest_hex(digest, sizeof(digest));
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_sha256(m_string *s)
+{
+    return string_sha256s(DATA(s), SIZE(s));
+}
+
+/* -------------------------------------------------------------------------- */
+
+public uint32_t string_crc32c(uint32_t crc, const char *data, size_t len)
+{
+    if (! data) return crc;
+
+    if (_search_engine == -1) string_api_setup();
+
+    return ~ _crc32c(~ crc, (const unsigned char *) data, len);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public uint64_t string_hash64(const char *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    uint64_t v[4];
+
+    if (! data) len = 0;
+
+    /* no buffering is needed when the whole message is there */
+    v[0] = seed + _H64_P1 + _H64_P2; v[1] = seed + _H64_P2;
+    v[2] = seed; v[3] = seed - _H64_P1;
+
+    _h64_stripes(v, p, len / 32);
+
+    return _h64_final(v, seed, len, p + (len & ~ (size_t) 31), len & 31);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public uint64_t string_casehash64(const char *data, size_t len, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    uint8_t buf[512];
+    size_t off = 0, n = 0;
+    uint64_t v[4];
+
+    if (! data) len = 0;
+
+    if (_search_engine == -1) string_api_setup();
+
+    v[0] = seed + _H64_P1 + _H64_P2; v[1] = seed + _H64_P2;
+    v[2] = seed; v[3] = seed - _H64_P1;
+
+    /* the stripes are folded to lower case on the stack */
+    for (off = 0; len - off >= 32; off += n) {
+        n = MIN(sizeof(buf), (len - off) & ~ (size_t) 31);
+        __simd_fold(_search_engine, buf, p + off, n, 0);
+        _h64_stripes(v, buf, n / 32);
+    }
+
+    __simd_fold(_search_engine, buf, p + off, len - off, 0);
+
+    return _h64_final(v, seed, len, buf, len - off);
+}
+
+#undef _ROL64
+
+/* -------------------------------------------------------------------------- */
+/* -- end of digest implementation */
+/* -------------------------------------------------------------------------- */
+
+/* -------------------------------------------------------------------------- */
+#ifdef _ENABLE_HTTP
+/* -------------------------------------------------------------------------- */
+
+public char *string_rawurlencode(const char *url, size_t len, int flags)
+{
+    char *buf = NULL;
+    int32_t bufsize = 0;
+    const char *p = url, *end = url + len, *run = NULL;
+    char *q = NULL;
+
+    bufsize = (len * 3) + 1;
+
+    if (bufsize * sizeof(*buf) < len) {
+        debug("string_rawurlencode(): integer overflow.\n");
+        return NULL;
+    }
+
+    if (! (q = buf = malloc(bufsize * sizeof(*buf))) ) {
+        perror(ERR(string_rawurlencode, malloc));
+        return NULL;
+    }
+
+    if (_search_engine == -1) string_api_setup();
+
+    while (p < end) {
+        /* letters and digits are never escaped, copy their runs at once */
+        run = __simd_skip_alnum(_search_engine, p, end - p);
+        memcpy(q, p, run - p); q += run - p;
+        if ((p = run) == end) break;
+
+        switch (_unsafe[(unsigned char) *p]) {
+        case 1: /* unsafe chars */
+        case 2: /* control chars */
+        case 3: /* 0x7f */
+        case 4: /* non US-ASCII */
+                goto _encode;
+        case 5: /* reserved chars */
+                if (flags & RFC1738_ESCAPE_RESERVED) goto _encode;
+        case 6: /* escape char (%) */
+                if (~flags & RFC1738_ESCAPE_UNESCAPED) goto _encode;
+        default:
+                /* copy the char unencoded */
+                *q ++ = *p ++;
+                continue;
+        }
+
+_encode:
+        *q ++ = '%';
+        *q ++ = _hex[(*p >> 4) & 0xf];
+        *q ++ = _hex[*p ++ & 0xf];
+    }
+
+    *q = '\0';
+
+    return buf;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_urlencode(m_string *url, int flags)
+{
+    char *encoded = NULL;
+    size_t len = 0;
+
+    if (! url || ! DATA(url)) return -1;
+
+    if (! (encoded = string_rawurlencode(DATA(url), SIZE(url), flags)) )
+        return -1;
+
+    len = strlen(encoded);
+
+    /* replace the original data */
+    if (string_extend(url, len) == -1) {
+        debug("string_urlencode(): cannot resize the string.\n");
+        free(encoded);
+        return -1;
+    }
+
+    memcpy((void *) DATA(url), encoded, len);
+
+    free(encoded);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline int _string_xdigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') return (c | 0x20) - 'a' + 10;
+
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public size_t string_rawurldecode(char *url, size_t len)
+{
+    /* the decoded url is never longer, so it is written over the input; the
+       C library already vectorizes the search of the escape character */
+
+    char *p = url, *q = url, *end = url + len, *pct = NULL;
+    int hi = 0, lo = 0;
+
+    if (! url) return 0;
+
+    while ( (pct = memchr(p, '%', end - p)) ) {
+        if (q != p) memmove(q, p, pct - p);
+        q += pct - p; p = pct;
+
+        /* malformed escape sequences are kept as they are */
+        if (end - p > 2 && (hi = _string_xdigit(p[1])) != -1 &&
+            (lo = _string_xdigit(p[2])) != -1) {
+            *q ++ = (char) (hi << 4 | lo); p += 3;
+        } else *q ++ = *p ++;
+    }
+
+    if (q != p) memmove(q, p, end - p);
+    q += end - p;
+
+    if (q < end) *q = '\0';
+
+    return q - url;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_urldecode(m_string *url)
+{
+    size_t len = 0;
+
+    if (! url || ! DATA(url)) return -1;
+
+    /* check if writing to the string is allowed */
+    if (_string_cow(url) == -1 || url->_flags & _STRING_FLAG_RDONLY) {
+        debug("string_urldecode(): illegal write attempt.\n");
+        return -1;
+    }
+
+    len = string_rawurldecode(url->_data, SIZE(url));
+
+    return string_suppr(url, len, SIZE(url) - len);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+/* Gay's dtoa, see util/m_util_dtoa.c */
+extern char *_m_dtoa(double, int, int, int *, int *, char **);
+extern void  _m_freedtoa(char *);
+
+static const char _string_digits[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+/* longest integer or number written by the writer */
+#define _WRITER_NUMBER 32
+
+/* -------------------------------------------------------------------------- */
+
+static char *_string_u64toa(uint64_t u, char *end)
+{
+    /* the digits are written backwards, two at a time */
+    while (u >= 100) {
+        end -= 2; memcpy(end, _string_digits + (u % 100) * 2, 2); u /= 100;
+    }
+
+    if (u >= 10) { end -= 2; memcpy(end, _string_digits + u * 2, 2); }
+    else *(-- end) = '0' + u;
+
+    return end;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static size_t _string_i64toa(int64_t i, char *out)
+{
+    char buffer[_WRITER_NUMBER], *p = NULL;
+    size_t len = 0;
+
+    p = _string_u64toa((i < 0) ? 0 - (uint64_t) i : (uint64_t) i,
+                       buffer + sizeof(buffer));
+    if (i < 0) *(-- p) = '-';
+
+    len = buffer + sizeof(buffer) - p;
+    memcpy(out, p, len);
+
+    return len;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static size_t _string_dtoa(double d, char *out)
+{
+    /* shortest digits which read back to the same number, laid out like
+       ECMAScript does: fixed notation from 1e-6 to 1e21, exponent beyond */
+
+    char shortest[FLOAT_DIGITS + 1];
+    char *digits = NULL, *end = NULL, *p = out;
+    int decpt = 0, sign = 0, n = 0, i = 0;
+
+    /* integers are exact up to 2^53 */
+    if (d >= -9007199254740992.0 && d <= 9007199254740992.0 &&
+        d == (double) (int64_t) d)
+        return _string_i64toa((int64_t) d, out);
+
+    if ( (n = float_dtoa(d, 0, 0, shortest, & decpt)) ) {
+        digits = shortest; sign = (d < 0);
+    } else if ( (digits = _m_dtoa(d, 0, 0, & decpt, & sign, & end)) ) {
+        n = end - digits;
+    } else return 0;
+
+    if (sign) *p ++ = '-';
+
+    if (decpt > 0 && decpt <= 21) {
+        if (decpt >= n) {
+            memcpy(p, digits, n); p += n;
+            for (i = n; i < decpt; i ++) *p ++ = '0';
+        } else {
+            memcpy(p, digits, decpt); p += decpt; *p ++ = '.';
+            memcpy(p, digits + decpt, n - decpt); p += n - decpt;
+        }
+    } else if (decpt <= 0 && decpt > -6) {
+        *p ++ = '0'; *p ++ = '.';
+        for (i = decpt; i < 0; i ++) *p ++ = '0';
+        memcpy(p, digits, n); p += n;
+    } else {
+        *p ++ = digits[0];
+        if (n > 1) { *p ++ = '.'; memcpy(p, digits + 1, n - 1); p += n - 1; }
+        *p ++ = 'e'; *p ++ = (decpt - 1 < 0) ? '-' : '+';
+        p += _string_i64toa((decpt - 1 < 0) ? 1 - decpt : decpt - 1, p);
+    }
+
+    if (digits != shortest) _m_freedtoa(digits);
+
+    return p - out;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline int _string_writer_reserve(m_string_writer *w, size_t n)
+{
+    return _string_reserve(w->_out, n);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline void _string_writer_commit(m_string_writer *w, size_t n)
+{
+    w->_out->_len += n;
+    w->_out->_data[w->_out->_len] = '\0';
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_writer_init(m_string_writer *w, m_string *out, char delim)
+{
+    /** @brief prepare a serialization writer */
+
+    if (! w || ! out || out->parent) {
+        debug("string_writer_init(): bad parameters.\n");
+        return -1;
+    }
+
+    if (_string_cow(out) == -1 || out->_flags & _STRING_FLAG_RDONLY) {
+        debug("string_writer_init(): illegal write attempt.\n");
+        return -1;
+    }
+
+    memset(w, 0, sizeof(*w));
+    w->_out = out; w->_delim = delim;
+
+    if (_search_engine == -1) string_api_setup();
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_text_field(m_string_writer *w, const char *data,
+                             size_t len)
+{
+    /** @brief append a field to a delimited text record */
+
+    uint8_t special[4] = { 0, '"', '\r', '\n' };
+    const char *p = data, *end = data + len, *q = NULL;
+    char *out = NULL;
+
+    if (! w || (! data && len)) {
+        debug("string_text_field(): bad parameters.\n");
+        return -1;
+    }
+
+    special[0] = w->_delim;
+
+    if (_string_writer_reserve(w, len + 3) == -1) return -1;
+
+    out = w->_out->_data + w->_out->_len;
+
+    if (w->_comma) *out ++ = w->_delim;
+    w->_comma = 1;
+
+    if (! __simd_find_any(_search_engine, data, len, special, 4)) {
+        memcpy(out, data, len); out += len;
+        _string_writer_commit(w, out - (w->_out->_data + w->_out->_len));
+        return 0;
+    }
+
+    /* quote the field and double its quotes */
+    *out ++ = '"';
+    _string_writer_commit(w, out - (w->_out->_data + w->_out->_len));
+
+    while ( (q = memchr(p, '"', end - p)) ) {
+        if (_string_writer_reserve(w, (q - p) + 2) == -1) return -1;
+        out = w->_out->_data + w->_out->_len;
+        memcpy(out, p, q - p); out += q - p; *out ++ = '"'; *out ++ = '"';
+        _string_writer_commit(w, (q - p) + 2);
+        p = q + 1;
+    }
+
+    if (_string_writer_reserve(w, (end - p) + 1) == -1) return -1;
+    out = w->_out->_data + w->_out->_len;
+    memcpy(out, p, end - p); out[end - p] = '"';
+    _string_writer_commit(w, (end - p) + 1);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_text_int(m_string_writer *w, int64_t value)
+{
+    /** @brief append an integer field to a delimited text record */
+
+    char *out = NULL;
+    size_t n = 0;
+
+    if (! w) {
+        debug("string_text_int(): bad parameters.\n");
+        return -1;
+    }
+
+    if (_string_writer_reserve(w, _WRITER_NUMBER + 1) == -1) return -1;
+
+    out = w->_out->_data + w->_out->_len;
+
+    if (w->_comma) out[n ++] = w->_delim;
+    w->_comma = 1;
+
+    n += _string_i64toa(value, out + n);
+    _string_writer_commit(w, n);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_text_double(m_string_writer *w, double value)
+{
+    /** @brief append a number field to a delimited text record */
+
+    char *out = NULL;
+    size_t n = 0, k = 0;
+
+    if (! w) {
+        debug("string_text_double(): bad parameters.\n");
+        return -1;
+    }
+
+    if (_string_writer_reserve(w, _WRITER_NUMBER + 1) == -1) return -1;
+
+    out = w->_out->_data + w->_out->_len;
+
+    if (w->_comma) out[n ++] = w->_delim;
+    w->_comma = 1;
+
+    if (value != value) { memcpy(out + n, "nan", 3); n += 3; }
+    else if (value - value != 0) {
+        if (value < 0) out[n ++] = '-';
+        memcpy(out + n, "inf", 3); n += 3;
+    } else if (! (k = _string_dtoa(value, out + n)) ) return -1;
+
+    _string_writer_commit(w, n + k);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_text_end(m_string_writer *w)
+{
+    /** @brief end a delimited text record */
+
+    if (! w) {
+        debug("string_text_end(): bad parameters.\n");
+        return -1;
+    }
+
+    if (_string_writer_reserve(w, 1) == -1) return -1;
+
+    w->_out->_data[w->_out->_len] = '\n';
+    _string_writer_commit(w, 1);
+    w->_comma = 0;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* -------------------------------------------------------------------------- */
+#ifdef _ENABLE_JSON
+/* -------------------------------------------------------------------------- */
+
+/* tokenizer states */
+#define _KEY 0x01   /* key expected */
+#define _VAL 0x02   /* value expected */
+#define _SIG 0x04   /* '+' or '-' sign found */
+#define _RAD 0x08   /* '.' decimal separator (radix point) found */
+#define _EXP 0x10   /* 'e' or 'E' exponent found */
+#define _BUG 0x20   /* only used in quirks mode */
+
+public int string_parse_json(m_string *s, char strict, m_json_parser *ctx)
+{
+    unsigned int pos = 0;
+    unsigned char class = 0;
+    char *p = NULL, state = 0, leading_digit = 0;
+    m_string *json = s, *parent = NULL;
+    int callback = 0, prealloc = 2;
+
+    if (! json) {
+        debug("string_parse_json(): bad parameters.\n");
+        return -1;
+    }
+
+    /* check if we should resume parsing */
+    if (PARTS(json) && IS_TYPE(LAST_TOKEN(json), JSON_TYPE)) {
+        if (IS_BUFFER(s)) {
+            /* the maximum amount of tokens was reached */
+            for (json = LAST_TOKEN(s); PARTS(json); json = LAST_TOKEN(json)) {
+                if (PARTS(LAST_TOKEN(json)) == STRING_TOKEN_MAX) {
+                    int i = 0;
+
+                    json = LAST_TOKEN(json);
+
+                    pos = DATA(LAST_TOKEN(json)) - DATA(json) +
+                          SIZE(LAST_TOKEN(json)) + 1;
+
+                    for (i = 0; i < STRING_TOKEN_MAX; i ++)
+                        string_free_token(json->token + i);
+                    json->parts = 0;
+
+                    s->_flags &= ~_STRING_FLAG_BUFFER;
+                    break;
+                }
+            }
+        } else if (HAS_ERROR(LAST_TOKEN(json))) {
+            /* input was incomplete */
+            if (PARTS(LAST_TOKEN(json))) json = LAST_TOKEN(json);
+
+            pos = DATA(LAST_TOKEN(json)) - DATA(json);
+            /* XXX make sure the opening quotation mark is accounted for */
+            if (IS_STRING(LAST_TOKEN(json))) pos --;
+
+            string_free_token(LAST_TOKEN(json)); json->parts --;
+
+            state = -(IS_OBJECT(json) && ! IS_STRING(LAST_TOKEN(json))) & _KEY;
+            state |= _VAL;
+        } else string_free_token(json);
+    } else {
+        /* skip UTF-8 BOM if present */
+        if (! memcmp(DATA(json), "\xef\xbb\xbf", MIN(SIZE(json), 3)))
+            pos += 3;
+        string_free_token(json);
+    }
+
+    for ( ; pos < SIZE(json); pos ++) {
+
+        class = _j[(uint8_t) json->_data[pos]];
+
+        if (likely(class >> 2) && unlikely(IS_STRING(json))) continue;
+
+        p = (char *) DATA(json) + pos;
+
+        switch (class) {
+
+        /* ', " */
+        case QUOTE: {
+            if (IS_STRING(json)) {
+                /* check if the quotes are matching */
+                if (json->_data[-1] != json->_data[pos])
+                    break;
+                json->_len = json->_alloc = pos;
+                goto _delim;
+            } else if (unlikely(IS_PRIMITIVE(json))) {
+                debug("string_parse_json(): unexpected quotation mark.\n");
+                goto _error;
+            }
+
+            if (strict) {
+                if (unlikely(json->_data[pos] == '\'')) {
+                    debug("string_parse_json(): strings must be enclosed "
+                          "in double-quotes.\n");
+                    goto _error;
+                }
+
+                if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
+                    if ((state & _VAL) == 0) {
+                        debug("string_parse_json(): unexpected string.\n");
+                        goto _error;
+                    }
+                }
+            }
+
+            if (likely(pos + 1 < SIZE(json))) {
+                json = string_add_token(json, pos + 1, SIZE(json));
+                if (unlikely(! json)) goto _nomem;
+
+                json->_flags &= ~JSON_TYPE;
+                json->_flags |= (JSON_STRING | _STRING_FLAG_ERRORS);
+                state &= ~_VAL; pos = -1;
+            } else return 0; /* EOF */
+
+            {   /* optimize for long strings */
+                uint32_t prefetch;
+                if (likely(pos + sizeof(prefetch) < SIZE(json))) {
+                    memcpy(& prefetch, json->_data, sizeof(prefetch));
+                    if (__zero(prefetch ^ (~0U / 255 * json->_data[-1])))
+                        break; /* " or ' */
+                    if (unlikely(__less(prefetch, ' ')))
+                        break; /* unescaped special char */
+                    if (likely(! (prefetch = __zero(prefetch ^ 0x5c5c5c5cU)))) {
+                        pos += sizeof(prefetch); break;
+                    } else pos += __zero_idx(prefetch); /* \ */
+                } else break;
+            }
+        } /* FALLTHRU */
+
+        /* \ */
+        case ESCAPESEQ: { /* escape sequence */
+            int z = 0;
+
+            if (! IS_STRING(json)) {
+                debug("string_parse_json(): escape sequences are only "
+                      "allowed in strings.\n");
+                goto _error;
+            }
+
+            switch (json->_data[++ pos]) {
+            case '\"': break;
+
+            /* QUIRK escaped single quotes, CRLF and capital U
+                     unicode escape sequences */
+            case '\r':
+            case '\n':
+            case '\'': z = 1;
+            case  'U': if (strict) goto _error; if (z)
+
+            case  '/':
+            case '\\':
+            case  'b':
+            case  'f':
+            case  'n':
+            case  'r':
+            case  't': break;
+
+            case  'u': { /* unicode escape sequence */
+                uint32_t prefetch;
+                if (likely(pos + 1 + sizeof(prefetch) < SIZE(json))) {
+                    memcpy(& prefetch, json->_data + pos + 1, sizeof(prefetch));
+                    if (! __less(prefetch, '0') && ! __more(prefetch, 'f'))
+                    if (likely(! __between(prefetch, '9', 'A')))
+                    if (likely(! __between(prefetch, 'F', 'a'))) {
+                        pos += sizeof(prefetch); break;
+                    }
+                } else break;
+            }
+
+            /* unexpected char */
+            default: goto _error;
+            }
+        } break;
+
+        case NON_PRINT: goto _error;
+
+        /* \t, \r, \n, 0x20 */
+        case WHITE: if (strict && IS_STRING(json)) goto _error;
+        case SPACE: if (likely(IS_PRIMITIVE(json))) {
+            if (state & _VAL) {
+                debug("string_parse_json(): incomplete primitive.\n");
+                goto _error;
+            }
+
+            /* QUIRK unquoted keys */
+            json->_flags = (json->_flags & ~JSON_TYPE) |
+                           (-(state & _BUG) & JSON_STRING) |
+                           (-(! (state & _BUG)) & JSON_PRIMITIVE);
+            state = (state & ~_KEY) | (-(IS_STRING(json) > 0) & _KEY);
+            state &= ~_BUG;
+            leading_digit = 0;
+            json->_len = json->_alloc = pos;
+            goto _delim;
+            break;
+        } break;
+
+        /* f, n, t */
+        case PRIMITIVE: if (likely(! IS_PRIMITIVE(json))) {
+            if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
+                if (state & _KEY) {
+                    /* QUIRK unquoted keys */
+                    if (! strict) {
+                        json = string_add_token(json, pos, SIZE(json));
+                        if (unlikely(! json)) goto _nomem;
+
+                        json->_flags &= ~JSON_TYPE;
+                        json->_flags |= JSON_PRIMITIVE;
+                        pos = 0; state &= ~(_KEY | _VAL); state |= _BUG;
+                        break;
+                    }
+
+                    debug("string_parse_json(): a key must be "
+                          "enclosed in quotation marks.\n");
+                    goto _error;
+                }
+
+                if ((state & _VAL) == 0) {
+                    debug("string_parse_json(): unexpected primitive.\n");
+                    goto _error;
+                }
+            }
+
+            switch (*p) {
+            case 'f': if (memcmp(p + 1, "alse", MIN(SIZE(json) - pos, 4)))
+                          goto _error; p += 4; break;
+            case 'n': if (memcmp(p + 1, "ull", MIN(SIZE(json) - pos, 3)))
+                          goto _error; p += 3; break;
+            case 't': if (memcmp(p + 1, "rue", MIN(SIZE(json) - pos, 3)))
+                          goto _error; p += 3; break;
+            default:  goto _error;
+            }
+
+            state &= ~(_VAL | _RAD | _EXP | _SIG);
+
+            json = string_add_token(json, pos, SIZE(json));
+            if (unlikely(! json)) goto _nomem;
+
+            json->_flags &= ~JSON_TYPE; json->_flags |= JSON_PRIMITIVE;
+
+            pos = p - DATA(json);
+
+            goto _token;
+        } else if (state & _BUG) break; goto _error; /* QUIRK unquoted keys */
+
+        /* e, E */
+        case DIGIT_EXP: {
+            /* exponent cannot be placed right after a radix point */
+            if ((state & _RAD) && p[-1] == '.') {
+                debug("string_parse_json(): a fractional part is expected.\n");
+                goto _error;
+            }
+
+            /* NOTE while it would seem more intuitive to check if a previous
+                    exponent was set first, leading_digit may not be in cache
+                    and accessing it below helps avoiding an expensive stall */
+            if ((state & _EXP) || leading_digit == 0) {
+                /* QUIRK unquoted keys */
+                if (! strict) {
+                    if (state & _KEY) {
+                        json = string_add_token(json, pos, SIZE(json));
+                        if (unlikely(! json)) goto _nomem;
+
+                        json->_flags &= ~JSON_TYPE;
+                        json->_flags |= JSON_PRIMITIVE;
+                        pos = 0; state &= ~(_KEY | _VAL); state |= _BUG;
+                        break;
+                    } else if ((state & _BUG) && (IS_PRIMITIVE(json)))
+                        break;
+                }
+
+                debug("string_parse_json(): unexpected exponent.\n");
+                goto _error;
+            }
+
+            state &= ~_SIG;
+            state |= (_EXP | _VAL);
+        } break;
+
+        /* . */
+        case DIGIT_RAD: {
+            if (unlikely(leading_digit == 0) || (state & (_RAD | _EXP))) {
+                debug("string_parse_json(): unexpected decimal separator.\n");
+                goto _error;
+            }
+
+            state &= ~_SIG; state |= _RAD;
+
+            {   /* optimize for large numbers */
+                uint32_t prefetch;
+                if (likely(pos + 1 + sizeof(prefetch) < SIZE(json))) {
+                    memcpy(& prefetch, p + 1, sizeof(prefetch));
+                    prefetch = __more(prefetch, '9') | __less(prefetch, '0');
+                    if ( (prefetch = __zero_idx(prefetch)) ) {
+                        pos += prefetch; break;
+                    }
+                }
+            }
+
+            /* QUIRK omitted fractional part */
+            state |= (-(strict) & _VAL);
+        } break;
+
+        /* + */
+        case DIGIT_POS: if ((state & (_SIG | _EXP | _VAL)) != (_EXP | _VAL)) {
+            debug("string_parse_json(): unexpected plus sign.\n");
+            goto _error;
+        } else state |= (_SIG | _VAL); break;
+
+        /* - */
+        case DIGIT_NEG: {
+            if (likely(! IS_PRIMITIVE(json))) {
+                if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
+                    if (state & _KEY) {
+                        debug("string_parse_json(): a key must be "
+                              "enclosed in quotation marks.\n");
+                        goto _error;
+                    }
+
+                    if ((state & _VAL) == 0) {
+                        debug("string_parse_json(): unexpected "
+                              "negative primitive.\n");
+                        goto _error;
+                    }
+                }
+
+                json = string_add_token(json, pos, SIZE(json));
+                if (unlikely(! json)) goto _nomem;
+
+                json->_flags &= ~JSON_TYPE; json->_flags |= JSON_PRIMITIVE;
+                pos = 0; state &= ~(_RAD | _EXP); leading_digit = 0;
+            } else if ((state & (_SIG | _EXP | _VAL)) != (_EXP | _VAL)) {
+                debug("string_parse_json(): unexpected minus sign.\n");
+                goto _error;
+            }
+
+            state |= _SIG;
+        } break;
+
+        /* 0-9 */
+        case DIGIT: if (likely(leading_digit)) {
+            if (leading_digit == '0') {
+                if ((state & (_RAD | _EXP)) == 0) {
+                    debug("string_parse_json(): octal integers "
+                          "are not supported.\n");
+                    goto _error;
+                }
+                leading_digit = 1;
+            }
+
+            state &= ~_VAL;
+
+            {   /* optimize for large numbers */
+                uint32_t prefetch;
+                if (likely(pos + 1 + sizeof(prefetch) < SIZE(json))) {
+                    memcpy(& prefetch, p + 1, sizeof(prefetch));
+                    prefetch = __more(prefetch, '9') | __less(prefetch, '0');
+                    pos += __zero_idx(prefetch);
+                }
+            }
+        } else {
+            leading_digit = *p;
+
+            if (likely(! IS_PRIMITIVE(json))) {
+                if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
+                    if (state & _KEY) {
+                        /* QUIRK unquoted keys */
+                        if (! strict) {
+                            json = string_add_token(json, pos, SIZE(json));
+                            if (unlikely(! json)) goto _nomem;
+
+                            json->_flags &= ~JSON_TYPE;
+                            json->_flags |= JSON_PRIMITIVE;
+                            pos = 0; state &= ~(_KEY | _VAL); state |= _BUG;
+                            break;
+                        }
+
+                        debug("string_parse_json(): a key must be a "
+                              "string enclosed in quotation marks.\n");
+                        goto _error;
+                    }
+
+                    if ((state & _VAL) == 0) {
+                        debug("string_parse_json(): unexpected "
+                              "numeric primitive.\n");
+                        goto _error;
+                    }
+                }
+
+                state &= ~(_VAL | _RAD | _EXP | _SIG);
+
+                json = string_add_token(json, pos, SIZE(json));
+                if (unlikely(! json)) goto _nomem;
+
+                json->_flags &= ~JSON_TYPE; json->_flags |= JSON_PRIMITIVE;
+
+                pos = 0;
+            } else state &= ~_VAL;
+        } break;
+
+        /* , */
+        case COMMA: {
+            if (strict && unlikely(state & _VAL)) {
+                debug("string_parse_json(): a value is expected.\n");
+                goto _error;
+            }
+
+            if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
+                state = (state & ~_KEY) | (-(IS_OBJECT(json) > 0) & _KEY);
+                state |= _VAL;
+
+                /* skip space */
+                pos += likely(p[1] == ' ');
+
+                break;
+            }
+
+            if (IS_PRIMITIVE(json)) {
+                pos --; leading_digit = 0;
+                goto _token;
+            }
+
+            if (strict) {
+                debug("string_parse_json(): comma-separated lists "
+                      "must be enclosed in brackets.\n");
+                goto _error;
+            }
+        } break;
+
+        /* : */
+        case COLON: {
+            if (unlikely((state & (_KEY | _VAL)) != _KEY)) {
+
+                /* QUIRK unquoted keys */
+                if (! strict && IS_PRIMITIVE(json)) {
+                    pos --; leading_digit = 0;
+                    state |= _KEY; state &= ~_BUG;
+                    json->_flags &= ~JSON_TYPE;
+                    json->_flags |= JSON_STRING;
+                    goto _token;
+                }
+
+                if (! IS_OBJECT(json))
+                    debug("string_parse_json(): key/value pairs are only "
+                          "allowed in objects.\n");
+                else debug("string_parse_json(): missing or malformed key.\n");
+
+                goto _error;
+            }
+
+            state &= ~_KEY; state |= _VAL;
+
+            /* skip space */
+            pos += likely(p[1] == ' ');
+
+            /* parser callback */
+            if (ctx) {
+                ctx->key.current = DATA(LAST_TOKEN(json));
+                ctx->key.len = SIZE(LAST_TOKEN(json));
+            }
+        } break;
+
+        /* {, [ */
+        case OBJ_START: {
+            if (unlikely(state & _KEY)) {
+                debug("string_parse_json(): opening bracket where "
+                      "a key was expected.\n");
+                goto _error;
+            }
+
+            if ((state & _VAL) == 0 && json->parent) {
+                debug("string_parse_json(): unexpected opening "
+                      "bracket.\n");
+                goto _error;
+            }
+
+            json = string_add_token(json, pos, SIZE(json));
+            if (unlikely(! json)) goto _nomem;
+
+            /* try to prealloc tokens */
+            if (likely(json->token = malloc(prealloc * sizeof(*json->token))))
+                json->_parts_alloc = prealloc;
+
+            pos = (*p == '{');
+
+            json->_flags &= ~JSON_TYPE;
+            json->_flags |= (-(pos) & JSON_OBJECT) | (-(! pos) & JSON_ARRAY);
+            json->_flags |= _STRING_FLAG_ERRORS;
+
+            state = (state & ~_KEY) | (-(pos) & _KEY) | _VAL;
+
+            /* skip space */
+            pos = (p[1] == ' ');
+
+            /* parser callback */
+            if (ctx && ctx->init) {
+                if (json->parent)
+                    ctx->parent = json->parent->_flags & JSON_TYPE;
+                else ctx->parent = 0;
+
+                if (ctx->init(json->_flags & JSON_TYPE, ctx) == 1)
+                    return 0;
+
+                ctx->key.current = NULL; ctx->key.len = 0;
+            }
+        } break;
+
+        /* }, ] */
+        case OBJ_CLOSE: {
+            if (strict) {
+                if ((state & _KEY) && json->parts & 0x1) {
+                    debug("string_parse_json(): a key is expected.\n");
+                    goto _error;
+                }
+
+                if ((state & _VAL) && json->parts) {
+                    debug("string_parse_json(): a value is expected.\n");
+                    goto _error;
+                }
+            }
+
+            if ((state & _VAL) && ! IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
+                debug("string_parse_json(): a value is expected.\n");
+                goto _error;
+            }
+
+            state &= ~(_KEY | _VAL);
+            prealloc = json->parts;
+
+            /* NOTE checking in that order helps avoiding a costly stall */
+            if (IS_PRIMITIVE(json)) {
+                if (IS_TYPE(json->parent, JSON_ARRAY | JSON_OBJECT)) {
+                    pos --; leading_digit = 0;
+                    goto _token;
+                }
+            } else if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
+                /* check if the brackets are matching */
+                if (*json->_data == *p - 2) goto _token;
+
+                debug("string_parse_json(): mismatched bracket (%c).\n",
+                      *json->_data);
+                goto _error;
+            }
+
+            /* a closing bracket must be within an array or object */
+            debug("string_parse_json(): stray closing bracket.\n");
+            goto _error;
+        } break;
+
+        case ASCII: if (strict)
+
+        default: goto _error;
+
+        /* QUIRK comments */
+        if (*p == '/') {
+            if (IS_PRIMITIVE(json)) {
+                leading_digit = 0; pos --;
+                if (state & _BUG) {
+                    state |= _KEY; state &= ~_BUG;
+                    json->_flags &= ~JSON_TYPE;
+                    json->_flags |= JSON_STRING;
+                }
+                goto _token;
+            }
+
+            if (*++ p == '/') {
+                do {
+                    uint32_t prefetch;
+                    memcpy(& prefetch, p, sizeof(prefetch));
+                    if (__zero(prefetch ^ 0x0a0a0a0aU)) {
+                        while (*p ++ != '\n');
+                        p --; break;
+                    }
+                    p += sizeof(prefetch);
+                } while (p < DATA(json) + SIZE(json));
+            } else if (*p ++ == '*') {
+                do {
+                    uint32_t prefetch;
+                    memcpy(& prefetch, p, sizeof(prefetch));
+                    if (__zero(prefetch ^ 0x2a2a2a2aU)) {
+                        while (*p ++ != '*');
+                        if (*p == '/') break;
+                    } else p += sizeof(prefetch);
+                } while (p < DATA(json) + SIZE(json));
+            }
+
+            if ((p - DATA(json)) - pos > 2) {
+                pos = p - DATA(json); break;
+            } else goto _error;
+        }
+
+        /* QUIRK unquoted keys */
+        if (state & _KEY) {
+            json = string_add_token(json, pos, SIZE(json));
+            if (unlikely(! json)) goto _nomem;
+
+            json->_flags &= ~JSON_TYPE; json->_flags |= JSON_PRIMITIVE;
+            pos = 0; state &= ~(_KEY | _VAL); state |= _BUG;
+            break;
+        } else if ((state & _BUG) && (IS_PRIMITIVE(json))) break;
+
+        /* QUIRK hexadecimal numbers */
+        if (json->_data[pos] == 'x') {
+            if (leading_digit != '0' || ++ pos > 2) goto _error;
+
+            do {
+                uint32_t prefetch;
+                memcpy(& prefetch, json->_data + pos, sizeof(prefetch));
+                if (__less(prefetch, '0') || __more(prefetch, 'f'))
+                    break;
+                if (__between(prefetch, '9', 'A'))
+                    break;
+                if (__between(prefetch, 'F', 'a'))
+                    break;
+                pos += sizeof(prefetch);
+            } while (pos < 18); /* 64 bits */
+
+            /* check the next characters */
+            while (pos < 18) {
+                if (json->_data[pos] < '0' || json->_data[pos] > 'f')
+                    break;
+                if (json->_data[pos] > '9' && json->_data[pos] < 'A')
+                    break;
+                if (json->_data[pos] > 'F' && json->_data[pos] < 'a')
+                    break;
+                pos ++;
+            }
+
+            /* '0x' without digits is not allowed */
+            if (-- pos == 1) goto _error;
+
+            break;
+        }
+
+        goto _error;
+
+        }
+
+        continue;
+
+_token: if (likely(json->_len != pos))
+        json->_len = json->_alloc = pos + 1;
+_delim: json->_flags &= ~_STRING_FLAG_ERRORS;
+        parent = json->parent;
+
+        /* parser callback */
+        if (ctx) {
+            int type = json->_flags & JSON_TYPE;
+
+            if (likely(parent))
+                ctx->parent = parent->_flags & JSON_TYPE;
+            else ctx->parent = 0;
+
+            if (ctx->exit && (type & (JSON_ARRAY | JSON_OBJECT))) {
+                callback = ctx->exit(type, ctx);
+                if (callback == 1) return 0;
+                ctx->key.current = NULL;
+                ctx->key.len = 0;
+            } else if (ctx->data && (state & _KEY) == 0) {
+                callback = ctx->data(type, DATA(json), SIZE(json), ctx);
+                if (callback == 1) return 0;
+            }
+        }
+
+        if (likely(parent)) {
+            pos += json->_data - parent->_data;
+            if (ctx && callback == 0 && (state & _KEY) == 0)
+                string_free_token(json);
+            json = parent;
+        } else break;
+    }
+
+    return 0;
+
+_error:
+    debug("string_parse_json(): illegal character \'%c\' at %i.\n",
+          json->_data[pos], (int) (json->_data - s->_data) + pos + 1);
+    string_free_token(s);
+    return -1;
+
+_nomem:
+    s->_flags |= _STRING_FLAG_BUFFER;
+    return 1;
+}
+
+#undef _KEY
+#undef _VAL
+#undef _SIG
+#undef _RAD
+#undef _EXP
+#undef _BUG
+
+/* -------------------------------------------------------------------------- */
+
+/* streaming parser states */
+#define _JS_BLANK   0 /* between two tokens */
+#define _JS_STRING  1 /* within a string */
+#define _JS_ESCAPE  2 /* after a backslash */
+#define _JS_UNICODE 3 /* within a unicode escape sequence */
+#define _JS_PRIM    4 /* within a number, a literal or an unquoted key */
+#define _JS_SLASH   5 /* QUIRK comments */
+#define _JS_LINE    6
+#define _JS_BLOCK   7
+#define _JS_STAR    8
+#define _JS_ERROR   9
+#define _JS_STOP   10
+
+/* what the grammar expects next */
+#define _JS_VALUE   0 /* a value */
+#define _JS_FIRST   1 /* a value or a closing bracket */
+#define _JS_KEY     2 /* a key */
+#define _JS_KEY1    3 /* a key or a closing bracket */
+#define _JS_COLON   4 /* a colon */
+#define _JS_NEXT    5 /* a comma or a closing bracket */
+
+/* characters ending a primitive */
+#define _JS_DELIM(c) (((1U << _j[(uint8_t) (c)]) & \
+                      ((1U << QUOTE) | (1U << WHITE) | (1U << SPACE) | \
+                       (1U << COMMA) | (1U << COLON) | (1U << OBJ_START) | \
+                       (1U << OBJ_CLOSE))) || (c) == '/')
+
+/* type of the innermost container, stored as one bit per level */
+#define _JS_TOP(js) ((! (js)->_depth) ? 0 : \
+                     ((js)->_stack[((js)->_depth - 1) >> 5] & \
+                     (1U << (((js)->_depth - 1) & 31))) ? JSON_OBJECT : JSON_ARRAY)
+
+public m_json_stream *string_json_stream_alloc(char strict, unsigned int depth,
+                                               m_json_parser *ctx)
+{
+    /** @brief allocate an incremental JSON parser */
+
+    m_json_stream *js = NULL;
+    size_t words = 0;
+
+    if (! depth) depth = JSON_STREAM_DEPTH;
+
+    words = (depth + 31) / 32;
+
+    /* the stack of containers directly follows the structure */
+    if (! (js = malloc(sizeof(*js) + words * sizeof(*js->_stack))) ) {
+        perror(ERR(string_json_stream_alloc, malloc));
+        return NULL;
+    }
+
+    memset(js, 0, sizeof(*js));
+
+    js->_ctx = ctx; js->_strict = strict; js->_max = depth;
+    js->_stack = (uint32_t *) (js + 1);
+
+    return js;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _json_stream_append(char **buf, size_t *len, size_t *alloc,
+                               const char *data, size_t n)
+{
+    char *p = NULL;
+    size_t size = 0;
+
+    /* the buffer may not be allocated yet */
+    if (! n) return 0;
+
+    if (*len + n > *alloc) {
+        for (size = (*alloc) ? *alloc : 64; size < *len + n; size *= 2);
+
+        if (! (p = realloc(*buf, size)) ) {
+            perror(ERR(_json_stream_append, realloc));
+            return -1;
+        }
+
+        *buf = p; *alloc = size;
+    }
+
+    memcpy(*buf + *len, data, n); *len += n;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _json_stream_primitive(const char *p, size_t len, char strict,
+                                  int key)
+{
+    size_t i = 0, d = 0;
+
+    if (! len) return -1;
+
+    /* QUIRK unquoted keys */
+    if (key) {
+        if (_j[(uint8_t) *p] == DIGIT) return -1;
+
+        for (i = 0; i < len; i ++) {
+            if (p[i] == '_' || p[i] == '$' || (unsigned char) p[i] > 0x7f)
+                continue;
+            if (! isalnum((unsigned char) p[i])) return -1;
+        }
+
+        return 0;
+    }
+
+    /* literals */
+    if ((len == 4 && (! memcmp(p, "true", 4) || ! memcmp(p, "null", 4))) ||
+        (len == 5 && ! memcmp(p, "false", 5)))
+        return 0;
+
+    /* QUIRK hexadecimal numbers (64 bits) */
+    if (! strict && len > 2 && p[0] == '0' && p[1] == 'x') {
+        if (len > 18) return -1;
+
+        for (i = 2; i < len; i ++)
+            if (! isxdigit((unsigned char) p[i])) return -1;
+
+        return 0;
+    }
+
+    /* numbers */
+    if (p[i] == '-') i ++;
+
+    if (i < len && p[i] == '0') i ++;
+    else if (i < len && p[i] > '0' && p[i] <= '9') {
+        while (i < len && _j[(uint8_t) p[i]] == DIGIT) i ++;
+    } else return -1;
+
+    if (i < len && p[i] == '.') {
+        for (d = ++ i; i < len && _j[(uint8_t) p[i]] == DIGIT; i ++);
+        /* QUIRK real numbers without fractional part */
+        if (i == d && strict) return -1;
+    }
+
+    if (i < len && (p[i] == 'e' || p[i] == 'E')) {
+        if (++ i < len && (p[i] == '+' || p[i] == '-')) i ++;
+        for (d = i; i < len && _j[(uint8_t) p[i]] == DIGIT; i ++);
+        if (i == d) return -1;
+    }
+
+    return (i == len) ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _json_stream_context(m_json_stream *js, int key)
+{
+    m_json_parser *ctx = js->_ctx;
+
+    ctx->parent = _JS_TOP(js);
+
+    if (key && ctx->parent == JSON_OBJECT) {
+        /* an empty key is still a key */
+        ctx->key.current = (js->_key) ? js->_key : "";
+        ctx->key.len = js->_keylen;
+    } else {
+        ctx->key.current = NULL; ctx->key.len = 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _json_stream_value(m_json_stream *js, int quoted)
+{
+    /* check that a value or a key may start here */
+    switch (js->_expect) {
+    case _JS_VALUE:
+    case _JS_FIRST: js->_iskey = 0; js->_seen = 1; return 0;
+    case _JS_KEY:
+    case _JS_KEY1: if (js->_strict && ! quoted) break;
+                   js->_iskey = 1; return 0;
+    }
+
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _json_stream_token(m_json_stream *js, const char *p, size_t len,
+                              int type)
+{
+    m_json_parser *ctx = js->_ctx;
+    int ret = 0;
+
+    /* the beginning of the token was received with a previous chunk */
+    if (js->_buflen) {
+        if (_json_stream_append(& js->_buf, & js->_buflen, & js->_bufalloc,
+                                p, len) == -1)
+            return -1;
+        p = js->_buf; len = js->_buflen;
+    }
+
+    js->_buflen = 0;
+
+    if (type == JSON_PRIMITIVE &&
+        _json_stream_primitive(p, len, js->_strict, js->_iskey) == -1) {
+        debug("string_json_stream_parse(): invalid primitive.\n");
+        return -1;
+    }
+
+    if (js->_iskey) {
+        /* keep the key for the callbacks of its value */
+        js->_keylen = 0;
+        if (_json_stream_append(& js->_key, & js->_keylen, & js->_keyalloc,
+                                p, len) == -1)
+            return -1;
+
+        js->_expect = _JS_COLON;
+        return 0;
+    }
+
+    js->_expect = (js->_depth) ? _JS_NEXT : _JS_VALUE;
+
+    if (ctx && ctx->data) {
+        _json_stream_context(js, 1);
+        ret = (ctx->data(type, p, len, ctx) == 1);
+    }
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _json_stream_open(m_json_stream *js, int type)
+{
+    m_json_parser *ctx = js->_ctx;
+    unsigned int bit = 0;
+    int ret = 0;
+
+    if (_json_stream_value(js, 0) == -1 || js->_iskey) {
+        debug("string_json_stream_parse(): unexpected opening bracket.\n");
+        return -1;
+    }
+
+    if (js->_depth == js->_max) {
+        debug("string_json_stream_parse(): too many nested levels.\n");
+        return -1;
+    }
+
+    if (ctx) _json_stream_context(js, 1);
+
+    bit = 1U << (js->_depth & 31);
+    if (type == JSON_OBJECT) js->_stack[js->_depth >> 5] |= bit;
+    else js->_stack[js->_depth >> 5] &= ~bit;
+    js->_depth ++;
+
+    js->_expect = (type == JSON_OBJECT) ? _JS_KEY1 : _JS_FIRST;
+
+    if (ctx && ctx->init) ret = (ctx->init(type, ctx) == 1);
+
+    if (ctx) { ctx->key.current = NULL; ctx->key.len = 0; }
+    js->_keylen = 0;
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _json_stream_close(m_json_stream *js, int type)
+{
+    m_json_parser *ctx = js->_ctx;
+
+    if (_JS_TOP(js) != type) {
+        debug("string_json_stream_parse(): mismatched bracket.\n");
+        return -1;
+    }
+
+    switch (js->_expect) {
+    case _JS_VALUE:
+    case _JS_KEY: if (js->_strict) {
+                      debug("string_json_stream_parse(): a value is "
+                            "expected.\n");
+                      return -1;
+                  } /* QUIRK trailing commas */
+    case _JS_FIRST:
+    case _JS_KEY1:
+    case _JS_NEXT: break;
+    default:
+        debug("string_json_stream_parse(): a value is expected.\n");
+        return -1;
+    }
+
+    js->_depth --; js->_keylen = 0;
+    js->_expect = (js->_depth) ? _JS_NEXT : _JS_VALUE;
+
+    if (ctx && ctx->exit) {
+        _json_stream_context(js, 0);
+        return (ctx->exit(type, ctx) == 1);
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_stream_parse(m_json_stream *js, const char *data,
+                                    size_t len)
+{
+    /** @brief parse a chunk of a JSON stream */
+
+    const char *p = data, *end = data + len, *tok = NULL;
+    unsigned char class = 0;
+    int ret = 0;
+
+    if (! js || (! data && len)) {
+        debug("string_json_stream_parse(): bad parameters.\n");
+        return -1;
+    }
+
+    if (js->_state == _JS_ERROR) return -1;
+    if (js->_state == _JS_STOP) return 1;
+
+    /* skip UTF-8 BOM if present */
+    if (! js->_offset && len >= 3 && ! memcmp(data, "\xef\xbb\xbf", 3))
+        p += 3;
+
+    /* a pending token continues at the beginning of the chunk */
+    if (js->_state >= _JS_STRING && js->_state <= _JS_PRIM) tok = p;
+
+    for ( ; p < end; p ++) {
+
+        switch (js->_state) {
+
+        case _JS_STRING: {
+            /* skip the regular characters */
+            while (p < end && _j[(uint8_t) *p] >> 2) p ++;
+            if (p == end) goto _pending;
+
+            switch (_j[(uint8_t) *p]) {
+            case QUOTE: if (*p != js->_quote) continue;
+                        ret = _json_stream_token(js, tok, p - tok,
+                                                 JSON_STRING);
+                        if (ret) goto _done;
+                        js->_state = _JS_BLANK; tok = NULL;
+                        continue;
+            case ESCAPESEQ: js->_state = _JS_ESCAPE; continue;
+            /* QUIRK unescaped tabs and CRLF */
+            case WHITE: if (! js->_strict) continue;
+            }
+        } goto _error;
+
+        case _JS_ESCAPE: {
+            switch (*p) {
+            /* QUIRK escaped single quotes, CRLF and capital U
+                     unicode escape sequences */
+            case '\'':
+            case '\r':
+            case '\n': if (js->_strict) goto _error;
+            case '\"':
+            case  '/':
+            case '\\':
+            case  'b':
+            case  'f':
+            case  'n':
+            case  'r':
+            case  't': js->_state = _JS_STRING; continue;
+            case  'U': if (js->_strict) goto _error;
+            case  'u': js->_state = _JS_UNICODE; js->_esc = 4; continue;
+            }
+        } goto _error;
+
+        case _JS_UNICODE: {
+            if (! isxdigit((unsigned char) *p)) goto _error;
+            if (! -- js->_esc) js->_state = _JS_STRING;
+        } continue;
+
+        case _JS_PRIM: {
+            while (p < end && ! _JS_DELIM(*p)) p ++;
+            if (p == end) goto _pending;
+
+            ret = _json_stream_token(js, tok, p - tok, JSON_PRIMITIVE);
+            if (ret) goto _done;
+            js->_state = _JS_BLANK; tok = NULL;
+        } break; /* the delimiter is processed below */
+
+        /* QUIRK comments */
+        case _JS_SLASH: {
+            if (*p == '/') js->_state = _JS_LINE;
+            else if (*p == '*') js->_state = _JS_BLOCK;
+            else goto _error;
+        } continue;
+
+        case _JS_LINE: {
+            if (! (p = memchr(p, '\n', end - p)) ) goto _done;
+            js->_state = _JS_BLANK;
+        } continue;
+
+        case _JS_BLOCK:
+        case _JS_STAR: {
+            if (*p == '/' && js->_state == _JS_STAR) js->_state = _JS_BLANK;
+            else js->_state = (*p == '*') ? _JS_STAR : _JS_BLOCK;
+        } continue;
+        }
+
+        /* between two tokens */
+        switch ( (class = _j[(uint8_t) *p]) ) {
+
+        case WHITE:
+        case SPACE: continue;
+
+        /* ', " */
+        case QUOTE: {
+            if (js->_strict && *p == '\'') {
+                debug("string_json_stream_parse(): strings must be enclosed "
+                      "in double-quotes.\n");
+                goto _error;
+            }
+
+            if (_json_stream_value(js, 1) == -1) goto _error;
+
+            js->_state = _JS_STRING; js->_quote = *p; tok = p + 1;
+        } continue;
+
+        /* {, [ */
+        case OBJ_START: {
+            ret = _json_stream_open(js, (*p == '{') ? JSON_OBJECT : JSON_ARRAY);
+            if (ret == -1) goto _error; else if (ret) goto _done;
+        } continue;
+
+        /* }, ] */
+        case OBJ_CLOSE: {
+            ret = _json_stream_close(js, (*p == '}') ? JSON_OBJECT : JSON_ARRAY);
+            if (ret == -1) goto _error; else if (ret) goto _done;
+        } continue;
+
+        case COMMA: {
+            if (js->_expect == _JS_NEXT) {
+                js->_keylen = 0;
+                js->_expect = (_JS_TOP(js) == JSON_OBJECT) ? _JS_KEY : _JS_VALUE;
+                continue;
+            }
+
+            /* QUIRK extra commas and missing values */
+            if (! js->_strict && js->_depth && js->_expect != _JS_COLON) {
+                js->_keylen = 0;
+                js->_expect = (_JS_TOP(js) == JSON_OBJECT) ? _JS_KEY : _JS_VALUE;
+                continue;
+            }
+        } goto _error;
+
+        case COLON: {
+            if (js->_expect != _JS_COLON) goto _error;
+            js->_expect = _JS_VALUE;
+        } continue;
+
+        case NON_PRINT:
+        case ESCAPESEQ: goto _error;
+
+        default: {
+            if (*p == '/' && ! js->_strict) {
+                js->_state = _JS_SLASH;
+                continue;
+            }
+
+            /* a number, a literal or an unquoted key */
+            if (_json_stream_value(js, 0) == -1) goto _error;
+
+            js->_state = _JS_PRIM; tok = p;
+        } continue;
+        }
+    }
+
+_pending:
+    /* keep the beginning of a pending token for the next chunk */
+    if (tok && js->_state >= _JS_STRING && js->_state <= _JS_PRIM &&
+        _json_stream_append(& js->_buf, & js->_buflen, & js->_bufalloc,
+                            tok, end - tok) == -1)
+        goto _error;
+
+    js->_offset += len;
+
+    return 0;
+
+_done:
+    js->_offset += len;
+
+    if (ret == 1) js->_state = _JS_STOP;
+    else if (ret == -1) goto _error;
+
+    return ret;
+
+_error:
+    debug("string_json_stream_parse(): illegal character \'%c\' at %lu.\n",
+          (p < end) ? *p : ' ', (unsigned long) (js->_offset + (p - data)));
+    js->_state = _JS_ERROR;
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_stream_end(m_json_stream *js)
+{
+    /** @brief signal the end of a JSON stream */
+
+    int ret = 0;
+
+    if (! js) {
+        debug("string_json_stream_end(): bad parameters.\n");
+        return -1;
+    }
+
+    /* a primitive may end with the stream */
+    if (js->_state == _JS_PRIM) {
+        ret = _json_stream_token(js, NULL, 0, JSON_PRIMITIVE);
+        if (! ret) js->_state = _JS_BLANK;
+    }
+
+    if (js->_state == _JS_ERROR) ret = -1;
+    else if (js->_state == _JS_STOP) ret = 1;
+    else if (! ret && (js->_depth || js->_expect != _JS_VALUE ||
+             (js->_state != _JS_BLANK && js->_state != _JS_LINE))) {
+        debug("string_json_stream_end(): incomplete input.\n");
+        ret = -1;
+    } else if (! ret && ! js->_seen) {
+        debug("string_json_stream_end(): empty input.\n");
+        ret = -1;
+    }
+
+    /* get ready for another stream */
+    js->_state = _JS_BLANK; js->_expect = _JS_VALUE; js->_seen = 0;
+    js->_depth = 0; js->_offset = 0;
+    js->_buflen = js->_keylen = 0;
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_stream *string_json_stream_free(m_json_stream *js)
+{
+    /** @brief destroy an incremental JSON parser */
+
+    if (! js) return NULL;
+
+    free(js->_buf); free(js->_key); free(js);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* number of index words kept on the stack, for documents up to 4KB */
+#define _JS_INDEX_LOCAL 64
+
+static inline unsigned int _json_ctz64(uint64_t x)
+{
+    #if defined(__GNUC__)
+    return __builtin_ctzll(x);
+    #else
+    return ((uint32_t) x) ? __ctz((uint32_t) x) :
+                            32 + __ctz((uint32_t) (x >> 32));
+    #endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline uint64_t _json_prefix_xor(uint64_t x)
+{
+    /* each bit becomes the parity of the bits up to its position, so that
+       the bits between an opening and a closing quote are set */
+    x ^= x << 1; x ^= x << 2; x ^= x << 4;
+    x ^= x << 8; x ^= x << 16; x ^= x << 32;
+
+    return x;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _json_index(const char *data, size_t len, uint64_t *index,
+                       uint64_t *escapes)
+{
+    /* first stage: mark the structural characters, the quotes delimiting
+       the strings and the first character of each primitive, 64 bytes at
+       a time and without any branch depending on the data. The blocks
+       with backslashes are also marked, so that only the strings they
+       contain have to be checked for valid escape sequences */
+
+    const uint64_t even = 0x5555555555555555ULL;
+    uint64_t bs = 0, follows = 0, odd = 0, seq = 0, escaped = 0, quote = 0;
+    uint64_t in = 0, scalar = 0, error = 0;
+    uint64_t prev_escaped = 0, prev_in = 0, prev_scalar = 0;
+    size_t i = 0, w = 0;
+    char tail[64];
+    const char *p = NULL;
+    __json_masks m;
+
+    for (i = 0; i < len; i += 64, w ++) {
+        p = data + i;
+
+        /* pad the last block with spaces */
+        if (len - i < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, p, len - i);
+            p = tail;
+        }
+
+        __simd_json_classify(_search_engine, p, & m);
+
+        /* escaped characters follow an odd sequence of backslashes */
+        bs = m.backslash & ~prev_escaped;
+        follows = (bs << 1) | prev_escaped;
+        odd = bs & ~even & ~follows;
+        seq = odd + bs;
+        prev_escaped = (seq < odd);
+        escaped = (even ^ (seq << 1)) & follows;
+
+        /* the characters within strings, including the opening quotes */
+        quote = m.quote & ~escaped;
+        in = _json_prefix_xor(quote) ^ prev_in;
+        prev_in = (uint64_t) ((int64_t) in >> 63);
+
+        /* control characters must be escaped in strings */
+        error |= m.control & in & ~quote;
+
+        if (m.backslash) escapes[w >> 6] |= (uint64_t) 1 << (w & 63);
+
+        /* primitives are the runs of other characters */
+        scalar = ~(m.structural | m.space | m.quote) & ~in;
+        index[w] = (m.structural & ~in) | quote |
+                   (scalar & ~((scalar << 1) | prev_scalar));
+        prev_scalar = scalar >> 63;
+    }
+
+    if (error || prev_in) {
+        debug("string_scan_json(): unterminated string or control "
+              "character.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _json_check_escapes(const char *p, size_t len)
+{
+    const char *end = p + len;
+
+    while ( (p = memchr(p, '\\', end - p)) ) {
+        if (++ p == end) return -1;
+
+        switch (*p) {
+        case '\"':
+        case  '/':
+        case '\\':
+        case  'b':
+        case  'f':
+        case  'n':
+        case  'r':
+        case  't': p ++; continue;
+        case  'u': if (end - p < 5 || ! isxdigit((unsigned char) p[1]) ||
+                       ! isxdigit((unsigned char) p[2]) ||
+                       ! isxdigit((unsigned char) p[3]) ||
+                       ! isxdigit((unsigned char) p[4]))
+                       return -1;
+                   p += 5; continue;
+        }
+
+        return -1;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_scan_json(const char *data, size_t len, char strict,
+                            m_json_parser *ctx)
+{
+    /** @brief parse a JSON document in two vectorized stages */
+
+    uint64_t local[_JS_INDEX_LOCAL + 1], *index = local, *escapes = NULL;
+    uint64_t bits = 0;
+    uint32_t stack[(JSON_STREAM_DEPTH + 31) / 32];
+    size_t words = 0, blocks = 0, w = 0, i = 0, j = 0, k = 0;
+    m_json_stream js, *stream = NULL;
+    int ret = 0;
+
+    if (! data && len) {
+        debug("string_scan_json(): bad parameters.\n");
+        return -1;
+    }
+
+    /* QUIRKS mode relies on the stateful parser */
+    if (! strict) {
+        if (! (stream = string_json_stream_alloc(0, 0, ctx)) ) return -1;
+        if (! (ret = string_json_stream_parse(stream, data, len)) )
+            ret = string_json_stream_end(stream);
+        string_json_stream_free(stream);
+        return ret;
+    }
+
+    if (_search_engine == -1) string_api_setup();
+
+    /* skip UTF-8 BOM if present */
+    if (len >= 3 && ! memcmp(data, "\xef\xbb\xbf", 3)) {
+        data += 3; len -= 3;
+    }
+
+    /* one bit per byte, then one bit per block of 64 bytes */
+    words = (len + 63) / 64; blocks = (words + 63) / 64;
+
+    if (words + blocks > _JS_INDEX_LOCAL + 1 &&
+        ! (index = malloc((words + blocks) * sizeof(*index))) ) {
+        perror(ERR(string_scan_json, malloc));
+        return -1;
+    }
+
+    escapes = index + words;
+    memset(escapes, 0, blocks * sizeof(*escapes));
+
+    memset(& js, 0, sizeof(js));
+    js._ctx = ctx; js._strict = 1; js._max = JSON_STREAM_DEPTH;
+    js._stack = stack;
+
+    if (_json_index(data, len, index, escapes) == -1) goto _error;
+
+    /* second stage: only visit the marked positions */
+
+    for (w = 0; w < words; w ++) {
+        bits = index[w];
+
+        while (bits) {
+            i = (w << 6) + _json_ctz64(bits);
+            bits &= bits - 1;
+
+            switch (data[i]) {
+            case '{': ret = _json_stream_open(& js, JSON_OBJECT); break;
+            case '[': ret = _json_stream_open(& js, JSON_ARRAY); break;
+            case '}': ret = _json_stream_close(& js, JSON_OBJECT); break;
+            case ']': ret = _json_stream_close(& js, JSON_ARRAY); break;
+
+            case ',': {
+                if (js._expect != _JS_NEXT) goto _error;
+                js._keylen = 0;
+                js._expect = (_JS_TOP(& js) == JSON_OBJECT) ? _JS_KEY :
+                                                              _JS_VALUE;
+            } continue;
+
+            case ':': {
+                if (js._expect != _JS_COLON) goto _error;
+                js._expect = _JS_VALUE;
+            } continue;
+
+            case '"': {
+                if (_json_stream_value(& js, 1) == -1) goto _error;
+
+                /* the next marked position is the closing quote */
+                while (! bits && ++ w < words) bits = index[w];
+                if (! bits) goto _error;
+
+                j = (w << 6) + _json_ctz64(bits);
+                bits &= bits - 1;
+
+                for (k = i >> 6; k <= j >> 6; k ++) {
+                    if (! (escapes[k >> 6] & ((uint64_t) 1 << (k & 63))))
+                        continue;
+                    if (_json_check_escapes(data + i + 1, j - i - 1) == -1) {
+                        debug("string_scan_json(): invalid escape "
+                              "sequence.\n");
+                        goto _error;
+                    }
+                    break;
+                }
+
+                /* the document is complete, keys are not copied */
+                if (js._iskey) {
+                    js._key = (char *) data + i + 1; js._keylen = j - i - 1;
+                    js._expect = _JS_COLON;
+                    continue;
+                }
+
+                ret = _json_stream_token(& js, data + i + 1, j - i - 1,
+                                         JSON_STRING);
+            } break;
+
+            default: {
+                /* a number or a literal, up to the end of its run */
+                if (_json_stream_value(& js, 0) == -1) goto _error;
+
+                for (j = i + 1; j < len; j ++) {
+                    switch (data[j]) {
+                    case '{': case '}': case '[': case ']': case ':':
+                    case ',': case '"': case ' ': case '\t': case '\r':
+                    case '\n': break;
+                    default: continue;
+                    }
+                    break;
+                }
+
+                ret = _json_stream_token(& js, data + i, j - i,
+                                         JSON_PRIMITIVE);
+            } break;
+            }
+
+            if (ret == -1) goto _error;
+            if (ret == 1) goto _done;
+        }
+    }
+
+    if (js._depth || js._expect != _JS_VALUE) {
+        debug("string_scan_json(): incomplete input.\n");
+        goto _error;
+    }
+
+    if (! js._seen) {
+        debug("string_scan_json(): empty input.\n");
+        goto _error;
+    }
+
+_done:
+    if (index != local) free(index);
+
+    return ret;
+
+_error:
+    if (index != local) free(index);
+
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static const char *_json_string_end(const char *p, const char *end)
+{
+    const char *q = NULL, *b = NULL;
+
+    /* the closing quote is not preceded by an odd number of backslashes */
+    while ( (q = memchr(p, '"', end - p)) ) {
+        for (b = q; b > p && b[-1] == '\\'; b --);
+        if (! ((q - b) & 1)) return q;
+        p = q + 1;
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static const char *_json_skip(const char *p, const char *end)
+{
+    /* find the end of a container without looking at its values, the
+       brackets must be balanced */
+    uint32_t stack[(JSON_STREAM_DEPTH + 31) / 32];
+    unsigned int depth = 0, bit = 0;
+
+    for ( ; p < end; p ++) {
+        switch (*p) {
+        case '"': if (! (p = _json_string_end(p + 1, end)) ) return NULL;
+                  break;
+        case '{':
+        case '[': if (depth == JSON_STREAM_DEPTH) return NULL;
+                  bit = 1U << (depth & 31);
+                  if (*p == '{') stack[depth >> 5] |= bit;
+                  else stack[depth >> 5] &= ~bit;
+                  depth ++; break;
+        case '}':
+        case ']': if (! depth) return NULL;
+                  depth --; bit = 1U << (depth & 31);
+                  if (! (stack[depth >> 5] & bit) != (*p == ']'))
+                      return NULL;
+                  if (! depth) return p + 1;
+                  break;
+        }
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline const char *_json_blank(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        p ++;
+
+    return p;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static const char *_json_node_value(m_json_node *node, const char *p,
+                                    const char *end)
+{
+    const char *q = NULL;
+
+    switch (*p) {
+    case '"': {
+        if (! (q = _json_string_end(p + 1, end)) ) return NULL;
+
+        if (memchr(p + 1, '\\', q - p - 1) &&
+            _json_check_escapes(p + 1, q - p - 1) == -1)
+            return NULL;
+
+        node->_data = p + 1; node->_len = q - p - 1;
+        node->_flags = JSON_STRING;
+    } return q + 1;
+
+    case '{':
+    case '[': {
+        if (! (q = _json_skip(p, end)) ) return NULL;
+
+        node->_data = p; node->_len = q - p; node->_resume = p + 1;
+        node->_flags = (*p == '{') ? JSON_OBJECT : JSON_ARRAY;
+    } return q;
+
+    default: {
+        for (q = p; q < end && ! _JS_DELIM(*q); q ++);
+
+        if (_json_stream_primitive(p, q - p, 1, 0) == -1) return NULL;
+
+        node->_data = p; node->_len = q - p;
+        node->_flags = JSON_PRIMITIVE;
+    } return q;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static m_json_node *_json_node_expand(m_json_doc *doc, m_json_node *node)
+{
+    /* expand the next child of a container */
+    const char *p = node->_resume, *end = node->_data + node->_len;
+    const char *key = NULL, *q = NULL;
+    m_json_node *child = NULL;
+    size_t keylen = 0;
+
+    if (! p) return NULL;
+
+    p = _json_blank(p, end);
+
+    if (p < end && *p == ((IS_OBJECT(node)) ? '}' : ']')) {
+        node->_resume = NULL;
+        return NULL;
+    }
+
+    if (node->parts) {
+        if (p == end || *p != ',') goto _error;
+        p = _json_blank(p + 1, end);
+    }
+
+    if (IS_OBJECT(node)) {
+        if (p == end || *p != '"' || ! (q = _json_string_end(p + 1, end)) )
+            goto _error;
+
+        key = p + 1; keylen = q - p - 1;
+
+        if (memchr(key, '\\', keylen) &&
+            _json_check_escapes(key, keylen) == -1)
+            goto _error;
+
+        p = _json_blank(q + 1, end);
+        if (p == end || *p != ':') goto _error;
+        p = _json_blank(p + 1, end);
+    }
+
+    if (p == end) goto _error;
+
+    if (! (child = _string_arena_alloc(& doc->_arena, sizeof(*child))) )
+        return NULL;
+
+    memset(child, 0, sizeof(*child));
+    child->key = key; child->keylen = keylen;
+
+    if (! (node->_resume = _json_node_value(child, p, end)) ) goto _error;
+
+    if (node->_last) node->_last->_next = child;
+    else node->_child = child;
+    node->_last = child; node->parts ++;
+
+    return child;
+
+_error:
+    debug("_json_node_expand(): invalid JSON.\n");
+    node->_flags |= _STRING_FLAG_ERRORS;
+    node->_resume = NULL;
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static uint32_t _json_hex4(const char *p)
+{
+    uint32_t v = 0;
+    unsigned int i = 0;
+
+    for (i = 0; i < 4; i ++)
+        v = (v << 4) | ((p[i] <= '9') ? p[i] - '0' : (p[i] | 0x20) - 'a' + 10);
+
+    return v;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _json_key_equal(const char *raw, size_t rawlen, const char *key,
+                           size_t len)
+{
+    /* compare an escaped key of the document with a decoded key */
+    const char *p = raw, *end = raw + rawlen, *k = key, *kend = key + len;
+    unsigned char c[4];
+    uint32_t cp = 0, lo = 0;
+    size_t n = 0;
+
+    while (p < end) {
+        if (*p != '\\') {
+            if (k == kend || *k != *p) return 0;
+            p ++; k ++;
+            continue;
+        }
+
+        /* the escape sequences were checked when the key was expanded */
+        switch (*(++ p)) {
+        case 'b': c[0] = '\b'; n = 1; break;
+        case 'f': c[0] = '\f'; n = 1; break;
+        case 'n': c[0] = '\n'; n = 1; break;
+        case 'r': c[0] = '\r'; n = 1; break;
+        case 't': c[0] = '\t'; n = 1; break;
+        case 'u': {
+            cp = _json_hex4(p + 1); p += 4;
+
+            /* surrogate pair */
+            if (cp >= 0xD800 && cp < 0xDC00 && end - p > 6 &&
+                p[1] == '\\' && p[2] == 'u' &&
+                (lo = _json_hex4(p + 3)) >= 0xDC00 && lo < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                p += 6;
+            }
+
+            /* encode the code point in UTF-8 */
+            if (cp < 0x80) { c[0] = cp; n = 1; }
+            else if (cp < 0x800) {
+                c[0] = 0xC0 | (cp >> 6); c[1] = 0x80 | (cp & 0x3F); n = 2;
+            } else if (cp < 0x10000) {
+                c[0] = 0xE0 | (cp >> 12); c[1] = 0x80 | ((cp >> 6) & 0x3F);
+                c[2] = 0x80 | (cp & 0x3F); n = 3;
+            } else {
+                c[0] = 0xF0 | (cp >> 18); c[1] = 0x80 | ((cp >> 12) & 0x3F);
+                c[2] = 0x80 | ((cp >> 6) & 0x3F); c[3] = 0x80 | (cp & 0x3F);
+                n = 4;
+            }
+        } break;
+        default: c[0] = *p; n = 1; /* " / \ */
+        }
+
+        p ++;
+
+        if ((size_t) (kend - k) < n || memcmp(k, c, n)) return 0;
+        k += n;
+    }
+
+    return (k == kend);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_doc *string_json_doc_alloc(const m_string *s)
+{
+    /** @brief create a lazy JSON document */
+
+    m_json_doc *doc = NULL;
+    const char *p = NULL, *q = NULL, *end = NULL;
+
+    if (! s || ! s->_data) {
+        debug("string_json_doc_alloc(): bad parameters.\n");
+        return NULL;
+    }
+
+    if (! (doc = malloc(sizeof(*doc))) ) {
+        perror(ERR(string_json_doc_alloc, malloc));
+        return NULL;
+    }
+
+    memset(doc, 0, sizeof(*doc));
+    doc->_arena._size = STRING_ARENA_BLOCK;
+
+    p = s->_data; end = doc->_end = s->_data + s->_len;
+
+    /* skip UTF-8 BOM if present */
+    if (s->_len >= 3 && ! memcmp(p, "\xef\xbb\xbf", 3)) p += 3;
+
+    p = _json_blank(p, end);
+
+    /* an empty document has no root */
+    if (p == end) return doc;
+
+    if (*p == '{' || *p == '[') {
+        /* nothing but blanks may follow the root container */
+        if (! (q = _json_skip(p, end)) || _json_blank(q, end) != end)
+            goto _error;
+
+        doc->_root._data = p; doc->_root._len = q - p;
+        doc->_root._resume = p + 1;
+        doc->_root._flags = (*p == '{') ? JSON_OBJECT : JSON_ARRAY;
+    } else if (! (p = _json_node_value(& doc->_root, p, end)) ||
+               _json_blank(p, end) != end)
+        goto _error;
+
+    return doc;
+
+_error:
+    debug("string_json_doc_alloc(): invalid JSON document.\n");
+    free(doc);
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_doc *string_json_doc_free(m_json_doc *doc)
+{
+    /** @brief destroy a lazy JSON document */
+
+    void **block = NULL, **b = NULL;
+
+    if (! doc) return NULL;
+
+    for (block = doc->_arena._block; block; block = b) {
+        b = *block; free(block);
+    }
+
+    free(doc);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_root(m_json_doc *doc)
+{
+    /** @brief get the top-level value of a lazy JSON document */
+
+    if (! doc) {
+        debug("string_json_root(): bad parameters.\n");
+        return NULL;
+    }
+
+    return (doc->_root._flags & JSON_TYPE) ? & doc->_root : NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_next(m_json_doc *doc, m_json_node *node,
+                                     m_json_node *child)
+{
+    /** @brief iterate over the children of a lazy JSON node */
+
+    if (! doc || ! node) {
+        debug("string_json_next(): bad parameters.\n");
+        return NULL;
+    }
+
+    if (! IS_TYPE(node, JSON_OBJECT | JSON_ARRAY)) return NULL;
+
+    child = (child) ? child->_next : node->_child;
+
+    return (child) ? child : _json_node_expand(doc, node);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_child(m_json_doc *doc, m_json_node *node,
+                                      const char *key, size_t len)
+{
+    /** @brief look a key up in a lazy JSON object */
+
+    m_json_node *child = NULL;
+
+    if (! doc || ! node || (! key && len)) {
+        debug("string_json_child(): bad parameters.\n");
+        return NULL;
+    }
+
+    if (! IS_OBJECT(node)) return NULL;
+
+    /* the children already expanded, then the next ones */
+    while ( (child = string_json_next(doc, node, child)) ) {
+        if (child->keylen < len) continue;
+
+        if (memchr(child->key, '\\', child->keylen)) {
+            if (_json_key_equal(child->key, child->keylen, key, len))
+                return child;
+        } else if (child->keylen == len && ! memcmp(child->key, key, len))
+            return child;
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_at(m_json_doc *doc, m_json_node *node,
+                                   unsigned int index)
+{
+    /** @brief get a value of a lazy JSON array */
+
+    m_json_node *child = NULL;
+
+    if (! doc || ! node) {
+        debug("string_json_at(): bad parameters.\n");
+        return NULL;
+    }
+
+    if (! IS_ARRAY(node)) return NULL;
+
+    while ( (child = string_json_next(doc, node, child)) && index)
+        index --;
+
+    return child;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_path *string_json_path_compile(const char *pointer)
+{
+    /** @brief compile a JSON pointer */
+
+    m_json_path *path = NULL;
+    unsigned int count = 0, i = 0;
+    size_t size = 0, j = 0;
+    const char *p = NULL;
+    char *w = NULL;
+    long index = 0;
+
+    if (! pointer || (*pointer && *pointer != '/')) {
+        debug("string_json_path_compile(): bad parameters.\n");
+        return NULL;
+    }
+
+    for (p = pointer; *p; p ++) count += (*p == '/');
+
+    size = sizeof(*path) + ((count) ? count - 1 : 0) * sizeof(path->_segment);
+
+    /* the decoded segments follow the path */
+    if (! (path = malloc(size + strlen(pointer))) ) {
+        perror(ERR(string_json_path_compile, malloc));
+        return NULL;
+    }
+
+    path->_count = count;
+    w = (char *) path + size;
+
+    for (p = pointer, i = 0; i < count; i ++) {
+        path->_segment[i].key = w;
+
+        for (p ++; *p && *p != '/'; p ++) {
+            if (*p != '~') { *w ++ = *p; continue; }
+            /* ~0 is ~, ~1 is / */
+            if (p[1] == '0') *w ++ = '~';
+            else if (p[1] == '1') *w ++ = '/';
+            else goto _error;
+            p ++;
+        }
+
+        path->_segment[i].len = w - path->_segment[i].key;
+        path->_segment[i].index = -1;
+
+        /* array indexes have no leading zero */
+        if (! path->_segment[i].len || path->_segment[i].len > 9 ||
+            (path->_segment[i].key[0] == '0' && path->_segment[i].len > 1))
+            continue;
+
+        for (j = 0, index = 0; j < path->_segment[i].len; j ++) {
+            if (! isdigit((unsigned char) path->_segment[i].key[j])) break;
+            index = index * 10 + path->_segment[i].key[j] - '0';
+        }
+
+        if (j == path->_segment[i].len) path->_segment[i].index = index;
+    }
+
+    return path;
+
+_error:
+    debug("string_json_path_compile(): invalid escape sequence.\n");
+    free(path);
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_path *string_json_path_free(m_json_path *path)
+{
+    /** @brief destroy a compiled JSON pointer */
+
+    free(path);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_lookup(m_json_doc *doc,
+                                       const m_json_path *path)
+{
+    /** @brief look a compiled JSON pointer up in a lazy JSON document */
+
+    m_json_node *node = NULL;
+    unsigned int i = 0;
+
+    if (! doc || ! path) {
+        debug("string_json_lookup(): bad parameters.\n");
+        return NULL;
+    }
+
+    node = string_json_root(doc);
+
+    for (i = 0; node && i < path->_count; i ++) {
+        if (IS_OBJECT(node))
+            node = string_json_child(doc, node, path->_segment[i].key,
+                                     path->_segment[i].len);
+        else if (IS_ARRAY(node) && path->_segment[i].index != -1)
+            node = string_json_at(doc, node, path->_segment[i].index);
+        else node = NULL;
+    }
+
+    return node;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_get(m_json_doc *doc, const char *pointer)
+{
+    /** @brief look a JSON pointer up in a lazy JSON document */
+
+    m_json_path *path = NULL;
+    m_json_node *ret = NULL;
+
+    if (! (path = string_json_path_compile(pointer)) ) return NULL;
+
+    ret = string_json_lookup(doc, path);
+
+    string_json_path_free(path);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_integer(const m_json_node *node, int64_t *value)
+{
+    /** @brief decode an integer of a lazy JSON document */
+
+    const char *p = NULL, *end = NULL;
+    uint64_t u = 0, max = INT64_MAX;
+    int neg = 0;
+
+    if (! node || ! value) {
+        debug("string_json_integer(): bad parameters.\n");
+        return -1;
+    }
+
+    if (! IS_PRIMITIVE(node) || ! node->_len) return -1;
+
+    p = node->_data; end = p + node->_len;
+
+    if (*p == '-') { neg = 1; max ++; p ++; }
+
+    if (p == end) return -1;
+
+    for ( ; p < end; p ++) {
+        if (*p < '0' || *p > '9') return -1;
+        if (u > (max - (*p - '0')) / 10) return -1;
+        u = u * 10 + (*p - '0');
+    }
+
+    *value = (neg) ? (int64_t) (0 - u) : (int64_t) u;
+
+    return 0;
+}
 
-            /* unexpected char */
-            default: goto _error;
-            }
-        } break;
+/* -------------------------------------------------------------------------- */
 
-        case NON_PRINT: goto _error;
+public int string_json_number(const m_json_node *node, double *value)
+{
+    /** @brief decode a number of a lazy JSON document */
 
-        /* \t, \r, \n, 0x20 */
-        case WHITE: if (strict && IS_STRING(json)) goto _error;
-        case SPACE: if (likely(IS_PRIMITIVE(json))) {
-            if (state & _VAL) {
-                debug("string_parse_json(): incomplete primitive.\n");
-                goto _error;
-            }
+    const char *p = NULL, *end = NULL;
+    uint64_t m = 0;
+    int exp = 0, e = 0, digits = 0, neg = 0, eneg = 0;
+    char buffer[64];
 
-            /* QUIRK unquoted keys */
-            json->_flags = (json->_flags & ~JSON_TYPE) |
-                           (-(state & _BUG) & JSON_STRING) |
-                           (-(! (state & _BUG)) & JSON_PRIMITIVE);
-            state = (state & ~_KEY) | (-(IS_STRING(json) > 0) & _KEY);
-            state &= ~_BUG;
-            leading_digit = 0;
-            json->_len = json->_alloc = pos;
-            goto _delim;
-            break;
-        } break;
+    if (! node || ! value) {
+        debug("string_json_number(): bad parameters.\n");
+        return -1;
+    }
 
-        /* f, n, t */
-        case PRIMITIVE: if (likely(! IS_PRIMITIVE(json))) {
-            if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
-                if (state & _KEY) {
-                    /* QUIRK unquoted keys */
-                    if (! strict) {
-                        json = string_add_token(json, pos, SIZE(json));
-                        if (unlikely(! json)) goto _nomem;
+    if (! IS_PRIMITIVE(node) || ! node->_len ||
+        _json_stream_primitive(node->_data, node->_len, 1, 0) == -1 ||
+        ! (*node->_data == '-' || isdigit((unsigned char) *node->_data)))
+        return -1;
 
-                        json->_flags &= ~JSON_TYPE;
-                        json->_flags |= JSON_PRIMITIVE;
-                        pos = 0; state &= ~(_KEY | _VAL); state |= _BUG;
-                        break;
-                    }
+    p = node->_data; end = p + node->_len;
 
-                    debug("string_parse_json(): a key must be "
-                          "enclosed in quotation marks.\n");
-                    goto _error;
-                }
+    if (*p == '-') { neg = 1; p ++; }
 
-                if ((state & _VAL) == 0) {
-                    debug("string_parse_json(): unexpected primitive.\n");
-                    goto _error;
-                }
-            }
+    for ( ; p < end && isdigit((unsigned char) *p); p ++, digits ++)
+        m = m * 10 + (*p - '0');
 
-            switch (*p) {
-            case 'f': if (memcmp(p + 1, "alse", MIN(SIZE(json) - pos, 4)))
-                          goto _error; p += 4; break;
-            case 'n': if (memcmp(p + 1, "ull", MIN(SIZE(json) - pos, 3)))
-                          goto _error; p += 3; break;
-            case 't': if (memcmp(p + 1, "rue", MIN(SIZE(json) - pos, 3)))
-                          goto _error; p += 3; break;
-            default:  goto _error;
-            }
+    if (p < end && *p == '.') {
+        for (p ++; p < end && isdigit((unsigned char) *p); p ++, digits ++) {
+            m = m * 10 + (*p - '0'); exp --;
+        }
+    }
 
-            state &= ~(_VAL | _RAD | _EXP | _SIG);
+    if (p < end) {
+        if (*(++ p) == '-') { eneg = 1; p ++; } else if (*p == '+') p ++;
+        for ( ; p < end && e < 10000; p ++) e = e * 10 + (*p - '0');
+        exp += (eneg) ? -e : e;
+    }
 
-            json = string_add_token(json, pos, SIZE(json));
-            if (unlikely(! json)) goto _nomem;
+    /* correctly rounded when the digits fit in 64 bits */
+    if (digits <= 19 && float_decimal(m, exp, neg, value) == 0) return 0;
 
-            json->_flags &= ~JSON_TYPE; json->_flags |= JSON_PRIMITIVE;
+    /* C library for the rest */
+    if (node->_len >= sizeof(buffer)) return -1;
 
-            pos = p - DATA(json);
+    memcpy(buffer, node->_data, node->_len); buffer[node->_len] = '\0';
 
-            goto _token;
-        } else if (state & _BUG) break; goto _error; /* QUIRK unquoted keys */
+    *value = strtod(buffer, NULL);
 
-        /* e, E */
-        case DIGIT_EXP: {
-            /* exponent cannot be placed right after a radix point */
-            if ((state & _RAD) && p[-1] == '.') {
-                debug("string_parse_json(): a fractional part is expected.\n");
-                goto _error;
-            }
+    return 0;
+}
 
-            /* NOTE while it would seem more intuitive to check if a previous
-                    exponent was set first, leading_digit may not be in cache
-                    and accessing it below helps avoiding an expensive stall */
-            if ((state & _EXP) || leading_digit == 0) {
-                /* QUIRK unquoted keys */
-                if (! strict) {
-                    if (state & _KEY) {
-                        json = string_add_token(json, pos, SIZE(json));
-                        if (unlikely(! json)) goto _nomem;
+/* -------------------------------------------------------------------------- */
 
-                        json->_flags &= ~JSON_TYPE;
-                        json->_flags |= JSON_PRIMITIVE;
-                        pos = 0; state &= ~(_KEY | _VAL); state |= _BUG;
-                        break;
-                    } else if ((state & _BUG) && (IS_PRIMITIVE(json)))
-                        break;
-                }
+static char *_json_writer_value(m_string_writer *w, size_t n, int key)
+{
+    /* reserve room for a value or a key and its separator */
+    unsigned int top = w->_depth - 1;
+    char *out = NULL;
+    int object = 0;
 
-                debug("string_parse_json(): unexpected exponent.\n");
-                goto _error;
-            }
+    object = w->_depth && (w->_stack[top >> 5] & (1U << (top & 31)));
 
-            state &= ~_SIG;
-            state |= (_EXP | _VAL);
-        } break;
+    /* keys only go in objects, where each value follows its own key */
+    if ((key) ? (! object || w->_key) : (object && ! w->_key)) {
+        debug("_json_writer_value(): misplaced JSON %s.\n",
+              (key) ? "key" : "value");
+        return NULL;
+    }
 
-        /* . */
-        case DIGIT_RAD: {
-            if (unlikely(leading_digit == 0) || (state & (_RAD | _EXP))) {
-                debug("string_parse_json(): unexpected decimal separator.\n");
-                goto _error;
-            }
+    if (_string_writer_reserve(w, n + 1) == -1) return NULL;
 
-            state &= ~_SIG; state |= _RAD;
+    out = w->_out->_data + w->_out->_len;
 
-            {   /* optimize for large numbers */
-                uint32_t prefetch;
-                if (likely(pos + 1 + sizeof(prefetch) < SIZE(json))) {
-                    memcpy(& prefetch, p + 1, sizeof(prefetch));
-                    prefetch = __more(prefetch, '9') | __less(prefetch, '0');
-                    if ( (prefetch = __zero_idx(prefetch)) ) {
-                        pos += prefetch; break;
-                    }
-                }
-            }
+    if (w->_comma) { *out ++ = ','; _string_writer_commit(w, 1); }
+    w->_comma = 1; w->_key = key;
 
-            /* QUIRK omitted fractional part */
-            state |= (-(strict) & _VAL);
-        } break;
+    return out;
+}
 
-        /* + */
-        case DIGIT_POS: if ((state & (_SIG | _EXP | _VAL)) != (_EXP | _VAL)) {
-            debug("string_parse_json(): unexpected plus sign.\n");
-            goto _error;
-        } else state |= (_SIG | _VAL); break;
+/* -------------------------------------------------------------------------- */
 
-        /* - */
-        case DIGIT_NEG: {
-            if (likely(! IS_PRIMITIVE(json))) {
-                if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
-                    if (state & _KEY) {
-                        debug("string_parse_json(): a key must be "
-                              "enclosed in quotation marks.\n");
-                        goto _error;
-                    }
+static int _json_writer_begin(m_string_writer *w, int type)
+{
+    unsigned int bit = 0;
+    char *out = NULL;
 
-                    if ((state & _VAL) == 0) {
-                        debug("string_parse_json(): unexpected "
-                              "negative primitive.\n");
-                        goto _error;
-                    }
-                }
+    if (! w) {
+        debug("string_json_begin(): bad parameters.\n");
+        return -1;
+    }
 
-                json = string_add_token(json, pos, SIZE(json));
-                if (unlikely(! json)) goto _nomem;
+    if (w->_depth == STRING_WRITER_DEPTH) {
+        debug("string_json_begin(): too many nested levels.\n");
+        return -1;
+    }
 
-                json->_flags &= ~JSON_TYPE; json->_flags |= JSON_PRIMITIVE;
-                pos = 0; state &= ~(_RAD | _EXP); leading_digit = 0;
-            } else if ((state & (_SIG | _EXP | _VAL)) != (_EXP | _VAL)) {
-                debug("string_parse_json(): unexpected minus sign.\n");
-                goto _error;
-            }
+    if (! (out = _json_writer_value(w, 1, 0)) ) return -1;
 
-            state |= _SIG;
-        } break;
+    *out = (type == JSON_OBJECT) ? '{' : '[';
+    _string_writer_commit(w, 1);
 
-        /* 0-9 */
-        case DIGIT: if (likely(leading_digit)) {
-            if (leading_digit == '0') {
-                if ((state & (_RAD | _EXP)) == 0) {
-                    debug("string_parse_json(): octal integers "
-                          "are not supported.\n");
-                    goto _error;
-                }
-                leading_digit = 1;
-            }
+    bit = 1U << (w->_depth & 31);
+    if (type == JSON_OBJECT) w->_stack[w->_depth >> 5] |= bit;
+    else w->_stack[w->_depth >> 5] &= ~bit;
+    w->_depth ++; w->_comma = 0;
 
-            state &= ~_VAL;
+    return 0;
+}
 
-            {   /* optimize for large numbers */
-                uint32_t prefetch;
-                if (likely(pos + 1 + sizeof(prefetch) < SIZE(json))) {
-                    memcpy(& prefetch, p + 1, sizeof(prefetch));
-                    prefetch = __more(prefetch, '9') | __less(prefetch, '0');
-                    pos += __zero_idx(prefetch);
-                }
-            }
-        } else {
-            leading_digit = *p;
+/* -------------------------------------------------------------------------- */
 
-            if (likely(! IS_PRIMITIVE(json))) {
-                if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
-                    if (state & _KEY) {
-                        /* QUIRK unquoted keys */
-                        if (! strict) {
-                            json = string_add_token(json, pos, SIZE(json));
-                            if (unlikely(! json)) goto _nomem;
+public int string_json_begin_object(m_string_writer *w)
+{
+    /** @brief open a JSON object */
 
-                            json->_flags &= ~JSON_TYPE;
-                            json->_flags |= JSON_PRIMITIVE;
-                            pos = 0; state &= ~(_KEY | _VAL); state |= _BUG;
-                            break;
-                        }
+    return _json_writer_begin(w, JSON_OBJECT);
+}
 
-                        debug("string_parse_json(): a key must be a "
-                              "string enclosed in quotation marks.\n");
-                        goto _error;
-                    }
+/* -------------------------------------------------------------------------- */
 
-                    if ((state & _VAL) == 0) {
-                        debug("string_parse_json(): unexpected "
-                              "numeric primitive.\n");
-                        goto _error;
-                    }
-                }
+public int string_json_begin_array(m_string_writer *w)
+{
+    /** @brief open a JSON array */
 
-                state &= ~(_VAL | _RAD | _EXP | _SIG);
+    return _json_writer_begin(w, JSON_ARRAY);
+}
 
-                json = string_add_token(json, pos, SIZE(json));
-                if (unlikely(! json)) goto _nomem;
+/* -------------------------------------------------------------------------- */
 
-                json->_flags &= ~JSON_TYPE; json->_flags |= JSON_PRIMITIVE;
+public int string_json_end(m_string_writer *w)
+{
+    /** @brief close the innermost JSON object or array */
 
-                pos = 0;
-            } else state &= ~_VAL;
-        } break;
+    if (! w || ! w->_depth) {
+        debug("string_json_end(): bad parameters.\n");
+        return -1;
+    }
 
-        /* , */
-        case COMMA: {
-            if (strict && unlikely(state & _VAL)) {
-                debug("string_parse_json(): a value is expected.\n");
-                goto _error;
-            }
+    if (w->_key) {
+        debug("string_json_end(): the last key has no value.\n");
+        return -1;
+    }
 
-            if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
-                state = (state & ~_KEY) | (-(IS_OBJECT(json) > 0) & _KEY);
-                state |= _VAL;
+    if (_string_writer_reserve(w, 1) == -1) return -1;
 
-                /* skip space */
-                pos += likely(p[1] == ' ');
+    w->_depth --;
+    w->_out->_data[w->_out->_len] =
+        (w->_stack[w->_depth >> 5] & (1U << (w->_depth & 31))) ? '}' : ']';
+    _string_writer_commit(w, 1);
+    w->_comma = 1;
 
-                break;
-            }
+    return 0;
+}
 
-            if (IS_PRIMITIVE(json)) {
-                pos --; leading_digit = 0;
-                goto _token;
-            }
+/* -------------------------------------------------------------------------- */
 
-            if (strict) {
-                debug("string_parse_json(): comma-separated lists "
-                      "must be enclosed in brackets.\n");
-                goto _error;
+static int _json_writer_escape(m_string_writer *w, const char *data,
+                               size_t len)
+{
+    const char *p = data, *end = data + len, *q = NULL;
+    char *out = NULL;
+    uint8_t c = 0;
+
+    /* copy the runs of regular characters, escape the others */
+    do {
+        if (! (q = __simd_find_escape(_search_engine, p, end - p)) ) q = end;
+
+        /* room for the run and one escape sequence */
+        if (_string_writer_reserve(w, (q - p) + 7) == -1) return -1;
+
+        out = w->_out->_data + w->_out->_len;
+        memcpy(out, p, q - p); out += q - p;
+
+        if (q < end) {
+            *out ++ = '\\';
+            switch ( (c = (uint8_t) *q) ) {
+            case '"':  *out ++ = '"'; break;
+            case '\\': *out ++ = '\\'; break;
+            case '\b': *out ++ = 'b'; break;
+            case '\f': *out ++ = 'f'; break;
+            case '\n': *out ++ = 'n'; break;
+            case '\r': *out ++ = 'r'; break;
+            case '\t': *out ++ = 't'; break;
+            default:   memcpy(out, "u00", 3); out += 3;
+                       *out ++ = "0123456789abcdef"[c >> 4];
+                       *out ++ = "0123456789abcdef"[c & 0xf];
             }
-        } break;
+            q ++;
+        }
+
+        _string_writer_commit(w, out - (w->_out->_data + w->_out->_len));
+        p = q;
+    } while (p < end);
+
+    return 0;
+}
 
-        /* : */
-        case COLON: {
-            if (unlikely((state & (_KEY | _VAL)) != _KEY)) {
+/* -------------------------------------------------------------------------- */
 
-                /* QUIRK unquoted keys */
-                if (! strict && IS_PRIMITIVE(json)) {
-                    pos --; leading_digit = 0;
-                    state |= _KEY; state &= ~_BUG;
-                    json->_flags &= ~JSON_TYPE;
-                    json->_flags |= JSON_STRING;
-                    goto _token;
-                }
+public int string_json_key(m_string_writer *w, const char *key, size_t len)
+{
+    /** @brief write the key of the next JSON value */
 
-                if (! IS_OBJECT(json))
-                    debug("string_parse_json(): key/value pairs are only "
-                          "allowed in objects.\n");
-                else debug("string_parse_json(): missing or malformed key.\n");
+    char *out = NULL;
 
-                goto _error;
-            }
+    if (! w || (! key && len)) {
+        debug("string_json_key(): bad parameters.\n");
+        return -1;
+    }
 
-            state &= ~_KEY; state |= _VAL;
+    if (! (out = _json_writer_value(w, len + 3, 1)) ) return -1;
 
-            /* skip space */
-            pos += likely(p[1] == ' ');
+    *out = '"'; _string_writer_commit(w, 1);
 
-            /* parser callback */
-            if (ctx) {
-                ctx->key.current = DATA(LAST_TOKEN(json));
-                ctx->key.len = SIZE(LAST_TOKEN(json));
-            }
-        } break;
+    if (len && _json_writer_escape(w, key, len) == -1) return -1;
 
-        /* {, [ */
-        case OBJ_START: {
-            if (unlikely(state & _KEY)) {
-                debug("string_parse_json(): opening bracket where "
-                      "a key was expected.\n");
-                goto _error;
-            }
+    if (_string_writer_reserve(w, 2) == -1) return -1;
 
-            if ((state & _VAL) == 0 && json->parent) {
-                debug("string_parse_json(): unexpected opening "
-                      "bracket.\n");
-                goto _error;
-            }
+    memcpy(w->_out->_data + w->_out->_len, "\":", 2);
+    _string_writer_commit(w, 2);
+    w->_comma = 0;
 
-            json = string_add_token(json, pos, SIZE(json));
-            if (unlikely(! json)) goto _nomem;
+    return 0;
+}
 
-            /* try to prealloc tokens */
-            if (likely(json->token = malloc(prealloc * sizeof(*json->token))))
-                json->_parts_alloc = prealloc;
+/* -------------------------------------------------------------------------- */
 
-            pos = (*p == '{');
+public int string_json_str(m_string_writer *w, const char *data, size_t len)
+{
+    /** @brief write an escaped JSON string */
 
-            json->_flags &= ~JSON_TYPE;
-            json->_flags |= (-(pos) & JSON_OBJECT) | (-(! pos) & JSON_ARRAY);
-            json->_flags |= _STRING_FLAG_ERRORS;
+    char *out = NULL;
 
-            state = (state & ~_KEY) | (-(pos) & _KEY) | _VAL;
+    if (! w || (! data && len)) {
+        debug("string_json_str(): bad parameters.\n");
+        return -1;
+    }
 
-            /* skip space */
-            pos = (p[1] == ' ');
+    if (! (out = _json_writer_value(w, len + 2, 0)) ) return -1;
 
-            /* parser callback */
-            if (ctx && ctx->init) {
-                if (json->parent)
-                    ctx->parent = json->parent->_flags & JSON_TYPE;
-                else ctx->parent = 0;
+    *out = '"'; _string_writer_commit(w, 1);
 
-                if (ctx->init(json->_flags & JSON_TYPE, ctx) == 1)
-                    return 0;
+    if (len && _json_writer_escape(w, data, len) == -1) return -1;
 
-                ctx->key.current = NULL; ctx->key.len = 0;
-            }
-        } break;
+    if (_string_writer_reserve(w, 1) == -1) return -1;
 
-        /* }, ] */
-        case OBJ_CLOSE: {
-            if (strict) {
-                if ((state & _KEY) && json->parts & 0x1) {
-                    debug("string_parse_json(): a key is expected.\n");
-                    goto _error;
-                }
+    w->_out->_data[w->_out->_len] = '"';
+    _string_writer_commit(w, 1);
 
-                if ((state & _VAL) && json->parts) {
-                    debug("string_parse_json(): a value is expected.\n");
-                    goto _error;
-                }
-            }
+    return 0;
+}
 
-            if ((state & _VAL) && ! IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
-                debug("string_parse_json(): a value is expected.\n");
-                goto _error;
-            }
+/* -------------------------------------------------------------------------- */
 
-            state &= ~(_KEY | _VAL);
-            prealloc = json->parts;
+public int string_json_int(m_string_writer *w, int64_t value)
+{
+    /** @brief write a JSON integer */
 
-            /* NOTE checking in that order helps avoiding a costly stall */
-            if (IS_PRIMITIVE(json)) {
-                if (IS_TYPE(json->parent, JSON_ARRAY | JSON_OBJECT)) {
-                    pos --; leading_digit = 0;
-                    goto _token;
-                }
-            } else if (IS_TYPE(json, JSON_ARRAY | JSON_OBJECT)) {
-                /* check if the brackets are matching */
-                if (*json->_data == *p - 2) goto _token;
+    char *out = NULL;
 
-                debug("string_parse_json(): mismatched bracket (%c).\n",
-                      *json->_data);
-                goto _error;
-            }
+    if (! w) {
+        debug("string_json_int(): bad parameters.\n");
+        return -1;
+    }
 
-            /* a closing bracket must be within an array or object */
-            debug("string_parse_json(): stray closing bracket.\n");
-            goto _error;
-        } break;
+    if (! (out = _json_writer_value(w, _WRITER_NUMBER, 0)) ) return -1;
 
-        case ASCII: if (strict)
+    _string_writer_commit(w, _string_i64toa(value, out));
 
-        default: goto _error;
+    return 0;
+}
 
-        /* QUIRK comments */
-        if (*p == '/') {
-            if (IS_PRIMITIVE(json)) {
-                leading_digit = 0; pos --;
-                if (state & _BUG) {
-                    state |= _KEY; state &= ~_BUG;
-                    json->_flags &= ~JSON_TYPE;
-                    json->_flags |= JSON_STRING;
-                }
-                goto _token;
-            }
+/* -------------------------------------------------------------------------- */
 
-            if (*++ p == '/') {
-                do {
-                    uint32_t prefetch;
-                    memcpy(& prefetch, p, sizeof(prefetch));
-                    if (__zero(prefetch ^ 0x0a0a0a0aU)) {
-                        while (*p ++ != '\n');
-                        p --; break;
-                    }
-                    p += sizeof(prefetch);
-                } while (p < DATA(json) + SIZE(json));
-            } else if (*p ++ == '*') {
-                do {
-                    uint32_t prefetch;
-                    memcpy(& prefetch, p, sizeof(prefetch));
-                    if (__zero(prefetch ^ 0x2a2a2a2aU)) {
-                        while (*p ++ != '*');
-                        if (*p == '/') break;
-                    } else p += sizeof(prefetch);
-                } while (p < DATA(json) + SIZE(json));
-            }
+public int string_json_double(m_string_writer *w, double value)
+{
+    /** @brief write a JSON number */
 
-            if ((p - DATA(json)) - pos > 2) {
-                pos = p - DATA(json); break;
-            } else goto _error;
-        }
+    char *out = NULL;
+    size_t n = 0;
 
-        /* QUIRK unquoted keys */
-        if (state & _KEY) {
-            json = string_add_token(json, pos, SIZE(json));
-            if (unlikely(! json)) goto _nomem;
+    if (! w) {
+        debug("string_json_double(): bad parameters.\n");
+        return -1;
+    }
 
-            json->_flags &= ~JSON_TYPE; json->_flags |= JSON_PRIMITIVE;
-            pos = 0; state &= ~(_KEY | _VAL); state |= _BUG;
-            break;
-        } else if ((state & _BUG) && (IS_PRIMITIVE(json))) break;
+    if (! (out = _json_writer_value(w, _WRITER_NUMBER, 0)) ) return -1;
 
-        /* QUIRK hexadecimal numbers */
-        if (json->_data[pos] == 'x') {
-            if (leading_digit != '0' || ++ pos > 2) goto _error;
+    if (value != value || value - value != 0) {
+        memcpy(out, "null", 4); n = 4;
+    } else if (! (n = _string_dtoa(value, out)) ) return -1;
 
-            do {
-                uint32_t prefetch;
-                memcpy(& prefetch, json->_data + pos, sizeof(prefetch));
-                if (__less(prefetch, '0') || __more(prefetch, 'f'))
-                    break;
-                if (__between(prefetch, '9', 'A'))
-                    break;
-                if (__between(prefetch, 'F', 'a'))
-                    break;
-                pos += sizeof(prefetch);
-            } while (pos < 18); /* 64 bits */
+    _string_writer_commit(w, n);
 
-            /* check the next characters */
-            while (pos < 18) {
-                if (json->_data[pos] < '0' || json->_data[pos] > 'f')
-                    break;
-                if (json->_data[pos] > '9' && json->_data[pos] < 'A')
-                    break;
-                if (json->_data[pos] > 'F' && json->_data[pos] < 'a')
-                    break;
-                pos ++;
-            }
+    return 0;
+}
 
-            /* '0x' without digits is not allowed */
-            if (-- pos == 1) goto _error;
+/* -------------------------------------------------------------------------- */
 
-            break;
-        }
+public int string_json_bool(m_string_writer *w, int value)
+{
+    /** @brief write a JSON boolean */
 
-        goto _error;
+    return string_json_raw(w, (value) ? "true" : "false", (value) ? 4 : 5);
+}
 
-        }
+/* -------------------------------------------------------------------------- */
 
-        continue;
+public int string_json_null(m_string_writer *w)
+{
+    /** @brief write a JSON null */
 
-_token: if (likely(json->_len != pos))
-        json->_len = json->_alloc = pos + 1;
-_delim: json->_flags &= ~_STRING_FLAG_ERRORS;
-        parent = json->parent;
+    return string_json_raw(w, "null", 4);
+}
 
-        /* parser callback */
-        if (ctx) {
-            int type = json->_flags & JSON_TYPE;
+/* -------------------------------------------------------------------------- */
 
-            if (likely(parent))
-                ctx->parent = parent->_flags & JSON_TYPE;
-            else ctx->parent = 0;
+public int string_json_raw(m_string_writer *w, const char *json, size_t len)
+{
+    /** @brief write a serialized JSON value */
 
-            if (ctx->exit && (type & (JSON_ARRAY | JSON_OBJECT))) {
-                callback = ctx->exit(type, ctx);
-                if (callback == 1) return 0;
-                ctx->key.current = NULL;
-                ctx->key.len = 0;
-            } else if (ctx->data && (state & _KEY) == 0) {
-                callback = ctx->data(type, DATA(json), SIZE(json), ctx);
-                if (callback == 1) return 0;
-            }
-        }
+    char *out = NULL;
 
-        if (likely(parent)) {
-            pos += json->_data - parent->_data;
-            if (ctx && callback == 0 && (state & _KEY) == 0)
-                string_free_token(json);
-            json = parent;
-        } else break;
+    if (! w || ! json || ! len) {
+        debug("string_json_raw(): bad parameters.\n");
+        return -1;
     }
 
-    return 0;
+    if (! (out = _json_writer_value(w, len, 0)) ) return -1;
 
-_error:
-    debug("string_parse_json(): illegal character \'%c\' at %i.\n",
-          json->_data[pos], (int) (json->_data - s->_data) + pos + 1);
-    string_free_token(s);
-    return -1;
+    memcpy(out, json, len);
+    _string_writer_commit(w, len);
 
-_nomem:
-    s->_flags |= _STRING_FLAG_BUFFER;
-    return 1;
+    return 0;
 }
 
-#undef _KEY
-#undef _VAL
-#undef _SIG
-#undef _RAD
-#undef _EXP
-#undef _BUG
+#undef _JS_INDEX_LOCAL
+#undef _JS_BLANK
+#undef _JS_STRING
+#undef _JS_ESCAPE
+#undef _JS_UNICODE
+#undef _JS_PRIM
+#undef _JS_SLASH
+#undef _JS_LINE
+#undef _JS_BLOCK
+#undef _JS_STAR
+#undef _JS_ERROR
+#undef _JS_STOP
+#undef _JS_VALUE
+#undef _JS_FIRST
+#undef _JS_KEY
+#undef _JS_KEY1
+#undef _JS_COLON
+#undef _JS_NEXT
+#undef _JS_DELIM
+#undef _JS_TOP
 
 /* -------------------------------------------------------------------------- */
 #endif
@@ -3911,6 +8753,26 @@ public void string_free_token(m_string *string)
 
 public void string_api_cleanup(void)
 {
+    #if defined(HAS_PCRE) || defined(HAS_ICONV)
+    unsigned int i = 0;
+    #endif
+
+    #ifdef HAS_PCRE
+    pthread_rwlock_wrlock(& _regex_lock);
+        for (i = 0; i < STRING_REGEX_CACHE; i ++)
+            _regex_cache[i] = string_regex_free(_regex_cache[i]);
+    pthread_rwlock_unlock(& _regex_lock);
+    #endif
+
+    #ifdef HAS_ICONV
+    pthread_mutex_lock(& _iconv_lock);
+        for (i = 0; i < STRING_ICONV_CACHE; i ++) {
+            if (_iconv_cache[i].idle) iconv_close(_iconv_cache[i].cd);
+            _iconv_cache[i].idle = 0;
+        }
+    pthread_mutex_unlock(& _iconv_lock);
+    #endif
+
     return;
 }
 
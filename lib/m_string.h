@@ -51,6 +51,8 @@
 
 #ifdef HAS_ICONV
 #include <iconv.h>
+/* number of idle iconv descriptors kept by string_conv() */
+#define STRING_ICONV_CACHE 16
 #endif
 
 /** @defgroup string core::string */
@@ -58,15 +60,25 @@
 typedef struct m_string {
     /* private */
     size_t _len;
-    uint16_t parts;
-    uint16_t _flags;
+    uint32_t parts;
+    uint32_t _flags;
     char *_data;
     struct m_string *token;
     struct m_string *parent;
     size_t _alloc;
-    uint16_t _parts_alloc;
+    uint32_t _parts_alloc;
 } m_string;
 
+/* maximum number of tokens added one by one with string_add_token(), the
+   JSON parser relies on it to process large documents in several passes */
+#define STRING_TOKEN_MAX 65535
+
+/* substring search engines */
+#define STRING_SEARCH_AUTO   0
+#define STRING_SEARCH_SCALAR 1
+#define STRING_SEARCH_SSE2   2
+#define STRING_SEARCH_AVX2   3
+
 typedef struct m_search_string {
     /* private */
     size_t _len;
@@ -74,20 +86,105 @@ typedef struct m_search_string {
     uint8_t _lut[UCHAR_MAX + 1];
 } m_search_string;
 
+typedef struct m_search_set {
+    /* private */
+    unsigned int _count;     /* number of patterns */
+    size_t _min;             /* length of the shortest pattern */
+    size_t _max;             /* length of the longest pattern */
+    const char **_pattern;   /* patterns, from the longest to the shortest */
+    size_t *_len;
+    unsigned int *_id;       /* position of the patterns in the caller set */
+    unsigned int _states;    /* Aho-Corasick automaton */
+    uint32_t *_next;
+    int32_t *_match;
+    unsigned int _first;     /* distinct first bytes of the patterns */
+    uint8_t _byte[4];
+} m_search_set;
+
+typedef struct m_string_cursor {
+    /* private */
+    const char *_data;
+    size_t _len;
+    off_t _off;
+    const char *_pattern;
+    size_t _plen;
+    const m_search_set *_set;
+    m_search_string _compiled;
+    m_string _token;
+} m_string_cursor;
+
+/* maximum nesting of the JSON writer */
+#define STRING_WRITER_DEPTH 256
+
+typedef struct m_string_writer {
+    /* private */
+    m_string *_out;
+    unsigned int _depth;
+    char _comma;            /* a separator is due before the next value */
+    char _key;              /* a key is waiting for its value */
+    char _delim;            /* field separator of delimited text */
+    uint32_t _stack[STRING_WRITER_DEPTH / 32]; /* one bit per level */
+} m_string_writer;
+
+/* default size of the blocks of a string arena */
+#define STRING_ARENA_BLOCK 16384
+
+typedef struct m_string_arena {
+    /* private */
+    struct m_string_arena *_prev; /* enclosing arena of this thread */
+    void *_block;                 /* additional blocks */
+    char *_ptr;                   /* free space of the current block */
+    char *_end;
+    size_t _size;
+    m_string *_strings;           /* strings allocated in this arena */
+} m_string_arena;
+
+/* codecs of the streaming compression */
+#define STRING_CODEC_DEFLATE 0    /* zlib framing (RFC 1950) */
+#define STRING_CODEC_GZIP    1    /* gzip framing (RFC 1952) */
+#define STRING_CODEC_RAW     2    /* raw deflate (RFC 1951) */
+#define STRING_CODEC_LZ      3    /* fast LZ77 blocks, for internal traffic */
+
+typedef struct m_string_zstream m_string_zstream;
+
+#define STRING_DIGEST_SHA1   0    /* FIPS 180-4, 20 bytes */
+#define STRING_DIGEST_SHA256 1    /* FIPS 180-4, 32 bytes */
+#define STRING_DIGEST_CRC32C 2    /* Castagnoli CRC (RFC 3720), 4 bytes */
+#define STRING_DIGEST_HASH64 3    /* non cryptographic XXH64, 8 bytes */
+
+typedef struct m_string_digest m_string_digest;
+
+#ifdef HAS_PCRE
+/* number of compiled patterns kept by string_parse() */
+#define STRING_REGEX_CACHE 64
+
+typedef struct m_regex {
+    /* private */
+    pcre *_regex;
+    pcre_extra *_extra;           /* study data, JIT code if available */
+    int _options;
+    int _captures;
+    volatile unsigned int _refs;
+    uint32_t _hash;
+    size_t _len;
+    char *_pattern;
+} m_regex;
+#endif
+
 /* private string flags */
 #define _STRING_FLAG_FIXLEN 0x0001 /* disable string resizing */
 #define _STRING_FLAG_RDONLY 0x0002 /* disable string writing */
 #define _STRING_FLAG_STATIC 0x0003 /* disable writing and resizing */
 #define _STRING_FLAG_NOFREE 0x0004 /* disable free() on string content */
 #define _STRING_FLAG_ENCAPS 0x0005 /* disable all dynamic allocation */
-/*                          0x0008    reserved */
+#define _STRING_FLAG_ARENA  0x0008 /* the string belongs to an arena */
 #define _STRING_FLAG_NALLOC 0x0010 /* static, stack allocated string */
 #define _STRING_FLAG_ERRORS 0x0020 /* this string contains errors */
 #define HAS_ERROR(x) ((x)->_flags & _STRING_FLAG_ERRORS)
 #define _STRING_FLAG_BUFFER 0x0040 /* this string is used for buffering */
 #define IS_BUFFER(x) ((x)->_flags & _STRING_FLAG_BUFFER)
 #define _STRING_FLAG_MASKXT 0x001F /* mask extension flags */
-/*                          0x0080    reserved */
+#define _STRING_FLAG_INLINE 0x0080 /* the data is stored after the struct */
 
 #ifdef _ENABLE_HTTP
 #define _STRING_FLAG_HTTP   0x0100 /* HTTP request */
@@ -101,6 +198,9 @@ typedef struct m_search_string {
 #define _STRING_FLAG_CHUNK  0x0800 /* HTTP 1.1 Chunked encoding */
 #define IS_CHUNK(x) ((x)->_flags & _STRING_FLAG_CHUNK)
 #endif
+/* JSON types                       0xF000 */
+#define _STRING_FLAG_SHARED 0x10000 /* the data is shared, copied on write */
+#define IS_SHARED(x) ((x)->_flags & _STRING_FLAG_SHARED)
 
 #ifdef _ENABLE_JSON
 typedef struct m_json_parser {
@@ -130,6 +230,65 @@ typedef struct m_json_parser {
 #define JSON_QUIRKS         0
 #define JSON_STRICT         1
 
+/* default maximum nesting of the incremental parser */
+#define JSON_STREAM_DEPTH   256
+
+typedef struct m_json_stream {
+    /* private */
+    m_json_parser *_ctx;
+    char _strict;
+    unsigned char _state;
+    unsigned char _expect;
+    unsigned char _iskey;
+    unsigned char _seen;    /* a value was found in the stream */
+    char _quote;
+    unsigned int _esc;
+    unsigned int _depth;
+    unsigned int _max;
+    uint32_t *_stack;       /* one bit per level: object or array */
+    size_t _offset;
+    char *_buf;             /* token spanning several chunks */
+    size_t _buflen;
+    size_t _bufalloc;
+    char *_key;             /* key of the current value */
+    size_t _keylen;
+    size_t _keyalloc;
+} m_json_stream;
+
+/* node of a lazy JSON document, the values are slices of the source */
+typedef struct m_json_node {
+    /* public */
+    const char *_data;      /* the value, without quotes for strings */
+    size_t _len;
+    uint32_t _flags;        /* JSON type, errors */
+    uint32_t parts;         /* number of children expanded so far */
+    const char *key;        /* its key, within an object */
+    size_t keylen;
+    /* private */
+    struct m_json_node *_child;
+    struct m_json_node *_last;
+    struct m_json_node *_next;
+    const char *_resume;    /* next child to expand, NULL when done */
+} m_json_node;
+
+typedef struct m_json_doc {
+    /* private */
+    m_string_arena _arena;  /* nodes */
+    const char *_end;
+    m_json_node _root;
+} m_json_doc;
+
+/* compiled JSON pointer (RFC 6901) */
+typedef struct m_json_path {
+    /* private */
+    unsigned int _count;
+    struct {
+        const char *key;
+        size_t len;
+        long index;         /* -1 if the segment is not an array index */
+    } _segment[1];
+} m_json_path;
+
 #endif
 
 #define STRING_STATIC_INITIALIZER(s, l) \
@@ -307,6 +466,106 @@ public m_string *string_encaps(const char *string, size_t len);
 
 /* -------------------------------------------------------------------------- */
 
+public m_string *string_share(const m_string *string);
+
+/**
+ * @ingroup string
+ * @fn m_string *string_share(const m_string *string)
+ * @param string the string to share.
+ * @return NULL if an error occured, a pointer to a new m_string otherwise.
+ *
+ * This function returns a read-only m_string sharing the data of
+ * @b string. The first call copies the data once into a reference counted
+ * buffer, and sharing the result again only adds a reference to this
+ * buffer, so the same payload can be queued on many sockets with
+ * @ref server_send_string() without being copied for each of them.
+ *
+ * Each shared string must be destroyed with @ref string_free(), and the
+ * buffer is released along with the last one. Modifying a shared string
+ * through the string API first gives it a private copy of the data.
+ *
+ * Example, to broadcast a message:
+ * m_string *msg = string_share(update);
+ * for (i = 0; i < n; i ++)
+ *     server_send_string(token, sockid[i], 0x0, string_share(msg));
+ * string_free(msg);
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_arena *string_arena_begin(size_t size);
+
+/**
+ * @ingroup string
+ * @fn m_string_arena *string_arena_begin(size_t size)
+ * @param size the size of the arena blocks, 0 for the default size.
+ * @return NULL if an error occured, a pointer to a new arena otherwise.
+ *
+ * This function starts an allocation arena for the calling thread. Until
+ * @ref string_arena_end() is called, all the strings created by this thread
+ * are carved out of the arena blocks instead of being allocated one by one
+ * with malloc(). Arenas may be nested, the innermost one is used.
+ *
+ * Only the strings themselves and their buffers come from the arena. Token
+ * arrays, such as the ones built by @ref string_split(), are still allocated
+ * on the heap since they may be reallocated or handed over to another string;
+ * the arena keeps track of them and releases them when it ends.
+ *
+ * Strings from an arena can still be passed to @ref string_free(), which
+ * releases their tokens and any buffer that was moved out of the arena,
+ * but they do not need to be: they all are destroyed by
+ * @ref string_arena_end(). A string which must outlive the arena has to be
+ * copied to the heap with @ref string_arena_escape().
+ *
+ * Arenas are opt-in: the server does not open one around plugin_main(), as
+ * the server and the plugins keep some of the strings of a request, such as
+ * incomplete requests or queued data. A plugin whose handler only creates
+ * temporary strings may open its own arena for each request, the headers and
+ * footers given to the server replies are escaped automatically.
+ *
+ * Example, for a plugin handling a request:
+ * m_string_arena *a = string_arena_begin(0);
+ * ... (temporary strings, tokens, formatted output) ...
+ * string_arena_end(a);
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_arena *string_arena_end(m_string_arena *arena);
+
+/**
+ * @ingroup string
+ * @fn m_string_arena *string_arena_end(m_string_arena *arena)
+ * @param arena the arena to destroy.
+ * @return always NULL.
+ *
+ * This function destroys an arena and all the strings allocated in it,
+ * along with their tokens. The enclosing arena, if any, becomes the
+ * current one again. It must be called by the thread which created the
+ * arena.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_arena_escape(m_string *string);
+
+/**
+ * @ingroup string
+ * @fn m_string *string_arena_escape(m_string *string)
+ * @param string the string to keep.
+ * @return NULL if an error occured, a heap allocated string otherwise.
+ *
+ * This function returns a copy of an arena string allocated on the heap,
+ * which survives the arena and must be freed with @ref string_free(). A
+ * string which does not belong to an arena is returned as is.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public m_string *string_vfmt(m_string *str, const char *fmt, va_list args);
 
 /**
@@ -357,6 +616,62 @@ public m_string *string_catfmt(m_string *str, const char *fmt, ...);
 
 /* -------------------------------------------------------------------------- */
 
+public m_string *string_fmt_compiled(m_string *str, const m_fmt *fmt, ...);
+
+/**
+ * @ingroup string
+ * @fn m_string *string_fmt_compiled(m_string *str, const m_fmt *fmt, ...)
+ * @param str the string to overwrite, or NULL to allocate a new one
+ * @param fmt a format compiled by @ref fmt_compile
+ * @param ... the arguments of the format
+ * @return NULL if an error occured, the formatted string otherwise
+ *
+ * This function works like @ref string_fmt, but the format is not parsed
+ * again and the output is written in a single pass. It should be used for
+ * the formats used over and over, like the responses of a plugin.
+ *
+ * @warning Unlike @ref string_fmt, the output is written over @b str as it
+ * is produced: if an error occurs, @b str is left empty.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_vfmt_compiled(m_string *str, const m_fmt *fmt,
+                                      va_list args);
+
+/**
+ * @ingroup string
+ * @fn m_string *string_vfmt_compiled(m_string *str, const m_fmt *fmt,
+ *                                    va_list args)
+ * @param str the string to overwrite, or NULL to allocate a new one
+ * @param fmt a format compiled by @ref fmt_compile
+ * @param args the arguments of the format
+ * @return NULL if an error occured, the formatted string otherwise
+ *
+ * This function works like @ref string_fmt_compiled with a va_list. If an
+ * error occurs, @b str is left empty.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_catfmt_compiled(m_string *str, const m_fmt *fmt, ...);
+
+/**
+ * @ingroup string
+ * @fn m_string *string_catfmt_compiled(m_string *str, const m_fmt *fmt, ...)
+ * @param str the string to append to, or NULL to allocate a new one
+ * @param fmt a format compiled by @ref fmt_compile
+ * @param ... the arguments of the format
+ * @return NULL if an error occured, the string otherwise
+ *
+ * This function works like @ref string_catfmt with a compiled format.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public m_string *string_from_uint32(uint32_t u32);
 
 /**
@@ -509,6 +824,43 @@ public int string_fetch_fmt(m_string *string, const char *fmt, ...);
 
 /* -------------------------------------------------------------------------- */
 
+public int string_peek_compiled(m_string *string, const m_scan *scan, ...);
+
+/**
+ * @ingroup string
+ * @fn int string_peek_compiled(m_string *string, const m_scan *scan, ...)
+ * @param string the string to read from
+ * @param scan a layout compiled by @ref scan_compile
+ * @param ... pointers to the fields of the layout
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function works like @ref string_peek_fmt with a compiled layout.
+ * If the string is too short, the function returns -1 and sets errno to
+ * ENOMEM before writing any fixed size field.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_fetch_compiled(m_string *string, const m_scan *scan, ...);
+
+/**
+ * @ingroup string
+ * @fn int string_fetch_compiled(m_string *string, const m_scan *scan, ...)
+ * @param string the string to read from
+ * @param scan a layout compiled by @ref scan_compile
+ * @param ... pointers to the fields of the layout
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function works like @ref string_fetch_fmt with a compiled layout:
+ * the bytes read are removed from the beginning of the string, just like
+ * @ref string_fetch does. Binary protocol frames should be decoded this
+ * way rather than with a format parsed on every call.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public int string_peek_buffer(m_string *string, char *out, size_t len);
 
 /* -------------------------------------------------------------------------- */
@@ -569,6 +921,24 @@ public int string_mbyte(m_string *string);
  *
  */
 
+/* -------------------------------------------------------------------------- */
+
+public size_t string_utf8_check(const char *data, size_t len);
+
+/**
+ * @ingroup string
+ * @fn size_t string_utf8_check(const char *data, size_t len)
+ * @param data the data to check
+ * @param len the length of the data
+ * @return the length of the longest valid UTF-8 prefix of the data
+ *
+ * This function validates UTF-8 data, rejecting overlong forms, surrogates
+ * and values above U+10FFFF; the data is valid if the result is @ref len.
+ * Otherwise, the result is the offset of the first invalid or truncated
+ * sequence. The validation is vectorized with SSSE3 or AVX2.
+ *
+ */
+
 /* -------------------------------------------------------------------------- */
 #ifdef HAS_ICONV
 /* -------------------------------------------------------------------------- */
@@ -592,6 +962,10 @@ public size_t string_convs(const char *src, size_t srclen, const char *src_enc,
  * string. If the output is NULL, the function will return the length the
  * output buffer should have to fit the converted string.
  *
+ * The conversions between UTF-8, UTF-16LE, UTF-16BE and ISO-8859-1 do not
+ * use iconv, they validate and convert the data in a single pass. The
+ * iconv descriptors of the other encodings are kept for the next calls.
+ *
  */
 
 /* -------------------------------------------------------------------------- */
@@ -606,8 +980,9 @@ public int string_conv(m_string *s, const char *src_enc, const char *dst_enc);
  * @param dst_enc the encoding to use for the conversion
  * @return -1 if an error occured, 0 otherwise.
  *
- * This function uses the Iconv library to convert the encoding of the given
- * string.
+ * This function converts the encoding of the given string, like
+ * @ref string_convs. A conversion from UTF-8 to UTF-8 only validates the
+ * data. The string is left unchanged if the conversion fails.
  *
  */
 
@@ -1023,6 +1398,59 @@ public int string_cmp(const m_string *a, const m_string *b);
 
 /* -------------------------------------------------------------------------- */
 
+public int string_casecmpn(const char *a, const char *b, size_t len);
+
+/**
+ * @ingroup string
+ * @fn int string_casecmpn(const char *a, const char *b, size_t len)
+ * @param a the first buffer
+ * @param b the second buffer
+ * @param len the number of bytes to compare
+ * @return 0 if the buffers match, the difference of the first mismatching
+ *         bytes in lower case otherwise, or 2 if an error occured
+ *
+ * This function compares two buffers like memcmp(), ignoring the case of
+ * the ASCII letters only; it does not depend on the locale and does not
+ * stop on NUL bytes. It is meant for the protocol keywords, like HTTP
+ * header names.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_casecmps(const m_string *a, const char *b, size_t len);
+
+/**
+ * @ingroup string
+ * @fn int string_casecmps(const m_string *a, const char *b, size_t len)
+ * @param a the string
+ * @param b the C string
+ * @param len the C string length
+ * @return 0 if the strings match, or the same values as @ref string_casecmpn
+ *
+ * This function works like @ref string_cmps, ignoring the ASCII case. Like
+ * @ref string_cmps, it only compares the common length of both strings, so
+ * it also tells if one of them begins with the other.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_casecmp(const m_string *a, const m_string *b);
+
+/**
+ * @ingroup string
+ * @fn int string_casecmp(const m_string *a, const m_string *b)
+ * @param a the first string
+ * @param b the second string
+ * @return 0 if the strings match, or the same values as @ref string_casecmpn
+ *
+ * This function is a wrapper around @ref string_casecmps.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public int string_upper(m_string *string);
 
 /**
@@ -1032,7 +1460,8 @@ public int string_upper(m_string *string);
  * @return -1 if an error occured, 0 otherwise
  *
  * This function simply converts the internal buffer of the given string to
- * upper case.
+ * upper case, up to the first NUL byte. Only the ASCII letters are converted,
+ * whatever the locale.
  *
  * Since the conversion is done in place, no resizing is done and thus
  * existing tokens are preserved.
@@ -1047,12 +1476,13 @@ public int string_lower(m_string *string);
 
 /**
  * @ingroup string
- * @fn int string_upper(m_string *string)
+ * @fn int string_lower(m_string *string)
  * @param string
  * @return -1 if an error occured, 0 otherwise
  *
  * This function simply converts the internal buffer of the given string to
- * lower case.
+ * lower case, up to the first NUL byte. Only the ASCII letters are converted,
+ * whatever the locale.
  *
  * Since the conversion is done in place, no resizing is done and thus
  * existing tokens are preserved.
@@ -1073,6 +1503,98 @@ public off_t string_compile_find(const char *s, size_t len, size_t o,
 
 /* -------------------------------------------------------------------------- */
 
+public int string_search_engine(int engine);
+
+/**
+ * @ingroup string
+ * @fn int string_search_engine(int engine)
+ * @param engine STRING_SEARCH_AUTO, STRING_SEARCH_SCALAR, STRING_SEARCH_SSE2
+ *               or STRING_SEARCH_AVX2
+ * @return the engine in use, or -1 if it is not supported
+ *
+ * This function selects the engine used by the substring search functions.
+ * By default, the fastest engine supported by the processor is detected at
+ * runtime; the scalar engine is a Boyer-Moore-Horspool search and the vector
+ * engines compare the first and the last byte of the needle with 16 or 32
+ * positions of the haystack at once.
+ *
+ * @warning The engine is shared by all the threads of the process, it should
+ * only be changed for testing or benchmarking purposes.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_search_set *string_search_set_alloc(const char **patterns,
+                                             const size_t *len,
+                                             unsigned int count);
+
+/**
+ * @ingroup string
+ * @fn m_search_set *string_search_set_alloc(const char **patterns,
+ *                                           const size_t *len,
+ *                                           unsigned int count)
+ * @param patterns an array of patterns.
+ * @param len the length of each pattern.
+ * @param count the number of patterns.
+ * @return a compiled set of patterns, or NULL.
+ *
+ * This function compiles a set of patterns which can then be searched
+ * simultaneously, in a single pass over the data, with
+ * @ref string_search_set_find(), @ref string_splits_set() or
+ * @ref string_reps_set().
+ *
+ * The patterns are compiled to an Aho-Corasick automaton. When the patterns
+ * start with at most 4 distinct bytes, the candidate positions are located
+ * with the vector engine selected by @ref string_search_engine() instead.
+ *
+ * The patterns are copied, and the set must be released with
+ * @ref string_search_set_free().
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_search_set *string_search_set_free(m_search_set *set);
+
+/**
+ * @ingroup string
+ * @fn m_search_set *string_search_set_free(m_search_set *set)
+ * @param set a compiled set of patterns.
+ * @return NULL
+ *
+ * This function releases a set allocated with
+ * @ref string_search_set_alloc().
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public off_t string_search_set_find(const m_search_set *set, const char *s,
+                                    size_t len, size_t o,
+                                    unsigned int *which, size_t *match_len);
+
+/**
+ * @ingroup string
+ * @fn off_t string_search_set_find(const m_search_set *set, const char *s,
+ *                                  size_t len, size_t o,
+ *                                  unsigned int *which, size_t *match_len)
+ * @param set a compiled set of patterns.
+ * @param s the "haystack".
+ * @param len the size of the haystack.
+ * @param o an offset within the bounds of the haystack.
+ * @param which if not NULL, receives the index of the matching pattern.
+ * @param match_len if not NULL, receives the length of the matching pattern.
+ * @return -1 if no pattern was found, or the position of the match.
+ *
+ * This function returns the earliest match of any pattern of the set,
+ * starting from the offset @b o. When several patterns match at the same
+ * position, the longest one is reported.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public off_t string_sfinds(const char *str, size_t slen, size_t o,
                            const char *sub, size_t len            );
 
@@ -1094,8 +1616,6 @@ public off_t string_finds(const m_string *str, size_t o, const char *sub,
  * This functions searches for a substring starting from the offset @b o
  * in the given string @b str.
  *
- * @warning The "needle" can not be longer than 255 bytes.
- *
  * If the substring is not found or an error occurs, this function will
  * return -1. Otherwise, the position of the first byte of the substring in
  * the string is returned.
@@ -1187,6 +1707,79 @@ public int string_split(m_string *string, const m_string *pattern);
  
 /* -------------------------------------------------------------------------- */
 
+public int string_splits_set(m_string *string, const m_search_set *set);
+
+/**
+ * @ingroup string
+ * @fn int string_splits_set(m_string *string, const m_search_set *set)
+ * @param string the string to be split.
+ * @param set the token delimiters.
+ * @return -1 if an error occured, 0 otherwise.
+ *
+ * This function works like @ref string_splits(), but any pattern of the
+ * given set delimits the tokens.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_cursor_init(m_string_cursor *c, const m_string *s,
+                              const char *pattern, size_t len);
+
+/**
+ * @ingroup string
+ * @fn int string_cursor_init(m_string_cursor *c, const m_string *s,
+ *                            const char *pattern, size_t len)
+ * @param c the cursor to initialize.
+ * @param s the string to walk.
+ * @param pattern the token delimiter.
+ * @param len the size of the delimiter.
+ * @return -1 if an error occured, 0 otherwise.
+ *
+ * This function prepares a cursor to walk the tokens of @b s one by one
+ * with @ref string_cursor_next(), without allocating the array of tokens
+ * like @ref string_splits() does. The cursor does not copy the string nor
+ * the delimiter, which must remain valid and unchanged while it is used.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_cursor_init_set(m_string_cursor *c, const m_string *s,
+                                  const m_search_set *set);
+
+/**
+ * @ingroup string
+ * @fn int string_cursor_init_set(m_string_cursor *c, const m_string *s,
+ *                                const m_search_set *set)
+ * @param c the cursor to initialize.
+ * @param s the string to walk.
+ * @param set the token delimiters.
+ * @return -1 if an error occured, 0 otherwise.
+ *
+ * This function works like @ref string_cursor_init(), but any pattern of
+ * the given set delimits the tokens.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public const m_string *string_cursor_next(m_string_cursor *c);
+
+/**
+ * @ingroup string
+ * @fn const m_string *string_cursor_next(m_string_cursor *c)
+ * @param c an initialized cursor.
+ * @return the next token, or NULL once all the tokens were returned.
+ *
+ * This function returns the next token of the string, as a read-only view
+ * of the string data which is only valid until the next call. The tokens
+ * are the same as the ones @ref string_splits() would produce.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public int string_merges(m_string *string, const char *pattern, size_t len);
 
 /**
@@ -1268,6 +1861,26 @@ public m_string *string_rep(m_string *string, const m_string *search,
 
 /* -------------------------------------------------------------------------- */
 
+public m_string *string_reps_set(m_string *string, const m_search_set *set,
+                                 const char *rep, size_t rlen);
+
+/**
+ * @ingroup string
+ * @fn m_string *string_reps_set(m_string *string, const m_search_set *set,
+ *                               const char *rep, size_t rlen)
+ * @param string the string where the patterns should be replaced.
+ * @param set the patterns to be replaced.
+ * @param rep the replacement string.
+ * @param rlen the length of the replacement string.
+ * @return NULL if an error occured, a pointer to the main string otherwise.
+ *
+ * This function works like @ref string_reps(), but replaces the matches of
+ * all the patterns of the given set in a single pass.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public m_string *string_rems(m_string *str, const char *rem, size_t len);
 
 /**
@@ -1345,36 +1958,95 @@ public m_string *string_dequeue_token(m_string *string);
 #ifdef HAS_PCRE
 /* -------------------------------------------------------------------------- */
 
-public int string_parse(m_string *string, const char *pattern, size_t len);
+public m_regex *string_regex_alloc(const char *pattern, size_t len,
+                                   int options);
 
 /**
  * @ingroup string
- * @fn int string_parse(m_string *string, const char *pattern, size_t len)
- * @param string the string to be processed
- * @param pattern the C string holding the regular expression to match
+ * @fn m_regex *string_regex_alloc(const char *pattern, size_t len, int options)
+ * @param pattern the regular expression
  * @param len the length of the pattern
- * @return -1 if an error happens, 0 otherwise
+ * @param options PCRE compile options, like PCRE_DOTALL
+ * @return a compiled regular expression or NULL if an error happens
  *
- * This function will match the regular expression @ref pattern with the
- * given @ref string. If a match is found, it will be stored as a token.
+ * This function compiles and studies a regular expression once, so that
+ * it can be matched many times with @ref string_parse_regex. The JIT
+ * compiler of PCRE is used when it is available.
  *
- * If you use the parenthesis to extract substrings, you can get the
- * substrings as subtokens of the matching token.
+ * The returned handle is not shared with the cache of @ref string_parse,
+ * it must be released with @ref string_regex_free. It can be used by
+ * several threads at the same time.
  *
  */
 
 /* -------------------------------------------------------------------------- */
-#endif
-/* -------------------------------------------------------------------------- */
 
-public m_string *string_b58s(const char *s, size_t size);
+public m_regex *string_regex_free(m_regex *regex);
 
 /**
  * @ingroup string
- * @fn m_string *string_b58s(const char *s, size_t size)
- * @param s the string to be processed
- * @param size the length of the string
- * @return NULL if an error occured, a pointer to the base58 string otherwise.
+ * @fn m_regex *string_regex_free(m_regex *regex)
+ * @param regex the compiled regular expression
+ * @return NULL
+ *
+ * This function releases a regular expression compiled by
+ * @ref string_regex_alloc.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_parse_regex(m_string *string, const m_regex *regex);
+
+/**
+ * @ingroup string
+ * @fn int string_parse_regex(m_string *string, const m_regex *regex)
+ * @param string the string to be processed
+ * @param regex the compiled regular expression to match
+ * @return -1 if an error happens, 0 otherwise
+ *
+ * This function works like @ref string_parse with a pattern compiled
+ * beforehand.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_parse(m_string *string, const char *pattern, size_t len);
+
+/**
+ * @ingroup string
+ * @fn int string_parse(m_string *string, const char *pattern, size_t len)
+ * @param string the string to be processed
+ * @param pattern the C string holding the regular expression to match
+ * @param len the length of the pattern
+ * @return -1 if an error happens, 0 otherwise
+ *
+ * This function will match the regular expression @ref pattern with the
+ * given @ref string. If a match is found, it will be stored as a token.
+ *
+ * If you use the parenthesis to extract substrings, you can get the
+ * substrings as subtokens of the matching token.
+ *
+ * The compiled pattern is kept in a process wide cache of
+ * @ref STRING_REGEX_CACHE entries, so parsing many strings with the same
+ * pattern only compiles it once. The cache is emptied by
+ * @ref string_api_cleanup.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_b58s(const char *s, size_t size);
+
+/**
+ * @ingroup string
+ * @fn m_string *string_b58s(const char *s, size_t size)
+ * @param s the string to be processed
+ * @param size the length of the string
+ * @return NULL if an error occured, a pointer to the base58 string otherwise.
  *
  * This function returns a base58 encoded copy of the given string, using
  * Satoshi Nakamoto's alphabet.
@@ -1438,11 +2110,15 @@ public m_string *string_b64s(const char *s, size_t size, size_t linesize);
  * @return NULL if an error occured, a pointer to the base64 string otherwise.
  *
  * This function returns a base64 encoded copy of the given string, with
- * @b linesize characters per line.
+ * @b linesize characters per line. Each line, the last one included, ends
+ * with a CRLF.
  *
  * If @b linesize is set to 0, the base64 string will be written "as this",
  * without additionnel CRLF.
  *
+ * Blocks of 12 or 24 bytes are encoded with SSSE3 or AVX2 byte shuffles when
+ * the CPU supports them, the selection follows @ref string_search_engine().
+ *
  * If a @b linesize is provided, it should be a multiple of 4 and not greater
  * than 72, or the function will return NULL.
  *
@@ -1476,7 +2152,8 @@ public m_string *string_deb64s(const char *s, size_t size);
  * @return NULL if an error occured, a pointer to the decoded string otherwise.
  *
  * This function decodes a base64 encoded string to plain text, handling
- * eventual embedded CRLFs.
+ * eventual embedded CRLFs. Characters outside of the base64 alphabet are
+ * skipped and the decoding ends with the input.
  *
  */
 
@@ -1495,6 +2172,26 @@ public m_string *string_deb64(const m_string *s);
  *
  */
 
+/* -------------------------------------------------------------------------- */
+
+public int string_deb64_inplace(m_string *s);
+
+/**
+ * @ingroup string
+ * @fn int string_deb64_inplace(m_string *s)
+ * @param s the string to be processed
+ * @return -1 if an error occured, 0 otherwise.
+ *
+ * This function decodes a base64 encoded string over its own buffer, which
+ * avoids allocating a second string for large attachments. Like
+ * @ref string_deb64s(), it skips the embedded CRLFs.
+ *
+ * The blocks of 16 or 32 characters without noise are decoded with SSSE3 or
+ * AVX2 byte shuffles when the CPU supports them, the selection follows
+ * @ref string_search_engine().
+ *
+ */
+
 /* -------------------------------------------------------------------------- */
 #ifdef HAS_ZLIB
 /* -------------------------------------------------------------------------- */
@@ -1523,6 +2220,8 @@ public m_string *string_uncompress(m_string *s, size_t original_size);
  * @return NULL if an error occured, a pointer to uncompressed string otherwise.
  *
  * This function returns an uncompressed copy of a given compressed string.
+ * If @ref original_size is 0, the size is not known in advance and the
+ * output grows as needed.
  *
  */
 
@@ -1530,46 +2229,435 @@ public m_string *string_uncompress(m_string *s, size_t original_size);
 #endif
 /* -------------------------------------------------------------------------- */
 
+public m_string_zstream *string_compressor_alloc(int codec, int level);
+
+/**
+ * @ingroup string
+ * @fn m_string_zstream *string_compressor_alloc(int codec, int level)
+ * @param codec STRING_CODEC_DEFLATE, STRING_CODEC_GZIP, STRING_CODEC_RAW or
+ *              STRING_CODEC_LZ
+ * @param level the compression level from 0 to 9, -1 for the default
+ * @return a compression context or NULL if an error occured
+ *
+ * This function prepares the compression of a stream fed by chunks with
+ * @ref string_zstream_write, so large payloads never need to be held in
+ * memory twice.
+ *
+ * The deflate codecs require zlib. STRING_CODEC_LZ is always available;
+ * it favors speed over ratio, ignores the level, and is meant for traffic
+ * between concrete processes and cached blobs.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_zstream *string_decompressor_alloc(int codec);
+
+/**
+ * @ingroup string
+ * @fn m_string_zstream *string_decompressor_alloc(int codec)
+ * @param codec the codec the stream was compressed with
+ * @return a decompression context or NULL if an error occured
+ *
+ * This function prepares the decompression of a stream fed by chunks
+ * of any size with @ref string_zstream_write.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_zstream_write(m_string_zstream *z, const char *data,
+                                size_t len, m_string *out);
+
+/**
+ * @ingroup string
+ * @fn int string_zstream_write(m_string_zstream *z, const char *data,
+ *                              size_t len, m_string *out)
+ * @param z the compression or decompression context
+ * @param data the next chunk of the stream
+ * @param len the length of the chunk
+ * @param out the string the output is appended to
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function feeds a chunk to the context. Whatever output is ready is
+ * appended to @ref out, a compressor usually keeps some data back until
+ * it is flushed.
+ *
+ * Once an error occured, the context cannot be used anymore.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_zstream_flush(m_string_zstream *z, m_string *out);
+
+/**
+ * @ingroup string
+ * @fn int string_zstream_flush(m_string_zstream *z, m_string *out)
+ * @param z the compression or decompression context
+ * @param out the string the output is appended to
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function appends to @ref out all the output for the data fed so
+ * far, so that the peer can decode it without waiting for the end of the
+ * stream. Flushing too often lowers the compression ratio.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_zstream_end(m_string_zstream *z, m_string *out);
+
+/**
+ * @ingroup string
+ * @fn int string_zstream_end(m_string_zstream *z, m_string *out)
+ * @param z the compression or decompression context
+ * @param out the string the output is appended to
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function terminates a compressed stream, or checks that a
+ * decompressed stream was complete. No data can be fed afterward.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_zstream *string_zstream_free(m_string_zstream *z);
+
+/**
+ * @ingroup string
+ * @fn m_string_zstream *string_zstream_free(m_string_zstream *z)
+ * @param z the compression or decompression context
+ * @return NULL
+ *
+ * This function releases a compression or decompression context.
+ *
+ */
+
 public m_string *string_sha1s(const char *string, size_t len);
 
 /* -------------------------------------------------------------------------- */
 
 public m_string *string_sha1(m_string *s);
 
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_sha256s(const char *string, size_t len);
+
+/**
+ * @ingroup string
+ * @fn m_string *string_sha256s(const char *string, size_t len)
+ * @param string the data to hash
+ * @param len the length of the data
+ * @return NULL if an error occured, the hexadecimal SHA-256 sum otherwise
+ *
+ * This function computes the SHA-256 sum of the given data. Like
+ * @ref string_sha1s, it uses the SHA extensions of the CPU when they are
+ * available and the search engine is not forced to the scalar code.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string *string_sha256(m_string *s);
+
+/* -------------------------------------------------------------------------- */
+
+public uint32_t string_crc32c(uint32_t crc, const char *data, size_t len);
+
+/**
+ * @ingroup string
+ * @fn uint32_t string_crc32c(uint32_t crc, const char *data, size_t len)
+ * @param crc 0, or the value returned for the previous part of the data
+ * @param data the data to check
+ * @param len the length of the data
+ * @return the updated CRC32C
+ *
+ * This function computes a CRC with the Castagnoli polynomial, which
+ * SSE 4.2 processors compute 8 bytes at a time. It can be called on
+ * consecutive parts of a message, like zlib's crc32().
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public uint64_t string_hash64(const char *data, size_t len, uint64_t seed);
+
+/**
+ * @ingroup string
+ * @fn uint64_t string_hash64(const char *data, size_t len, uint64_t seed)
+ * @param data the data to hash
+ * @param len the length of the data
+ * @param seed the hash seed
+ * @return the 64 bit hash of the data
+ *
+ * This function computes a fast non cryptographic hash, compatible with
+ * XXH64. It is meant for hash tables and for spotting accidental changes,
+ * not for authentication.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public uint64_t string_casehash64(const char *data, size_t len, uint64_t seed);
+
+/**
+ * @ingroup string
+ * @fn uint64_t string_casehash64(const char *data, size_t len, uint64_t seed)
+ * @param data the data to hash
+ * @param len the length of the data
+ * @param seed the hash seed
+ * @return the 64 bit hash of the data in lower case
+ *
+ * This function returns the @ref string_hash64 of the data with its ASCII
+ * letters in lower case, without copying it: keys differing only by their
+ * case, like HTTP header names, get the same hash.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_digest *string_digest_alloc(int algorithm);
+
+/**
+ * @ingroup string
+ * @fn m_string_digest *string_digest_alloc(int algorithm)
+ * @param algorithm STRING_DIGEST_SHA1, STRING_DIGEST_SHA256,
+ *                  STRING_DIGEST_CRC32C or STRING_DIGEST_HASH64
+ * @return NULL if an error occured, a new digest context otherwise
+ *
+ * This function allocates a context to compute a digest over data fed
+ * with @ref string_digest_write and @ref string_digest_update, so that
+ * large payloads never need to be held in memory at once.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_digest_write(m_string_digest *d, const char *data,
+                               size_t len);
+
+/**
+ * @ingroup string
+ * @fn int string_digest_write(m_string_digest *d, const char *data,
+ *                             size_t len)
+ * @param d the digest context
+ * @param data the next part of the message
+ * @param len the length of the data
+ * @return -1 if an error occured, 0 otherwise
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_digest_update(m_string_digest *d, m_string *s);
+
+/**
+ * @ingroup string
+ * @fn int string_digest_update(m_string_digest *d, m_string *s)
+ * @param d the digest context
+ * @param s the next part of the message
+ * @return -1 if an error occured, 0 otherwise
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_digest_end(m_string_digest *d, m_string *out);
+
+/**
+ * @ingroup string
+ * @fn int string_digest_end(m_string_digest *d, m_string *out)
+ * @param d the digest context
+ * @param out the string the digest is appended to
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function terminates the message and appends its digest to
+ * @ref out, in hexadecimal. The CRC and the 64 bit hash are written
+ * most significant byte first. The context can then be reused for a new
+ * message.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_string_digest *string_digest_free(m_string_digest *d);
+
+/**
+ * @ingroup string
+ * @fn m_string_digest *string_digest_free(m_string_digest *d)
+ * @param d the digest context
+ * @return NULL
+ *
+ */
+
 /* -------------------------------------------------------------------------- */
 #ifdef _ENABLE_HTTP
 /* -------------------------------------------------------------------------- */
 
 public char *string_rawurlencode(const char *url, size_t len, int flags);
 
+/**
+ * @ingroup string
+ * @fn char *string_rawurlencode(const char *url, size_t len, int flags)
+ * @param url the data to encode
+ * @param len the length of the data
+ * @param flags RFC1738_ESCAPE_RESERVED, RFC1738_ESCAPE_UNESCAPED or 0
+ * @return NULL if an error occured, a newly allocated C string otherwise.
+ *
+ * This function escapes the unsafe characters of an url. The runs of
+ * letters and digits are located with vectorized compares and copied at
+ * once.
+ *
+ */
+
 /* -------------------------------------------------------------------------- */
 
 public int string_urlencode(m_string *url, int flags);
 
+/* -------------------------------------------------------------------------- */
+
+public size_t string_rawurldecode(char *url, size_t len);
+
+/**
+ * @ingroup string
+ * @fn size_t string_rawurldecode(char *url, size_t len)
+ * @param url the data to decode
+ * @param len the length of the data
+ * @return the length of the decoded data.
+ *
+ * This function replaces the %XX escape sequences of an url by the bytes
+ * they stand for, in place. Malformed sequences are left untouched and '+'
+ * is not translated to a space.
+ *
+ * The result is terminated by a \0 when it is shorter than the input.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_urldecode(m_string *url);
+
+/**
+ * @ingroup string
+ * @fn int string_urldecode(m_string *url)
+ * @param url the string to decode
+ * @return -1 if an error occured, 0 otherwise.
+ *
+ * This function is a wrapper around @ref string_rawurldecode() which
+ * decodes a m_string in place and updates its length.
+ *
+ */
+
 /* -------------------------------------------------------------------------- */
 #endif
 /* -------------------------------------------------------------------------- */
 
 /* -------------------------------------------------------------------------- */
-#ifdef _ENABLE_JSON
+
+public int string_writer_init(m_string_writer *w, m_string *out, char delim);
+
+/**
+ * @ingroup string
+ * @fn int string_writer_init(m_string_writer *w, m_string *out, char delim)
+ * @param w the writer to initialize
+ * @param out the string to append to
+ * @param delim the field separator of delimited text, e.g. ',' or '\t'
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function prepares a writer which serializes JSON values with the
+ * string_json_* functions, or delimited text with the string_text_*
+ * functions, at the end of @b out. Unlike @ref string_catfmt(), the writer
+ * does not go through the formatting engine: each call reserves at once the
+ * room it may need, the buffer grows geometrically, strings are escaped
+ * with vectorized searches and numbers have dedicated conversions.
+ *
+ * The writer does not allocate anything and needs no cleanup.
+ *
+ */
+
 /* -------------------------------------------------------------------------- */
 
-public int string_parse_json(m_string *s, char strict, m_json_parser *ctx);
+public int string_text_field(m_string_writer *w, const char *data,
+                             size_t len);
 
 /**
  * @ingroup string
- * @fn m_string *string_parse_json(m_string *s, int strict, m_json_parser *ctx)
- * @param s the string to be parsed
- * @param strict boolean - enable or disable strict parsing
- * @param ctx optional parser context
+ * @fn int string_text_field(m_string_writer *w, const char *data,
+ *                           size_t len)
+ * @param w a writer
+ * @param data the field
+ * @param len the length of the field
  * @return -1 if an error occured, 0 otherwise
  *
- * This function creates tokens for each JSON element in the provided string.
+ * This function appends a field to the current record. Fields containing
+ * the separator, double quotes or line breaks are quoted as in RFC 4180.
  *
- * In STRICT mode, the function rigorously follows RFC 7159 and will reject
- * any non-compliant or malformed input.
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_text_int(m_string_writer *w, int64_t value);
+
+/**
+ * @ingroup string
+ * @fn int string_text_int(m_string_writer *w, int64_t value)
+ * @param w a writer
+ * @param value the integer field
+ * @return -1 if an error occured, 0 otherwise
  *
- * In QUIRKS mode, the function loosely follows the JSON5 guidelines and will
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_text_double(m_string_writer *w, double value);
+
+/**
+ * @ingroup string
+ * @fn int string_text_double(m_string_writer *w, double value)
+ * @param w a writer
+ * @param value the number field
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * The number is written with the shortest representation which reads back
+ * to the same value.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_text_end(m_string_writer *w);
+
+/**
+ * @ingroup string
+ * @fn int string_text_end(m_string_writer *w)
+ * @param w a writer
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function ends the current record with a line feed.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+#ifdef _ENABLE_JSON
+/* -------------------------------------------------------------------------- */
+
+public int string_parse_json(m_string *s, char strict, m_json_parser *ctx);
+
+/**
+ * @ingroup string
+ * @fn m_string *string_parse_json(m_string *s, int strict, m_json_parser *ctx)
+ * @param s the string to be parsed
+ * @param strict boolean - enable or disable strict parsing
+ * @param ctx optional parser context
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function creates tokens for each JSON element in the provided string.
+ *
+ * In STRICT mode, the function rigorously follows RFC 7159 and will reject
+ * any non-compliant or malformed input.
+ *
+ * In QUIRKS mode, the function loosely follows the JSON5 guidelines and will
  * accept several popular extensions to the JSON specification:
  * - unquoted keys in objects (ECMAScript 5.1 IdentifierName),
  * - single quoted strings,
@@ -1593,6 +2681,460 @@ public int string_parse_json(m_string *s, char strict, m_json_parser *ctx);
  *
  */
 
+/* -------------------------------------------------------------------------- */
+
+public m_json_stream *string_json_stream_alloc(char strict, unsigned int depth,
+                                               m_json_parser *ctx);
+
+/**
+ * @ingroup string
+ * @fn m_json_stream *string_json_stream_alloc(char strict, unsigned int depth,
+ *                                             m_json_parser *ctx)
+ * @param strict boolean - enable or disable strict parsing
+ * @param depth the maximum nesting level, 0 for @ref JSON_STREAM_DEPTH
+ * @param ctx parser context
+ * @return NULL if an error occured, a new incremental parser otherwise
+ *
+ * This function creates a parser which accepts a JSON stream chunk by chunk
+ * with @ref string_json_stream_parse(), for instance as it is received from
+ * a socket. It accepts the same syntax as @ref string_parse_json() in the
+ * same STRICT and QUIRKS modes, but does not create any token: the callbacks
+ * of @b ctx are called as soon as each element is complete.
+ *
+ * The parser does not keep the input, its memory only depends on the
+ * maximum nesting level and on the size of the largest string or number
+ * split across two chunks.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_stream_parse(m_json_stream *js, const char *data,
+                                    size_t len);
+
+/**
+ * @ingroup string
+ * @fn int string_json_stream_parse(m_json_stream *js, const char *data,
+ *                                  size_t len)
+ * @param js the incremental parser
+ * @param data the next chunk of the stream
+ * @param len the size of the chunk
+ * @return -1 if an error occured, 1 if a callback stopped the parser,
+ *         0 otherwise
+ *
+ * This function parses the next chunk of a JSON stream. Each callback is
+ * given the type of the container of the element in @b ctx->parent and,
+ * within an object, the key of the element in @b ctx->key. The element data
+ * are only valid during the callback. If a callback returns 1, parsing stops
+ * and the rest of the stream is ignored.
+ *
+ * Once an error occured, the parser rejects any further input until
+ * @ref string_json_stream_end() is called.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_stream_end(m_json_stream *js);
+
+/**
+ * @ingroup string
+ * @fn int string_json_stream_end(m_json_stream *js)
+ * @param js the incremental parser
+ * @return -1 if the stream was empty, incomplete or invalid, 1 if a
+ *         callback stopped the parser, 0 otherwise
+ *
+ * This function signals the end of the stream, so that a trailing number
+ * is reported, and checks that all the elements were complete. Like
+ * json_checker, a stream holding only whitespace is rejected. The parser
+ * is then ready to parse a new stream.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_stream *string_json_stream_free(m_json_stream *js);
+
+/**
+ * @ingroup string
+ * @fn m_json_stream *string_json_stream_free(m_json_stream *js)
+ * @param js the incremental parser to destroy
+ * @return always NULL
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_scan_json(const char *data, size_t len, char strict,
+                            m_json_parser *ctx);
+
+/**
+ * @ingroup string
+ * @fn int string_scan_json(const char *data, size_t len, char strict,
+ *                          m_json_parser *ctx)
+ * @param data the JSON document
+ * @param len the size of the document
+ * @param strict boolean - enable or disable strict parsing
+ * @param ctx parser context
+ * @return -1 if an error occured or the document was empty or incomplete,
+ *         1 if a callback stopped the parser, 0 otherwise
+ *
+ * This function parses a complete JSON document and calls the callbacks of
+ * @b ctx exactly like @ref string_json_stream_parse() would, without creating
+ * any token.
+ *
+ * In STRICT mode, a first vectorized pass classifies 64 bytes at a time and
+ * builds a bitmap of the structural characters, string delimiters and
+ * primitives, and a second pass only visits the marked positions. Large
+ * documents are parsed several times faster than with the byte by byte
+ * parsers. In QUIRKS mode, the document is given to an incremental parser.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_doc *string_json_doc_alloc(const m_string *s);
+
+/**
+ * @ingroup string
+ * @fn m_json_doc *string_json_doc_alloc(const m_string *s)
+ * @param s the JSON document
+ * @return NULL if an error occured, a new lazy JSON document otherwise
+ *
+ * This function creates a read-only document over the JSON text of @b s.
+ * Nothing is parsed beforehand: the children of an object or an array are
+ * expanded the first time they are looked up, and only up to the requested
+ * one, so that the rest of a large document is never parsed, or only
+ * skipped. The nodes are allocated in an arena released with the document,
+ * and their data, keys, strings and numbers are slices of @b s, which must
+ * not be modified or freed before the document.
+ *
+ * The brackets of the document must be balanced, and only blanks may
+ * follow its top-level value. The expanded values are checked as in STRICT
+ * mode; a node which could not be expanded entirely is flagged with
+ * @ref HAS_ERROR. Use @ref string_scan_json() first to check the whole
+ * document.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_doc *string_json_doc_free(m_json_doc *doc);
+
+/**
+ * @ingroup string
+ * @fn m_json_doc *string_json_doc_free(m_json_doc *doc)
+ * @param doc the lazy JSON document to destroy
+ * @return always NULL
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_root(m_json_doc *doc);
+
+/**
+ * @ingroup string
+ * @fn m_json_node *string_json_root(m_json_doc *doc)
+ * @param doc a lazy JSON document
+ * @return NULL if the document is empty, its top-level value otherwise
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_next(m_json_doc *doc, m_json_node *node,
+                                     m_json_node *child);
+
+/**
+ * @ingroup string
+ * @fn m_json_node *string_json_next(m_json_doc *doc, m_json_node *node,
+ *                                   m_json_node *child)
+ * @param doc a lazy JSON document
+ * @param node an object or an array of the document
+ * @param child the current child, or NULL to get the first one
+ * @return NULL after the last child, the next child otherwise
+ *
+ * This function iterates over the values of an object or an array,
+ * expanding them one at a time. Within an object, the key of each value
+ * is given by its @b key and @b keylen fields.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_child(m_json_doc *doc, m_json_node *node,
+                                      const char *key, size_t len);
+
+/**
+ * @ingroup string
+ * @fn m_json_node *string_json_child(m_json_doc *doc, m_json_node *node,
+ *                                    const char *key, size_t len)
+ * @param doc a lazy JSON document
+ * @param node an object of the document
+ * @param key the key to look for
+ * @param len the length of the key
+ * @return NULL if the key was not found, its value otherwise
+ *
+ * The escape sequences of the keys of the document are decoded before they
+ * are compared with @b key.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_at(m_json_doc *doc, m_json_node *node,
+                                   unsigned int index);
+
+/**
+ * @ingroup string
+ * @fn m_json_node *string_json_at(m_json_doc *doc, m_json_node *node,
+ *                                 unsigned int index)
+ * @param doc a lazy JSON document
+ * @param node an array of the document
+ * @param index the position of the value
+ * @return NULL if the array is too short, the value otherwise
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_path *string_json_path_compile(const char *pointer);
+
+/**
+ * @ingroup string
+ * @fn m_json_path *string_json_path_compile(const char *pointer)
+ * @param pointer a JSON pointer, e.g. "/user/id"
+ * @return NULL if an error occured, the compiled path otherwise
+ *
+ * This function splits and decodes a JSON pointer (RFC 6901) once, so that
+ * a handler can look the same path up in each document it receives with
+ * @ref string_json_lookup().
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_path *string_json_path_free(m_json_path *path);
+
+/**
+ * @ingroup string
+ * @fn m_json_path *string_json_path_free(m_json_path *path)
+ * @param path the compiled path to destroy
+ * @return always NULL
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_lookup(m_json_doc *doc,
+                                       const m_json_path *path);
+
+/**
+ * @ingroup string
+ * @fn m_json_node *string_json_lookup(m_json_doc *doc,
+ *                                     const m_json_path *path)
+ * @param doc a lazy JSON document
+ * @param path a compiled path
+ * @return NULL if the path does not exist, its value otherwise
+ *
+ * Only the containers along the path are expanded, and only up to the
+ * requested values.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_json_node *string_json_get(m_json_doc *doc, const char *pointer);
+
+/**
+ * @ingroup string
+ * @fn m_json_node *string_json_get(m_json_doc *doc, const char *pointer)
+ * @param doc a lazy JSON document
+ * @param pointer a JSON pointer, e.g. "/user/id"
+ * @return NULL if the path does not exist, its value otherwise
+ *
+ * This function is a shortcut for @ref string_json_path_compile() followed
+ * by @ref string_json_lookup().
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_integer(const m_json_node *node, int64_t *value);
+
+/**
+ * @ingroup string
+ * @fn int string_json_integer(const m_json_node *node, int64_t *value)
+ * @param node a primitive of the document
+ * @param value the decoded integer
+ * @return -1 if the value is not an integer or overflows, 0 otherwise
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_number(const m_json_node *node, double *value);
+
+/**
+ * @ingroup string
+ * @fn int string_json_number(const m_json_node *node, double *value)
+ * @param node a primitive of the document
+ * @param value the decoded number
+ * @return -1 if the value is not a number, 0 otherwise
+ *
+ * The numbers are only decoded when requested.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_begin_object(m_string_writer *w);
+
+/**
+ * @ingroup string
+ * @fn int string_json_begin_object(m_string_writer *w)
+ * @param w a writer
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function opens an object, closed with @ref string_json_end(). Within
+ * an object, each value must follow a @ref string_json_key(): the value
+ * writers return -1 when called in an object without a pending key.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_begin_array(m_string_writer *w);
+
+/**
+ * @ingroup string
+ * @fn int string_json_begin_array(m_string_writer *w)
+ * @param w a writer
+ * @return -1 if an error occured, 0 otherwise
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_end(m_string_writer *w);
+
+/**
+ * @ingroup string
+ * @fn int string_json_end(m_string_writer *w)
+ * @param w a writer
+ * @return -1 if no object or array is open or a key has no value, 0 otherwise
+ *
+ * This function closes the innermost object or array.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_key(m_string_writer *w, const char *key, size_t len);
+
+/**
+ * @ingroup string
+ * @fn int string_json_key(m_string_writer *w, const char *key, size_t len)
+ * @param w a writer
+ * @param key the key of the next value
+ * @param len the length of the key
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * A key can only be written within an object, and must be followed by its
+ * value before the next key.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_str(m_string_writer *w, const char *data, size_t len);
+
+/**
+ * @ingroup string
+ * @fn int string_json_str(m_string_writer *w, const char *data, size_t len)
+ * @param w a writer
+ * @param data a UTF-8 string
+ * @param len the length of the string
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function writes an escaped string. Double quotes, backslashes and
+ * control characters are escaped, other characters are copied as is.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_int(m_string_writer *w, int64_t value);
+
+/**
+ * @ingroup string
+ * @fn int string_json_int(m_string_writer *w, int64_t value)
+ * @param w a writer
+ * @param value the integer
+ * @return -1 if an error occured, 0 otherwise
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_double(m_string_writer *w, double value);
+
+/**
+ * @ingroup string
+ * @fn int string_json_double(m_string_writer *w, double value)
+ * @param w a writer
+ * @param value the number
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * The number is written with the shortest representation which reads back
+ * to the same value. JSON has no representation for NaN and infinities,
+ * they are written as null.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_bool(m_string_writer *w, int value);
+
+/**
+ * @ingroup string
+ * @fn int string_json_bool(m_string_writer *w, int value)
+ * @param w a writer
+ * @param value boolean
+ * @return -1 if an error occured, 0 otherwise
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_null(m_string_writer *w);
+
+/**
+ * @ingroup string
+ * @fn int string_json_null(m_string_writer *w)
+ * @param w a writer
+ * @return -1 if an error occured, 0 otherwise
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int string_json_raw(m_string_writer *w, const char *json, size_t len);
+
+/**
+ * @ingroup string
+ * @fn int string_json_raw(m_string_writer *w, const char *json, size_t len)
+ * @param w a writer
+ * @param json a serialized JSON value
+ * @param len the length of the value
+ * @return -1 if an error occured, 0 otherwise
+ *
+ * This function writes a value which is already serialized, for instance a
+ * node of a lazy JSON document, without checking it.
+ *
+ */
+
 /* -------------------------------------------------------------------------- */
 #endif
 /* -------------------------------------------------------------------------- */
@@ -255,6 +255,34 @@ public void *shm_attach(const char *name, size_t size)
 
 /* -------------------------------------------------------------------------- */
 
+public const void *shm_attach_readonly(const char *name, size_t size)
+{
+    HANDLE hmap = NULL;
+    void *ret = NULL;
+
+    if (! name || ! size) return NULL;
+
+    hmap = OpenFileMapping(FILE_MAP_READ, 0, name);
+    if (! hmap) {
+        perror(ERR(shm_attach_readonly, OpenFileMapping));
+        return NULL;
+    }
+
+    /* map the shared memory without write access */
+    ret = MapViewOfFileEx(hmap, FILE_MAP_READ, 0, 0, size, NULL);
+
+    CloseHandle(hmap);
+
+    if (! ret) {
+        perror(ERR(shm_attach_readonly, MapViewOfFileEx));
+        return NULL;
+    }
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public void shm_detach(void *start, UNUSED size_t _dummy)
 {
     /* we already dropped the reference of the map object, just unmap it */
@@ -344,7 +372,7 @@ public void *shm_attach(const char *name, size_t size)
 
     /* try to get the shared memory descriptor */
     shm = shm_open(name, O_RDWR, 0);
-    if (shm == -1) { perror(ERR(shm_attach, shm_open)); }
+    if (shm == -1) { perror(ERR(shm_attach, shm_open)); return NULL; }
 
     /* map the shared memory to the process address space */
     ret = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0x0);
@@ -357,6 +385,30 @@ public void *shm_attach(const char *name, size_t size)
 
 /* -------------------------------------------------------------------------- */
 
+public const void *shm_attach_readonly(const char *name, size_t size)
+{
+    int shm = 0;
+    void *ret = NULL;
+
+    if (! name || ! size) return NULL;
+
+    /* the segment may belong to another user, only ask for read access */
+    shm = shm_open(name, O_RDONLY, 0);
+    if (shm == -1) { perror(ERR(shm_attach_readonly, shm_open)); return NULL; }
+
+    ret = mmap(NULL, size, PROT_READ, MAP_SHARED, shm, 0x0);
+    if (ret == MAP_FAILED) {
+        perror(ERR(shm_attach_readonly, mmap));
+        ret = NULL;
+    }
+
+    close(shm);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
 public void shm_detach(void *start, size_t size)
 {
     munmap(start, size);
@@ -140,6 +140,7 @@ public int get_page_size(void);
 public void posix_memfree(void *memblock);
 public void *shm_alloc(const char *name, size_t size);
 public void *shm_attach(const char *name, size_t size);
+public const void *shm_attach_readonly(const char *name, size_t size);
 public void shm_detach(void *start, size_t size);
 public void shm_free(const char *name, void *start, size_t size);
 
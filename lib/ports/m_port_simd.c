@@ -0,0 +1,1534 @@
+/*******************************************************************************
+ *  Concrete Server                                                            *
+ *  Copyright (c) 2005-2024 Raphael Prevost <raph@el.bzh>                      *
+ *                                                                             *
+ *  This software is a computer program whose purpose is to provide a          *
+ *  framework for developing and prototyping network services.                 *
+ *                                                                             *
+ *  This software is governed by the CeCILL  license under French law and      *
+ *  abiding by the rules of distribution of free software.  You can  use,      *
+ *  modify and/ or redistribute the software under the terms of the CeCILL     *
+ *  license as circulated by CEA, CNRS and INRIA at the following URL          *
+ *  "http://www.cecill.info".                                                  *
+ *                                                                             *
+ *  As a counterpart to the access to the source code and  rights to copy,     *
+ *  modify and redistribute granted by the license, users are provided only    *
+ *  with a limited warranty  and the software's author,  the holder of the     *
+ *  economic rights,  and the successive licensors  have only  limited         *
+ *  liability.                                                                 *
+ *                                                                             *
+ *  In this respect, the user's attention is drawn to the risks associated     *
+ *  with loading,  using,  modifying and/or developing or reproducing the      *
+ *  software by the user in light of its specific status of free software,     *
+ *  that may mean  that it is complicated to manipulate,  and  that  also      *
+ *  therefore means  that it is reserved for developers  and  experienced      *
+ *  professionals having in-depth computer knowledge. Users are therefore      *
+ *  encouraged to load and test the software's suitability as regards their    *
+ *  requirements in conditions enabling the security of their systems and/or   *
+ *  data to be ensured and,  more generally, to use and operate it in the      *
+ *  same conditions as regards security.                                       *
+ *                                                                             *
+ *  The fact that you are presently reading this means that you have had       *
+ *  knowledge of the CeCILL license and that you accept its terms.             *
+ *                                                                             *
+ ******************************************************************************/
+
+/* vectorized primitives, included by the modules that need them; the SSE2
+   versions are the baseline on x86, the SSSE3 and AVX2 ones are selected at
+   runtime */
+
+#if defined(__GNUC__) && defined(__SSE2__) && \
+    (defined(__i386__) || defined(__x86_64__))
+#define _SIMD_SSE2
+#include <emmintrin.h>
+#if (__GNUC__ >= 5) || defined(__clang__)
+#define _SIMD_SSSE3
+#define _SIMD_SSE42
+#define _SIMD_SHA
+#define _SIMD_AVX2
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+#endif
+
+#define SIMD_NONE 0
+#define SIMD_SSE2 1
+#define SIMD_AVX2 2
+
+/* -------------------------------------------------------------------------- */
+
+static inline int __simd_level(void)
+{
+    #if defined(_SIMD_AVX2)
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    #endif
+
+    #if defined(_SIMD_SSE2)
+    return SIMD_SSE2;
+    #else
+    return SIMD_NONE;
+    #endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline int __simd_ssse3(void)
+{
+    /* byte shuffles are needed by table lookups, SSE2 does not have them */
+    #if defined(_SIMD_SSSE3)
+    return __builtin_cpu_supports("ssse3");
+    #else
+    return 0;
+    #endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline int __simd_sse42(void)
+{
+    #if defined(_SIMD_SSE42)
+    return __builtin_cpu_supports("sse4.2");
+    #else
+    return 0;
+    #endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline int __simd_sha(void)
+{
+    /* the SHA extensions are not known by every __builtin_cpu_supports(),
+       so ask cpuid once; the SHA-NI kernels also use SSSE3 and SSE4.1 */
+    #if defined(_SIMD_SHA)
+    static int sha = -1;
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+
+    if (sha == -1) {
+        if (__get_cpuid_max(0, NULL) >= 7) __cpuid_count(7, 0, a, b, c, d);
+        sha = ((b >> 29) & 1) && __builtin_cpu_supports("sse4.1");
+    }
+
+    return sha;
+    #else
+    return 0;
+    #endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline const char *__naive_find(const char *s, size_t n,
+                                       const char *sub, size_t len)
+{
+    const char *p = s, *end = s + n - len + 1;
+
+    while ( (p = memchr(p, sub[0], end - p)) ) {
+        if (! memcmp(p + 1, sub + 1, len - 1)) return p;
+        p ++;
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SSE2
+/* -------------------------------------------------------------------------- */
+
+static const char *__sse2_find(const char *s, size_t n,
+                               const char *sub, size_t len)
+{
+    /* compare the first and the last byte of the needle with 16 candidate
+       positions at once, and only check the middle of the matching ones */
+
+    const __m128i first = _mm_set1_epi8(sub[0]);
+    const __m128i last = _mm_set1_epi8(sub[len - 1]);
+    __m128i a, b;
+    uint32_t mask = 0;
+    size_t i = 0;
+
+    for (i = 0; i + len - 1 + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i *) (s + i));
+        b = _mm_loadu_si128((const __m128i *) (s + i + len - 1));
+
+        mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                               _mm_cmpeq_epi8(b, last)));
+
+        while (mask) {
+            const char *p = s + i + __ctz(mask);
+
+            if (len < 3 || ! memcmp(p + 1, sub + 1, len - 2)) return p;
+
+            mask &= mask - 1;
+        }
+    }
+
+    if (i + len > n) return NULL;
+
+    return __naive_find(s + i, n - i, sub, len);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+#ifdef _SIMD_AVX2
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static const char *__avx2_find(const char *s, size_t n,
+                               const char *sub, size_t len)
+{
+    const __m256i first = _mm256_set1_epi8(sub[0]);
+    const __m256i last = _mm256_set1_epi8(sub[len - 1]);
+    __m256i a, b;
+    uint32_t mask = 0;
+    size_t i = 0;
+
+    for (i = 0; i + len - 1 + 32 <= n; i += 32) {
+        a = _mm256_loadu_si256((const __m256i *) (s + i));
+        b = _mm256_loadu_si256((const __m256i *) (s + i + len - 1));
+
+        mask = _mm256_movemask_epi8(_mm256_and_si256(
+                                        _mm256_cmpeq_epi8(a, first),
+                                        _mm256_cmpeq_epi8(b, last)));
+
+        while (mask) {
+            const char *p = s + i + __ctz(mask);
+
+            if (len < 3 || ! memcmp(p + 1, sub + 1, len - 2)) return p;
+
+            mask &= mask - 1;
+        }
+    }
+
+    if (i + len > n) return NULL;
+
+    return __naive_find(s + i, n - i, sub, len);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline const char *__naive_find_any(const char *s, size_t n,
+                                           const uint8_t *b, unsigned int k)
+{
+    unsigned int j = 0;
+
+    for (; n; n --, s ++)
+        for (j = 0; j < k; j ++) if ((uint8_t) *s == b[j]) return s;
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SSE2
+/* -------------------------------------------------------------------------- */
+
+static const char *__sse2_find_any(const char *s, size_t n,
+                                   const uint8_t *b, unsigned int k)
+{
+    /* locate the first byte belonging to a set of at most 4 bytes */
+
+    __m128i set[4], a, eq;
+    uint32_t mask = 0;
+    unsigned int j = 0;
+    size_t i = 0;
+
+    for (j = 0; j < k; j ++) set[j] = _mm_set1_epi8(b[j]);
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i *) (s + i));
+        eq = _mm_cmpeq_epi8(a, set[0]);
+        for (j = 1; j < k; j ++) eq = _mm_or_si128(eq, _mm_cmpeq_epi8(a, set[j]));
+        if ( (mask = _mm_movemask_epi8(eq)) ) return s + i + __ctz(mask);
+    }
+
+    return __naive_find_any(s + i, n - i, b, k);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+#ifdef _SIMD_AVX2
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static const char *__avx2_find_any(const char *s, size_t n,
+                                   const uint8_t *b, unsigned int k)
+{
+    __m256i set[4], a, eq;
+    uint32_t mask = 0;
+    unsigned int j = 0;
+    size_t i = 0;
+
+    for (j = 0; j < k; j ++) set[j] = _mm256_set1_epi8(b[j]);
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        a = _mm256_loadu_si256((const __m256i *) (s + i));
+        eq = _mm256_cmpeq_epi8(a, set[0]);
+        for (j = 1; j < k; j ++)
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(a, set[j]));
+        if ( (mask = _mm256_movemask_epi8(eq)) ) return s + i + __ctz(mask);
+    }
+
+    return __naive_find_any(s + i, n - i, b, k);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline const char *__simd_find_any(int level, const char *s, size_t n,
+                                          const uint8_t *b, unsigned int k)
+{
+    if (k == 1) return memchr(s, b[0], n);
+
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: return __avx2_find_any(s, n, b, k);
+    #endif
+    #ifdef _SIMD_SSE2
+    case SIMD_SSE2: return __sse2_find_any(s, n, b, k);
+    #endif
+    default: return __naive_find_any(s, n, b, k);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline const char *__simd_find(int level, const char *s, size_t n,
+                                      const char *sub, size_t len)
+{
+    /* the C library already vectorizes single byte searches */
+    if (len == 1) return memchr(s, sub[0], n);
+
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: return __avx2_find(s, n, sub, len);
+    #endif
+    #ifdef _SIMD_SSE2
+    case SIMD_SSE2: return __sse2_find(s, n, sub, len);
+    #endif
+    default: return __naive_find(s, n, sub, len);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* character classes of a 64 bytes block, one bit per byte, used by the
+   structural indexing of JSON documents */
+typedef struct __json_masks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t structural;
+    uint64_t space;
+    uint64_t control;
+} __json_masks;
+
+/* -------------------------------------------------------------------------- */
+
+static inline void __naive_json_classify(const char *s, __json_masks *m)
+{
+    unsigned int i = 0;
+    uint64_t bit = 0;
+
+    memset(m, 0, sizeof(*m));
+
+    for (i = 0; i < 64; i ++) {
+        bit = (uint64_t) 1 << i;
+        switch (s[i]) {
+        case '"': m->quote |= bit; break;
+        case '\\': m->backslash |= bit; break;
+        case '{': case '}': case '[': case ']': case ':': case ',':
+            m->structural |= bit; break;
+        case ' ': case '\r': case '\n': case '\t': m->space |= bit; break;
+        }
+        if ((uint8_t) s[i] < 0x20) m->control |= bit;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SSE2
+/* -------------------------------------------------------------------------- */
+
+static void __sse2_json_classify(const char *s, __json_masks *m)
+{
+    /* brackets and braces only differ by the 0x20 bit, so folding it lets
+       two comparisons match the four of them */
+
+    const __m128i quote = _mm_set1_epi8('"'), bs = _mm_set1_epi8('\\');
+    const __m128i open = _mm_set1_epi8('{'), close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':'), comma = _mm_set1_epi8(',');
+    const __m128i fold = _mm_set1_epi8(0x20), ctrl = _mm_set1_epi8(0x1F);
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    __m128i a, f, eq;
+    unsigned int i = 0;
+    uint64_t shift = 0;
+
+    memset(m, 0, sizeof(*m));
+
+    for (i = 0; i < 64; i += 16) {
+        a = _mm_loadu_si128((const __m128i *) (s + i));
+        f = _mm_or_si128(a, fold);
+        shift = i;
+
+        m->quote |= (uint64_t) (uint16_t)
+                    _mm_movemask_epi8(_mm_cmpeq_epi8(a, quote)) << shift;
+        m->backslash |= (uint64_t) (uint16_t)
+                        _mm_movemask_epi8(_mm_cmpeq_epi8(a, bs)) << shift;
+
+        eq = _mm_or_si128(_mm_cmpeq_epi8(f, open), _mm_cmpeq_epi8(f, close));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi8(a, colon));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi8(a, comma));
+        m->structural |= (uint64_t) (uint16_t) _mm_movemask_epi8(eq) << shift;
+
+        eq = _mm_or_si128(_mm_cmpeq_epi8(a, sp), _mm_cmpeq_epi8(a, tab));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi8(a, lf));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi8(a, cr));
+        m->space |= (uint64_t) (uint16_t) _mm_movemask_epi8(eq) << shift;
+
+        eq = _mm_cmpeq_epi8(_mm_max_epu8(a, ctrl), ctrl);
+        m->control |= (uint64_t) (uint16_t) _mm_movemask_epi8(eq) << shift;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+#ifdef _SIMD_AVX2
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static void __avx2_json_classify(const char *s, __json_masks *m)
+{
+    const __m256i quote = _mm256_set1_epi8('"'), bs = _mm256_set1_epi8('\\');
+    const __m256i open = _mm256_set1_epi8('{'), close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':'), comma = _mm256_set1_epi8(',');
+    const __m256i fold = _mm256_set1_epi8(0x20), ctrl = _mm256_set1_epi8(0x1F);
+    const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+    __m256i a, f, eq;
+    unsigned int i = 0;
+    uint64_t shift = 0;
+
+    memset(m, 0, sizeof(*m));
+
+    for (i = 0; i < 64; i += 32) {
+        a = _mm256_loadu_si256((const __m256i *) (s + i));
+        f = _mm256_or_si256(a, fold);
+        shift = i;
+
+        m->quote |= (uint64_t) (uint32_t)
+                    _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, quote)) << shift;
+        m->backslash |= (uint64_t) (uint32_t)
+                        _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, bs)) << shift;
+
+        eq = _mm256_or_si256(_mm256_cmpeq_epi8(f, open),
+                             _mm256_cmpeq_epi8(f, close));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(a, colon));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(a, comma));
+        m->structural |= (uint64_t) (uint32_t)
+                         _mm256_movemask_epi8(eq) << shift;
+
+        eq = _mm256_or_si256(_mm256_cmpeq_epi8(a, sp),
+                             _mm256_cmpeq_epi8(a, tab));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(a, lf));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(a, cr));
+        m->space |= (uint64_t) (uint32_t) _mm256_movemask_epi8(eq) << shift;
+
+        eq = _mm256_cmpeq_epi8(_mm256_max_epu8(a, ctrl), ctrl);
+        m->control |= (uint64_t) (uint32_t) _mm256_movemask_epi8(eq) << shift;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline void __simd_json_classify(int level, const char *s,
+                                        __json_masks *m)
+{
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: __avx2_json_classify(s, m); break;
+    #endif
+    #ifdef _SIMD_SSE2
+    case SIMD_SSE2: __sse2_json_classify(s, m); break;
+    #endif
+    default: __naive_json_classify(s, m);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline const char *__naive_find_escape(const char *s, size_t n)
+{
+    for (; n; n --, s ++)
+        if (*s == '"' || *s == '\\' || (uint8_t) *s < 0x20) return s;
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SSE2
+/* -------------------------------------------------------------------------- */
+
+static const char *__sse2_find_escape(const char *s, size_t n)
+{
+    /* locate the first character to escape in a JSON string */
+
+    const __m128i quote = _mm_set1_epi8('"'), bs = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    __m128i a, eq;
+    uint32_t mask = 0;
+    size_t i = 0;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i *) (s + i));
+        eq = _mm_or_si128(_mm_cmpeq_epi8(a, quote), _mm_cmpeq_epi8(a, bs));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi8(_mm_max_epu8(a, ctrl), ctrl));
+        if ( (mask = _mm_movemask_epi8(eq)) ) return s + i + __ctz(mask);
+    }
+
+    return __naive_find_escape(s + i, n - i);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+#ifdef _SIMD_AVX2
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static const char *__avx2_find_escape(const char *s, size_t n)
+{
+    const __m256i quote = _mm256_set1_epi8('"'), bs = _mm256_set1_epi8('\\');
+    const __m256i ctrl = _mm256_set1_epi8(0x1F);
+    __m256i a, eq;
+    uint32_t mask = 0;
+    size_t i = 0;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        a = _mm256_loadu_si256((const __m256i *) (s + i));
+        eq = _mm256_or_si256(_mm256_cmpeq_epi8(a, quote),
+                             _mm256_cmpeq_epi8(a, bs));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(_mm256_max_epu8(a, ctrl),
+                                                   ctrl));
+        if ( (mask = _mm256_movemask_epi8(eq)) ) return s + i + __ctz(mask);
+    }
+
+    return __naive_find_escape(s + i, n - i);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline const char *__simd_find_escape(int level, const char *s,
+                                             size_t n)
+{
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: return __avx2_find_escape(s, n);
+    #endif
+    #ifdef _SIMD_SSE2
+    case SIMD_SSE2: return __sse2_find_escape(s, n);
+    #endif
+    default: return __naive_find_escape(s, n);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline const char *__naive_skip_alnum(const char *s, size_t n)
+{
+    for (; n && isalnum((unsigned char) *s); n --, s ++);
+
+    return s;
+}
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SSE2
+/* -------------------------------------------------------------------------- */
+
+static const char *__sse2_skip_alnum(const char *s, size_t n)
+{
+    /* locate the first byte which is not an ASCII letter or digit; bytes
+       above 0x7f are negative and fail both signed range checks */
+
+    const __m128i d0 = _mm_set1_epi8('0' - 1), d9 = _mm_set1_epi8('9' + 1);
+    const __m128i la = _mm_set1_epi8('a' - 1), lz = _mm_set1_epi8('z' + 1);
+    const __m128i fold = _mm_set1_epi8(0x20);
+    __m128i a, f, ok;
+    uint32_t mask = 0;
+    size_t i = 0;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i *) (s + i));
+        f = _mm_or_si128(a, fold);
+        ok = _mm_and_si128(_mm_cmpgt_epi8(a, d0), _mm_cmpgt_epi8(d9, a));
+        ok = _mm_or_si128(ok, _mm_and_si128(_mm_cmpgt_epi8(f, la),
+                                            _mm_cmpgt_epi8(lz, f)));
+        if ( (mask = _mm_movemask_epi8(ok) ^ 0xFFFF) )
+            return s + i + __ctz(mask);
+    }
+
+    return __naive_skip_alnum(s + i, n - i);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+#ifdef _SIMD_AVX2
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static const char *__avx2_skip_alnum(const char *s, size_t n)
+{
+    const __m256i d0 = _mm256_set1_epi8('0' - 1), d9 = _mm256_set1_epi8('9' + 1);
+    const __m256i la = _mm256_set1_epi8('a' - 1), lz = _mm256_set1_epi8('z' + 1);
+    const __m256i fold = _mm256_set1_epi8(0x20);
+    __m256i a, f, ok;
+    uint32_t mask = 0;
+    size_t i = 0;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        a = _mm256_loadu_si256((const __m256i *) (s + i));
+        f = _mm256_or_si256(a, fold);
+        ok = _mm256_and_si256(_mm256_cmpgt_epi8(a, d0),
+                              _mm256_cmpgt_epi8(d9, a));
+        ok = _mm256_or_si256(ok, _mm256_and_si256(_mm256_cmpgt_epi8(f, la),
+                                                  _mm256_cmpgt_epi8(lz, f)));
+        if ( (mask = ~ (uint32_t) _mm256_movemask_epi8(ok)) )
+            return s + i + __ctz(mask);
+    }
+
+    return __naive_skip_alnum(s + i, n - i);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline const char *__simd_skip_alnum(int level, const char *s,
+                                            size_t n)
+{
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: return __avx2_skip_alnum(s, n);
+    #endif
+    #ifdef _SIMD_SSE2
+    case SIMD_SSE2: return __sse2_skip_alnum(s, n);
+    #endif
+    default: return __naive_skip_alnum(s, n);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* base64 with byte shuffles (Mula, Lemire): the encoder spreads 3 bytes over
+   4 lanes and isolates the 6 bit fields with two multiplications, the decoder
+   validates and translates with nibble lookups and packs with multiply-adds.
+   Both only process whole blocks and return what they consumed, the caller
+   finishes the job, and the decoder stops before a block holding any
+   character outside of the alphabet, the padding included. */
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SSSE3
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("ssse3")))
+static inline __m128i __ssse3_b64_map(__m128i i)
+{
+    /* the range of each 6 bit index selects the offset to its character */
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '+' - 62,
+                                          '/' - 63, 'A', 0, 0);
+    __m128i r = _mm_subs_epu8(i, _mm_set1_epi8(51));
+
+    r = _mm_or_si128(r, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), i),
+                                      _mm_set1_epi8(13)));
+
+    return _mm_add_epi8(i, _mm_shuffle_epi8(offsets, r));
+}
+
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("ssse3")))
+static size_t __ssse3_b64_encode(const uint8_t *in, size_t n, char *out)
+{
+    const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                         7, 6, 8, 7, 10, 9, 11, 10);
+    __m128i a, hi, lo;
+    size_t i = 0;
+
+    for (i = 0; i + 16 <= n; i += 12, out += 16) {
+        a = _mm_loadu_si128((const __m128i *) (in + i));
+        a = _mm_shuffle_epi8(a, spread);
+        hi = _mm_mulhi_epu16(_mm_and_si128(a, _mm_set1_epi32(0x0fc0fc00)),
+                             _mm_set1_epi32(0x04000040));
+        lo = _mm_mullo_epi16(_mm_and_si128(a, _mm_set1_epi32(0x003f03f0)),
+                             _mm_set1_epi32(0x01000010));
+        _mm_storeu_si128((__m128i *) out, __ssse3_b64_map(_mm_or_si128(hi, lo)));
+    }
+
+    return i;
+}
+
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("ssse3")))
+static size_t __ssse3_b64_decode(const char *in, size_t n, uint8_t *out,
+                                 size_t *used)
+{
+    /* lut_lo and lut_hi share a bit for every invalid character; 0x2f is
+       both the nibble mask (bit 5 is ignored by the shuffles) and '/' */
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                         0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                         0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                       14, 13, 12, -1, -1, -1, -1);
+    const __m128i m2f = _mm_set1_epi8(0x2f);
+    __m128i a, hi, lo;
+    size_t i = 0, j = 0;
+
+    for (i = 0; i + 16 <= n; i += 16, j += 12) {
+        a = _mm_loadu_si128((const __m128i *) (in + i));
+        hi = _mm_and_si128(_mm_srli_epi32(a, 4), m2f);
+        lo = _mm_and_si128(a, m2f);
+
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(
+                _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo),
+                              _mm_shuffle_epi8(lut_hi, hi)),
+                _mm_setzero_si128())))
+            break;
+
+        a = _mm_add_epi8(a, _mm_shuffle_epi8(lut_roll,
+                         _mm_add_epi8(_mm_cmpeq_epi8(a, m2f), hi)));
+
+        /* 4 x 6 bits to 3 bytes, 12 bytes are stored out of 16 */
+        a = _mm_maddubs_epi16(a, _mm_set1_epi32(0x01400140));
+        a = _mm_madd_epi16(a, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i *) (out + j), _mm_shuffle_epi8(a, pack));
+    }
+
+    *used = i;
+
+    return j;
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+#ifdef _SIMD_AVX2
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static inline __m256i __avx2_b64_map(__m256i i)
+{
+    const __m256i offsets = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+    __m256i r = _mm256_subs_epu8(i, _mm256_set1_epi8(51));
+
+    r = _mm256_or_si256(r, _mm256_and_si256(
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(26), i), _mm256_set1_epi8(13)));
+
+    return _mm256_add_epi8(i, _mm256_shuffle_epi8(offsets, r));
+}
+
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static size_t __avx2_b64_encode(const uint8_t *in, size_t n, char *out)
+{
+    /* 24 bytes in, 32 characters out, 12 bytes in each lane */
+    const __m256i spread = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m256i a, hi, lo;
+    size_t i = 0;
+
+    for (i = 0; i + 28 <= n; i += 24, out += 32) {
+        a = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                _mm_loadu_si128((const __m128i *) (in + i))),
+                _mm_loadu_si128((const __m128i *) (in + i + 12)), 1);
+        a = _mm256_shuffle_epi8(a, spread);
+        hi = _mm256_mulhi_epu16(
+                _mm256_and_si256(a, _mm256_set1_epi32(0x0fc0fc00)),
+                _mm256_set1_epi32(0x04000040));
+        lo = _mm256_mullo_epi16(
+                _mm256_and_si256(a, _mm256_set1_epi32(0x003f03f0)),
+                _mm256_set1_epi32(0x01000010));
+        _mm256_storeu_si256((__m256i *) out,
+                            __avx2_b64_map(_mm256_or_si256(hi, lo)));
+    }
+
+    return i;
+}
+
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static size_t __avx2_b64_decode(const char *in, size_t n, uint8_t *out,
+                                size_t *used)
+{
+    const __m256i lut_lo = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A));
+    const __m256i lut_hi = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+    const __m256i lut_roll = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                      0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i pack = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                      -1, -1, -1, -1));
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    const __m256i m2f = _mm256_set1_epi8(0x2f);
+    __m256i a, hi, lo;
+    size_t i = 0, j = 0;
+
+    for (i = 0; i + 32 <= n; i += 32, j += 24) {
+        a = _mm256_loadu_si256((const __m256i *) (in + i));
+        hi = _mm256_and_si256(_mm256_srli_epi32(a, 4), m2f);
+        lo = _mm256_and_si256(a, m2f);
+
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(
+                _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, lo),
+                                 _mm256_shuffle_epi8(lut_hi, hi)),
+                _mm256_setzero_si256())))
+            break;
+
+        a = _mm256_add_epi8(a, _mm256_shuffle_epi8(lut_roll,
+                            _mm256_add_epi8(_mm256_cmpeq_epi8(a, m2f), hi)));
+
+        /* 12 bytes at the start of each lane, then packed together */
+        a = _mm256_maddubs_epi16(a, _mm256_set1_epi32(0x01400140));
+        a = _mm256_madd_epi16(a, _mm256_set1_epi32(0x00011000));
+        a = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(a, pack), lanes);
+        _mm256_storeu_si256((__m256i *) (out + j), a);
+    }
+
+    *used = i;
+
+    return j;
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline size_t __simd_b64_encode(int level, const uint8_t *in, size_t n,
+                                       char *out)
+{
+    /* returns the number of bytes encoded, always a multiple of 3 */
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: return __avx2_b64_encode(in, n, out);
+    #endif
+    #ifdef _SIMD_SSSE3
+    case SIMD_SSE2: return (__simd_ssse3()) ? __ssse3_b64_encode(in, n, out) : 0;
+    #endif
+    default: return 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline size_t __simd_b64_decode(int level, const char *in, size_t n,
+                                       uint8_t *out, size_t *used)
+{
+    /* returns the number of bytes decoded, and stores in used the number of
+       characters consumed; the stores go past the decoded bytes but never
+       past out + used, so an output as large as the input is enough and
+       decoding in place is safe */
+    *used = 0;
+
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: return __avx2_b64_decode(in, n, out, used);
+    #endif
+    #ifdef _SIMD_SSSE3
+    case SIMD_SSE2:
+        return (__simd_ssse3()) ? __ssse3_b64_decode(in, n, out, used) : 0;
+    #endif
+    default: return 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SSE42
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("sse4.2")))
+static size_t __sse42_crc32c(uint32_t *crc, const uint8_t *p, size_t n)
+{
+    /* the crc32 instruction computes the Castagnoli polynomial, 8 bytes at
+       a time on 64 bit hosts */
+    uint32_t c = *crc;
+    size_t i = 0;
+
+    #if defined(__x86_64__)
+    uint64_t w = 0, c64 = 0;
+
+    for ( ; i < n && ((uintptr_t) (p + i) & 7); i ++)
+        c = _mm_crc32_u8(c, p[i]);
+
+    for (c64 = c; i + 8 <= n; i += 8) {
+        memcpy(& w, p + i, sizeof(w));
+        c64 = _mm_crc32_u64(c64, w);
+    }
+    c = (uint32_t) c64;
+    #else
+    uint32_t w = 0;
+
+    for ( ; i + 4 <= n; i += 4) {
+        memcpy(& w, p + i, sizeof(w));
+        c = _mm_crc32_u32(c, w);
+    }
+    #endif
+
+    for ( ; i < n; i ++) c = _mm_crc32_u8(c, p[i]);
+
+    *crc = c;
+
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline size_t __simd_crc32c(int level, uint32_t *crc, const uint8_t *p,
+                                   size_t n)
+{
+    /* returns the number of bytes processed, 0 if the scalar code has
+       to be used */
+    #ifdef _SIMD_SSE42
+    if (level != SIMD_NONE && __simd_sse42()) return __sse42_crc32c(crc, p, n);
+    #endif
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SHA
+/* -------------------------------------------------------------------------- */
+
+/* four SHA-1 rounds: e carries the fifth state word, f selects the round
+   function and the constant */
+#define __SHA1_QROUND(e0, e1, m, f)                         \
+    do {                                                    \
+        e0 = _mm_sha1nexte_epu32(e0, m); e1 = abcd;         \
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, f);            \
+    } while (0)
+
+/* message schedule: m1 + 4 is derived from m1 ^ m3 ^ m1 + 2 ^ m1 + 3 */
+#define __SHA1_SCHED(m0, m1, m2, m3)                        \
+    do {                                                    \
+        m1 = _mm_sha1msg2_epu32(m1, m0);                    \
+        m3 = _mm_sha1msg1_epu32(m3, m0);                    \
+        m2 = _mm_xor_si128(m2, m0);                         \
+    } while (0)
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void __shani_sha1(uint32_t *h, const uint8_t *data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+                                        0x08090a0b0c0d0e0fULL);
+    __m128i abcd, abcd_save, e0, e0_save, e1, m0, m1, m2, m3;
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) h), 0x1b);
+    e0 = _mm_set_epi32((int) h[4], 0, 0, 0);
+
+    for ( ; blocks; blocks --, data += 64) {
+        abcd_save = abcd; e0_save = e0;
+
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), mask);
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)),
+                              mask);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)),
+                              mask);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)),
+                              mask);
+
+        /* rounds 0 to 15, the schedule starts as the words come in */
+        e0 = _mm_add_epi32(e0, m0); e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        __SHA1_QROUND(e1, e0, m1, 0);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+        __SHA1_QROUND(e0, e1, m2, 0);
+        m1 = _mm_sha1msg1_epu32(m1, m2); m0 = _mm_xor_si128(m0, m2);
+        __SHA1_QROUND(e1, e0, m3, 0);
+        __SHA1_SCHED(m3, m0, m1, m2);
+
+        /* rounds 16 to 63 */
+        __SHA1_QROUND(e0, e1, m0, 0); __SHA1_SCHED(m0, m1, m2, m3);
+        __SHA1_QROUND(e1, e0, m1, 1); __SHA1_SCHED(m1, m2, m3, m0);
+        __SHA1_QROUND(e0, e1, m2, 1); __SHA1_SCHED(m2, m3, m0, m1);
+        __SHA1_QROUND(e1, e0, m3, 1); __SHA1_SCHED(m3, m0, m1, m2);
+        __SHA1_QROUND(e0, e1, m0, 1); __SHA1_SCHED(m0, m1, m2, m3);
+        __SHA1_QROUND(e1, e0, m1, 1); __SHA1_SCHED(m1, m2, m3, m0);
+        __SHA1_QROUND(e0, e1, m2, 2); __SHA1_SCHED(m2, m3, m0, m1);
+        __SHA1_QROUND(e1, e0, m3, 2); __SHA1_SCHED(m3, m0, m1, m2);
+        __SHA1_QROUND(e0, e1, m0, 2); __SHA1_SCHED(m0, m1, m2, m3);
+        __SHA1_QROUND(e1, e0, m1, 2); __SHA1_SCHED(m1, m2, m3, m0);
+        __SHA1_QROUND(e0, e1, m2, 2); __SHA1_SCHED(m2, m3, m0, m1);
+        __SHA1_QROUND(e1, e0, m3, 3); __SHA1_SCHED(m3, m0, m1, m2);
+        __SHA1_QROUND(e0, e1, m0, 3); __SHA1_SCHED(m0, m1, m2, m3);
+
+        /* rounds 64 to 79, the schedule winds down */
+        __SHA1_QROUND(e1, e0, m1, 3);
+        m2 = _mm_sha1msg2_epu32(m2, m1); m3 = _mm_xor_si128(m3, m1);
+        __SHA1_QROUND(e0, e1, m2, 3);
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        __SHA1_QROUND(e1, e0, m3, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((__m128i *) h, _mm_shuffle_epi32(abcd, 0x1b));
+    h[4] = (uint32_t) _mm_extract_epi32(e0, 3);
+}
+
+#undef __SHA1_QROUND
+#undef __SHA1_SCHED
+
+/* -------------------------------------------------------------------------- */
+
+static const uint32_t __sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* four SHA-256 rounds with the message words m and the constants from k */
+#define __SHA256_QROUND(m, k)                                               \
+    do {                                                                    \
+        t = _mm_add_epi32(m, _mm_loadu_si128((const __m128i *)              \
+                                             (__sha256_k + (k))));          \
+        s1 = _mm_sha256rnds2_epu32(s1, s0, t);                              \
+        s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(t, 0x0e));     \
+    } while (0)
+
+/* message schedule: the next words m1 from m1, the last two groups m3
+   and m0, then the first half of the schedule of the group m3 */
+#define __SHA256_SCHED(m0, m1, m3)                                          \
+    do {                                                                    \
+        m1 = _mm_add_epi32(m1, _mm_alignr_epi8(m0, m3, 4));                 \
+        m1 = _mm_sha256msg2_epu32(m1, m0);                                  \
+        m3 = _mm_sha256msg1_epu32(m3, m0);                                  \
+    } while (0)
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void __shani_sha256(uint32_t *h, const uint8_t *data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    __m128i s0, s1, save0, save1, t, m0, m1, m2, m3;
+
+    /* the instructions want the state as ABEF and CDGH */
+    t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) h), 0xb1);
+    s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) (h + 4)), 0x1b);
+    s0 = _mm_alignr_epi8(t, s1, 8);
+    s1 = _mm_blend_epi16(s1, t, 0xf0);
+
+    for ( ; blocks; blocks --, data += 64) {
+        save0 = s0; save1 = s1;
+
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), mask);
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)),
+                              mask);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)),
+                              mask);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)),
+                              mask);
+
+        __SHA256_QROUND(m0, 0);
+        __SHA256_QROUND(m1, 4); m0 = _mm_sha256msg1_epu32(m0, m1);
+        __SHA256_QROUND(m2, 8); m1 = _mm_sha256msg1_epu32(m1, m2);
+        __SHA256_QROUND(m3, 12); __SHA256_SCHED(m3, m0, m2);
+        __SHA256_QROUND(m0, 16); __SHA256_SCHED(m0, m1, m3);
+        __SHA256_QROUND(m1, 20); __SHA256_SCHED(m1, m2, m0);
+        __SHA256_QROUND(m2, 24); __SHA256_SCHED(m2, m3, m1);
+        __SHA256_QROUND(m3, 28); __SHA256_SCHED(m3, m0, m2);
+        __SHA256_QROUND(m0, 32); __SHA256_SCHED(m0, m1, m3);
+        __SHA256_QROUND(m1, 36); __SHA256_SCHED(m1, m2, m0);
+        __SHA256_QROUND(m2, 40); __SHA256_SCHED(m2, m3, m1);
+        __SHA256_QROUND(m3, 44); __SHA256_SCHED(m3, m0, m2);
+        __SHA256_QROUND(m0, 48); __SHA256_SCHED(m0, m1, m3);
+        __SHA256_QROUND(m1, 52);
+        m2 = _mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4));
+        m2 = _mm_sha256msg2_epu32(m2, m1);
+        __SHA256_QROUND(m2, 56);
+        m3 = _mm_add_epi32(m3, _mm_alignr_epi8(m2, m1, 4));
+        m3 = _mm_sha256msg2_epu32(m3, m2);
+        __SHA256_QROUND(m3, 60);
+
+        s0 = _mm_add_epi32(s0, save0);
+        s1 = _mm_add_epi32(s1, save1);
+    }
+
+    t = _mm_shuffle_epi32(s0, 0x1b);
+    s1 = _mm_shuffle_epi32(s1, 0xb1);
+    _mm_storeu_si128((__m128i *) h, _mm_blend_epi16(t, s1, 0xf0));
+    _mm_storeu_si128((__m128i *) (h + 4), _mm_alignr_epi8(s1, t, 8));
+}
+
+#undef __SHA256_QROUND
+#undef __SHA256_SCHED
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline int __simd_sha1(int level, uint32_t *h, const uint8_t *data,
+                              size_t blocks)
+{
+    /* returns 0 if the blocks were hashed, -1 if the scalar code has to
+       be used */
+    #ifdef _SIMD_SHA
+    if (level != SIMD_NONE && __simd_sha()) {
+        __shani_sha1(h, data, blocks);
+        return 0;
+    }
+    #endif
+
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline int __simd_sha256(int level, uint32_t *h, const uint8_t *data,
+                                size_t blocks)
+{
+    #ifdef _SIMD_SHA
+    if (level != SIMD_NONE && __simd_sha()) {
+        __shani_sha256(h, data, blocks);
+        return 0;
+    }
+    #endif
+
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline size_t __utf8_boundary(const uint8_t *s, size_t i)
+{
+    /* back up to the first byte of the last character before i, so that a
+       character straddling i is validated as a whole */
+    size_t k = 0;
+
+    while (k < 3 && k < i && (s[i - 1 - k] & 0xc0) == 0x80) k ++;
+
+    return (k < i && s[i - 1 - k] >= 0xc0) ? i - 1 - k : i;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline size_t __naive_skip_ascii(const uint8_t *s, size_t n)
+{
+    size_t i = 0;
+
+    while (i < n && s[i] < 0x80) i ++;
+
+    return i;
+}
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SSE2
+/* -------------------------------------------------------------------------- */
+
+static size_t __sse2_skip_ascii(const uint8_t *s, size_t n)
+{
+    size_t i = 0;
+    uint32_t mask = 0;
+
+    for ( ; i + 16 <= n; i += 16) {
+        mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (s + i)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+
+    return i + __naive_skip_ascii(s + i, n - i);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+#ifdef _SIMD_AVX2
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static size_t __avx2_skip_ascii(const uint8_t *s, size_t n)
+{
+    size_t i = 0;
+    uint32_t mask = 0;
+
+    for ( ; i + 32 <= n; i += 32) {
+        mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)
+                                                       (s + i)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+
+    return i + __sse2_skip_ascii(s + i, n - i);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline size_t __simd_skip_ascii(int level, const uint8_t *s, size_t n)
+{
+    /* returns the length of the leading run of ASCII bytes */
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: return __avx2_skip_ascii(s, n);
+    #endif
+    #ifdef _SIMD_SSE2
+    case SIMD_SSE2: return __sse2_skip_ascii(s, n);
+    #endif
+    default: return __naive_skip_ascii(s, n);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* UTF-8 validation by table lookups (Keiser and Lemire, "Validating UTF-8
+   in less than one instruction per byte", 2021): the high and low nibbles
+   of each byte and the high nibble of the next one index three tables, a
+   bit surviving the AND of the three entries is an error */
+#define __U8_TOO_SHORT  0x01  /* lead byte not followed by a continuation */
+#define __U8_TOO_LONG   0x02  /* ASCII followed by a continuation */
+#define __U8_OVERLONG_3 0x04
+#define __U8_TOO_LARGE  0x08  /* above U+10FFFF */
+#define __U8_SURROGATE  0x10
+#define __U8_OVERLONG_2 0x20
+#define __U8_TOO_LARGE2 0x40  /* also overlong 4 byte sequences */
+#define __U8_TWO_CONTS  0x80  /* continuation after a continuation */
+#define __U8_CARRY      0x83
+
+#define __U8_BYTE1_HIGH                                                     \
+    0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,                         \
+    (char) 0x80, (char) 0x80, (char) 0x80, (char) 0x80,                     \
+    0x21, 0x01, 0x15, 0x49
+
+#define __U8_BYTE1_LOW                                                      \
+    (char) 0xe7, (char) 0xa3, (char) 0x83, (char) 0x83,                     \
+    (char) 0x8b, (char) 0xcb, (char) 0xcb, (char) 0xcb,                     \
+    (char) 0xcb, (char) 0xcb, (char) 0xcb, (char) 0xcb,                     \
+    (char) 0xcb, (char) 0xdb, (char) 0xcb, (char) 0xcb
+
+#define __U8_BYTE2_HIGH                                                     \
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,                         \
+    (char) 0xe6, (char) 0xae, (char) 0xba, (char) 0xba,                     \
+    0x01, 0x01, 0x01, 0x01
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SSSE3
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("ssse3")))
+static size_t __ssse3_utf8_valid(const uint8_t *s, size_t n)
+{
+    const __m128i hi1 = _mm_setr_epi8(__U8_BYTE1_HIGH);
+    const __m128i lo1 = _mm_setr_epi8(__U8_BYTE1_LOW);
+    const __m128i hi2 = _mm_setr_epi8(__U8_BYTE2_HIGH);
+    const __m128i nibble = _mm_set1_epi8(0x0f), zero = _mm_setzero_si128();
+    /* the last bytes of a block must not start a sequence left open */
+    const __m128i open = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                       -1, -1, -1, (char) 0xef, (char) 0xdf,
+                                       (char) 0xbf);
+    __m128i in, prev = zero, pending = zero, p1, p2, p3, err;
+    size_t i = 0;
+
+    for ( ; i + 16 <= n; i += 16) {
+        in = _mm_loadu_si128((const __m128i *) (s + i));
+
+        if (! _mm_movemask_epi8(in)) {
+            /* pure ASCII, only a sequence left open can be wrong */
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(pending, zero)) != 0xffff)
+                break;
+            prev = in; pending = zero;
+            continue;
+        }
+
+        p1 = _mm_alignr_epi8(in, prev, 15);
+        p2 = _mm_alignr_epi8(in, prev, 14);
+        p3 = _mm_alignr_epi8(in, prev, 13);
+
+        err = _mm_and_si128(_mm_and_si128(
+                  _mm_shuffle_epi8(hi1, _mm_and_si128(_mm_srli_epi16(p1, 4),
+                                                      nibble)),
+                  _mm_shuffle_epi8(lo1, _mm_and_si128(p1, nibble))),
+                  _mm_shuffle_epi8(hi2, _mm_and_si128(_mm_srli_epi16(in, 4),
+                                                      nibble)));
+
+        /* third and fourth bytes must be continuations, and only them */
+        err = _mm_xor_si128(err, _mm_and_si128(_mm_or_si128(
+                  _mm_subs_epu8(p2, _mm_set1_epi8(0xe0 - 0x80)),
+                  _mm_subs_epu8(p3, _mm_set1_epi8(0xf0 - 0x80))),
+                  _mm_set1_epi8((char) 0x80)));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(err, zero)) != 0xffff) break;
+
+        pending = _mm_subs_epu8(in, open);
+        prev = in;
+    }
+
+    return __utf8_boundary(s, i);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+#ifdef _SIMD_AVX2
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static size_t __avx2_utf8_valid(const uint8_t *s, size_t n)
+{
+    const __m256i hi1 = _mm256_setr_epi8(__U8_BYTE1_HIGH, __U8_BYTE1_HIGH);
+    const __m256i lo1 = _mm256_setr_epi8(__U8_BYTE1_LOW, __U8_BYTE1_LOW);
+    const __m256i hi2 = _mm256_setr_epi8(__U8_BYTE2_HIGH, __U8_BYTE2_HIGH);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i open = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1, (char) 0xef, (char) 0xdf,
+                                          (char) 0xbf);
+    __m256i in, prev = _mm256_setzero_si256(), pending = prev;
+    __m256i cross, p1, p2, p3, err;
+    size_t i = 0;
+
+    for ( ; i + 32 <= n; i += 32) {
+        in = _mm256_loadu_si256((const __m256i *) (s + i));
+
+        if (! _mm256_movemask_epi8(in)) {
+            if (! _mm256_testz_si256(pending, pending)) break;
+            prev = in; pending = _mm256_setzero_si256();
+            continue;
+        }
+
+        /* the previous bytes of each lane, across the lane boundary */
+        cross = _mm256_permute2x128_si256(prev, in, 0x21);
+        p1 = _mm256_alignr_epi8(in, cross, 15);
+        p2 = _mm256_alignr_epi8(in, cross, 14);
+        p3 = _mm256_alignr_epi8(in, cross, 13);
+
+        err = _mm256_and_si256(_mm256_and_si256(
+                  _mm256_shuffle_epi8(hi1, _mm256_and_si256(
+                      _mm256_srli_epi16(p1, 4), nibble)),
+                  _mm256_shuffle_epi8(lo1, _mm256_and_si256(p1, nibble))),
+                  _mm256_shuffle_epi8(hi2, _mm256_and_si256(
+                      _mm256_srli_epi16(in, 4), nibble)));
+
+        err = _mm256_xor_si256(err, _mm256_and_si256(_mm256_or_si256(
+                  _mm256_subs_epu8(p2, _mm256_set1_epi8(0xe0 - 0x80)),
+                  _mm256_subs_epu8(p3, _mm256_set1_epi8(0xf0 - 0x80))),
+                  _mm256_set1_epi8((char) 0x80)));
+
+        if (! _mm256_testz_si256(err, err)) break;
+
+        pending = _mm256_subs_epu8(in, open);
+        prev = in;
+    }
+
+    return __utf8_boundary(s, i);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline size_t __simd_utf8_valid(int level, const uint8_t *s, size_t n)
+{
+    /* returns the length of a prefix known to be valid UTF-8 and to end on a
+       character boundary; the rest, including the first error if any, is
+       left to the scalar code */
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: return __avx2_utf8_valid(s, n);
+    #endif
+    #ifdef _SIMD_SSSE3
+    case SIMD_SSE2: return (__simd_ssse3()) ? __ssse3_utf8_valid(s, n) : 0;
+    #endif
+    default: return 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* ASCII case folding: the letters from lo to lo + 25 get their 0x20 bit
+   flipped, which is 'A' for the lower case and 'a' for the upper case */
+static inline void __naive_case(uint8_t *dst, const uint8_t *src, size_t n,
+                                uint8_t lo)
+{
+    size_t i = 0;
+
+    for (i = 0; i < n; i ++)
+        dst[i] = src[i] ^ ((uint8_t) (src[i] - lo) < 26) << 5;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline size_t __naive_casecmp(const uint8_t *a, const uint8_t *b,
+                                     size_t n)
+{
+    /* returns the offset of the first difference, ignoring the case */
+    size_t i = 0;
+
+    for (i = 0; i < n; i ++) {
+        if (a[i] != b[i] && ((a[i] ^ b[i]) != 0x20 ||
+                             (uint8_t) ((a[i] | 0x20) - 'a') >= 26))
+            break;
+    }
+
+    return i;
+}
+
+/* -------------------------------------------------------------------------- */
+#ifdef _SIMD_SSE2
+/* -------------------------------------------------------------------------- */
+
+static inline __m128i __sse2_case(__m128i x, uint8_t lo)
+{
+    /* the letters are moved to the bottom of the signed range, so that a
+       single comparison finds them */
+    __m128i t = _mm_sub_epi8(x, _mm_set1_epi8((char) (lo + 128)));
+    __m128i m = _mm_cmplt_epi8(t, _mm_set1_epi8(-128 + 26));
+
+    return _mm_xor_si128(x, _mm_and_si128(m, _mm_set1_epi8(0x20)));
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void __sse2_fold(uint8_t *dst, const uint8_t *src, size_t n,
+                        uint8_t lo)
+{
+    size_t i = 0;
+
+    for ( ; i + 16 <= n; i += 16) {
+        _mm_storeu_si128((__m128i *) (dst + i), __sse2_case(
+                         _mm_loadu_si128((const __m128i *) (src + i)), lo));
+    }
+
+    __naive_case(dst + i, src + i, n - i, lo);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static size_t __sse2_casecmp(const uint8_t *a, const uint8_t *b, size_t n)
+{
+    size_t i = 0;
+    uint32_t mask = 0;
+
+    for ( ; i + 16 <= n; i += 16) {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+               __sse2_case(_mm_loadu_si128((const __m128i *) (a + i)), 'A'),
+               __sse2_case(_mm_loadu_si128((const __m128i *) (b + i)), 'A')));
+        if (mask != 0xffff) return i + __builtin_ctz(~mask);
+    }
+
+    return i + __naive_casecmp(a + i, b + i, n - i);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+#ifdef _SIMD_AVX2
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static inline __m256i __avx2_case(__m256i x, uint8_t lo)
+{
+    __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8((char) (lo + 128)));
+    __m256i m = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), t);
+
+    return _mm256_xor_si256(x, _mm256_and_si256(m, _mm256_set1_epi8(0x20)));
+}
+
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static void __avx2_fold(uint8_t *dst, const uint8_t *src, size_t n,
+                        uint8_t lo)
+{
+    size_t i = 0;
+
+    for ( ; i + 32 <= n; i += 32) {
+        _mm256_storeu_si256((__m256i *) (dst + i), __avx2_case(
+                            _mm256_loadu_si256((const __m256i *) (src + i)),
+                            lo));
+    }
+
+    __sse2_fold(dst + i, src + i, n - i, lo);
+}
+
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static size_t __avx2_casecmp(const uint8_t *a, const uint8_t *b, size_t n)
+{
+    size_t i = 0;
+    uint32_t mask = 0;
+
+    for ( ; i + 32 <= n; i += 32) {
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+               __avx2_case(_mm256_loadu_si256((const __m256i *) (a + i)), 'A'),
+               __avx2_case(_mm256_loadu_si256((const __m256i *) (b + i)),
+                           'A')));
+        if (mask != 0xffffffff) return i + __builtin_ctz(~mask);
+    }
+
+    return i + __sse2_casecmp(a + i, b + i, n - i);
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
+static inline void __simd_fold(int level, uint8_t *dst, const uint8_t *src,
+                               size_t n, int upper)
+{
+    /* dst may be src, for an in place conversion */
+    uint8_t lo = (upper) ? 'a' : 'A';
+
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: __avx2_fold(dst, src, n, lo); break;
+    #endif
+    #ifdef _SIMD_SSE2
+    case SIMD_SSE2: __sse2_fold(dst, src, n, lo); break;
+    #endif
+    default: __naive_case(dst, src, n, lo);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline size_t __simd_casecmp(int level, const uint8_t *a,
+                                    const uint8_t *b, size_t n)
+{
+    /* returns the offset of the first difference, ignoring the ASCII case */
+    switch (level) {
+    #ifdef _SIMD_AVX2
+    case SIMD_AVX2: return __avx2_casecmp(a, b, n);
+    #endif
+    #ifdef _SIMD_SSE2
+    case SIMD_SSE2: return __sse2_casecmp(a, b, n);
+    #endif
+    default: return __naive_casecmp(a, b, n);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
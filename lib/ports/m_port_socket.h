@@ -77,6 +77,12 @@
     #define socklen_t size_t
 #endif
 
+/* Winsock2 has no gathering write with POSIX semantics */
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+
 #ifndef INVALID_FILE_HANDLE
     #define INVALID_FILE_HANDLE ((HANDLE)INVALID_HANDLE_VALUE)
 #endif
@@ -155,6 +161,7 @@ private const char *_socket_win32_strerror(void);
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <sys/select.h>
 
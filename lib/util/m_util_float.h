@@ -46,6 +46,9 @@
 /** Read or write a little endian floating point value */
 #define FLOAT_LITTLE 0x10
 
+/** Maximum number of digits produced by float_dtoa() */
+#define FLOAT_DIGITS 17
+
 /* -------------------------------------------------------------------------- */
 
 public float float_read_single(const char *buffer, int flags);
@@ -122,4 +125,70 @@ public int float_write_double(char *buffer, const void *f, int flags);
 
 /* -------------------------------------------------------------------------- */
 
+public int float_dtoa(double value, int mode, int ndigits, char *digits,
+                      int *decpt);
+
+/**
+ * @ingroup float
+ * @fn int float_dtoa(double value, int mode, int ndigits, char *digits,
+ *                    int *decpt)
+ * @param value the double to convert.
+ * @param mode 0 for the shortest digits, 2 for ndigits significant digits or
+ *        3 for ndigits after the decimal point, like dtoa.
+ * @param ndigits the number of digits requested in modes 2 and 3.
+ * @param digits a buffer of at least FLOAT_DIGITS + 1 bytes.
+ * @param decpt the position of the decimal point relative to the digits.
+ * @return the number of digits written, or 0 if the fast path gave up.
+ *
+ * This function computes the decimal digits of the absolute value of a
+ * double with integer arithmetic only (Grisu). The shortest digits read back
+ * to the same double, the counted ones are correctly rounded. Trailing zeros
+ * are removed and the digits are terminated by a \0.
+ *
+ * About 0.5% of the doubles are left undecided, as well as zero, infinities,
+ * NaN and requests of more than FLOAT_DIGITS digits: the caller must then
+ * use an exact big number conversion.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public int float_decimal(uint64_t w, int q, int negative, double *value);
+
+/**
+ * @ingroup float
+ * @fn int float_decimal(uint64_t w, int q, int negative, double *value)
+ * @param w the decimal significand.
+ * @param q the power of ten applied to the significand.
+ * @param negative set the sign of the result.
+ * @param value a pointer to store the double.
+ * @return -1 if the fast path gave up, 0 otherwise.
+ *
+ * This function returns in value the double nearest to w * 10^q, using a
+ * 128 bit multiplication by a table of powers of five (Eisel-Lemire).
+ *
+ * Ambiguous halfway cases, overflows and subnormals are left to the caller,
+ * which should parse the input again with strtod().
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public double float_strtod(const char *string, char **end);
+
+/**
+ * @ingroup float
+ * @fn double float_strtod(const char *string, char **end)
+ * @param string the string to parse.
+ * @param end a pointer to store the end of the parsed number, or NULL.
+ * @return the double parsed.
+ *
+ * This function is a drop-in replacement for strtod(), which handles decimal
+ * numbers of up to 19 significant digits with float_decimal() and uses the
+ * C library for everything else. The decimal point is always a dot.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 #endif
@@ -119,6 +119,8 @@ static int __grow_type_table(unsigned char **typetable, int *tablesize);
 #define MAXEXP      308
 /* 128 bit fraction takes up 39 decimal digits; max reasonable precision */
 #define MAXFRACT    39
+/* digits and trailing zeros produced by the fast path of cvt() */
+#define CVT_BUFSIZE 64
 
 
 static int _write_int(char *out, size_t len, const u_char *b, size_t w, int flags);
@@ -129,7 +131,7 @@ static int _write_float(char *out, size_t len, const u_char *b, int flags);
 
 extern char *_m_dtoa(double, int, int, int *, int *, char **);
 extern void  _m_freedtoa(char *);
-static char *cvt(double, int, int, int *, int *, int, int *);
+static char *cvt(double, int, int, int *, int *, int, int *, char *);
 static int exponent(char *, int, int);
 
 #else /* no FLOATING_POINT */
@@ -207,6 +209,7 @@ public int m_vsnprintf(char *buffer, size_t bufsize, const char *fmt0, va_list a
     int ndig=0;        /* actual number of digits returned by cvt */
     char expstr[7];        /* buffer for exponent string */
     char *dtoaresult = NULL;
+    char dtoabuf[CVT_BUFSIZE];    /* digits from the fast path of cvt */
 #endif
 
     uintmax_t _umax;    /* integer arguments %[diouxX] */
@@ -621,8 +624,9 @@ reswitch:    switch (ch) {
             flags |= FPT;
             if (dtoaresult)
                 _m_freedtoa(dtoaresult);
-            dtoaresult = cp = cvt(_double, prec, flags, &softsign,
-                &expt, ch, &ndig);
+            cp = cvt(_double, prec, flags, &softsign, &expt, ch, &ndig,
+                dtoabuf);
+            dtoaresult = (cp != dtoabuf) ? cp : NULL;
             if (ch == 'g' || ch == 'G') {
                 if (expt <= -4 || expt > prec)
                     ch = (ch == 'g') ? 'e' : 'E';
@@ -1371,9 +1375,9 @@ static int __grow_type_table(unsigned char **typetable, int *tablesize)
 #ifdef FLOATING_POINT
 
 static char *cvt(double value, int ndigits, int flags, int *sign,
-                 int *decpt, int ch, int *length)
+                 int *decpt, int ch, int *length, char *buf)
 {
-    int mode;
+    int mode, n = 0;
     char *digits, *bp, *rve;
 
     if (ch == 'f') {
@@ -1389,7 +1393,20 @@ static char *cvt(double value, int ndigits, int flags, int *sign,
         mode = 2;        /* ndigits significant digits */
     }
 
-    digits = _m_dtoa(value, mode, ndigits, decpt, sign, &rve);
+    /* integer only digits generation first, the big number dtoa for the
+       cases it cannot decide and for outputs too long for buf */
+    if (value == 0) {
+        buf[0] = '0'; buf[1] = '\0'; n = 1; *decpt = 1;
+    } else
+        n = float_dtoa(value, mode, ndigits, buf, decpt);
+
+    if (n && ndigits + ((ch == 'f' && *decpt > 0) ? *decpt : 0) <
+        CVT_BUFSIZE) {
+        *sign = (signbit(value) != 0);
+        digits = buf; rve = buf + n;
+    } else
+        digits = _m_dtoa(value, mode, ndigits, decpt, sign, &rve);
+
     if ((ch != 'g' && ch != 'G') || flags & ALT) {/* Print trailing zeros */
         bp = digits + ndigits;
         if (ch == 'f') {
@@ -1573,3 +1590,172 @@ public int m_snprintf_db(void *con, char *buffer, size_t size,
 #endif
 
 /* -------------------------------------------------------------------------- */
+
+static void _fmt_add(m_fmt *fmt, int type, int arg, int stars,
+                     size_t off, size_t len)
+{
+    m_fmt_op *op = fmt->_op + fmt->_count;
+
+    /* adjacent literals are copied at once */
+    if (type == FMT_LITERAL && fmt->_count && op[-1].type == FMT_LITERAL &&
+        op[-1].off + op[-1].len == off) {
+        op[-1].len += len;
+        return;
+    }
+
+    op->type = type; op->arg = arg; op->stars = stars;
+    op->off = off; op->len = len;
+
+    fmt->_count ++;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_fmt *fmt_compile(const char *format)
+{
+    /** @brief parse a format once into a list of operations */
+
+    m_fmt *ret = NULL;
+    const char *p = NULL, *spec = NULL;
+    size_t len = 0, count = 0, specs = 0;
+    int arg = 0, stars = 0, plain = 0, ch = 0;
+
+    if (! format) {
+        debug("fmt_compile(): bad parameters.\n");
+        return NULL;
+    }
+
+    len = strlen(format);
+
+    for (p = format; (p = strchr(p, '%')); p ++) count ++;
+
+    if (len > INT_MAX / 2) {
+        debug("fmt_compile(): format too long.\n");
+        return NULL;
+    }
+
+    /* each conversion may be followed by a literal */
+    if (! (ret = malloc(sizeof(*ret) + 2 * count * sizeof(*ret->_op))) ) {
+        perror(ERR(fmt_compile, malloc));
+        return NULL;
+    }
+
+    /* the format, then the NUL terminated specifications */
+    if (! (ret->_text = malloc(2 * len + count + 2)) ) {
+        perror(ERR(fmt_compile, malloc));
+        free(ret);
+        return NULL;
+    }
+
+    memcpy(ret->_text, format, len + 1);
+    ret->_count = 0; ret->_fallback = 0;
+    specs = len + 1;
+
+    for (p = format; *p; ) {
+        if (*p != '%') {
+            spec = p;
+            if (! (p = strchr(p, '%')) ) p = format + len;
+            _fmt_add(ret, FMT_LITERAL, 0, 0, spec - format, p - spec);
+            continue;
+        }
+
+        spec = p ++; arg = FMT_ARG_INT; stars = 0; plain = 1;
+
+        if (*p == '%') {
+            _fmt_add(ret, FMT_LITERAL, 0, 0, p - format, 1);
+            p ++;
+            continue;
+        }
+
+        /* flags, width and precision */
+        for (; *p && strchr(" #+-0", *p); p ++) plain = 0;
+
+        if (*p == '*') { stars ++; p ++; plain = 0; }
+        else for (; is_digit(*p); p ++) plain = 0;
+
+        if (*p == '.') {
+            plain = 0;
+            if (*(++ p) == '*') { stars ++; p ++; }
+            else for (; is_digit(*p); p ++);
+        }
+
+        /* positional arguments need the whole type table */
+        if (*p == '$') goto _fallback;
+
+        switch (*p) {
+        case 'h': p += (p[1] == 'h') ? 2 : 1; plain = 0; break;
+        case 'l':
+            if (p[1] == 'l') { arg = FMT_ARG_LLONG; p += 2; }
+            else { arg = FMT_ARG_LONG; p ++; }
+            break;
+        case 'q': arg = FMT_ARG_LLONG; p ++; break;
+        case 'j': arg = FMT_ARG_INTMAX; p ++; break;
+        case 'z': arg = FMT_ARG_SIZE; p ++; break;
+        case 't': arg = FMT_ARG_PTRDIFF; p ++; break;
+        }
+
+        switch ( (ch = *p ++) ) {
+        case 'D': case 'O': case 'U':
+            arg = FMT_ARG_LONG; plain = 0;
+            break;
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            break;
+        case 'c':
+            arg = FMT_ARG_INT; plain = 0;
+            break;
+        case 'e': case 'E': case 'f': case 'g': case 'G':
+            arg = FMT_ARG_DOUBLE;
+            break;
+        case 's': case 'p':
+            arg = FMT_ARG_PTR;
+            break;
+        default:
+            /* binary extensions, long doubles and the likes */
+            goto _fallback;
+        }
+
+        #ifdef _ENABLE_HTTP
+        /* %url encodes a string */
+        if (ch == 'u' && p[0] == 'r' && p[1] == 'l') {
+            arg = FMT_ARG_PTR; plain = 0; p += 2;
+        }
+        #endif
+
+        if (plain && (ch == 'd' || ch == 'i') && arg <= FMT_ARG_SIZE)
+            _fmt_add(ret, FMT_INT, arg, 0, 0, 0);
+        else if (plain && ch == 'u' && arg <= FMT_ARG_SIZE)
+            _fmt_add(ret, FMT_UINT, arg, 0, 0, 0);
+        else if (plain && ch == 's')
+            _fmt_add(ret, FMT_STR, arg, 0, 0, 0);
+        else if (p - spec == 4 && ! memcmp(spec, "%.*s", 4))
+            _fmt_add(ret, FMT_STRN, arg, 1, 0, 0);
+        else {
+            memcpy(ret->_text + specs, spec, p - spec);
+            _fmt_add(ret, FMT_SPEC, arg, stars, specs, p - spec);
+            specs += p - spec; ret->_text[specs ++] = '\0';
+        }
+    }
+
+    return ret;
+
+_fallback:
+    ret->_count = 0; ret->_fallback = 1;
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_fmt *fmt_free(m_fmt *fmt)
+{
+    /** @brief release a compiled format */
+
+    if (! fmt) return NULL;
+
+    free(fmt->_text);
+    free(fmt);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -39,6 +39,41 @@
 
 #include "m_util_def.h"
 #include "m_util_float.h"
+
+/* operations of a compiled format, see fmt_compile() */
+#define FMT_LITERAL 0   /* text copied as is */
+#define FMT_INT     1   /* %i or %d */
+#define FMT_UINT    2   /* %u */
+#define FMT_STR     3   /* %s */
+#define FMT_STRN    4   /* %.*s */
+#define FMT_SPEC    5   /* any other conversion, run through m_snprintf() */
+
+/* size of the argument of an operation */
+#define FMT_ARG_INT     0
+#define FMT_ARG_LONG    1
+#define FMT_ARG_LLONG   2
+#define FMT_ARG_SIZE    3
+#define FMT_ARG_INTMAX  4
+#define FMT_ARG_PTRDIFF 5
+#define FMT_ARG_DOUBLE  6
+#define FMT_ARG_PTR     7
+
+typedef struct m_fmt_op {
+    uint8_t type;
+    uint8_t arg;
+    uint8_t stars;      /* '*' widths and precisions taken before the value */
+    uint32_t off;       /* text or NUL terminated specification */
+    uint32_t len;
+} m_fmt_op;
+
+typedef struct m_fmt {
+    /* private */
+    char *_text;
+    unsigned int _count;
+    int _fallback;      /* the format must go through m_vsnprintf() */
+    m_fmt_op _op[1];
+} m_fmt;
+
 #include "../m_string.h"
 
 #define FLOATING_POINT
@@ -142,6 +177,40 @@ public int m_vsnprintf_db(void *con, char *buffer, size_t bufsize,
 
 /* -------------------------------------------------------------------------- */
 
+public m_fmt *fmt_compile(const char *format);
+
+/**
+ * @ingroup string
+ * @fn m_fmt *fmt_compile(const char *format)
+ * @param format a format accepted by m_vsnprintf()
+ * @return the compiled format or NULL if an error occured
+ *
+ * This function parses a format once into a list of operations, to be
+ * used many times with @ref string_fmt_compiled. Plain %i, %u, %s and
+ * %.*s conversions are formatted inline, other standard conversions are
+ * formatted one by one.
+ *
+ * Positional arguments and the binary extensions are not compiled; the
+ * format then goes through m_vsnprintf() as a whole.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_fmt *fmt_free(m_fmt *fmt);
+
+/**
+ * @ingroup string
+ * @fn m_fmt *fmt_free(m_fmt *fmt)
+ * @param fmt a compiled format
+ * @return NULL
+ *
+ * This function releases a format compiled by @ref fmt_compile.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 public int m_snprintf(char *buffer, size_t size, const char *fmt, ...);
 
 /**
@@ -372,7 +372,7 @@ literal:
          * Consume leading white space, except for formats
          * that suppress this.
          */
-        if ((flags & NOSKIP) == 0) {
+        if ((flags & (NOSKIP | BINARY)) == 0) {
             while (isspace(*b)) {
                 nread++;
                 if (--bufsize > 0)
@@ -674,6 +674,8 @@ literal:
                 else
                     *va_arg(ap, int *) = (int) res;
                 nassigned++;
+            } else if (flags & BINARY) {
+                b += width; bufsize -= width;
             }
 
             nread += (flags & BINARY) ? width : (size_t) (p - buf);
@@ -775,7 +777,7 @@ literal:
                     b += width; bufsize -= width;
                 } else {
                     *p = '\0';
-                    res = strtod(buf, (char **) NULL);
+                    res = float_strtod(buf, (char **) NULL);
                 }
 
                 if (flags & LONGDBL)
@@ -785,6 +787,8 @@ literal:
                 else
                     *va_arg(ap, float *) = res;
                 nassigned++;
+            } else if (flags & BINARY) {
+                b += width; bufsize -= width;
             }
 
             nread += (flags & BINARY) ? width : (size_t) (p - buf);
@@ -974,3 +978,219 @@ public int m_snscanf(const char *buffer, size_t size, const char *fmt, ...)
 }
 
 /* -------------------------------------------------------------------------- */
+
+static void _scan_add(m_scan *scan, int type, int arg, size_t width,
+                      int order, size_t off, size_t len)
+{
+    m_scan_op *op = scan->_op + scan->_count;
+
+    /* adjacent literals are matched at once */
+    if (type == SCAN_LITERAL && scan->_count && op[-1].type == SCAN_LITERAL &&
+        op[-1].off + op[-1].len == off) {
+        op[-1].len += len;
+        return;
+    }
+
+    op->type = type; op->arg = arg; op->width = width; op->order = order;
+    op->off = off; op->len = len;
+
+    scan->_count ++;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_scan *scan_compile(const char *format)
+{
+    /** @brief parse a binary layout once into a list of operations */
+
+    m_scan *ret = NULL;
+    m_scan_op *op = NULL;
+    const char *p = NULL;
+    size_t len = 0, count = 0, width = 0, size = 0, fixed = 0;
+    unsigned int i = 0;
+    int flags = 0, arg = 0, order = 0, dollar = 0, ch = 0;
+
+    if (! format) {
+        debug("scan_compile(): bad parameters.\n");
+        return NULL;
+    }
+
+    len = strlen(format);
+
+    for (p = format; (p = strchr(p, '%')); p ++) count ++;
+
+    if (len > INT_MAX / 2) {
+        debug("scan_compile(): format too long.\n");
+        return NULL;
+    }
+
+    /* each conversion may be followed by a literal */
+    if (! (ret = malloc(sizeof(*ret) + 2 * count * sizeof(*ret->_op))) ) {
+        perror(ERR(scan_compile, malloc));
+        return NULL;
+    }
+
+    if (! (ret->_text = malloc(len + 1)) ) {
+        perror(ERR(scan_compile, malloc));
+        free(ret);
+        return NULL;
+    }
+
+    memcpy(ret->_text, format, len + 1);
+    ret->_count = 0; ret->_fallback = 0; ret->_fixed = 0;
+
+    for (p = format; *p; ) {
+        /* whitespaces match any amount of whitespaces */
+        if (isspace((u_char) *p)) goto _fallback;
+
+        if (*p != '%' || p[1] == '%') {
+            p += (*p == '%');
+            _scan_add(ret, SCAN_LITERAL, 0, 0, 0, p - format, 1);
+            p ++;
+            continue;
+        }
+
+        flags = 0; width = 0; arg = SCAN_ARG_INT; dollar = 0;
+
+        for (p ++; ; p ++) {
+            switch (*p) {
+            case '*': flags |= SUPPRESS; continue;
+            case '$': dollar = 1; continue;
+            case 'b': flags |= (flags & BINARY) ? LITTLE : BINARY; continue;
+            case 'B': flags |= BIG; continue;
+            case 'h':
+                if (p[1] == 'h') { arg = SCAN_ARG_CHAR; p ++; }
+                else arg = SCAN_ARG_SHORT;
+                continue;
+            case 'l':
+                if (p[1] == 'l') { arg = SCAN_ARG_QUAD; p ++; }
+                else arg = SCAN_ARG_LONG;
+                continue;
+            case 'q': arg = SCAN_ARG_QUAD; continue;
+            case 'z': arg = SCAN_ARG_SIZE; continue;
+            }
+
+            if (*p < '0' || *p > '9') break;
+
+            if ( (width = width * 10 + *p - '0') > INT_MAX) goto _fallback;
+        }
+
+        order = (flags & BIG) ? FLOAT_BIG : (flags & LITTLE) ? FLOAT_LITTLE : 0;
+
+        switch ( (ch = *p ++) ) {
+        case 'c':
+            /* the '$' flag would give the width */
+            if (dollar) goto _fallback;
+            _scan_add(ret, SCAN_CHARS, (flags & SUPPRESS) ? SCAN_ARG_NONE :
+                      SCAN_ARG_CHAR, 0, 0, 0, (width) ? width : 1);
+            continue;
+
+        case 'D': case 'O': case 'U':
+            arg = SCAN_ARG_LONG;
+            /* FALLTHROUGH */
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+        case 's':
+            break;
+
+        case 'p':
+            arg = SCAN_ARG_PTR;
+            break;
+
+        case 'e': case 'E': case 'f': case 'g': case 'G':
+            if (~flags & BINARY || dollar || width) goto _fallback;
+            arg = (arg == SCAN_ARG_LONG) ? SCAN_ARG_DOUBLE : SCAN_ARG_FLOAT;
+            _scan_add(ret, SCAN_FLOAT, (flags & SUPPRESS) ? SCAN_ARG_NONE :
+                      arg, (arg == SCAN_ARG_DOUBLE) ? sizeof(double) :
+                      sizeof(float), order, 0, 0);
+            continue;
+
+        default:
+            /* text conversions, truncated integers and the likes */
+            goto _fallback;
+        }
+
+        /* text integers and strings */
+        if (~flags & BINARY) goto _fallback;
+
+        switch (arg) {
+        case SCAN_ARG_CHAR: size = sizeof(char); break;
+        case SCAN_ARG_SHORT: size = sizeof(short); break;
+        case SCAN_ARG_LONG: size = sizeof(long); break;
+        case SCAN_ARG_QUAD: size = sizeof(int64_t); break;
+        case SCAN_ARG_SIZE: size = sizeof(ssize_t); break;
+        case SCAN_ARG_PTR: size = sizeof(int *); break;
+        default: size = sizeof(int);
+        }
+
+        if (! width || width >= sizeof(long double)) width = size;
+
+        if (width > sizeof(uint64_t)) goto _fallback;
+
+        if (ch != 's') {
+            if (dollar) goto _fallback;
+            _scan_add(ret, SCAN_INT, (flags & SUPPRESS) ? SCAN_ARG_NONE :
+                      arg, width, order, 0, 0);
+            continue;
+        }
+
+        /* the string is copied in a buffer of the given size */
+        if (! (flags & SUPPRESS) == ! dollar) {
+            debug("scan_compile(): length prefixed strings need a buffer "
+                  "size, or to be suppressed.\n");
+            goto _error;
+        }
+
+        _scan_add(ret, SCAN_STR, (flags & SUPPRESS) ? SCAN_ARG_NONE :
+                  SCAN_ARG_CHAR, width, order, 0, 0);
+    }
+
+    /* strings must leave enough room for the following fields */
+    for (i = ret->_count; i --; ) {
+        op = ret->_op + i;
+        if (op->type == SCAN_STR) op->len = fixed;
+        fixed += (op->type == SCAN_LITERAL || op->type == SCAN_CHARS) ?
+                 op->len : op->width;
+    }
+
+    ret->_fixed = fixed;
+
+    return ret;
+
+_fallback:
+    /* look for binary strings, m_vsnscanf() would read them as text */
+    for (p = format; (p = strchr(p, '%')); ) {
+        for (flags = 0, p ++; *p && strchr("*$0123456789bBhlqz", *p); p ++)
+            if (*p == 'b') flags |= BINARY;
+
+        if (*p == 's' && flags & BINARY) {
+            debug("scan_compile(): length prefixed strings cannot be mixed "
+                  "with text conversions.\n");
+            goto _error;
+        }
+
+        if (*p) p ++;
+    }
+
+    ret->_count = 0; ret->_fallback = 1;
+
+    return ret;
+
+_error:
+    return scan_free(ret);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public m_scan *scan_free(m_scan *scan)
+{
+    /** @brief release a compiled layout */
+
+    if (! scan) return NULL;
+
+    free(scan->_text);
+    free(scan);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -40,6 +40,43 @@
 #include "m_util_def.h"
 #include "m_util_float.h"
 
+/* operations of a compiled layout, see scan_compile() */
+#define SCAN_LITERAL 0  /* bytes which must match */
+#define SCAN_INT     1  /* binary integer, e.g. %bBi */
+#define SCAN_FLOAT   2  /* binary floating point number, e.g. %bBf */
+#define SCAN_CHARS   3  /* fixed number of bytes, e.g. %16c */
+#define SCAN_STR     4  /* length prefixed string, e.g. %$bBhs */
+
+/* destination of an operation */
+#define SCAN_ARG_NONE   0   /* suppressed with '*' */
+#define SCAN_ARG_CHAR   1
+#define SCAN_ARG_SHORT  2
+#define SCAN_ARG_INT    3
+#define SCAN_ARG_LONG   4
+#define SCAN_ARG_QUAD   5
+#define SCAN_ARG_SIZE   6
+#define SCAN_ARG_PTR    7
+#define SCAN_ARG_FLOAT  8
+#define SCAN_ARG_DOUBLE 9
+
+typedef struct m_scan_op {
+    uint8_t type;
+    uint8_t arg;
+    uint8_t width;      /* size of the integer or of the length prefix */
+    uint8_t order;      /* FLOAT_BIG, FLOAT_LITTLE or 0 for the system */
+    uint32_t off;       /* literal bytes */
+    uint32_t len;       /* literal or %c length, fixed bytes after a string */
+} m_scan_op;
+
+typedef struct m_scan {
+    /* private */
+    char *_text;
+    unsigned int _count;
+    int _fallback;      /* the layout must go through m_vsnscanf() */
+    size_t _fixed;      /* bytes read by the fixed size fields */
+    m_scan_op _op[1];
+} m_scan;
+
 /** @defgroup scanf util::scanf */
 
 /* -------------------------------------------------------------------------- */
@@ -159,4 +196,45 @@ public int m_snscanf(const char *buffer, size_t size, const char *fmt, ...);
 
 /* -------------------------------------------------------------------------- */
 
+public m_scan *scan_compile(const char *format);
+
+/**
+ * @ingroup scanf
+ * @fn m_scan *scan_compile(const char *format)
+ * @param format a binary layout accepted by m_vsnscanf()
+ * @return the compiled layout or NULL if an error occured
+ *
+ * This function parses a layout once into a list of operations, to be
+ * used many times with @ref string_fetch_compiled. Binary integers and
+ * floating point numbers are loaded directly, %Nc copies N bytes and the
+ * other characters of the layout must match exactly. The input length is
+ * checked once for all the fixed size fields.
+ *
+ * Compiled layouts also understand length prefixed strings: %$bBhs reads a
+ * 16 bits big endian length, then as many bytes. The length prefix follows
+ * the integer rules, and the '$' flag takes the size of the output buffer,
+ * which is NUL terminated. A string which does not fit is an error.
+ *
+ * Layouts with whitespaces, text conversions or truncated integers are not
+ * compiled; they go through m_vsnscanf() as a whole, and cannot hold
+ * length prefixed strings.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
+public m_scan *scan_free(m_scan *scan);
+
+/**
+ * @ingroup scanf
+ * @fn m_scan *scan_free(m_scan *scan)
+ * @param scan a compiled layout
+ * @return NULL
+ *
+ * This function releases a layout compiled by @ref scan_compile.
+ *
+ */
+
+/* -------------------------------------------------------------------------- */
+
 #endif
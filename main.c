@@ -42,10 +42,12 @@
 /* -------------------------------------------------------------------------- */
 
 static int interrupt = 0;
+static int dump = 0;
 
 /* UNIX daemon functions */
 static void daemonize(int forcefork);
 static void _sigusr1_handler(UNUSED int _dummy);
+static void _sigusr2_handler(UNUSED int _dummy);
 
 #ifdef __APPLE__
 #define CONCRETE_OS " for Mac OS X"
@@ -68,6 +70,8 @@ static void _sigusr1_handler(UNUSED int _dummy);
 #endif
 #define MAIN_OPTSHRT_PRINTH "-h"
 #define MAIN_OPTLONG_PRINTH "--help"
+#define MAIN_OPTSHRT_METRIC "-m"
+#define MAIN_OPTLONG_METRIC "--metrics"
 
 #if defined(_ENABLE_CONFIG) && defined(HAS_LIBXML)
 #define MAIN_PRINTHLP \
@@ -81,6 +85,8 @@ static void _sigusr1_handler(UNUSED int _dummy);
 "\t\tstart the server as a background process\n" \
 "\t"MAIN_OPTSHRT_PRINTV", "MAIN_OPTLONG_PRINTV \
 "\t\toutput version information and exit\n" \
+"\t"MAIN_OPTSHRT_METRIC", "MAIN_OPTLONG_METRIC" PID" \
+"\tdisplay the metrics of a running server and exit\n" \
 "\t"MAIN_OPTSHRT_PRINTH", "MAIN_OPTLONG_PRINTH \
 "\t\tdisplay this help and exit\n" \
 "\t"MAIN_OPTIONS_CNFDBG \
@@ -99,6 +105,8 @@ static void _sigusr1_handler(UNUSED int _dummy);
 "\t\tstart the server as a background process\n" \
 "\t"MAIN_OPTSHRT_PRINTV", "MAIN_OPTLONG_PRINTV \
 "\t\toutput version information and exit\n" \
+"\t"MAIN_OPTSHRT_METRIC", "MAIN_OPTLONG_METRIC" PID" \
+"\tdisplay the metrics of a running server and exit\n" \
 "\t"MAIN_OPTSHRT_PRINTH", "MAIN_OPTLONG_PRINTH \
 "\t\tdisplay this help and exit\n\n"
 #endif
@@ -149,6 +157,8 @@ static VOID WINAPI _service_main(DWORD argc, LPSTR *argv);
 #define MAIN_OPTLONG_PRINTV "/version"
 #define MAIN_OPTSHRT_PRINTH "/h"
 #define MAIN_OPTLONG_PRINTH "/help"
+#define MAIN_OPTSHRT_METRIC "/m"
+#define MAIN_OPTLONG_METRIC "/metrics"
 #define MAIN_OPTSHRT_INSTAL "/i"
 #define MAIN_OPTLONG_INSTAL "/install"
 #define MAIN_OPTSHRT_UNINST "/u"
@@ -183,6 +193,8 @@ static VOID WINAPI _service_main(DWORD argc, LPSTR *argv);
 "\t\tstop the NT service\n" \
 "\t"MAIN_OPTSHRT_PRINTV", "MAIN_OPTLONG_PRINTV \
 "\t\toutput version information and exit\n" \
+"\t"MAIN_OPTSHRT_METRIC", "MAIN_OPTLONG_METRIC" PID" \
+"\tdisplay the metrics of a running server and exit\n" \
 "\t"MAIN_OPTSHRT_PRINTH", "MAIN_OPTLONG_PRINTH \
 "\t\tdisplay this help and exit\n" \
 "\t"MAIN_OPTIONS_CNFDBG \
@@ -207,6 +219,8 @@ static VOID WINAPI _service_main(DWORD argc, LPSTR *argv);
 "\t\tstop the NT service\n" \
 "\t"MAIN_OPTSHRT_PRINTV", "MAIN_OPTLONG_PRINTV \
 "\t\toutput version information and exit\n" \
+"\t"MAIN_OPTSHRT_METRIC", "MAIN_OPTLONG_METRIC" PID" \
+"\tdisplay the metrics of a running server and exit\n" \
 "\t"MAIN_OPTSHRT_PRINTH", "MAIN_OPTLONG_PRINTH \
 "\t\tdisplay this help and exit\n\n"
 #endif
@@ -225,6 +239,7 @@ static VOID _spawn_child(UNUSED VOID *dummy);
 
 /* COMMON */
 static void main_process(int option_daemon, int argc, char **argv);
+static int main_metrics(const char *pid);
 
 /* -------------------------------------------------------------------------- */
 /* CONCRETE SERVER MAIN */
@@ -264,6 +279,10 @@ int main(int argc, char **argv)
             ! strcmp(argv[argc], MAIN_OPTLONG_PRINTH))
             option_help = 1;
 
+        if (! strcmp(argv[argc], MAIN_OPTSHRT_METRIC) ||
+            ! strcmp(argv[argc], MAIN_OPTLONG_METRIC))
+            exit(main_metrics(argv[argc + 1]));
+
         #ifdef WIN32
         if (! strcmp(argv[argc], MAIN_OPTSHRT_INSTAL) ||
             ! strcmp(argv[argc], MAIN_OPTLONG_INSTAL)) {
@@ -333,6 +352,42 @@ int main(int argc, char **argv)
     exit(EXIT_SUCCESS);
 }
 
+/* -------------------------------------------------------------------------- */
+
+static int main_metrics(const char *pid)
+{
+    const m_server_metrics *metrics = NULL;
+    const m_server_counters *c = NULL;
+    unsigned int i = 0;
+
+    if (! pid || ! (metrics = server_metrics_attach(strtoul(pid, NULL, 10))) ) {
+        fprintf(stderr, "Concrete: no metrics available for this process.\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Concrete Server [%s] - up %lu seconds\n\n", pid,
+           (unsigned long) (time(NULL) - metrics->started));
+
+    printf("queues: %u readable, %u writable, %u blocking, %u incoming\n\n",
+           metrics->readable, metrics->writable, metrics->blocking,
+           metrics->incoming);
+
+    printf("%6s %12s %14s %14s %10s %10s %12s %10s\n", "thread", "requests",
+           "received", "sent", "accepted", "closed", "calls", "avg (us)");
+
+    for (i = 0; i < metrics->threads; i ++) {
+        c = & metrics->thread[i];
+        printf("%6u %12"PRIu64" %14"PRIu64" %14"PRIu64" %10"PRIu64
+               " %10"PRIu64" %12"PRIu64" %10"PRIu64"\n", i, c->requests,
+               c->rx, c->tx, c->accepted, c->closed, c->plugin_calls,
+               (c->plugin_calls) ? c->plugin_usec / c->plugin_calls : 0);
+    }
+
+    server_metrics_detach(metrics);
+
+    return EXIT_SUCCESS;
+}
+
 /* -------------------------------------------------------------------------- */
 #ifndef WIN32
 /* -------------------------------------------------------------------------- */
@@ -348,6 +403,7 @@ static void main_process(int option_daemon, UNUSED int argc, UNUSED char **argv)
 
     int syslog[2]; pid_t logger = 0;
     sigset_t mask, oldmask;
+    int c = 0;
 
     /* timezone */
     tzset();
@@ -436,22 +492,29 @@ static void main_process(int option_daemon, UNUSED int argc, UNUSED char **argv)
         if (server_init() == 0) {
             if (! option_daemon) {
 
-                fprintf(stderr, "-- Interactive session - Press Q to exit.\n");
+                fprintf(stderr, "-- Interactive session - Press Q to exit, "
+                                "L to print the latencies.\n");
 
-                while (getchar() != 'q');
+                while ( (c = getchar()) != 'q')
+                    if (c == 'l') server_latency_dump(stderr);
 
                 fprintf(stderr, "-- End of the interactive session\n");
 
             } else {
 
-                /* wait for the SIGUSR1 signal */
+                /* wait for the SIGUSR1 signal, SIGUSR2 dumps the latencies */
                 sigemptyset(& mask); sigaddset(& mask, SIGUSR1);
+                sigaddset(& mask, SIGUSR2);
 
                 signal(SIGUSR1, _sigusr1_handler);
+                signal(SIGUSR2, _sigusr2_handler);
 
                 sigprocmask(SIG_BLOCK, & mask, & oldmask);
 
-                while (! interrupt) sigsuspend(& oldmask);
+                while (! interrupt) {
+                    sigsuspend(& oldmask);
+                    if (dump) { dump = 0; server_latency_dump(stderr); }
+                }
 
                 sigprocmask(SIG_UNBLOCK, & mask, NULL);
 
@@ -475,8 +538,9 @@ static void main_process(int option_daemon, UNUSED int argc, UNUSED char **argv)
         break;
 
     default:
-        /* ignore SIGUSR1, so the child handle it */
+        /* ignore SIGUSR1 and SIGUSR2, so the child handle them */
         signal(SIGUSR1, SIG_IGN);
+        signal(SIGUSR2, SIG_IGN);
 
         /* father, handle privileges requests and wait for the child */
         close(sockpair[0]);
@@ -560,6 +624,13 @@ static void _sigusr1_handler(UNUSED int _dummy)
     interrupt = 1;
 }
 
+/* -------------------------------------------------------------------------- */
+
+static void _sigusr2_handler(UNUSED int _dummy)
+{
+    dump = 1;
+}
+
 /* -------------------------------------------------------------------------- */
 #else /* WIN32 */
 /* -------------------------------------------------------------------------- */
@@ -89,6 +89,9 @@
 #define DIALMSN_LINESEPARATOR "\n"            /* line separator */
 #define DIALMSN_LINESEPLENGTH 1               /* line separator length */
 
+/* size of the chunks used to build long user lists */
+#define DIALMSN_LIST_CHUNK 16384
+
 /* main commands */
 #define DIALMSN_AUTH 0x00000001               /* authentication */
 #define DIALMSN_LIST 0x00000002               /* listing */
@@ -795,6 +795,7 @@ private void dialmsn_userlist_getmisc(uint16_t session, uint32_t request)
     uint32_t uid = 0, header = 0, error = DIALMSN_LIST | DIALMSN_LIST_ERROR;
     int favsession = 0;
     m_string *list = NULL;
+    m_rope *rope = NULL;
     char buffer[1024];
     size_t size = 0;
     const char *query = NULL;
@@ -824,8 +825,9 @@ private void dialmsn_userlist_getmisc(uint16_t session, uint32_t request)
         goto _err_abort;
     }
 
-    if (! (list = string_from_uint32(header)) ) {
+    if (! (rope = rope_alloc()) || ! (list = string_from_uint32(header)) ) {
         debug("DialMessenger::LIST: out of memory (0).\n");
+        rope = rope_free(rope);
         error |= DIALMSN_LIST_ERR_ENOMEM;
         goto _err_abort;
     }
@@ -835,7 +837,7 @@ private void dialmsn_userlist_getmisc(uint16_t session, uint32_t request)
     if (! (r = db_query(con, query, uid)) ) {
         debug("DialMessenger::LIST: SQL error.\n");
         error |= DIALMSN_LIST_ERR_EINVAL;
-        list = string_free(list);
+        list = string_free(list); rope = rope_free(rope);
         goto _err_abort;
     }
 
@@ -844,7 +846,7 @@ private void dialmsn_userlist_getmisc(uint16_t session, uint32_t request)
     if (! r->rows) {
         debug("DialMessenger::LIST: empty users list.\n");
         error |= DIALMSN_LIST_ERR_EEMPTY;
-        r = db_free(r); list = string_free(list);
+        r = db_free(r); list = string_free(list); rope = rope_free(rope);
         goto _err_abort;
     }
 
@@ -876,13 +878,17 @@ private void dialmsn_userlist_getmisc(uint16_t session, uint32_t request)
                               db_integer(r, "expiration"),     /* subscriber */
                               DIALMSN_LINESEPLENGTH, DIALMSN_LINESEPARATOR);
 
-            if (! string_cats(list, buffer, size)) {
-                debug("DialMessenger::LIST: out of memory (1).\n");
-                r = db_free(r); list = string_free(list);
-                error |= DIALMSN_LIST_ERR_ENOMEM;
-                goto _err_abort;
+            /* long lists are sent as a rope of chunks, never reallocated */
+            if (SIZE(list) + size > DIALMSN_LIST_CHUNK) {
+                if (rope_append(rope, list) == -1 ||
+                    ! (list = string_prealloc(NULL, 0, DIALMSN_LIST_CHUNK)) ) {
+                    list = NULL;
+                    goto _err_chunk;
+                }
             }
 
+            if (! string_cats(list, buffer, size)) goto _err_chunk;
+
             count ++;
         }
     } while (db_movenext(r) != -1);
@@ -890,26 +896,33 @@ private void dialmsn_userlist_getmisc(uint16_t session, uint32_t request)
     r = db_free(r);
 
     if (count) {
-        if (! string_cats(list, (char *) & term, sizeof(term))) {
-            debug("DialMessenger::LIST: out of memory (2).\n");
+        if (! string_cats(list, (char *) & term, sizeof(term)))
             list = string_free(list);
+
+        /* the rope owns the chunk, even if rope_append() fails */
+        if (! list || rope_append(rope, list) == -1) {
+            debug("DialMessenger::LIST: out of memory (2).\n");
+            rope = rope_free(rope);
             error |= DIALMSN_LIST_ERR_ENOMEM;
             goto _err_abort;
         }
 
-        server_send_buffer(plugin_get_token(), session, 0x0,
-                           DATA(list), SIZE(list));
+        if (server_send_rope(plugin_get_token(), session, 0x0, rope) == -1)
+            rope = rope_free(rope);
     } else {
         debug("DialMessenger::LIST: all users from the list are offline.\n");
         error |= DIALMSN_LIST_ERR_EEMPTY;
-        list = string_free(list);
+        list = string_free(list); rope = rope_free(rope);
         goto _err_abort;
     }
 
-    list = string_free(list);
-
     return;
 
+_err_chunk:
+    debug("DialMessenger::LIST: out of memory (1).\n");
+    r = db_free(r); list = string_free(list); rope = rope_free(rope);
+    error |= DIALMSN_LIST_ERR_ENOMEM;
+
 _err_abort:
     con = dialmsn_db_return(con);
 
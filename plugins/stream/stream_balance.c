@@ -0,0 +1,634 @@
+/*******************************************************************************
+ *  Concrete Server                                                            *
+ *  Copyright (c) 2005-2020 Raphael Prevost <raph@el.bzh>                      *
+ *                                                                             *
+ *  This software is a computer program whose purpose is to provide a          *
+ *  framework for developing and prototyping network services.                 *
+ *                                                                             *
+ *  This software is governed by the CeCILL  license under French law and      *
+ *  abiding by the rules of distribution of free software.  You can  use,      *
+ *  modify and/ or redistribute the software under the terms of the CeCILL     *
+ *  license as circulated by CEA, CNRS and INRIA at the following URL          *
+ *  "http://www.cecill.info".                                                  *
+ *                                                                             *
+ *  As a counterpart to the access to the source code and  rights to copy,     *
+ *  modify and redistribute granted by the license, users are provided only    *
+ *  with a limited warranty  and the software's author,  the holder of the     *
+ *  economic rights,  and the successive licensors  have only  limited         *
+ *  liability.                                                                 *
+ *                                                                             *
+ *  In this respect, the user's attention is drawn to the risks associated     *
+ *  with loading,  using,  modifying and/or developing or reproducing the      *
+ *  software by the user in light of its specific status of free software,     *
+ *  that may mean  that it is complicated to manipulate,  and  that  also      *
+ *  therefore means  that it is reserved for developers  and  experienced      *
+ *  professionals having in-depth computer knowledge. Users are therefore      *
+ *  encouraged to load and test the software's suitability as regards their    *
+ *  requirements in conditions enabling the security of their systems and/or   *
+ *  data to be ensured and,  more generally, to use and operate it in the      *
+ *  same conditions as regards security.                                       *
+ *                                                                             *
+ *  The fact that you are presently reading this means that you have had       *
+ *  knowledge of the CeCILL license and that you accept its terms.             *
+ *                                                                             *
+ ******************************************************************************/
+
+#include "stream_plugin.h"
+
+/* number of points of each worker on the consistent hashing ring */
+#define _RING_POINTS 64
+
+/* smoothing factor of the latency moving average (1 / 2^_EWMA_SHIFT) */
+#define _EWMA_SHIFT  3
+
+/* MASTER: workers statistics */
+static pthread_mutex_t _balance_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+    int stream;              /* stream served by the worker, or -1 */
+    uint32_t caps;           /* capabilities announced in the HELLO */
+    unsigned int pending;    /* connections requested but not yet opened */
+    unsigned int active;     /* pipes currently opened by the worker */
+    uint64_t probe;          /* transmission time of the unanswered probe */
+    uint8_t seq;             /* sequence number of the unanswered probe */
+    uint8_t next;            /* sequence number of the queued probe */
+    uint64_t latency;        /* smoothed round trip time, in microseconds */
+} _stats[SOCKET_MAX];
+
+/* MASTER: map a pipe end to the worker which opened it */
+static uint16_t _owner[SOCKET_MAX];
+
+/* MASTER: map a waiting public connection to the worker hired for it */
+static uint16_t _hiring[SOCKET_MAX];
+
+typedef struct _point {
+    uint32_t hash;
+    uint16_t worker;
+} _point;
+
+/* MASTER: workers of each stream and their consistent hashing ring */
+static struct {
+    uint16_t *worker;
+    unsigned int workers;
+    _point *ring;
+} _pool[_STREAMS_MAX];
+
+/* -------------------------------------------------------------------------- */
+
+static uint64_t _now(void)
+{
+    struct timespec ts;
+
+    monotonic_timer(& ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static uint32_t _hash(const char *data, size_t len, uint32_t h)
+{
+    size_t i = 0;
+
+    /* FNV-1a, with a final avalanche since the keys are very short */
+    for (h ^= 0x811c9dc5, i = 0; i < len; i ++)
+        h = (h ^ (uint8_t) data[i]) * 0x01000193;
+
+    h ^= h >> 16; h *= 0x85ebca6b;
+    h ^= h >> 13; h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _point_cmp(const void *a, const void *b)
+{
+    const _point *p0 = a, *p1 = b;
+
+    return (p0->hash > p1->hash) - (p0->hash < p1->hash);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _ring_build(int stream_id)
+{
+    unsigned int i = 0, j = 0, n = 0;
+    uint16_t key[2];
+
+    free(_pool[stream_id].ring);
+    _pool[stream_id].ring = NULL;
+
+    if (! _pool[stream_id].workers) return;
+
+    n = _pool[stream_id].workers * _RING_POINTS;
+
+    if (! (_pool[stream_id].ring = malloc(n * sizeof(_point))) ) {
+        perror(ERR(_ring_build, malloc));
+        return;
+    }
+
+    /* the socket id identifies the worker as long as it stays connected */
+    for (i = 0; i < _pool[stream_id].workers; i ++) {
+        for (j = 0; j < _RING_POINTS; j ++) {
+            key[0] = _pool[stream_id].worker[i]; key[1] = j;
+            _pool[stream_id].ring[i * _RING_POINTS + j].hash =
+            _hash((char *) key, sizeof(key), 0);
+            _pool[stream_id].ring[i * _RING_POINTS + j].worker = key[0];
+        }
+    }
+
+    qsort(_pool[stream_id].ring, n, sizeof(_point), _point_cmp);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static uint64_t _latency(uint16_t worker, uint64_t now)
+{
+    uint64_t elapsed = 0;
+
+    /* an unanswered probe is a lower bound of the current latency */
+    if (_stats[worker].probe && now > _stats[worker].probe) {
+        elapsed = now - _stats[worker].probe;
+        if (elapsed > _stats[worker].latency) return elapsed;
+    }
+
+    return _stats[worker].latency;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _ejected(uint16_t worker, uint64_t now)
+{
+    uint64_t limit = stream_config_eject(_stats[worker].stream);
+
+    return (limit && _latency(worker, now) > limit * 1000);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static uint16_t _select_best(int stream_id, int policy, int strict)
+{
+    uint16_t worker = 0, best = 0;
+    uint64_t now = _now(), score = 0, min = 0;
+    unsigned int i = 0, load = 0, minload = 0;
+
+    for (i = 0; i < _pool[stream_id].workers; i ++) {
+        worker = _pool[stream_id].worker[i];
+
+        if (stream_get_status(worker) != STREAM_STATUS_WORK) continue;
+        if (strict && _ejected(worker, now)) continue;
+
+        load = _stats[worker].pending + _stats[worker].active;
+        score = (policy == BALANCE_LATENCY) ? _latency(worker, now) : load;
+
+        /* ties are broken using the load */
+        if (! best || score < min || (score == min && load < minload)) {
+            best = worker; min = score; minload = load;
+        }
+    }
+
+    return best;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static uint16_t _select_ring(int stream_id, uint32_t hash, int strict)
+{
+    _point *ring = _pool[stream_id].ring;
+    unsigned int n = _pool[stream_id].workers * _RING_POINTS;
+    unsigned int lo = 0, hi = n, i = 0;
+    uint64_t now = _now();
+    uint16_t worker = 0;
+
+    if (! ring) return 0;
+
+    /* find the first point clockwise from the hash */
+    while (lo < hi) {
+        i = lo + (hi - lo) / 2;
+        if (ring[i].hash < hash) lo = i + 1; else hi = i;
+    }
+
+    /* walk the ring until a worker is able to accept the connection */
+    for (i = 0; i < n; i ++) {
+        worker = ring[(lo + i) % n].worker;
+        if (stream_get_status(worker) != STREAM_STATUS_WORK) continue;
+        if (strict && _ejected(worker, now)) continue;
+        return worker;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private int stream_balance_init(void)
+{
+    int i = 0;
+
+    for (i = 0; i < SOCKET_MAX; i ++) _stats[i].stream = -1;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_balance_join(int stream_id, uint16_t worker, uint32_t caps)
+{
+    uint16_t *pool = NULL;
+    unsigned int n = 0;
+
+    if (worker < 1 || worker >= SOCKET_MAX) {
+        debug("stream_balance_join(): bad parameters.\n");
+        return;
+    }
+
+    if (stream_id < 0 || stream_id >= _STREAMS_MAX) {
+        debug("stream_balance_join(): bad parameters.\n");
+        return;
+    }
+
+    pthread_mutex_lock(& _balance_lock);
+
+        if (_stats[worker].stream != -1) {
+            pthread_mutex_unlock(& _balance_lock);
+            return;
+        }
+
+        n = _pool[stream_id].workers + 1;
+
+        if (! (pool = realloc(_pool[stream_id].worker, n * sizeof(*pool))) ) {
+            perror(ERR(stream_balance_join, realloc));
+            pthread_mutex_unlock(& _balance_lock);
+            return;
+        }
+
+        pool[n - 1] = worker;
+        _pool[stream_id].worker = pool;
+        _pool[stream_id].workers = n;
+
+        memset(& _stats[worker], 0, sizeof(_stats[worker]));
+        _stats[worker].stream = stream_id;
+        _stats[worker].caps = caps;
+
+        if (stream_config_balance(stream_id) == BALANCE_AFFINITY)
+            _ring_build(stream_id);
+
+    pthread_mutex_unlock(& _balance_lock);
+
+    /* start measuring the latency of the new worker */
+    if (stream_config_probe(stream_id) && stream_probe(worker) == -1)
+        debug("Stream: failed to probe worker %i.\n", worker);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_balance_leave(uint16_t socket_id)
+{
+    uint16_t owner = 0;
+    unsigned int i = 0;
+    int stream_id = 0;
+
+    if (socket_id < 1 || socket_id >= SOCKET_MAX) {
+        debug("stream_balance_leave(): bad parameters.\n");
+        return;
+    }
+
+    pthread_mutex_lock(& _balance_lock);
+
+        /* a pipe was closed */
+        if ( (owner = _owner[socket_id]) ) {
+            if (_stats[owner].active) _stats[owner].active --;
+            _owner[socket_id] = 0;
+        }
+
+        /* a public connection was closed */
+        _hiring[socket_id] = 0;
+
+        /* a worker left */
+        if ( (stream_id = _stats[socket_id].stream) != -1) {
+            for (i = 0; i < _pool[stream_id].workers; i ++) {
+                if (_pool[stream_id].worker[i] == socket_id) {
+                    _pool[stream_id].worker[i] =
+                    _pool[stream_id].worker[-- _pool[stream_id].workers];
+                    break;
+                }
+            }
+
+            for (i = 0; i < SOCKET_MAX; i ++) {
+                if (_owner[i] == socket_id) _owner[i] = 0;
+                /* let the waiting clients hire another worker */
+                if (_hiring[i] == socket_id) _hiring[i] = 0;
+            }
+
+            _stats[socket_id].stream = -1;
+
+            if (stream_config_balance(stream_id) == BALANCE_AFFINITY)
+                _ring_build(stream_id);
+        }
+
+    pthread_mutex_unlock(& _balance_lock);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private int stream_balance_ejected(uint16_t worker)
+{
+    int ret = 0;
+
+    if (worker < 1 || worker >= SOCKET_MAX) {
+        debug("stream_balance_ejected(): bad parameters.\n");
+        return 0;
+    }
+
+    pthread_mutex_lock(& _balance_lock);
+        if (_stats[worker].stream != -1) ret = _ejected(worker, _now());
+    pthread_mutex_unlock(& _balance_lock);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private uint16_t stream_balance_select(int stream_id, uint16_t socket_id)
+{
+    char host[NI_MAXHOST];
+    uint16_t worker = 0;
+    uint32_t hash = 0;
+    unsigned int tries = 0;
+    int policy = 0;
+
+    if (stream_id < 0 || stream_id >= _STREAMS_MAX) {
+        debug("stream_balance_select(): bad parameters.\n");
+        return 0;
+    }
+
+    policy = stream_config_balance(stream_id);
+
+    /* the client address is hashed to elect its worker */
+    if (policy == BALANCE_AFFINITY) {
+        if (! socket_id || socket_ip(socket_id, host, sizeof(host), NULL))
+            policy = BALANCE_LEASTCONN;
+        else hash = _hash(host, strlen(host), 0);
+    }
+
+    if (policy == BALANCE_ROUNDROBIN) {
+        pthread_mutex_lock(& _balance_lock);
+            tries = _pool[stream_id].workers;
+        pthread_mutex_unlock(& _balance_lock);
+
+        /* skip the ejected workers, unless there is no other choice */
+        do {
+            if (! (worker = stream_borrow_worker(stream_id)) ) break;
+            stream_release_worker(stream_id, worker);
+        } while (stream_balance_ejected(worker) && tries -- > 1);
+
+        return worker;
+    }
+
+    pthread_mutex_lock(& _balance_lock);
+
+        if (policy == BALANCE_AFFINITY) {
+            if (! (worker = _select_ring(stream_id, hash, 1)) )
+                worker = _select_ring(stream_id, hash, 0);
+        } else {
+            if (! (worker = _select_best(stream_id, policy, 1)) )
+                worker = _select_best(stream_id, policy, 0);
+        }
+
+    pthread_mutex_unlock(& _balance_lock);
+
+    return worker;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private int stream_balance_hire(uint16_t worker, uint16_t socket_id,
+                                uint32_t *ticket)
+{
+    int ret = 0;
+
+    if (worker < 1 || worker >= SOCKET_MAX || socket_id >= SOCKET_MAX) {
+        debug("stream_balance_hire(): bad parameters.\n");
+        return -1;
+    }
+
+    if (! ticket) {
+        debug("stream_balance_hire(): bad parameters.\n");
+        return -1;
+    }
+
+    *ticket = 0;
+
+    pthread_mutex_lock(& _balance_lock);
+
+        /* a client already waiting for a pipe does not hire again */
+        if (socket_id && _hiring[socket_id]) ret = -1;
+        else if (_stats[worker].stream != -1) {
+            /* the ticket lets the master know who opened a connection;
+               without it, the connection cannot be tracked as pending */
+            if (_stats[worker].caps & WORKER_CAP_TICKET) {
+                *ticket = ((uint32_t) worker << 16) | socket_id;
+                if (socket_id) _hiring[socket_id] = worker;
+                _stats[worker].pending ++;
+            }
+        }
+
+    pthread_mutex_unlock(& _balance_lock);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private uint16_t stream_balance_ready(uint16_t conn, uint32_t ticket)
+{
+    uint16_t worker = ticket >> 16, socket_id = ticket & 0xFFFF;
+
+    if (conn < 1 || conn >= SOCKET_MAX) {
+        debug("stream_balance_ready(): bad parameters.\n");
+        return 0;
+    }
+
+    if (! ticket || worker >= SOCKET_MAX || socket_id >= SOCKET_MAX)
+        return 0;
+
+    pthread_mutex_lock(& _balance_lock);
+
+        if (_stats[worker].stream != -1) {
+            if (_stats[worker].pending) _stats[worker].pending --;
+            _stats[worker].active ++;
+            _owner[conn] = worker;
+        }
+
+        /* the ticket is stale if the client hired someone else since */
+        if (socket_id && _hiring[socket_id] == worker)
+            _hiring[socket_id] = 0;
+        else socket_id = 0;
+
+    pthread_mutex_unlock(& _balance_lock);
+
+    return socket_id;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private uint16_t stream_balance_owner(uint16_t conn)
+{
+    uint16_t worker = 0;
+
+    if (conn < 1 || conn >= SOCKET_MAX) {
+        debug("stream_balance_owner(): bad parameters.\n");
+        return 0;
+    }
+
+    pthread_mutex_lock(& _balance_lock);
+        worker = _owner[conn];
+    pthread_mutex_unlock(& _balance_lock);
+
+    return worker;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_balance_attach(uint16_t socket_id, uint16_t worker)
+{
+    if (socket_id < 1 || socket_id >= SOCKET_MAX) {
+        debug("stream_balance_attach(): bad parameters.\n");
+        return;
+    }
+
+    if (worker < 1 || worker >= SOCKET_MAX) {
+        debug("stream_balance_attach(): bad parameters.\n");
+        return;
+    }
+
+    pthread_mutex_lock(& _balance_lock);
+
+        /* the connection is served by the worker over a multiplexed link */
+        if (_stats[worker].stream != -1) {
+            _stats[worker].active ++;
+            _owner[socket_id] = worker;
+        }
+
+    pthread_mutex_unlock(& _balance_lock);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private int stream_probe(uint16_t worker)
+{
+    m_reply *reply = NULL;
+    m_string *data = NULL;
+    unsigned int delay = 0;
+    int stream_id = 0;
+    uint8_t seq = 0;
+
+    if (worker < 1 || worker >= SOCKET_MAX) {
+        debug("stream_probe(): bad parameters.\n");
+        return -1;
+    }
+
+    /* the worker echoes the sequence number, so that only the answer
+       to this probe is used to measure the round trip time */
+    pthread_mutex_lock(& _balance_lock);
+        stream_id = _stats[worker].stream;
+        seq = _stats[worker].next = (_stats[worker].next + 1) & PROBE_SEQ;
+    pthread_mutex_unlock(& _balance_lock);
+
+    /* the worker is gone, stop probing */
+    if (stream_id == -1 || ! (delay = stream_config_probe(stream_id)) )
+        return 0;
+
+    reply = server_reply_init(SERVER_TRANS_ACK | SERVER_TRANS_OOB,
+                              plugin_get_token());
+    if (! reply) goto _err_rep;
+
+    if (! (data = string_fmt(NULL, "%bB1u", MASTER_OP_PROBE | seq)) )
+        goto _err_fmt;
+
+    if (server_reply_setheader(reply, data) == -1) goto _err_set;
+
+    if (server_reply_setdelay(reply, delay) == -1) goto _err_set;
+
+    reply = server_send_reply(worker, reply);
+
+    return 0;
+
+_err_set:
+    string_free(data);
+_err_fmt:
+    server_reply_free(reply);
+_err_rep:
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_balance_probed(uint16_t worker)
+{
+    if (worker < 1 || worker >= SOCKET_MAX) {
+        debug("stream_balance_probed(): bad parameters.\n");
+        return;
+    }
+
+    pthread_mutex_lock(& _balance_lock);
+        if (_stats[worker].stream != -1) {
+            /* only one probe is queued at a time */
+            _stats[worker].probe = _now();
+            _stats[worker].seq = _stats[worker].next;
+        }
+    pthread_mutex_unlock(& _balance_lock);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_balance_sample(uint16_t worker, uint8_t seq)
+{
+    int64_t rtt = 0;
+
+    if (worker < 1 || worker >= SOCKET_MAX) {
+        debug("stream_balance_sample(): bad parameters.\n");
+        return;
+    }
+
+    pthread_mutex_lock(& _balance_lock);
+
+        /* ignore the late answers to the previous probes */
+        if (_stats[worker].stream != -1 && _stats[worker].probe &&
+            _stats[worker].seq == seq) {
+            rtt = _now() - _stats[worker].probe;
+
+            if (_stats[worker].latency) {
+                rtt -= (int64_t) _stats[worker].latency;
+                _stats[worker].latency += rtt / (1 << _EWMA_SHIFT);
+            } else _stats[worker].latency = rtt;
+
+            _stats[worker].probe = 0;
+
+            debug("Stream: worker %i latency is %lu us.\n", worker,
+                  (unsigned long) _stats[worker].latency);
+        }
+
+    pthread_mutex_unlock(& _balance_lock);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_balance_fini(void)
+{
+    int i = 0;
+
+    pthread_mutex_lock(& _balance_lock);
+
+        for (i = 0; i < _STREAMS_MAX; i ++) {
+            free(_pool[i].worker); _pool[i].worker = NULL;
+            free(_pool[i].ring); _pool[i].ring = NULL;
+            _pool[i].workers = 0;
+        }
+
+    pthread_mutex_unlock(& _balance_lock);
+}
+
+/* -------------------------------------------------------------------------- */
@@ -41,6 +41,11 @@ static int personality = 0;
 static unsigned int master_streams = 0;
 static char *ingress_end[_STREAMS_MAX];
 static char *workers_end[_STREAMS_MAX];
+static int balance[_STREAMS_MAX];
+static unsigned int probe_delay[_STREAMS_MAX];
+static unsigned int eject_latency[_STREAMS_MAX];
+static unsigned int mux_links[_STREAMS_MAX];
+static size_t queue_limit[_STREAMS_MAX];
 
 /* worker options */
 static unsigned int worker_streams = 0;
@@ -61,6 +66,11 @@ private int stream_config_init(int argc, char **argv)
     const char *_master_streams = NULL;
     const char *opt_ingress_end = NULL;
     const char *opt_workers_end = NULL;
+    const char *opt_balance = NULL;
+    const char *opt_probe_delay = NULL;
+    const char *opt_eject_latency = NULL;
+    const char *opt_mux_links = NULL;
+    const char *opt_queue_limit = NULL;
     const char *_worker_streams = NULL;
     const char *opt_master_host = NULL;
     const char *opt_master_port = NULL;
@@ -125,6 +135,55 @@ private int stream_config_init(int argc, char **argv)
             /* TODO check workers_end is numeric */
 
             workers_end[i] = string_dups(opt_workers_end, strlen(opt_workers_end));
+
+            /* worker selection policy, defaults to round robin */
+            opt_balance = plugin_getarrayopt("balance", i, argc, argv);
+            if (! opt_balance || ! strcmp(opt_balance, "roundrobin"))
+                balance[i] = BALANCE_ROUNDROBIN;
+            else if (! strcmp(opt_balance, "leastconn"))
+                balance[i] = BALANCE_LEASTCONN;
+            else if (! strcmp(opt_balance, "latency"))
+                balance[i] = BALANCE_LATENCY;
+            else if (! strcmp(opt_balance, "affinity"))
+                balance[i] = BALANCE_AFFINITY;
+            else {
+                fprintf(stderr, "Stream: incorrect value for option: "
+                        "\"balance\".\n");
+                return -1;
+            }
+
+            /* workers whose latency exceeds this value (ms) are ejected */
+            opt_eject_latency = plugin_getarrayopt("eject_latency", i, argc, argv);
+            if (opt_eject_latency) eject_latency[i] = atoi(opt_eject_latency);
+
+            /* the workers' latency is only probed if it is actually used */
+            if (balance[i] == BALANCE_LATENCY || eject_latency[i]) {
+                opt_probe_delay = plugin_getarrayopt("probe_interval", i,
+                                                     argc, argv);
+                probe_delay[i] = (opt_probe_delay) ? atoi(opt_probe_delay) : 10;
+
+                if (! probe_delay[i] || probe_delay[i] > 3600) {
+                    fprintf(stderr, "Stream: incorrect value for option: "
+                            "\"probe_interval\".\n");
+                    return -1;
+                }
+            }
+
+            /* number of multiplexed links to request from each worker */
+            opt_mux_links = plugin_getarrayopt("multiplex", i, argc, argv);
+            if (opt_mux_links) mux_links[i] = atoi(opt_mux_links);
+
+            if (mux_links[i] > 64) {
+                fprintf(stderr, "Stream: incorrect value for option: "
+                        "\"multiplex\".\n");
+                return -1;
+            }
+
+            /* bytes a client can send while waiting for a worker */
+            opt_queue_limit = plugin_getarrayopt("queue_limit", i, argc, argv);
+            queue_limit[i] = (opt_queue_limit) ? strtoul(opt_queue_limit,
+                                                         NULL, 10)
+                                               : STREAM_QUEUE_LIMIT;
         }
     }
 
@@ -295,6 +354,67 @@ private const char *stream_config_plugin_name(int stream)
     return plugin_name[stream];
 }
 
+/* -------------------------------------------------------------------------- */
+
+private int stream_config_balance(int stream)
+{
+    if (stream < 0 || stream >= _STREAMS_MAX) {
+        debug("stream_config_balance(): bad parameters.\n");
+        return BALANCE_ROUNDROBIN;
+    }
+
+    return balance[stream];
+}
+
+/* -------------------------------------------------------------------------- */
+
+private unsigned int stream_config_probe(int stream)
+{
+    if (stream < 0 || stream >= _STREAMS_MAX) {
+        debug("stream_config_probe(): bad parameters.\n");
+        return 0;
+    }
+
+    return probe_delay[stream];
+}
+
+/* -------------------------------------------------------------------------- */
+
+private unsigned int stream_config_eject(int stream)
+{
+    if (stream < 0 || stream >= _STREAMS_MAX) {
+        debug("stream_config_eject(): bad parameters.\n");
+        return 0;
+    }
+
+    return eject_latency[stream];
+}
+
+/* -------------------------------------------------------------------------- */
+
+private unsigned int stream_config_multiplex(int stream)
+{
+    if (stream < 0 || stream >= _STREAMS_MAX) {
+        debug("stream_config_multiplex(): bad parameters.\n");
+        return 0;
+    }
+
+    return mux_links[stream];
+}
+
+/* -------------------------------------------------------------------------- */
+
+private size_t stream_config_queue_limit(int stream)
+{
+    if (stream < 0 || stream >= _STREAMS_MAX) {
+        debug("stream_config_queue_limit(): bad parameters.\n");
+        return 0;
+    }
+
+    return queue_limit[stream];
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 private void stream_config_fini(void)
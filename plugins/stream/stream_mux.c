@@ -0,0 +1,693 @@
+/*******************************************************************************
+ *  Concrete Server                                                            *
+ *  Copyright (c) 2005-2020 Raphael Prevost <raph@el.bzh>                      *
+ *                                                                             *
+ *  This software is a computer program whose purpose is to provide a          *
+ *  framework for developing and prototyping network services.                 *
+ *                                                                             *
+ *  This software is governed by the CeCILL  license under French law and      *
+ *  abiding by the rules of distribution of free software.  You can  use,      *
+ *  modify and/ or redistribute the software under the terms of the CeCILL     *
+ *  license as circulated by CEA, CNRS and INRIA at the following URL          *
+ *  "http://www.cecill.info".                                                  *
+ *                                                                             *
+ *  As a counterpart to the access to the source code and  rights to copy,     *
+ *  modify and redistribute granted by the license, users are provided only    *
+ *  with a limited warranty  and the software's author,  the holder of the     *
+ *  economic rights,  and the successive licensors  have only  limited         *
+ *  liability.                                                                 *
+ *                                                                             *
+ *  In this respect, the user's attention is drawn to the risks associated     *
+ *  with loading,  using,  modifying and/or developing or reproducing the      *
+ *  software by the user in light of its specific status of free software,     *
+ *  that may mean  that it is complicated to manipulate,  and  that  also      *
+ *  therefore means  that it is reserved for developers  and  experienced      *
+ *  professionals having in-depth computer knowledge. Users are therefore      *
+ *  encouraged to load and test the software's suitability as regards their    *
+ *  requirements in conditions enabling the security of their systems and/or   *
+ *  data to be ensured and,  more generally, to use and operate it in the      *
+ *  same conditions as regards security.                                       *
+ *                                                                             *
+ *  The fact that you are presently reading this means that you have had       *
+ *  knowledge of the CeCILL license and that you accept its terms.             *
+ *                                                                             *
+ ******************************************************************************/
+
+#include "stream_plugin.h"
+
+/*
+ * A multiplexed link is a persistent connection opened by a worker to its
+ * master, which carries the traffic of many public connections. Each public
+ * connection is identified on the link by a stream id, which is the socket id
+ * of the public connection on the master.
+ *
+ * Every frame starts with an 8 bytes header holding the stream id, the frame
+ * type and the length of the payload. Each end of a stream may only send
+ * MUX_WINDOW bytes which have not been delivered yet by the other end; the
+ * receiver grants more credit with MUX_OP_WINDOW frames once the data have
+ * actually been written to their destination. A stream which runs out of
+ * credit stops reading from its local end until the remote end grants more,
+ * so a slow consumer slows down the producer instead of filling the memory.
+ */
+
+static pthread_mutex_t _mux_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ALL: links */
+static struct {
+    int stream;              /* stream served by the link, or -1 */
+    uint16_t owner;          /* MASTER: worker which opened the link */
+    unsigned int streams;    /* number of streams carried by the link */
+    uint16_t *map;           /* stream id -> local socket */
+    m_string *rx;            /* incomplete incoming frame */
+} _link[SOCKET_MAX];
+
+/* ALL: multiplexed sockets */
+static struct {
+    uint16_t link;           /* link carrying the socket traffic */
+    uint16_t sid;            /* stream id on the link */
+    uint32_t credit;         /* bytes the remote end can still accept */
+    uint32_t consumed;       /* bytes delivered but not yet credited back */
+    int suspended;           /* the local end is not read anymore */
+    m_string *backlog;       /* outgoing data waiting for credit */
+    m_queue *inflight;       /* size of the writes not yet acknowledged */
+} _mux[SOCKET_MAX];
+
+/* MASTER: links of each stream */
+static struct {
+    uint16_t *link;
+    unsigned int links;
+} _links[_STREAMS_MAX];
+
+/* -------------------------------------------------------------------------- */
+
+static int _mux_frame(uint16_t link, uint16_t sid, uint8_t op,
+                      const char *data, size_t len)
+{
+    m_string *frame = NULL;
+
+    if (len > UINT32_MAX) {
+        debug("_mux_frame(): frame too large.\n");
+        return -1;
+    }
+
+    frame = string_fmt(NULL, "%bB2u%bB1u%bB1u%bB4u", sid, op, 0, (uint32_t) len);
+
+    if (! frame || (len && ! string_cats(frame, data, len)) ) {
+        debug("_mux_frame(): cannot allocate frame.\n");
+        string_free(frame);
+        return -1;
+    }
+
+    return server_send_string(plugin_get_token(), link, 0x0, frame);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _mux_pump(uint16_t socket_id)
+{
+    size_t len = 0;
+
+    /* send as much data as the remote end can accept */
+    while (_mux[socket_id].backlog && _mux[socket_id].credit) {
+        len = SIZE(_mux[socket_id].backlog);
+        if (len > _mux[socket_id].credit) len = _mux[socket_id].credit;
+        if (len > MUX_FRAME_MAX) len = MUX_FRAME_MAX;
+
+        if (_mux_frame(_mux[socket_id].link, _mux[socket_id].sid, MUX_OP_DATA,
+                       DATA(_mux[socket_id].backlog), len) == -1)
+            break;
+
+        _mux[socket_id].credit -= len;
+
+        if (len == SIZE(_mux[socket_id].backlog))
+            _mux[socket_id].backlog = string_free(_mux[socket_id].backlog);
+        else string_suppr(_mux[socket_id].backlog, 0, len);
+    }
+
+    /* stop reading the local end until the remote end catches up */
+    if (!! _mux[socket_id].backlog != _mux[socket_id].suspended) {
+        _mux[socket_id].suspended = !! _mux[socket_id].backlog;
+        server_suspend_socket(plugin_get_token(), socket_id,
+                              _mux[socket_id].suspended);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _mux_credit(uint16_t socket_id, size_t len)
+{
+    uint32_t credit = 0;
+
+    _mux[socket_id].consumed += len;
+
+    /* give the credit back in batches */
+    if (_mux[socket_id].consumed >= MUX_WINDOW / 4) {
+        credit = htonl(_mux[socket_id].consumed);
+        _mux_frame(_mux[socket_id].link, _mux[socket_id].sid,
+                   MUX_OP_WINDOW, (char *) & credit, sizeof(credit));
+        _mux[socket_id].consumed = 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _mux_bind(uint16_t link, uint16_t sid, uint16_t socket_id)
+{
+    _link[link].map[sid] = socket_id;
+    _link[link].streams ++;
+
+    _mux[socket_id].link = link;
+    _mux[socket_id].sid = sid;
+    _mux[socket_id].credit = MUX_WINDOW;
+    _mux[socket_id].consumed = 0;
+    _mux[socket_id].suspended = 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static uint16_t _mux_unbind(uint16_t socket_id)
+{
+    uint16_t link = _mux[socket_id].link;
+
+    if (! link) return 0;
+
+    if (_link[link].map && _link[link].map[_mux[socket_id].sid] == socket_id) {
+        _link[link].map[_mux[socket_id].sid] = 0;
+        if (_link[link].streams) _link[link].streams --;
+    }
+
+    _mux[socket_id].backlog = string_free(_mux[socket_id].backlog);
+    _mux[socket_id].inflight = queue_free(_mux[socket_id].inflight);
+    _mux[socket_id].link = _mux[socket_id].sid = 0;
+    _mux[socket_id].suspended = 0;
+
+    return link;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _mux_register(int stream_id, uint16_t link)
+{
+    if (_link[link].stream != -1) return 0;
+
+    if (! (_link[link].map = calloc(SOCKET_MAX, sizeof(*_link[link].map))) ) {
+        perror(ERR(_mux_register, calloc));
+        return -1;
+    }
+
+    _link[link].stream = stream_id;
+    _link[link].streams = 0;
+    _link[link].owner = 0;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _mux_dispatch(uint16_t link, uint16_t sid, uint8_t op,
+                         const char *data, size_t len)
+{
+    uint16_t socket_id = 0;
+    uint32_t credit = 0;
+    int server_id = 0, ingress_id = 0, stream_id = 0, ret = 0;
+
+    pthread_mutex_lock(& _mux_lock);
+        /* the link may have been closed by another thread */
+        if ( (stream_id = _link[link].stream) != -1)
+            socket_id = _link[link].map[sid];
+    pthread_mutex_unlock(& _mux_lock);
+
+    if (stream_id == -1) return -1;
+
+    switch (op) {
+
+    case MUX_OP_OPEN: { /* WORKER: connect to the server for a new client */
+        if (socket_id) {
+            debug("Stream: stream %i reopened on link %i.\n", sid, link);
+            stream_mux_close(socket_id);
+            server_close_managed_socket(plugin_get_token(), socket_id);
+        }
+
+        ingress_id = stream_get_ingress(stream_id, ROUTE_SERVER);
+
+        server_id = server_open_managed_socket(
+            plugin_get_token(),
+            stream_config_host(stream_id, SERVER_ADDRESS),
+            stream_config_port(stream_id, SERVER_ADDRESS),
+            INGRESS(ingress_id)
+        );
+
+        if (server_id == -1) {
+            debug("Stream: cannot open stream %i on link %i.\n", sid, link);
+            pthread_mutex_lock(& _mux_lock);
+                _mux_frame(link, sid, MUX_OP_CLOSE, NULL, 0);
+            pthread_mutex_unlock(& _mux_lock);
+            return 0;
+        }
+
+        pthread_mutex_lock(& _mux_lock);
+            if ( (ret = _link[link].stream) != -1)
+                _mux_bind(link, sid, server_id);
+        pthread_mutex_unlock(& _mux_lock);
+
+        if (ret == -1) {
+            server_close_managed_socket(plugin_get_token(), server_id);
+            return -1;
+        }
+
+        stream_set_status(server_id, STREAM_STATUS_MUX);
+    } break;
+
+    case MUX_OP_DATA: { /* forward the data to the local end */
+        if (! socket_id || ! len) break;
+
+        pthread_mutex_lock(& _mux_lock);
+
+            if (! _mux[socket_id].inflight)
+                _mux[socket_id].inflight = queue_alloc();
+
+            /* the credit is given back once the data are written */
+            if (! _mux[socket_id].inflight ||
+                server_send_buffer(plugin_get_token(), socket_id,
+                                   SERVER_TRANS_ACK, data, len) == -1) {
+                ret = -1;
+            } else if (queue_add(_mux[socket_id].inflight,
+                                 (void *) (uintptr_t) len) == -1) {
+                /* the data will be written anyway */
+                _mux_credit(socket_id, len);
+            }
+
+        pthread_mutex_unlock(& _mux_lock);
+
+        /* the local end is lost, the credit will never be given back */
+        if (ret == -1) {
+            debug("Stream: cannot deliver stream %i on link %i.\n", sid, link);
+            stream_mux_close(socket_id);
+            server_close_managed_socket(plugin_get_token(), socket_id);
+        }
+    } break;
+
+    case MUX_OP_WINDOW: { /* the remote end delivered some data */
+        if (! socket_id || len < sizeof(credit)) break;
+
+        memcpy(& credit, data, sizeof(credit)); credit = ntohl(credit);
+
+        pthread_mutex_lock(& _mux_lock);
+
+            /* a stale grant may still come for a stream id which was reused,
+               so never let the remote end open more than a window */
+            if (credit > MUX_WINDOW - _mux[socket_id].credit) {
+                debug("Stream: excessive credit for stream %i on link %i.\n",
+                      sid, link);
+                credit = MUX_WINDOW - _mux[socket_id].credit;
+            }
+
+            _mux[socket_id].credit += credit;
+            _mux_pump(socket_id);
+
+        pthread_mutex_unlock(& _mux_lock);
+    } break;
+
+    case MUX_OP_CLOSE: { /* the remote end was closed */
+        if (! socket_id) break;
+
+        pthread_mutex_lock(& _mux_lock);
+            _mux_unbind(socket_id);
+        pthread_mutex_unlock(& _mux_lock);
+
+        server_close_managed_socket(plugin_get_token(), socket_id);
+    } break;
+
+    default: debug("Stream: unknown frame type 0x%x on link %i.\n", op, link);
+
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private int stream_mux_init(void)
+{
+    int i = 0;
+
+    for (i = 0; i < SOCKET_MAX; i ++) _link[i].stream = -1;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private int stream_mux_request(uint16_t worker, unsigned int links)
+{
+    if (worker < 1 || worker >= SOCKET_MAX || ! links) {
+        debug("stream_mux_request(): bad parameters.\n");
+        return -1;
+    }
+
+    /* the ticket lets the master know which worker opened the links */
+    return server_send_response(plugin_get_token(), worker, 0x0,
+                                "%bB4u%bB4u%bB4u", MASTER_OP_LINKS, links,
+                                (uint32_t) worker << 16);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_mux_join(int stream_id, uint16_t link, uint32_t ticket)
+{
+    uint16_t *links = NULL;
+    unsigned int n = 0;
+
+    if (link < 1 || link >= SOCKET_MAX) {
+        debug("stream_mux_join(): bad parameters.\n");
+        return;
+    }
+
+    if (stream_id < 0 || stream_id >= _STREAMS_MAX) {
+        debug("stream_mux_join(): bad parameters.\n");
+        return;
+    }
+
+    if (stream_set_status(link, STREAM_STATUS_LINK) == -1) return;
+
+    pthread_mutex_lock(& _mux_lock);
+
+        if (_link[link].stream != -1 || _mux_register(stream_id, link) == -1) {
+            pthread_mutex_unlock(& _mux_lock);
+            return;
+        }
+
+        n = _links[stream_id].links + 1;
+
+        if (! (links = realloc(_links[stream_id].link, n * sizeof(*links))) ) {
+            perror(ERR(stream_mux_join, realloc));
+            pthread_mutex_unlock(& _mux_lock);
+            return;
+        }
+
+        links[n - 1] = link;
+        _links[stream_id].link = links;
+        _links[stream_id].links = n;
+
+        _link[link].owner = ticket >> 16;
+
+    pthread_mutex_unlock(& _mux_lock);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_mux_attach(int stream_id, uint16_t link)
+{
+    if (link < 1 || link >= SOCKET_MAX) {
+        debug("stream_mux_attach(): bad parameters.\n");
+        return;
+    }
+
+    if (stream_id < 0 || stream_id >= _STREAMS_MAX) {
+        debug("stream_mux_attach(): bad parameters.\n");
+        return;
+    }
+
+    pthread_mutex_lock(& _mux_lock);
+        _mux_register(stream_id, link);
+    pthread_mutex_unlock(& _mux_lock);
+
+    stream_set_status(link, STREAM_STATUS_LINK);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private uint16_t stream_mux_select(int stream_id, uint16_t socket_id)
+{
+    uint16_t worker = 0, link = 0, best = 0;
+    unsigned int i = 0;
+
+    if (stream_id < 0 || stream_id >= _STREAMS_MAX) {
+        debug("stream_mux_select(): bad parameters.\n");
+        return 0;
+    }
+
+    /* let the balancer elect the worker */
+    if (! (worker = stream_balance_select(stream_id, socket_id)) ) return 0;
+
+    pthread_mutex_lock(& _mux_lock);
+
+        /* use the least busy link of the worker */
+        for (i = 0; i < _links[stream_id].links; i ++) {
+            link = _links[stream_id].link[i];
+            if (_link[link].owner != worker) continue;
+            if (stream_get_status(link) != STREAM_STATUS_LINK) continue;
+            if (! best || _link[link].streams < _link[best].streams)
+                best = link;
+        }
+
+    pthread_mutex_unlock(& _mux_lock);
+
+    return best;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private int stream_mux_open(uint16_t link, uint16_t socket_id)
+{
+    m_string *packet = NULL;
+    uint16_t worker = 0;
+
+    if (link < 1 || link >= SOCKET_MAX) {
+        debug("stream_mux_open(): bad parameters.\n");
+        return -1;
+    }
+
+    if (socket_id < 1 || socket_id >= SOCKET_MAX) {
+        debug("stream_mux_open(): bad parameters.\n");
+        return -1;
+    }
+
+    if (stream_set_status(socket_id, STREAM_STATUS_MUX) == -1) return -1;
+
+    pthread_mutex_lock(& _mux_lock);
+
+        if (_link[link].stream == -1) {
+            pthread_mutex_unlock(& _mux_lock);
+            return -1;
+        }
+
+        _mux_bind(link, socket_id, socket_id);
+        _mux_frame(link, socket_id, MUX_OP_OPEN, NULL, 0);
+        worker = _link[link].owner;
+
+    pthread_mutex_unlock(& _mux_lock);
+
+    stream_balance_attach(socket_id, worker);
+
+    /* send the packets received while the stream was not opened */
+    if ( (packet = stream_dequeue_packet(socket_id)) ) {
+        if (stream_mux_send(socket_id, DATA(packet), SIZE(packet)) == -1)
+            server_close_managed_socket(plugin_get_token(), socket_id);
+        string_free(packet);
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private int stream_mux_send(uint16_t socket_id, const char *data, size_t len)
+{
+    int ret = 0;
+
+    if (socket_id < 1 || socket_id >= SOCKET_MAX || ! data) {
+        debug("stream_mux_send(): bad parameters.\n");
+        return -1;
+    }
+
+    if (! len) return 0;
+
+    pthread_mutex_lock(& _mux_lock);
+
+        if (! _mux[socket_id].link) ret = -1;
+        else if (! _mux[socket_id].backlog) {
+            if (! (_mux[socket_id].backlog = string_alloc(data, len)) )
+                ret = -1;
+        } else if (! string_cats(_mux[socket_id].backlog, data, len)) ret = -1;
+
+        if (ret == 0) _mux_pump(socket_id);
+
+    pthread_mutex_unlock(& _mux_lock);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_mux_receive(uint16_t link, m_string *data)
+{
+    m_string *rx = NULL, *pending = NULL;
+    size_t off = 0;
+    uint16_t sid = 0;
+    uint32_t len = 0;
+    uint8_t op = 0;
+    int stream_id = 0;
+
+    if (link < 1 || link >= SOCKET_MAX || ! data) {
+        debug("stream_mux_receive(): bad parameters.\n");
+        return;
+    }
+
+    /* take the incomplete frame out of the link while parsing */
+    pthread_mutex_lock(& _mux_lock);
+        if ( (stream_id = _link[link].stream) != -1) {
+            rx = _link[link].rx; _link[link].rx = NULL;
+        }
+    pthread_mutex_unlock(& _mux_lock);
+
+    if (stream_id == -1) return;
+
+    if (rx) {
+        if (! string_cat(rx, data)) goto _corrupted;
+    } else rx = data;
+
+    while (SIZE(rx) - off >= MUX_HEADER) {
+        sid = (uint8_t) DATA(rx)[off] << 8 | (uint8_t) DATA(rx)[off + 1];
+        op = DATA(rx)[off + 2];
+        memcpy(& len, DATA(rx) + off + 4, sizeof(len)); len = ntohl(len);
+
+        if (len > MUX_FRAME_MAX || sid >= SOCKET_MAX) {
+            debug("Stream: corrupted frame on link %i.\n", link);
+            goto _corrupted;
+        }
+
+        if (SIZE(rx) - off < MUX_HEADER + len) break;
+
+        /* the link was closed meanwhile */
+        if (_mux_dispatch(link, sid, op, DATA(rx) + off + MUX_HEADER, len) == -1)
+            goto _closed;
+
+        off += MUX_HEADER + len;
+    }
+
+    /* keep the incomplete frame */
+    if (off < SIZE(rx)) {
+        if (rx != data) { string_suppr(rx, 0, off); pending = rx; rx = NULL; }
+        else if (! (pending = string_alloc(DATA(rx) + off, SIZE(rx) - off)) )
+            goto _corrupted;
+    }
+
+    pthread_mutex_lock(& _mux_lock);
+        if (_link[link].stream != -1) {
+            _link[link].rx = pending; pending = NULL;
+        }
+    pthread_mutex_unlock(& _mux_lock);
+
+    string_free(pending);
+    if (rx != data) string_free(rx);
+
+    return;
+
+_corrupted:
+    server_close_managed_socket(plugin_get_token(), link);
+_closed:
+    if (rx != data) string_free(rx);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_mux_transmitted(uint16_t socket_id)
+{
+    if (socket_id < 1 || socket_id >= SOCKET_MAX) {
+        debug("stream_mux_transmitted(): bad parameters.\n");
+        return;
+    }
+
+    pthread_mutex_lock(& _mux_lock);
+
+        if (_mux[socket_id].link)
+            _mux_credit(socket_id,
+                        (uintptr_t) queue_get(_mux[socket_id].inflight));
+
+    pthread_mutex_unlock(& _mux_lock);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_mux_close(uint16_t socket_id)
+{
+    uint16_t link = 0, sid = 0, worker = 0, conn = 0;
+    unsigned int i = 0;
+    int stream_id = 0;
+
+    if (socket_id < 1 || socket_id >= SOCKET_MAX) {
+        debug("stream_mux_close(): bad parameters.\n");
+        return;
+    }
+
+    pthread_mutex_lock(& _mux_lock);
+
+        /* a multiplexed socket was closed, notify the remote end */
+        if ( (sid = _mux[socket_id].sid) && (link = _mux_unbind(socket_id)) )
+            _mux_frame(link, sid, MUX_OP_CLOSE, NULL, 0);
+
+        if ( (stream_id = _link[socket_id].stream) == -1) {
+            pthread_mutex_unlock(& _mux_lock);
+            return;
+        }
+
+        /* a link was closed, stop using it */
+        for (i = 0; i < _links[stream_id].links; i ++) {
+            if (_links[stream_id].link[i] == socket_id) {
+                _links[stream_id].link[i] =
+                _links[stream_id].link[-- _links[stream_id].links];
+                break;
+            }
+        }
+
+        worker = _link[socket_id].owner;
+
+    pthread_mutex_unlock(& _mux_lock);
+
+    /* close all the streams it carried */
+    for (i = 0; i < SOCKET_MAX; i ++) {
+        pthread_mutex_lock(& _mux_lock);
+            if ( (conn = _link[socket_id].map[i]) ) _mux_unbind(conn);
+        pthread_mutex_unlock(& _mux_lock);
+
+        if (conn) server_close_managed_socket(plugin_get_token(), conn);
+    }
+
+    pthread_mutex_lock(& _mux_lock);
+        free(_link[socket_id].map); _link[socket_id].map = NULL;
+        _link[socket_id].rx = string_free(_link[socket_id].rx);
+        _link[socket_id].stream = -1;
+        _link[socket_id].owner = 0;
+    pthread_mutex_unlock(& _mux_lock);
+
+    /* MASTER: replace the lost link if the worker is still alive */
+    if (worker && stream_get_status(worker) == STREAM_STATUS_WORK)
+        stream_mux_request(worker, 1);
+}
+
+/* -------------------------------------------------------------------------- */
+
+private void stream_mux_fini(void)
+{
+    int i = 0;
+
+    pthread_mutex_lock(& _mux_lock);
+
+        for (i = 0; i < SOCKET_MAX; i ++) {
+            _mux[i].backlog = string_free(_mux[i].backlog);
+            _mux[i].inflight = queue_free(_mux[i].inflight);
+            _link[i].rx = string_free(_link[i].rx);
+            free(_link[i].map); _link[i].map = NULL;
+            _link[i].stream = -1;
+        }
+
+        for (i = 0; i < _STREAMS_MAX; i ++) {
+            free(_links[i].link); _links[i].link = NULL;
+            _links[i].links = 0;
+        }
+
+    pthread_mutex_unlock(& _mux_lock);
+}
+
+/* -------------------------------------------------------------------------- */
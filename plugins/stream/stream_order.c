@@ -0,0 +1,77 @@
+/*******************************************************************************
+ *  Concrete Server                                                            *
+ *  Copyright (c) 2005-2020 Raphael Prevost <raph@el.bzh>                      *
+ *                                                                             *
+ *  This software is a computer program whose purpose is to provide a          *
+ *  framework for developing and prototyping network services.                 *
+ *                                                                             *
+ *  This software is governed by the CeCILL  license under French law and      *
+ *  abiding by the rules of distribution of free software.  You can  use,      *
+ *  modify and/ or redistribute the software under the terms of the CeCILL     *
+ *  license as circulated by CEA, CNRS and INRIA at the following URL          *
+ *  "http://www.cecill.info".                                                  *
+ *                                                                             *
+ *  As a counterpart to the access to the source code and  rights to copy,     *
+ *  modify and redistribute granted by the license, users are provided only    *
+ *  with a limited warranty  and the software's author,  the holder of the     *
+ *  economic rights,  and the successive licensors  have only  limited         *
+ *  liability.                                                                 *
+ *                                                                             *
+ *  In this respect, the user's attention is drawn to the risks associated     *
+ *  with loading,  using,  modifying and/or developing or reproducing the      *
+ *  software by the user in light of its specific status of free software,     *
+ *  that may mean  that it is complicated to manipulate,  and  that  also      *
+ *  therefore means  that it is reserved for developers  and  experienced      *
+ *  professionals having in-depth computer knowledge. Users are therefore      *
+ *  encouraged to load and test the software's suitability as regards their    *
+ *  requirements in conditions enabling the security of their systems and/or   *
+ *  data to be ensured and,  more generally, to use and operate it in the      *
+ *  same conditions as regards security.                                       *
+ *                                                                             *
+ *  The fact that you are presently reading this means that you have had       *
+ *  knowledge of the CeCILL license and that you accept its terms.             *
+ *                                                                             *
+ ******************************************************************************/
+
+
+#include "stream_plugin.h"
+
+/*
+ * The orders sent by a master to its workers are made of 32 bits words in
+ * network byte order: the order itself, followed by its arguments. A single
+ * read may hold several orders, and the last one may be incomplete.
+ */
+
+/* -------------------------------------------------------------------------- */
+
+private int stream_fetch_order(m_string *data, uint32_t *order, uint32_t *args)
+{
+    uint32_t op = 0;
+    size_t len = 0, i = 0;
+
+    if (! data || ! order || ! args) {
+        debug("stream_fetch_order(): bad parameters.\n");
+        return -1;
+    }
+
+    if (SIZE(data) < sizeof(op)) return -1;
+
+    string_to_uint32(data, & op);
+
+    switch (ntohl(op)) {
+    case MASTER_OP_TAKEN: len = 1; break;
+    case MASTER_OP_LINKS: len = 2; break;
+    default: len = 0;
+    }
+
+    /* wait for the whole order */
+    if (SIZE(data) < (len + 1) * sizeof(op)) return -1;
+
+    *order = ntohl(string_fetch_uint32(data));
+
+    for (i = 0; i < len; i ++) args[i] = ntohl(string_fetch_uint32(data));
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
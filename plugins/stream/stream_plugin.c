@@ -79,6 +79,16 @@ public int plugin_init(uint32_t id, int argc, char **argv)
         goto _init_sock_failure;
     }
 
+    if (stream_balance_init() == -1) {
+        fprintf(stderr, "Stream: failed to initialize balancing.\n");
+        goto _init_sock_failure;
+    }
+
+    if (stream_mux_init() == -1) {
+        fprintf(stderr, "Stream: failed to initialize multiplexing.\n");
+        goto _init_sock_failure;
+    }
+
     if (stream_router_init() == -1) {
         fprintf(stderr, "Stream: failed to initialize routing.\n");
         goto _init_sock_failure;
@@ -87,6 +97,8 @@ public int plugin_init(uint32_t id, int argc, char **argv)
     return 0;
 
 _init_sock_failure:
+    stream_mux_fini();
+    stream_balance_fini();
     stream_socket_fini();
 _init_conf_failure:
     stream_config_fini();
@@ -97,14 +109,41 @@ _init_conf_failure:
 
 public void plugin_main(uint16_t socket_id, uint16_t ingress_id, m_string *data)
 {
-    uint16_t egress = 0;
+    uint16_t egress = 0, conn = 0;
+    uint32_t ticket = 0, links = 0, op = 0, args[2] = { 0, 0 };
     int stream_id = 0;
 
+    /* multiplexed link */
+    if (stream_get_status(socket_id) == STREAM_STATUS_LINK) {
+        stream_mux_receive(socket_id, data);
+        string_flush(data);
+        return;
+    }
+
+    /* multiplexed stream */
+    if (stream_get_status(socket_id) == STREAM_STATUS_MUX) {
+        if (stream_mux_send(socket_id, DATA(data), SIZE(data)) == -1)
+            server_close_managed_socket(plugin_get_token(), socket_id);
+        string_flush(data);
+        return;
+    }
+
     if (stream_personality() & PERSONALITY_WORKER) {
         if ( (stream_id = stream_get_id(socket_id, PERSONALITY_WORKER)) != -1) {
-            if (ntohl(string_fetch_uint32(data)) == MASTER_OP_HIRED)
-                stream_open_pipe(stream_id);
-            else debug("Stream: unsupported message from Master.\n");
+            /* the master may have sent several orders at once */
+            while (stream_fetch_order(data, & op, args) == 0) {
+                switch (op) {
+                case MASTER_OP_HIRED: stream_open_pipe(stream_id, 0, 0); break;
+                case MASTER_OP_TAKEN: { /* the ticket must be sent back */
+                    stream_open_pipe(stream_id, args[0], 0);
+                } break;
+                case MASTER_OP_LINKS: { /* open persistent links */
+                    links = args[0];
+                    while (links --) stream_open_pipe(stream_id, args[1], 1);
+                } break;
+                default: debug("Stream: unsupported message from Master.\n");
+                }
+            }
         }
     }
 
@@ -119,9 +158,24 @@ public void plugin_main(uint16_t socket_id, uint16_t ingress_id, m_string *data)
 
                 switch (ntohl(string_fetch_uint32(data))) {
                 case WORKER_OP_HELLO: { /* new worker */
-                    stream_add_worker(stream_id, socket_id);
+                    ticket = ntohl(string_fetch_uint32(data));
+                    stream_add_worker(stream_id, socket_id, ticket);
+                    /* let the worker open its multiplexed links */
+                    if ((ticket & WORKER_CAP_MUX) &&
+                        (links = stream_config_multiplex(stream_id)) )
+                        stream_mux_request(socket_id, links);
+                } break;
+                case WORKER_OP_LINKED: { /* new multiplexed link */
+                    ticket = ntohl(string_fetch_uint32(data));
+                    stream_mux_join(stream_id, socket_id, ticket);
                 } break;
                 case WORKER_OP_READY: { /* new connection, ask for a pipe */
+                    ticket = ntohl(string_fetch_uint32(data));
+                    /* the connection was requested for a waiting client */
+                    conn = stream_balance_ready(socket_id, ticket);
+                    if (conn && stream_get_status(conn) == STREAM_STATUS_CONN &&
+                        ! stream_bind_pipe(conn, socket_id))
+                        return;
                     socket_id = stream_enqueue_connection(stream_id, socket_id);
                     if ( (socket_id = stream_dequeue_waiting(stream_id)) )
                         stream_get_pipe(stream_id, socket_id);
@@ -134,7 +188,12 @@ public void plugin_main(uint16_t socket_id, uint16_t ingress_id, m_string *data)
             } break;
 
             case ROUTE_PUBLIC: { /* received data from a client */
-                stream_enqueue_packet(socket_id, data);
+                if (stream_enqueue_packet(stream_id, socket_id, data) == -1) {
+                    debug("Stream: client %i exceeded its queue.\n", socket_id);
+                    server_close_managed_socket(plugin_get_token(), socket_id);
+                    string_flush(data);
+                    return;
+                }
                 stream_get_pipe(stream_id, socket_id);
                 string_flush(data);
                 return;
@@ -180,16 +239,24 @@ public void plugin_intr(uint16_t socket_id, uint16_t ingress_id, int event,
         stream_set_status(socket_id, STREAM_STATUS_CONN);
         if (stream_personality() & PERSONALITY_WORKER) {
             if (stream_get_id(socket_id, PERSONALITY_WORKER) != -1)
-                server_send_response(plugin_get_token(), socket_id,
-                                     0x0, "%bB4u", WORKER_OP_HELLO);
+                server_send_response(plugin_get_token(), socket_id, 0x0,
+                                     "%bB4u%bB4u", WORKER_OP_HELLO,
+                                     WORKER_CAPS);
         }
     } break;
 
     case PLUGIN_EVENT_SOCKET_DISCONNECTED: {
+        /* multiplexed links and streams are not part of any pipe */
+        if (stream_get_status(socket_id) &
+            (STREAM_STATUS_LINK | STREAM_STATUS_MUX))
+            stream_mux_close(socket_id);
         /* if this was the end of a pipe, we need to shut down the egress */
-        if ( (egress = stream_get_egress(socket_id, ingress_id)) )
+        else if ( (egress = stream_get_egress(socket_id, ingress_id)) )
             server_close_managed_socket(plugin_get_token(), egress);
         stream_set_status(socket_id, STREAM_STATUS_DOWN);
+        /* forget the worker or the pipe */
+        if (stream_personality() & PERSONALITY_MASTER)
+            stream_balance_leave(socket_id);
         /* discard queued packets */
         stream_drop_packets(socket_id);
     } break;
@@ -202,6 +269,19 @@ public void plugin_intr(uint16_t socket_id, uint16_t ingress_id, int event,
     } break;
 
     case PLUGIN_EVENT_REQUEST_TRANSMITTED: {
+        if (stream_get_status(socket_id) == STREAM_STATUS_MUX) {
+            /* data delivered on behalf of a multiplexed stream */
+            stream_mux_transmitted(socket_id);
+            break;
+        }
+        if ( (stream_personality() & PERSONALITY_MASTER) &&
+             stream_get_route(ingress_id) == ROUTE_WORKER) {
+            /* latency probe sent to a worker */
+            stream_balance_probed(socket_id);
+            if (stream_probe(socket_id) == -1)
+                debug("Stream: failed to probe worker.\n");
+            break;
+        }
         debug("Stream: sending heartbeat.\n");
         if (stream_heartbeat(socket_id) == -1)
             debug("Stream: failed to send heartbeat.\n");
@@ -211,6 +291,19 @@ public void plugin_intr(uint16_t socket_id, uint16_t ingress_id, int event,
         m_string *message = event_data;
         uint8_t packet = string_fetch_uint8(message);
         debug("Stream: received OOB message: 0x%x\n", packet);
+
+        if ((packet & MASTER_OP_PROBE) &&
+            (stream_personality() & PERSONALITY_WORKER) &&
+            stream_get_id(socket_id, PERSONALITY_WORKER) != -1) {
+            /* answer the latency probe of the master right away */
+            server_send_response(plugin_get_token(), socket_id,
+                                 SERVER_TRANS_OOB, "%bB1u", packet);
+        } else if ((packet & MASTER_OP_PROBE) &&
+                   (stream_personality() & PERSONALITY_MASTER) &&
+                   stream_get_route(ingress_id) == ROUTE_WORKER) {
+            /* the heartbeats never have the probe bit set */
+            stream_balance_sample(socket_id, packet & PROBE_SEQ);
+        }
     } break;
 
     case PLUGIN_EVENT_SERVER_SHUTTINGDOWN:
@@ -225,6 +318,8 @@ public void plugin_intr(uint16_t socket_id, uint16_t ingress_id, int event,
 
 public void plugin_fini(void)
 {
+    stream_mux_fini();
+    stream_balance_fini();
     stream_socket_fini();
     stream_config_fini();
     fprintf(stderr, "Stream: successfully unloaded.\n");
@@ -71,12 +71,42 @@
 #define STREAM_STATUS_CONN 0x01
 #define STREAM_STATUS_WORK 0x02
 #define STREAM_STATUS_WAIT 0x04
+#define STREAM_STATUS_LINK 0x08
 #define STREAM_STATUS_PIPE 0x10
+#define STREAM_STATUS_MUX  0x20
 
 #define WORKER_OP_HELLO    0x31108055
 #define WORKER_OP_READY    0x1E75D017
+#define WORKER_OP_LINKED   0x11A4ED01
 #define WORKER_OP_ALIVE    0x1A
+#define MASTER_OP_PROBE    0x80    /* | 7 bit sequence, echoed by the worker */
+#define PROBE_SEQ          0x7F
 #define MASTER_OP_HIRED    0xA600D10B
+#define MASTER_OP_TAKEN    0xA600D1CE
+#define MASTER_OP_LINKS    0xA6011245
+
+/* capabilities advertised by the workers in their WORKER_OP_HELLO */
+#define WORKER_CAP_TICKET  0x00000001
+#define WORKER_CAP_MUX     0x00000002
+#define WORKER_CAPS        (WORKER_CAP_TICKET | WORKER_CAP_MUX)
+
+/* multiplexed links: frame header is [stream id:2][op:1][rsvd:1][length:4] */
+#define MUX_OP_OPEN        0x01
+#define MUX_OP_DATA        0x02
+#define MUX_OP_CLOSE       0x03
+#define MUX_OP_WINDOW      0x04
+#define MUX_HEADER         8
+#define MUX_FRAME_MAX      16384
+#define MUX_WINDOW         262144
+
+/* bytes queued while waiting for a worker, the client is closed beyond */
+#define STREAM_QUEUE_LIMIT 1048576
+
+/* worker selection policies */
+#define BALANCE_ROUNDROBIN 0x00
+#define BALANCE_LEASTCONN  0x01
+#define BALANCE_LATENCY    0x02
+#define BALANCE_AFFINITY   0x03
 
 /* -------------------------------------------------------------------------- */
 /* MANDATORY PLUGIN CALLBACKS */
@@ -203,6 +233,11 @@ private const char *stream_config_host(int stream, int target);
 private const char *stream_config_port(int stream, int target);
 private int stream_config_destination(int stream);
 private const char *stream_config_plugin_name(int stream);
+private int stream_config_balance(int stream);
+private unsigned int stream_config_probe(int stream);
+private unsigned int stream_config_eject(int stream);
+private unsigned int stream_config_multiplex(int stream);
+private size_t stream_config_queue_limit(int stream);
 private void stream_config_fini(void);
 
 /* -------------------------------------------------------------------------- */
@@ -226,21 +261,64 @@ private void stream_router_fini(void);
 private int stream_socket_init(void);
 private int stream_set_status(uint16_t socket_id, int status);
 private int stream_get_status(uint16_t socket_id);
-private void stream_add_worker(int stream_id, uint16_t worker);
+private void stream_add_worker(int stream_id, uint16_t worker, uint32_t caps);
 private uint16_t stream_borrow_worker(int stream_id);
 private uint16_t stream_release_worker(int stream_id, uint16_t worker);
+private int stream_bind_pipe(uint16_t socket_id, uint16_t worker);
 private uint16_t stream_enqueue_connection(int stream_id, uint16_t conn);
-private uint16_t stream_dequeue_connection(int stream_id);
+private uint16_t stream_dequeue_connection(int stream_id, uint16_t owner);
 private uint16_t stream_enqueue_waiting(int stream_id, uint16_t conn);
 private uint16_t stream_dequeue_waiting(int stream_id);
-private m_string *stream_enqueue_packet(uint16_t socket_id, m_string *data);
+private int stream_enqueue_packet(int stream_id, uint16_t socket_id,
+                                  m_string *data);
 private m_string *stream_dequeue_packet(uint16_t socket_id);
 private void stream_drop_packets(uint16_t socket_id);
-private int stream_get_connection(int stream_id);
+private int stream_get_connection(int stream_id, uint16_t socket_id);
 private int stream_get_pipe(int stream_id, uint16_t socket_id);
-private void stream_open_pipe(int stream_id);
+private void stream_open_pipe(int stream_id, uint32_t ticket, int link);
 private void stream_socket_fini(void);
 
+/* -------------------------------------------------------------------------- */
+/* Balancer */
+/* -------------------------------------------------------------------------- */
+
+private int stream_balance_init(void);
+private void stream_balance_join(int stream_id, uint16_t worker, uint32_t caps);
+private void stream_balance_leave(uint16_t socket_id);
+private int stream_balance_ejected(uint16_t worker);
+private uint16_t stream_balance_select(int stream_id, uint16_t socket_id);
+private int stream_balance_hire(uint16_t worker, uint16_t socket_id,
+                                uint32_t *ticket);
+private uint16_t stream_balance_ready(uint16_t conn, uint32_t ticket);
+private uint16_t stream_balance_owner(uint16_t conn);
+private void stream_balance_attach(uint16_t socket_id, uint16_t worker);
+private int stream_probe(uint16_t worker);
+private void stream_balance_probed(uint16_t worker);
+private void stream_balance_sample(uint16_t worker, uint8_t seq);
+private void stream_balance_fini(void);
+
+/* -------------------------------------------------------------------------- */
+/* Multiplexer */
+/* -------------------------------------------------------------------------- */
+
+private int stream_mux_init(void);
+private int stream_mux_request(uint16_t worker, unsigned int links);
+private void stream_mux_join(int stream_id, uint16_t link, uint32_t ticket);
+private void stream_mux_attach(int stream_id, uint16_t link);
+private uint16_t stream_mux_select(int stream_id, uint16_t socket_id);
+private int stream_mux_open(uint16_t link, uint16_t socket_id);
+private int stream_mux_send(uint16_t socket_id, const char *data, size_t len);
+private void stream_mux_receive(uint16_t link, m_string *data);
+private void stream_mux_transmitted(uint16_t socket_id);
+private void stream_mux_close(uint16_t socket_id);
+private void stream_mux_fini(void);
+
+/* -------------------------------------------------------------------------- */
+/* Orders */
+/* -------------------------------------------------------------------------- */
+
+private int stream_fetch_order(m_string *data, uint32_t *order, uint32_t *args);
+
 /* -------------------------------------------------------------------------- */
 
 #endif
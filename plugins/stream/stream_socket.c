@@ -47,9 +47,9 @@ static m_socket_queue **_pending = NULL;
 /* MASTER: list of connections waiting for a worker */
 static m_socket_queue **_waiting = NULL;
 
-/* MASTER: pending packets */
+/* MASTER: data received from the clients waiting for a pipe */
 static pthread_mutex_t _packets_lock = PTHREAD_MUTEX_INITIALIZER;
-static m_queue *_packets[SOCKET_MAX];
+static m_string *_packets[SOCKET_MAX];
 
 /* ALL: link status */
 static pthread_mutex_t _status_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -127,7 +127,7 @@ private int stream_get_status(uint16_t socket_id)
 
 /* -------------------------------------------------------------------------- */
 
-private void stream_add_worker(int stream_id, uint16_t worker)
+private void stream_add_worker(int stream_id, uint16_t worker, uint32_t caps)
 {
     if (worker < 1 || worker >= SOCKET_MAX) {
         debug("stream_add_worker(): bad parameters.\n");
@@ -138,8 +138,10 @@ private void stream_add_worker(int stream_id, uint16_t worker)
         return;
     }
 
-    if (! stream_set_status(worker, STREAM_STATUS_WORK))
+    if (! stream_set_status(worker, STREAM_STATUS_WORK)) {
         socket_queue_add(_workers[stream_id], worker);
+        stream_balance_join(stream_id, worker, caps);
+    }
 }
 
 /* -------------------------------------------------------------------------- */
@@ -181,6 +183,36 @@ private uint16_t stream_release_worker(int stream_id, uint16_t worker)
 
 /* -------------------------------------------------------------------------- */
 
+private int stream_bind_pipe(uint16_t socket_id, uint16_t worker)
+{
+    m_string *packet = NULL;
+
+    if (socket_id < 1 || socket_id >= SOCKET_MAX) {
+        debug("stream_bind_pipe(): bad parameters.\n");
+        return -1;
+    }
+
+    if (worker < 1 || worker >= SOCKET_MAX) {
+        debug("stream_bind_pipe(): bad parameters.\n");
+        return -1;
+    }
+
+    /* record the pipe */
+    stream_set_route(ROUTE_WORKER, socket_id, worker);
+
+    /* set the proper status */
+    if (stream_set_status(socket_id, STREAM_STATUS_PIPE)) return -1;
+    if (stream_set_status(worker, STREAM_STATUS_PIPE)) return -1;
+
+    /* check if there is pending packets and send them directly */
+    if ( (packet = stream_dequeue_packet(socket_id)) )
+        server_send_string(plugin_get_token(), worker, 0x0, packet);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
 private uint16_t stream_enqueue_connection(int stream_id, uint16_t conn)
 {
     if (conn < 1 || conn >= SOCKET_MAX) {
@@ -201,19 +233,33 @@ private uint16_t stream_enqueue_connection(int stream_id, uint16_t conn)
 
 /* -------------------------------------------------------------------------- */
 
-private uint16_t stream_dequeue_connection(int stream_id)
+private uint16_t stream_dequeue_connection(int stream_id, uint16_t owner)
 {
     uint16_t conn = 0;
+    unsigned int n = 0;
 
     if (stream_id < 0 || stream_id >= _STREAMS_MAX) {
         debug("stream_dequeue_connection(): bad parameters.\n");
         return 0;
     }
 
-    do conn = socket_queue_get(_pending[stream_id]);
-    while (conn && stream_get_status(conn) != STREAM_STATUS_WAIT);
+    if (! owner) {
+        do conn = socket_queue_get(_pending[stream_id]);
+        while (conn && stream_get_status(conn) != STREAM_STATUS_WAIT);
 
-    return conn;
+        return conn;
+    }
+
+    /* look for an idle connection opened by the given worker, the
+       connections of the other workers are queued again */
+    for (n = socket_queue_length(_pending[stream_id]); n; n --) {
+        if (! (conn = socket_queue_get(_pending[stream_id])) ) break;
+        if (stream_get_status(conn) != STREAM_STATUS_WAIT) continue;
+        if (stream_balance_owner(conn) == owner) return conn;
+        socket_queue_add(_pending[stream_id], conn);
+    }
+
+    return 0;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -254,23 +300,32 @@ private uint16_t stream_dequeue_waiting(int stream_id)
 
 /* -------------------------------------------------------------------------- */
 
-private m_string *stream_enqueue_packet(uint16_t socket_id, m_string *data)
+private int stream_enqueue_packet(int stream_id, uint16_t socket_id,
+                                  m_string *data)
 {
+    size_t limit = 0;
+    int ret = 0;
+
     if (socket_id < 1 || socket_id >= SOCKET_MAX || ! data) {
         debug("stream_enqueue_packet(): bad parameters.\n");
-        return NULL;
+        return -1;
     }
 
-    pthread_mutex_lock(& _packets_lock);
+    limit = stream_config_queue_limit(stream_id);
 
-        if (! _packets[socket_id]) _packets[socket_id] = queue_alloc();
+    pthread_mutex_lock(& _packets_lock);
 
-        if (_packets[socket_id])
-            queue_add(_packets[socket_id], string_dup(data));
+        /* the client sent too much data before a worker was available, the
+           data cannot be dropped without corrupting the stream */
+        if (limit && (_packets[socket_id] ? SIZE(_packets[socket_id]) : 0) +
+            SIZE(data) > limit) ret = -1;
+        else if (! _packets[socket_id]) {
+            if (! (_packets[socket_id] = string_dup(data)) ) ret = -1;
+        } else if (! string_cat(_packets[socket_id], data)) ret = -1;
 
     pthread_mutex_unlock(& _packets_lock);
 
-    return NULL;
+    return ret;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -284,9 +339,11 @@ private m_string *stream_dequeue_packet(uint16_t socket_id)
         return NULL;
     }
 
+    /* all the queued packets are returned at once */
     pthread_mutex_lock(& _packets_lock);
 
-        data = queue_get(_packets[socket_id]);
+        data = _packets[socket_id];
+        _packets[socket_id] = NULL;
 
     pthread_mutex_unlock(& _packets_lock);
 
@@ -304,29 +361,35 @@ private void stream_drop_packets(uint16_t socket_id)
 
     pthread_mutex_lock(& _packets_lock);
 
-        queue_free_nodes(_packets[socket_id], (void (*)(void *)) string_free);
-        _packets[socket_id] = queue_free(_packets[socket_id]);
+        _packets[socket_id] = string_free(_packets[socket_id]);
 
     pthread_mutex_unlock(& _packets_lock);
 }
 
 /* -------------------------------------------------------------------------- */
 
-private int stream_get_connection(int stream_id)
+private int stream_get_connection(int stream_id, uint16_t socket_id)
 {
     uint16_t worker = 0;
+    uint32_t ticket = 0;
 
     /* try to get a worker */
-    if (! (worker = stream_borrow_worker(stream_id)) ) {
+    if (! (worker = stream_balance_select(stream_id, socket_id)) ) {
         debug("Stream: no worker available on stream %i.\n", stream_id);
         return -1;
     }
 
-    /* ask the worker to connect */
-    server_send_response(plugin_get_token(), worker, 0x0,
-                         "%bB4u", MASTER_OP_HIRED);
+    /* the client is already waiting for a connection */
+    if (stream_balance_hire(worker, socket_id, & ticket) == -1) return 0;
 
-    stream_release_worker(stream_id, worker);
+    /* ask the worker to connect */
+    if (ticket) {
+        server_send_response(plugin_get_token(), worker, 0x0,
+                             "%bB4u%bB4u", MASTER_OP_TAKEN, ticket);
+    } else {
+        server_send_response(plugin_get_token(), worker, 0x0,
+                             "%bB4u", MASTER_OP_HIRED);
+    }
 
     return 0;
 }
@@ -335,29 +398,29 @@ private int stream_get_connection(int stream_id)
 
 private int stream_get_pipe(int stream_id, uint16_t socket_id)
 {
-    uint16_t worker = 0;
-    m_string *packet = NULL;
+    uint16_t worker = 0, link = 0, elected = 0;
 
     if (socket_id < 1 || socket_id >= SOCKET_MAX) {
         debug("stream_get_pipe(): bad parameters.\n");
         return -1;
     }
 
-    /* try to get a connection */
-    if ( (worker = stream_dequeue_connection(stream_id)) ) {
-        /* record the pipe */
-        stream_set_route(ROUTE_WORKER, socket_id, worker);
+    /* prefer a stream on a multiplexed link when there is one */
+    if (stream_config_multiplex(stream_id) &&
+        (link = stream_mux_select(stream_id, socket_id)) )
+        return stream_mux_open(link, socket_id);
 
-        /* set the proper status */
-        if (stream_set_status(socket_id, STREAM_STATUS_PIPE)) return -1;
-        if (stream_set_status(worker, STREAM_STATUS_PIPE)) return -1;
+    /* try to get a connection; with client affinity, the pipe
+       must be opened by the worker elected for this client */
+    if (stream_config_balance(stream_id) != BALANCE_AFFINITY)
+        worker = stream_dequeue_connection(stream_id, 0);
+    else if ( (elected = stream_balance_select(stream_id, socket_id)) )
+        worker = stream_dequeue_connection(stream_id, elected);
 
-        /* check if there is pending packets and send them directly */
-        while ( (packet = stream_dequeue_packet(socket_id)) )
-            server_send_string(plugin_get_token(), worker, 0x0, packet);
-    }
+    if (worker && stream_bind_pipe(socket_id, worker) == -1) return -1;
 
-    if (! stream_get_connection(stream_id) && ! worker) {
+    if (! stream_get_connection(stream_id, (worker) ? 0 : socket_id) &&
+        ! worker) {
         /* successfully asked for a connection, but none ready yet */
         stream_enqueue_waiting(stream_id, socket_id);
     }
@@ -367,7 +430,7 @@ private int stream_get_pipe(int stream_id, uint16_t socket_id)
 
 /* -------------------------------------------------------------------------- */
 
-private void stream_open_pipe(int stream_id)
+private void stream_open_pipe(int stream_id, uint32_t ticket, int link)
 {
     int master_id = 0, server_id = 0, ingress_id = 0;
     const char *host = NULL;
@@ -379,8 +442,21 @@ private void stream_open_pipe(int stream_id)
 
     master_id = server_open_managed_socket(plugin_get_token(), host, port,
                                            INGRESS(ingress_id));
-    server_send_response(plugin_get_token(), master_id, 0x0,
-                         "%bB4u", WORKER_OP_READY);
+    if (link) {
+        /* multiplexed link, the streams are opened on demand */
+        if (master_id == -1) return;
+        stream_mux_attach(stream_id, master_id);
+        server_send_response(plugin_get_token(), master_id, 0x0,
+                             "%bB4u%bB4u", WORKER_OP_LINKED, ticket);
+        return;
+    } else if (ticket) {
+        /* the master hired us on behalf of a specific client */
+        server_send_response(plugin_get_token(), master_id, 0x0,
+                             "%bB4u%bB4u", WORKER_OP_READY, ticket);
+    } else {
+        server_send_response(plugin_get_token(), master_id, 0x0,
+                             "%bB4u", WORKER_OP_READY);
+    }
 
     host = stream_config_host(stream_id, SERVER_ADDRESS);
     port = stream_config_port(stream_id, SERVER_ADDRESS);
@@ -426,10 +502,8 @@ private void stream_socket_fini(void)
             }
         }
 
-        for (i = 0; i < SOCKET_MAX; i ++) {
-            queue_free_nodes(_packets[i], (void (*)(void *)) string_free);
-            queue_free(_packets[i]);
-        }
+        for (i = 0; i < SOCKET_MAX; i ++)
+            _packets[i] = string_free(_packets[i]);
     }
 }
 
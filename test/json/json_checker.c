@@ -298,6 +298,15 @@ int main(int argc, char **argv)
     ctx.data = json_data;
     ctx.exit = json_exit;
 
+    /* check with the two stages scanner */
+    if (argc > 2 && ! strcmp(argv[2], "--scan")) {
+        if (string_scan_json(src, len, JSON_STRICT, & ctx) == -1) {
+            fprintf(stderr, "%s: parse error.\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+    }
+
     do {
         ret = string_parse_json(json, JSON_STRICT, & ctx);
         printf("Parsing interrupted.\n");
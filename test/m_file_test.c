@@ -45,7 +45,8 @@ static void *threadA(UNUSED void *dummy)
 static void *threadB(UNUSED void *dummy)
 {
     m_file *file = NULL;
-    m_string *test = NULL;
+    m_string *test = NULL, *sum = NULL, *ref = NULL;
+    m_string_digest *d = NULL;
 
     if (! (test = string_alloc("new_test", sizeof("new_test"))) )
         pthread_exit(NULL);
@@ -72,6 +73,17 @@ static void *threadB(UNUSED void *dummy)
     printf("(*) Opened file %.*s\n", (int) file->pathlen, file->path);
     printf("(*) Thread B got: %s\n", DATA(file->data));
 
+    /* the digest of the contents must not depend on how they are fed */
+    if (! (d = string_digest_alloc(STRING_DIGEST_SHA256)) ||
+        ! (sum = string_alloc(NULL, 0)) || fs_digest(file, d) == -1 ||
+        string_digest_end(d, sum) == -1 ||
+        ! (ref = string_sha256(file->data)) || string_cmp(sum, ref)) {
+        printf("(!) Digest of a virtual file: FAILURE\n");
+    } else printf("(*) Digest of a virtual file: %s\n", DATA(sum));
+
+    d = string_digest_free(d);
+    sum = string_free(sum); ref = string_free(ref);
+
     file = fs_closefile(file);
 
     pthread_exit(NULL);
@@ -79,6 +91,47 @@ static void *threadB(UNUSED void *dummy)
 
 /* -------------------------------------------------------------------------- */
 
+static int test_fs_digest(void)
+{
+    m_view *v = NULL;
+    m_file *f = NULL;
+    m_string *data = NULL, *sum = NULL, *ref = NULL;
+    m_string_digest *d = NULL;
+    char buffer[BUFSIZ];
+    FILE *fp = NULL;
+    size_t r = 0;
+    int ret = -1;
+
+    /* larger than a single chunk */
+    if (! (fp = fopen("lib/m_string.c", "rb")) ) return -1;
+    data = string_alloc(NULL, 0);
+    while ( (r = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        string_cats(data, buffer, r);
+    fclose(fp);
+
+    if (! (v = fs_openview("lib", strlen("lib"))) ||
+        ! (f = fs_openfile(v, "m_string.c", strlen("m_string.c"), NULL)) ||
+        ! (d = string_digest_alloc(STRING_DIGEST_SHA256)) ||
+        ! (sum = string_alloc(NULL, 0)) || fs_digest(f, d) == -1 ||
+        string_digest_end(d, sum) == -1 || SIZE(data) <= 65536 ||
+        ! (ref = string_sha256(data)) || string_cmp(sum, ref))
+        goto _end;
+
+    printf("(*) Digest of a physical file: %s\n", DATA(sum));
+
+    ret = 0;
+
+_end:
+    string_digest_free(d);
+    string_free(sum); string_free(ref); string_free(data);
+    fs_closefile(f);
+    fs_closeview(v);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
 int test_fs(void)
 {
     pthread_t a, b;
@@ -137,6 +190,12 @@ int test_fs(void)
     printf("(*) Closing the view.\n");
     view = fs_closeview(view);
 
+    /* physical files are digested by chunks */
+    if (test_fs_digest() == -1) {
+        printf("(!) Digest of a physical file: FAILURE\n");
+        return -1;
+    }
+
     fs_getpath("/home/raphael/test/file/file.txt",
                strlen("/home/raphael/test/file/file.txt"),
                buffer, sizeof(buffer));
@@ -169,6 +169,21 @@ int test_http(void)
     }
     m = string_free(m);
 
+    /* header names are case insensitive, and must be followed by a colon */
+    http_status = 0;
+    z = string_alloc("HTTP/1.1 200 OK\r\ncontent-length: 3\r\nX-Token: abc"
+                     "\r\n\r\nxyz", 55);
+
+    if (! (w = http_get_request(& http_status, & m, z)) || SIZE(w) != 3 ||
+        memcmp(DATA(w), "xyz", 3) || ! (frag = http_get_header(w, "x-token")) ||
+        memcmp(frag, "abc", 3) || http_get_header(w, "X-Tok")) {
+        printf("(!) Case insensitive HTTP headers: FAILURE\n");
+        z = string_free(z); m = string_free(m);
+        return -1;
+    } else printf("(*) Case insensitive HTTP headers: SUCCESS\n");
+
+    z = string_free(z); m = string_free(m);
+
     return 0;
 }
 
@@ -5,6 +5,8 @@
 extern int test_socket(void);
 extern int test_string(void);
 extern int test_queue(void);
+extern int test_rope(void);
+extern int test_stream(void);
 #ifdef _ENABLE_HASHTABLE
 extern int test_hashtable(void);
 #endif
@@ -20,6 +22,9 @@ extern int test_http(void);
 #ifdef _ENABLE_DB
 extern int test_db(void);
 #endif
+#if defined(_ENABLE_SERVER) && defined(_BUILTIN_PLUGIN)
+extern int test_server(void);
+#endif
 
 char *working_directory = NULL;
 
@@ -58,6 +63,16 @@ int main(void)
         exit(EXIT_FAILURE);
     } else printf("=== m_queue test: SUCCESS ===\n");
 
+    if (test_rope() == -1) {
+        printf("!!! m_rope test: FAILURE !!!\n");
+        exit(EXIT_FAILURE);
+    } else printf("=== m_rope test: SUCCESS ===\n");
+
+    if (test_stream() == -1) {
+        printf("!!! stream test: FAILURE !!!\n");
+        exit(EXIT_FAILURE);
+    } else printf("=== stream test: SUCCESS ===\n");
+
     #ifdef _ENABLE_TRIE
     if (test_trie() == -1) {
         printf("!!! m_trie test: FAILURE !!!\n");
@@ -79,6 +94,14 @@ int main(void)
     } else printf("=== m_db test: SUCCESS ===\n");
     #endif
 
+    /* the server tears down the APIs used by the other tests, so it runs last */
+    #if defined(_ENABLE_SERVER) && defined(_BUILTIN_PLUGIN)
+    if (test_server() == -1) {
+        printf("!!! m_server test: FAILURE !!!\n");
+        exit(EXIT_FAILURE);
+    } else printf("=== m_server test: SUCCESS ===\n");
+    #endif
+
     exit(EXIT_SUCCESS);
 }
 
@@ -0,0 +1,259 @@
+#include "../lib/m_server.h"
+#include "../lib/m_rope.h"
+
+#define TESTPORT 8987
+#define PIECES 200000
+
+static const char *piece = "<user id=\"%u\" name=\"user%u\" status=\"online\"/>";
+
+static size_t expected = 0;
+static m_string *received = NULL;
+
+/* -------------------------------------------------------------------------- */
+
+static void *_reader(void *params)
+{
+    m_socket *s = params;
+    char buffer[SOCKET_BUFFER];
+    ssize_t r = 0;
+
+    while (SIZE(received) < expected) {
+        if ( (r = socket_read(s, buffer, sizeof(buffer))) == SOCKET_EAGAIN)
+            continue;
+        if (r < 0) break;
+        string_cats(received, buffer, r);
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _rope_check(const m_rope *r, const m_string *ref, const char *what)
+{
+    m_string *flat = NULL;
+    int ret = 0;
+
+    if (rope_size(r) != SIZE(ref) || ! (flat = rope_flatten(r)) ||
+        SIZE(flat) != SIZE(ref) || memcmp(DATA(flat), DATA(ref), SIZE(ref))) {
+        printf("(!) %s: FAILURE\n", what);
+        ret = -1;
+    }
+
+    string_free(flat);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _rope_send(m_rope *r)
+{
+    m_socket *server = NULL, *client = NULL, *peer = NULL;
+    pthread_t reader;
+    ssize_t w = 0;
+    uint64_t tx = 0;
+    int ret = -1;
+
+    if (! (server = socket_open("127.0.0.1", ""STR(TESTPORT)"",
+                                SOCKET_SERVER | SOCKET_BIO)) ) return -1;
+
+    if (socket_listen(server) == SOCKET_EFATAL) goto _err_listen;
+
+    if (! (client = socket_open("127.0.0.1", ""STR(TESTPORT)"", SOCKET_BIO)) )
+        goto _err_listen;
+
+    if (socket_connect(client) == -1) goto _err_connect;
+
+    if (! (peer = socket_accept(server)) ) goto _err_connect;
+
+    expected = rope_size(r);
+    received = string_prealloc(NULL, 0, expected);
+
+    if (pthread_create(& reader, NULL, _reader, peer) != 0) goto _err_thread;
+
+    tx = client->_tx;
+
+    do w = rope_write(r, client);
+    while (w > 0 || w == SOCKET_EAGAIN);
+
+    pthread_join(reader, NULL);
+
+    if (w == 0 && ! rope_size(r) && client->_tx - tx == expected &&
+        SIZE(received) == expected) ret = 0;
+
+_err_thread:
+    peer = socket_close(peer);
+_err_connect:
+    client = socket_close(client);
+_err_listen:
+    server = socket_close(server);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+int test_rope(void)
+{
+    m_rope *r = NULL, *s = NULL, *t = NULL;
+    m_string *ref = NULL, *cat = NULL, *flat = NULL;
+    clock_t start, stop;
+    size_t off = 0, len = 0;
+    unsigned int i = 0;
+    #ifdef _ENABLE_FILE
+    m_view *v = NULL;
+    m_file *f = NULL;
+    FILE *fp = NULL;
+    #endif
+
+    socket_api_setup();
+
+    /* basic assembly */
+    if (! (r = rope_alloc()) ) return -1;
+
+    rope_append(r, string_alloc("world", 5));
+    rope_prepend(r, string_alloc("hello ", 6));
+    rope_append_buffer(r, " !", 2);
+    rope_prepend_buffer(r, "> ", 2);
+    rope_append(r, string_alloc("", 0));
+
+    ref = string_alloc("> hello world !", 15);
+
+    if (_rope_check(r, ref, "Appending and prepending segments") == -1)
+        return -1;
+    else printf("(*) Appending and prepending segments: SUCCESS\n");
+
+    /* slices share the segments, and outlive the original rope */
+    s = rope_slice(r, 3, 9);
+    t = rope_slice(r, 0, 0);
+    r = rope_free(r);
+
+    string_free(ref);
+    ref = string_alloc("ello worl", 9);
+
+    if (! s || _rope_check(s, ref, "Slicing a rope") == -1) return -1;
+
+    string_free(ref);
+    ref = string_alloc("> hello world !", 15);
+
+    if (! t || _rope_check(t, ref, "Slicing a whole rope") == -1) return -1;
+
+    if (rope_cat(t, s) == -1) return -1;
+
+    string_cats(ref, "ello worl", 9);
+
+    if (_rope_check(t, ref, "Concatenating ropes") == -1) return -1;
+    else printf("(*) Slicing and concatenating ropes: SUCCESS\n");
+
+    t = rope_free(t);
+    ref = string_free(ref);
+
+    /* large responses */
+    printf("(-) Assembling "STR(PIECES)" pieces with string_catfmt().\n");
+
+    start = clock();
+    cat = string_alloc("<users>", 7);
+    for (i = 0; i < PIECES; i ++) string_catfmt(cat, piece, i, i);
+    string_cats(cat, "</users>", 8);
+    stop = clock();
+
+    printf("(-) Time elapsed = %.3f s.\n",
+           (double) (stop - start) / CLOCKS_PER_SEC);
+
+    printf("(-) Assembling "STR(PIECES)" pieces with rope_append().\n");
+
+    start = clock();
+    r = rope_alloc();
+    for (i = 0; i < PIECES; i ++)
+        rope_append(r, string_fmt(NULL, piece, i, i));
+    rope_append_buffer(r, "</users>", 8);
+    rope_prepend_buffer(r, "<users>", 7);
+    stop = clock();
+
+    printf("(-) Time elapsed = %.3f s.\n",
+           (double) (stop - start) / CLOCKS_PER_SEC);
+
+    if (_rope_check(r, cat, "Assembling a large rope") == -1) return -1;
+    else printf("(*) Assembling a large rope: SUCCESS\n");
+
+    /* random slices */
+    for (i = 0; i < 1000; i ++) {
+        off = rand() % SIZE(cat);
+        len = 1 + rand() % 4096;
+        if (len > SIZE(cat) - off) len = SIZE(cat) - off;
+
+        s = rope_slice(r, off, len);
+        ref = string_alloc(DATA(cat) + off, len);
+
+        if (! s || _rope_check(s, ref, "Random slices") == -1) return -1;
+
+        s = rope_free(s);
+        ref = string_free(ref);
+    }
+
+    printf("(*) Random slices: SUCCESS\n");
+
+    #ifdef _ENABLE_FILE
+    /* file segments */
+    v = fs_openview("lib", strlen("lib"));
+
+    if (! (f = fs_openfile(v, "m_string.c", strlen("m_string.c"), NULL)) ) {
+        printf("(!) Opening a file: FAILURE\n");
+        return -1;
+    }
+
+    if (! (fp = fopen("lib/m_string.c", "rb")) ) return -1;
+    flat = string_prealloc(NULL, 0, 70000);
+    flat->_len = fread(flat->_data, 1, 70000, fp);
+    fclose(fp);
+
+    if (SIZE(flat) != 70000) return -1;
+
+    string_cats(cat, DATA(flat) + 100, 70000 - 100);
+    string_pres(cat, DATA(flat), 100);
+
+    rope_append_file(r, fs_reopenfile(f), 100, 70000 - 100);
+    rope_prepend_file(r, f, 0, 100);
+
+    flat = string_free(flat);
+
+    if (_rope_check(r, cat, "Adding file segments") == -1) return -1;
+
+    s = rope_slice(r, 50, SIZE(cat) - 100);
+    ref = string_alloc(DATA(cat) + 50, SIZE(cat) - 100);
+
+    if (! s || _rope_check(s, ref, "Slicing file segments") == -1) return -1;
+    else printf("(*) Adding and slicing file segments: SUCCESS\n");
+
+    s = rope_free(s);
+    ref = string_free(ref);
+    #endif
+
+    /* scatter-gather transmission */
+    printf("(-) Sending the rope over a socket.\n");
+
+    start = clock();
+    if (_rope_send(r) == -1 || SIZE(received) != SIZE(cat) ||
+        memcmp(DATA(received), DATA(cat), SIZE(cat))) {
+        printf("(!) Sending a rope: FAILURE\n");
+        return -1;
+    }
+    stop = clock();
+
+    printf("(-) Time elapsed = %.3f s.\n",
+           (double) (stop - start) / CLOCKS_PER_SEC);
+    printf("(*) Sending a rope: SUCCESS\n");
+
+    r = rope_free(r);
+    received = string_free(received);
+    cat = string_free(cat);
+
+    #ifdef _ENABLE_FILE
+    v = fs_closeview(v);
+    #endif
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,438 @@
+#include "../lib/m_server.h"
+
+#if defined(_ENABLE_SERVER) && defined(_BUILTIN_PLUGIN)
+
+#define TESTPORT 8988
+#define REQUESTS 100
+
+/* the server configuration only sets the number of threads, the test program
+   itself is loaded as the builtin plugin */
+static const char *config =
+"<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n"
+"<!DOCTYPE concrete PUBLIC \"-//BURO.ASIA//CONCRETE//CONFIG\" \"concrete.dtd\">\n"
+"<concrete configuration=\"production\">\n"
+"    <options profile=\"any\"><threads number=\"2\" /></options>\n"
+"    <plugins path=\"plugins\" profile=\"debug\">\n"
+"        <plugin image=\"none.so\" id=\"none\" />\n"
+"    </plugins>\n"
+"</concrete>\n";
+
+static uint32_t _token = 0;
+
+/* -------------------------------------------------------------------------- */
+/* Builtin plugin */
+/* -------------------------------------------------------------------------- */
+
+public unsigned int plugin_api(void)
+{
+    return __CONCRETE__;
+}
+
+/* -------------------------------------------------------------------------- */
+
+public int plugin_init(uint32_t id, UNUSED int argc, UNUSED char **argv)
+{
+    _token = id;
+
+    return server_open_managed_socket(id, "127.0.0.1", ""STR(TESTPORT)"",
+                                      SOCKET_SERVER);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public void plugin_main(uint16_t socket_id, UNUSED uint16_t ingress_id,
+                        m_string *data)
+{
+    /* spend some time in the handler so that it can be measured */
+    usleep(100);
+
+    server_send_buffer(_token, socket_id, 0, DATA(data), SIZE(data));
+    string_flush(data);
+}
+
+/* -------------------------------------------------------------------------- */
+
+public void plugin_fini(void)
+{
+    _token = 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _server_counters(const m_server_metrics *m, m_server_counters *c)
+{
+    unsigned int i = 0;
+
+    memset(c, 0, sizeof(*c));
+
+    /* each thread has its own counters */
+    for (i = 0; i < m->threads; i ++) {
+        c->requests += m->thread[i].requests;
+        c->rx += m->thread[i].rx;
+        c->tx += m->thread[i].tx;
+        c->accepted += m->thread[i].accepted;
+        c->closed += m->thread[i].closed;
+        c->plugin_calls += m->thread[i].plugin_calls;
+        c->plugin_usec += m->thread[i].plugin_usec;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _server_setup(char *dir)
+{
+    char cwd[PATH_MAX], path[PATH_MAX + sizeof("/concrete.dtd")];
+    FILE *fp = NULL;
+
+    if (! getcwd(cwd, sizeof(cwd)) || ! mkdtemp(dir)) return -1;
+
+    /* the configuration is validated against the DTD of the repository */
+    snprintf(path, sizeof(path), "%s/concrete.dtd", cwd);
+    if (chdir(dir) == -1 || symlink(path, "concrete.dtd") == -1) goto _err;
+
+    if (! (fp = fopen("concrete.xml", "w")) ) goto _err;
+    fputs(config, fp);
+    fclose(fp);
+
+    if (chdir(cwd) == -1) return -1;
+
+    working_directory = dir;
+
+    return 0;
+
+_err:
+    if (chdir(cwd) == -1) perror(ERR(_server_setup, chdir));
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _server_cleanup(char *dir)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/concrete.xml", dir); unlink(path);
+    snprintf(path, sizeof(path), "%s/concrete.dtd", dir); unlink(path);
+    rmdir(dir);
+
+    working_directory = NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _server_connect(void)
+{
+    struct sockaddr_in addr;
+    int fd = -1;
+
+    /* the client does not go through the socket API hooked by the server */
+    if ( (fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) return -1;
+
+    memset(& addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TESTPORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr *) & addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _server_echo(int fd, const char *data, size_t len)
+{
+    char buffer[256];
+    size_t got = 0;
+    ssize_t r = 0;
+
+    if (send(fd, data, len, 0) != (ssize_t) len) return -1;
+
+    while (got < len) {
+        if ( (r = recv(fd, buffer + got, sizeof(buffer) - got, 0)) <= 0)
+            return -1;
+        got += r;
+    }
+
+    return (got == len && ! memcmp(buffer, data, len)) ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _test_metrics(void)
+{
+    const m_server_metrics *m = NULL;
+    m_server_counters before, after;
+    const char *ping = "ping";
+    unsigned int i = 0, blocking = 0;
+    int fd = -1, ret = -1;
+
+    if (! (m = server_metrics_attach(getpid())) ) {
+        printf("(!) Attaching the metrics segment: FAILURE\n");
+        return -1;
+    }
+
+    if (m->magic != SERVER_METRICS_MAGIC ||
+        m->version != SERVER_METRICS_VERSION || ! m->threads ||
+        m->size != sizeof(*m) + m->threads * sizeof(*m->thread) ||
+        sizeof(*m) % 64 || sizeof(*m->thread) % 64 || ! m->started) {
+        printf("(!) Checking the metrics segment layout: FAILURE\n");
+        goto _end;
+    }
+
+    printf("(*) Attaching the metrics segment (%u threads): SUCCESS\n",
+           m->threads);
+
+    _server_counters(m, & before);
+
+    if ( (fd = _server_connect()) == -1) {
+        printf("(!) Connecting to the server: FAILURE\n");
+        goto _end;
+    }
+
+    for (i = 0; i < REQUESTS; i ++) {
+        if (_server_echo(fd, ping, strlen(ping)) == -1) {
+            printf("(!) Sending requests to the server: FAILURE\n");
+            goto _end;
+        }
+    }
+
+    /* the counters are updated once the reply is sent, and the queues
+       are sampled while polling */
+    for (i = 0; i < 100; i ++) {
+        _server_counters(m, & after);
+        if (m->blocking > blocking) blocking = m->blocking;
+        if (after.tx - before.tx == REQUESTS * strlen(ping) && blocking)
+            break;
+        usleep(10000);
+    }
+
+    if (after.requests - before.requests != REQUESTS ||
+        after.plugin_calls - before.plugin_calls < REQUESTS ||
+        after.plugin_usec - before.plugin_usec < REQUESTS * 100 ||
+        after.rx - before.rx != REQUESTS * strlen(ping) ||
+        after.tx - before.tx != REQUESTS * strlen(ping) ||
+        after.accepted - before.accepted != 1 || ! blocking) {
+        printf("(!) Counting the requests: FAILURE\n");
+        goto _end;
+    }
+
+    printf("(*) Counting %"PRIu64" requests, %"PRIu64" bytes in, "
+           "%"PRIu64" bytes out, %"PRIu64" us in the plugin: SUCCESS\n",
+           after.requests - before.requests, after.rx - before.rx,
+           after.tx - before.tx, after.plugin_usec - before.plugin_usec);
+
+    close(fd); fd = -1;
+
+    for (i = 0; i < 100 && after.closed == before.closed; i ++) {
+        usleep(10000);
+        _server_counters(m, & after);
+    }
+
+    if (after.closed - before.closed != 1) {
+        printf("(!) Counting the closed connections: FAILURE\n");
+        goto _end;
+    }
+
+    printf("(*) Counting the connections: SUCCESS\n");
+
+    ret = 0;
+
+_end:
+    if (fd != -1) close(fd);
+    server_metrics_detach(m);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _test_buckets(void)
+{
+    uint64_t usec = 0, bound = 0;
+    unsigned int bucket = 0, last = 0;
+
+    /* the first buckets hold a single value */
+    for (usec = 0; usec < 8; usec ++) {
+        if (server_latency_bucket(usec) != usec ||
+            server_latency_bound(usec) != usec) return -1;
+    }
+
+    /* then 4 buckets per power of two */
+    if (server_latency_bucket(8) != 8 || server_latency_bucket(9) != 8 ||
+        server_latency_bucket(10) != 9 || server_latency_bucket(15) != 11 ||
+        server_latency_bucket(16) != 12 || server_latency_bucket(1000) != 35 ||
+        server_latency_bound(35) != 1023) return -1;
+
+    for (usec = 1; usec < (1 << 20); usec ++) {
+        bucket = server_latency_bucket(usec);
+        bound = server_latency_bound(bucket);
+
+        /* the buckets are contiguous and 25% wide at most */
+        if (bucket < last || bucket > last + 1 || bound < usec ||
+            bound - usec > usec / 4 ||
+            (bucket && server_latency_bound(bucket - 1) >= usec)) return -1;
+
+        last = bucket;
+    }
+
+    /* the last buckets are unbounded */
+    bucket = server_latency_bucket(UINT32_MAX);
+
+    if (server_latency_bound(bucket) != UINT32_MAX ||
+        server_latency_bucket((uint64_t) UINT32_MAX + 1) !=
+        SERVER_LATENCY_BUCKETS - 1 ||
+        server_latency_bound(SERVER_LATENCY_BUCKETS - 1) != UINT64_MAX)
+        return -1;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _test_percentiles(void)
+{
+    m_server_latency h;
+    uint64_t usec = 0, p50 = 0, p99 = 0;
+
+    memset(& h, 0, sizeof(h));
+
+    if (server_latency_percentile(& h, 50) != 0) return -1;
+
+    /* one sample per microsecond from 1us to 1ms */
+    for (usec = 1; usec <= 1000; usec ++) {
+        h.count ++; h.sum += usec; h.max = usec;
+        h.bucket[server_latency_bucket(usec)] ++;
+    }
+
+    p50 = server_latency_percentile(& h, 50);
+    p99 = server_latency_percentile(& h, 99);
+
+    if (server_latency_percentile(& h, 0) != 1 ||
+        server_latency_percentile(& h, 100) != 1000 ||
+        p50 < 500 || p50 > 500 * 5 / 4 || p99 < 990 || p99 > 1000 ||
+        server_latency_percentile(& h, 101) != 0) {
+        printf("(!) Computing the percentiles (p50: %"PRIu64", "
+               "p99: %"PRIu64"): FAILURE\n", p50, p99);
+        return -1;
+    }
+
+    printf("(*) Computing the percentiles (p50: %"PRIu64", p99: %"PRIu64"): "
+           "SUCCESS\n", p50, p99);
+
+    /* the percentiles never exceed the slowest sample */
+    memset(& h, 0, sizeof(h));
+    h.count = 10; h.sum = 3000; h.max = 300;
+    h.bucket[server_latency_bucket(300)] = 10;
+
+    if (server_latency_percentile(& h, 50) != 300 ||
+        server_latency_percentile(& h, 99) != 300) return -1;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _test_snapshot(void)
+{
+    m_server_latency all, plugin, other;
+    int id = _token >> _SOCKET_RSS, kind = 0;
+    uint64_t p50 = 0, p99 = 0;
+
+    if (server_latency_snapshot(SERVER_LATENCY_KINDS, -1, -1, & all) != -1 ||
+        server_latency_snapshot(0, PLUGIN_MAX + 1, -1, & all) != -1 ||
+        server_latency_snapshot(0, -1, -1, NULL) != -1) return -1;
+
+    for (kind = 0; kind < SERVER_LATENCY_KINDS; kind ++) {
+        server_latency_snapshot(kind, -1, -1, & all);
+        server_latency_snapshot(kind, id, -1, & plugin);
+        server_latency_snapshot(kind, id + 1, -1, & other);
+
+        /* only the builtin plugin served requests */
+        if (all.count < REQUESTS || plugin.count != all.count ||
+            plugin.sum != all.sum || plugin.max != all.max || other.count ||
+            all.max > all.sum || all.max * all.count < all.sum) return -1;
+    }
+
+    /* the handler sleeps 100us */
+    server_latency_snapshot(SERVER_LATENCY_HANDLER, id, -1, & plugin);
+
+    p50 = server_latency_percentile(& plugin, 50);
+    p99 = server_latency_percentile(& plugin, 99);
+
+    if (plugin.count != REQUESTS || plugin.sum < REQUESTS * 100 ||
+        p50 < 100 || p50 > p99 || p99 > plugin.max) return -1;
+
+    printf("(*) Taking a snapshot of the handler latency (p50: %"PRIu64" us, "
+           "p99: %"PRIu64" us): SUCCESS\n", p50, p99);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+int test_server(void)
+{
+    char dir[] = "/tmp/concrete.test.XXXXXX";
+    int ret = -1;
+
+    if (_test_buckets() == -1) {
+        printf("(!) Indexing the latency buckets: FAILURE\n");
+        return -1;
+    }
+
+    printf("(*) Indexing the latency buckets: SUCCESS\n");
+
+    if (_test_percentiles() == -1) {
+        printf("(!) Computing the percentiles: FAILURE\n");
+        return -1;
+    }
+
+    if (_server_setup(dir) == -1) {
+        printf("(!) Configuring the server: FAILURE\n");
+        return -1;
+    }
+
+    /* the socket API was already set up by the previous tests */
+    socket_api_cleanup();
+
+    if (server_init() == -1) {
+        printf("(!) Starting the server: FAILURE\n");
+        goto _end;
+    }
+
+    if (! _token) {
+        printf("(!) Loading the builtin plugin: FAILURE\n");
+        goto _fini;
+    }
+
+    if (_test_metrics() == -1) goto _fini;
+
+    if (_test_snapshot() == -1) {
+        printf("(!) Taking a snapshot of the latency: FAILURE\n");
+        goto _fini;
+    }
+
+    ret = 0;
+
+_fini:
+    server_fini();
+
+    if (ret == 0 && server_metrics_attach(getpid())) {
+        printf("(!) Withdrawing the metrics segment: FAILURE\n");
+        ret = -1;
+    }
+
+_end:
+    _server_cleanup(dir);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+
+/* -------------------------------------------------------------------------- */
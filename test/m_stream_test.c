@@ -0,0 +1,382 @@
+#include "../lib/m_server.h"
+#include "../plugins/stream/stream_plugin.h"
+
+#define ORDERS 5
+
+/* the balancer tests use one stream per policy */
+#define WORKERS 8
+#define CLIENTS 512
+#define WORKER(n) (SOCKET_MAX - 64 + (n))
+
+/* -------------------------------------------------------------------------- */
+/* the parts of the plugin the balancer relies on */
+/* -------------------------------------------------------------------------- */
+
+static int _policy[3] = { BALANCE_LEASTCONN, BALANCE_LATENCY,
+                          BALANCE_AFFINITY };
+static unsigned int _eject = 0;
+
+private uint32_t plugin_get_token(void) { return 0; }
+
+private int stream_config_balance(int stream) { return _policy[stream]; }
+
+private unsigned int stream_config_probe(UNUSED int stream) { return 0; }
+
+private unsigned int stream_config_eject(UNUSED int stream) { return _eject; }
+
+private int stream_get_status(uint16_t socket_id)
+{
+    return (socket_id >= WORKER(0) && socket_id < WORKER(32)) ?
+           STREAM_STATUS_WORK : STREAM_STATUS_CONN;
+}
+
+private uint16_t stream_borrow_worker(UNUSED int stream_id) { return 0; }
+
+private uint16_t stream_release_worker(UNUSED int stream_id,
+                                       UNUSED uint16_t worker) { return 0; }
+
+/* -------------------------------------------------------------------------- */
+
+static const uint32_t orders[ORDERS][3] = {
+    { MASTER_OP_HIRED, 0, 0 },
+    { MASTER_OP_TAKEN, 0x00120001, 0 },
+    { MASTER_OP_LINKS, 3, 0x00130000 },
+    { MASTER_OP_HIRED, 0, 0 },
+    { MASTER_OP_TAKEN, 0x00140002, 0 }
+};
+
+/* -------------------------------------------------------------------------- */
+
+static m_string *_stream_orders(void)
+{
+    m_string *wire = string_alloc(NULL, 0);
+    unsigned int i = 0;
+
+    for (i = 0; i < ORDERS; i ++) {
+        switch (orders[i][0]) {
+        case MASTER_OP_TAKEN:
+            string_catfmt(wire, "%bB4u%bB4u", orders[i][0], orders[i][1]);
+            break;
+        case MASTER_OP_LINKS:
+            string_catfmt(wire, "%bB4u%bB4u%bB4u", orders[i][0],
+                          orders[i][1], orders[i][2]);
+            break;
+        default: string_catfmt(wire, "%bB4u", orders[i][0]);
+        }
+    }
+
+    return wire;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _stream_check(unsigned int n, uint32_t op, const uint32_t *args)
+{
+    if (n >= ORDERS || op != orders[n][0]) return -1;
+
+    if (op == MASTER_OP_TAKEN && args[0] != orders[n][1]) return -1;
+
+    if (op == MASTER_OP_LINKS &&
+        (args[0] != orders[n][1] || args[1] != orders[n][2])) return -1;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void _sample(uint16_t worker, unsigned int usec)
+{
+    uint8_t seq = 0;
+
+    /* the probe is not sent since no probe interval is configured */
+    stream_probe(worker);
+    stream_balance_probed(worker);
+    if (usec) usleep(usec);
+
+    /* the first probe of a worker has the sequence number 1 */
+    for (seq = 0; seq <= PROBE_SEQ; seq ++) stream_balance_sample(worker, seq);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static unsigned int _latency(uint16_t worker)
+{
+    unsigned int lo = 1, hi = 10000, mid = 0, limit = _eject;
+
+    /* smallest ejection limit (ms) the worker does not exceed */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2; _eject = mid;
+        if (stream_balance_ejected(worker)) lo = mid + 1; else hi = mid;
+    }
+
+    _eject = limit;
+
+    return lo;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _test_leastconn(void)
+{
+    unsigned int i = 0;
+    uint32_t ticket = 0;
+
+    for (i = 1; i <= 3; i ++)
+        stream_balance_join(0, WORKER(i), WORKER_CAP_TICKET);
+
+    /* 2 pipes on the first worker, 1 on the third one */
+    stream_balance_attach(100, WORKER(1));
+    stream_balance_attach(101, WORKER(1));
+    stream_balance_attach(102, WORKER(3));
+
+    if (stream_balance_select(0, 0) != WORKER(2)) return -1;
+
+    /* the connections requested but not opened yet count as well */
+    stream_balance_hire(WORKER(2), 0, & ticket);
+    stream_balance_hire(WORKER(2), 0, & ticket);
+
+    if (! ticket || stream_balance_select(0, 0) != WORKER(3)) return -1;
+
+    /* the pipes of the first worker are closed */
+    stream_balance_leave(100);
+    stream_balance_leave(101);
+
+    if (stream_balance_select(0, 0) != WORKER(1)) return -1;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _test_latency(void)
+{
+    unsigned int slow = 0, smooth = 0, i = 0, expected = 0;
+    double latency = 0;
+
+    stream_balance_join(1, WORKER(4), 0);
+    stream_balance_join(1, WORKER(5), 0);
+
+    _sample(WORKER(4), 0);
+    _sample(WORKER(5), 80000);
+
+    /* the first sample is taken as is */
+    slow = _latency(WORKER(5));
+
+    if (_latency(WORKER(4)) > 5 || slow < 80 || slow > 500) {
+        printf("(!) Measuring the latency (%u ms): FAILURE\n", slow);
+        return -1;
+    }
+
+    if (stream_balance_select(1, 0) != WORKER(4)) {
+        printf("(!) Electing the fastest worker: FAILURE\n");
+        return -1;
+    }
+
+    /* then each sample accounts for 1/8th of the average */
+    _sample(WORKER(5), 0);
+    smooth = _latency(WORKER(5));
+
+    if (smooth + 1 < slow * 7 / 8 || smooth > slow * 7 / 8 + 2) {
+        printf("(!) Averaging the latency (%u -> %u ms): FAILURE\n",
+               slow, smooth);
+        return -1;
+    }
+
+    printf("(*) Averaging the latency (%u -> %u ms): SUCCESS\n", slow, smooth);
+
+    /* the slow worker is ejected even if it is the least loaded one */
+    _policy[1] = BALANCE_LEASTCONN; _eject = 40;
+    stream_balance_attach(103, WORKER(4));
+
+    if (! stream_balance_ejected(WORKER(5)) ||
+        stream_balance_ejected(WORKER(4)) ||
+        stream_balance_select(1, 0) != WORKER(4)) {
+        printf("(!) Ejecting a slow worker: FAILURE\n");
+        return -1;
+    }
+
+    /* it is admitted back once its average goes below the limit */
+    for (latency = smooth - 0.5, expected = 0; latency > _eject; expected ++)
+        latency *= 7.0 / 8.0;
+
+    for (i = 0; i < 32 && stream_balance_ejected(WORKER(5)); i ++)
+        _sample(WORKER(5), 0);
+
+    if (i + 1 < expected || i > expected + 1 ||
+        stream_balance_select(1, 0) != WORKER(5)) {
+        printf("(!) Admitting a worker back after %u samples: FAILURE\n", i);
+        return -1;
+    }
+
+    printf("(*) Ejecting and admitting back a slow worker: SUCCESS\n");
+
+    _eject = 0;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int _test_affinity(void)
+{
+    m_socket *client[CLIENTS], *twin = NULL;
+    uint16_t worker[CLIENTS], w = 0;
+    unsigned int i = 0, moved = 0, hits[WORKERS];
+    char ip[32];
+    int ret = -1;
+
+    memset(client, 0, sizeof(client));
+    memset(hits, 0, sizeof(hits));
+
+    for (i = 0; i < WORKERS; i ++) stream_balance_join(2, WORKER(10 + i), 0);
+
+    for (i = 0; i < CLIENTS; i ++) {
+        /* no descriptor, only the address of the client is needed */
+        snprintf(ip, sizeof(ip), "10.%u.%u.%u", i % 7, i / 256, i % 256);
+        if (! (client[i] = socket_open(ip, "80", SOCKET_NEW)) ) goto _end;
+        client[i]->_fd = -1;
+
+        worker[i] = stream_balance_select(2, SOCKET_ID(client[i]));
+        if (worker[i] < WORKER(10) || worker[i] >= WORKER(10 + WORKERS))
+            goto _end;
+        hits[worker[i] - WORKER(10)] ++;
+    }
+
+    /* the same address always goes to the same worker */
+    for (i = 0; i < CLIENTS; i += 37) {
+        snprintf(ip, sizeof(ip), "10.%u.%u.%u", i % 7, i / 256, i % 256);
+        if (! (twin = socket_open(ip, "81", SOCKET_NEW)) ) goto _end;
+        twin->_fd = -1;
+
+        w = stream_balance_select(2, SOCKET_ID(twin));
+        twin = socket_close(twin);
+
+        if (w != worker[i] ||
+            stream_balance_select(2, SOCKET_ID(client[i])) != worker[i]) {
+            printf("(!) Sending a client to the same worker: FAILURE\n");
+            goto _end;
+        }
+    }
+
+    for (i = 0; i < WORKERS; i ++) {
+        if (! hits[i]) {
+            printf("(!) Spreading the clients over the workers: FAILURE\n");
+            goto _end;
+        }
+    }
+
+    printf("(*) Sending a client to the same worker: SUCCESS\n");
+
+    /* only the clients of the worker which left must move */
+    stream_balance_leave(WORKER(13));
+
+    for (i = 0; i < CLIENTS; i ++) {
+        w = stream_balance_select(2, SOCKET_ID(client[i]));
+        if (w == worker[i]) continue;
+        if (worker[i] != WORKER(13) || w == WORKER(13)) {
+            printf("(!) Keeping the clients of the other workers: FAILURE\n");
+            goto _end;
+        }
+        moved ++;
+    }
+
+    if (moved != hits[3] || moved > CLIENTS * 2 / WORKERS) {
+        printf("(!) Moving %u clients out of %u: FAILURE\n", moved, CLIENTS);
+        goto _end;
+    }
+
+    printf("(*) Moving %u clients out of %u when a worker leaves: SUCCESS\n",
+           moved, CLIENTS);
+
+    ret = 0;
+
+_end:
+    for (i = 0; i < CLIENTS; i ++) client[i] = socket_close(client[i]);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+int test_stream(void)
+{
+    m_string *wire = NULL, *data = NULL;
+    uint32_t op = 0, args[2] = { 0, 0 };
+    unsigned int n = 0;
+    size_t chunk = 0, off = 0, len = 0;
+
+    if (! (wire = _stream_orders()) ) return -1;
+
+    /* several orders in a single read, the last one being incomplete */
+    data = string_alloc(DATA(wire), SIZE(wire) - 2);
+
+    for (n = 0; stream_fetch_order(data, & op, args) == 0; n ++)
+        if (_stream_check(n, op, args) == -1) break;
+
+    if (n != ORDERS - 1 || SIZE(data) != 6) {
+        printf("(!) Processing several orders per read: FAILURE\n");
+        return -1;
+    }
+
+    /* the end of the order comes with the next read */
+    string_cats(data, DATA(wire) + SIZE(wire) - 2, 2);
+
+    if (stream_fetch_order(data, & op, args) == -1 ||
+        _stream_check(n, op, args) == -1 || SIZE(data)) {
+        printf("(!) Completing a partial order: FAILURE\n");
+        return -1;
+    }
+
+    printf("(*) Processing several orders per read: SUCCESS\n");
+
+    data = string_free(data);
+
+    /* the orders must not depend on how the reads are split */
+    for (chunk = 1; chunk <= SIZE(wire); chunk ++) {
+        data = string_alloc(NULL, 0);
+
+        for (n = 0, off = 0; off < SIZE(wire); off += len) {
+            len = (SIZE(wire) - off < chunk) ? SIZE(wire) - off : chunk;
+            string_cats(data, DATA(wire) + off, len);
+
+            while (stream_fetch_order(data, & op, args) == 0) {
+                if (_stream_check(n, op, args) == -1) {
+                    printf("(!) Splitting orders in %zu bytes reads: "
+                           "FAILURE\n", chunk);
+                    return -1;
+                }
+                n ++;
+            }
+        }
+
+        if (n != ORDERS || SIZE(data)) {
+            printf("(!) Splitting orders in %zu bytes reads: FAILURE\n", chunk);
+            return -1;
+        }
+
+        data = string_free(data);
+    }
+
+    printf("(*) Splitting orders across reads: SUCCESS\n");
+
+    wire = string_free(wire);
+
+    stream_balance_init();
+
+    if (_test_leastconn() == -1) {
+        printf("(!) Electing the least loaded worker: FAILURE\n");
+        return -1;
+    }
+
+    printf("(*) Electing the least loaded worker: SUCCESS\n");
+
+    if (_test_latency() == -1 || _test_affinity() == -1) return -1;
+
+    for (n = 0; n < 32; n ++) stream_balance_leave(WORKER(n));
+
+    stream_balance_fini();
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -6,6 +6,9 @@
 
 #define DUMMY_LEN 256
 
+#define SEARCH_HAYSTACK 4194304
+#define SEARCH_ROUNDS   16
+
 /* -------------------------------------------------------------------------- */
 
 static void print_tokens(const m_string *s, unsigned int indent)
@@ -42,6 +45,1518 @@ static void print_tokens(const m_string *s, unsigned int indent)
 
 /* -------------------------------------------------------------------------- */
 
+static int test_search(void)
+{
+    static const size_t needle[] = { 1, 2, 3, 4, 7, 16, 31, 64, 300, 1000 };
+    static const char *engine[] = { "auto", "scalar", "SSE2", "AVX2" };
+    m_string *haystack = NULL;
+    clock_t start, stop;
+    off_t pos = 0, ref = 0;
+    size_t i = 0, j = 0, k = 0;
+    int e = 0;
+
+    if (! (haystack = string_alloc(NULL, SEARCH_HAYSTACK)) ) return -1;
+
+    /* a small alphabet makes partial matches frequent */
+    for (i = 0; i < SEARCH_HAYSTACK; i ++)
+        haystack->_data[i] = 'a' + rand() % 4;
+
+    /* all the engines must agree with the scalar engine */
+    for (e = STRING_SEARCH_SSE2; e <= STRING_SEARCH_AVX2; e ++) {
+        if (string_search_engine(e) == -1) continue;
+
+        for (i = 0; i < 2000; i ++) {
+            j = needle[i % (sizeof(needle) / sizeof(*needle))];
+            k = rand() % (SEARCH_HAYSTACK - j);
+
+            /* search a needle taken from the haystack and a missing one */
+            string_search_engine(STRING_SEARCH_SCALAR);
+            ref = string_finds(haystack, i % 64, DATA(haystack) + k, j);
+            pos = string_finds(haystack, k + 1, "abcdx", 5);
+            string_search_engine(e);
+
+            if (string_finds(haystack, i % 64, DATA(haystack) + k, j) != ref ||
+                string_finds(haystack, k + 1, "abcdx", 5) != pos || pos != -1) {
+                printf("(!) %s substring search (needle of %zu bytes): "
+                       "FAILURE\n", engine[e], j);
+                string_free(haystack);
+                string_search_engine(STRING_SEARCH_AUTO);
+                return -1;
+            }
+        }
+
+        printf("(*) %s substring search: SUCCESS\n", engine[e]);
+    }
+
+    /* benchmark the engines against a needle at the end of the haystack */
+    for (j = 0; j < sizeof(needle) / sizeof(*needle); j ++) {
+        memcpy(haystack->_data + SEARCH_HAYSTACK - needle[j],
+               "0123456789", (needle[j] < 10) ? needle[j] : 10);
+
+        printf("(-) needle of %4zu bytes:", needle[j]);
+
+        for (e = STRING_SEARCH_SCALAR; e <= STRING_SEARCH_AVX2; e ++) {
+            if (string_search_engine(e) == -1) continue;
+
+            start = clock();
+            for (i = 0; i < SEARCH_ROUNDS; i ++) {
+                pos = string_finds(haystack, 0, DATA(haystack) +
+                                   SEARCH_HAYSTACK - needle[j], needle[j]);
+            }
+            stop = clock();
+
+            printf(" %s %.0f MiB/s", engine[e],
+                   (double) SEARCH_HAYSTACK * SEARCH_ROUNDS / 1048576 /
+                   ((double) (stop - start + 1) / CLOCKS_PER_SEC));
+        }
+
+        printf("\n");
+    }
+
+    string_search_engine(STRING_SEARCH_AUTO);
+    string_free(haystack);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_search_set(void)
+{
+    static const char *pattern[] = { "\r\n", "\n", "cab", "--", "bcab" };
+    static const size_t len[] = { 2, 1, 3, 2, 4 };
+    static const char *engine[] = { "auto", "scalar", "SSE2", "AVX2" };
+    char haystack[512];
+    m_search_set *set[2] = { NULL, NULL };
+    m_string *z = NULL;
+    size_t i = 0, j = 0, l = 0, best_len = 0;
+    off_t pos = 0, best = 0;
+    int e = 0;
+
+    /* the first set goes through the vector filter, not the second one */
+    if (! (set[0] = string_search_set_alloc(pattern, len, 5)) ||
+        ! (set[1] = string_search_set_alloc(pattern + 1, len + 1, 4)) ) {
+        printf("(!) Compiling a set of patterns: FAILURE\n");
+        goto _err;
+    }
+
+    for (e = STRING_SEARCH_SCALAR; e <= STRING_SEARCH_AVX2; e ++) {
+        if (string_search_engine(e) == -1) continue;
+
+        for (i = 0; i < 1000; i ++) {
+            for (j = 0; j < sizeof(haystack); j ++)
+                haystack[j] = "abc-\r\n"[rand() % 6];
+
+            /* the earliest, then longest, match of the patterns */
+            for (j = (i & 1), best = -1; j < 5; j ++) {
+                pos = string_sfinds(haystack, sizeof(haystack), i % 64,
+                                    pattern[j], len[j]);
+                if (pos != -1 && (best == -1 || pos < best ||
+                    (pos == best && len[j] > best_len)))
+                    best = pos, best_len = len[j];
+            }
+
+            pos = string_search_set_find(set[i & 1], haystack,
+                                         sizeof(haystack), i % 64, NULL, & l);
+
+            if (pos != best || (pos != -1 && l != best_len)) {
+                printf("(!) %s search of a set of patterns: FAILURE\n",
+                       engine[e]);
+                goto _err;
+            }
+        }
+
+        printf("(*) %s search of a set of patterns: SUCCESS\n", engine[e]);
+    }
+
+    string_search_engine(STRING_SEARCH_AUTO);
+
+    z = string_alloc("line 1\r\nline 2\nline 3--bcabc", 28);
+
+    if (string_splits_set(z, set[0]) == -1 || PARTS(z) != 5 ||
+        SIZE(TOKEN(z, 1)) != 6 || SIZE(TOKEN(z, 4)) != 1) {
+        printf("(!) Splitting on a set of patterns: FAILURE\n");
+        goto _err;
+    } else printf("(*) Splitting on a set of patterns: SUCCESS\n");
+
+    print_tokens(z, 0);
+
+    if (! string_reps_set(z, set[0], "<br />", 6) ||
+        strcmp(DATA(z), "line 1<br />line 2<br />line 3<br /><br />c")) {
+        printf("(!) Replacing a set of patterns: FAILURE\n");
+        goto _err;
+    } else printf("(*) Replacing a set of patterns \"%s\": SUCCESS\n", DATA(z));
+
+    string_free(z);
+    string_search_set_free(set[0]);
+    string_search_set_free(set[1]);
+
+    return 0;
+
+_err:
+    string_search_engine(STRING_SEARCH_AUTO);
+    string_free(z);
+    string_search_set_free(set[0]);
+    string_search_set_free(set[1]);
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_cursor(void)
+{
+    m_string *z = NULL;
+    m_string_cursor c;
+    const m_string *t = NULL;
+    clock_t start, stop;
+    unsigned int i = 0;
+
+    /* 100k tokens */
+    if (! (z = string_alloc(NULL, 0)) ) return -1;
+
+    for (i = 0; i < 100000; i ++) string_catfmt(z, "%u;", i);
+
+    start = clock();
+    if (string_splits(z, ";", 1) == -1 || PARTS(z) != 100001) {
+        printf("(!) Splitting in 100k tokens: FAILURE\n");
+        string_free(z);
+        return -1;
+    }
+    stop = clock();
+    printf("(*) Splitting in 100k tokens: SUCCESS (%.3f s)\n",
+           (double) (stop - start) / CLOCKS_PER_SEC);
+
+    /* the cursor must return the same tokens */
+    string_cursor_init(& c, z, ";", 1);
+
+    for (i = 0; (t = string_cursor_next(& c)); i ++) {
+        if (i >= PARTS(z) || DATA(t) != TOKEN_DATA(z, i) ||
+            SIZE(t) != TOKEN_SIZE(z, i)) break;
+    }
+
+    if (t || i != PARTS(z)) {
+        printf("(!) Walking the tokens with a cursor: FAILURE\n");
+        string_free(z);
+        return -1;
+    } else printf("(*) Walking the tokens with a cursor: SUCCESS\n");
+
+    string_free(z);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_arena(void)
+{
+    m_string_arena *a = NULL;
+    m_string *z = NULL, *y = NULL, *kept = NULL;
+    unsigned int i = 0;
+
+    if (! (a = string_arena_begin(256)) ) return -1;
+
+    /* a string growing at the end of the arena, then spilling over */
+    if (! (z = string_alloc("arena", 5)) ) goto _err;
+    for (i = 0; i < 1000; i ++) string_catfmt(z, ";%u", i);
+
+    if (~z->_flags & _STRING_FLAG_ARENA || string_splits(z, ";", 1) == -1 ||
+        PARTS(z) != 1001 || strncmp(TOKEN_DATA(z, 1000), "999", 3)) {
+        printf("(!) Allocating strings in an arena: FAILURE\n");
+        goto _err;
+    }
+
+    /* mixing explicitly freed and forgotten strings is fine */
+    for (i = 0; i < 100; i ++) {
+        y = string_fmt(NULL, "temporary string %u", i);
+        if (i & 1) y = string_free(y);
+    }
+
+    kept = string_arena_escape(TOKEN(z, 1000));
+    a = string_arena_end(a);
+
+    if (! kept || kept->_flags & _STRING_FLAG_ARENA ||
+        strcmp(DATA(kept), "999") || (z = string_alloc("x", 1)) == NULL ||
+        z->_flags & _STRING_FLAG_ARENA) {
+        printf("(!) Escaping a string from an arena: FAILURE\n");
+        string_free(kept); string_free(z);
+        return -1;
+    } else printf("(*) Escaping a string from an arena: SUCCESS\n");
+
+    string_free(kept); string_free(z);
+
+    return 0;
+
+_err:
+    string_arena_end(a);
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_share(void)
+{
+    m_string *z = NULL, *a = NULL, *b = NULL;
+    int ret = -1;
+
+    if (! (z = string_alloc("broadcast payload", 17)) ) return -1;
+
+    a = string_share(z); b = string_share(a);
+
+    /* dropping a written head keeps sharing the buffer */
+    if (! a || ! b || DATA(a) == DATA(z) || DATA(a) != DATA(b) ||
+        string_suppr(b, 0, 10) == -1 || DATA(b) != DATA(a) + 10 ||
+        ! IS_SHARED(b) || strcmp(DATA(b), "payload")) {
+        printf("(!) Sharing a string: FAILURE\n");
+        goto _end;
+    } else printf("(*) Sharing a string: SUCCESS\n");
+
+    /* writing gives a private copy */
+    z = string_free(z);
+
+    if (string_upper(a) == -1 || IS_SHARED(a) || strcmp(DATA(a),
+        "BROADCAST PAYLOAD") || strcmp(DATA(b), "payload") ||
+        ! string_cats(b, "s", 1) || strcmp(DATA(b), "payloads")) {
+        printf("(!) Copying a shared string on write: FAILURE\n");
+        goto _end;
+    } else printf("(*) Copying a shared string on write: SUCCESS\n");
+
+    ret = 0;
+
+_end:
+    string_free(z); string_free(a); string_free(b);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_fmt_compiled(void)
+{
+    const char *reply = "HTTP/1.1 %i OK\r\nContent-Length: %zu\r\n"
+                        "X-Id: %u-%lld\r\n%s: %.*s 100%%\r\n\r\n";
+    const char *other = "[%08.3f|%-6s|%x|%c|%*d|%.*f|%5.2s]";
+    m_fmt *f[3] = { NULL, NULL, NULL };
+    m_string *a = NULL, *b = NULL, *c = NULL;
+    char buffer[64] = "previous";
+    clock_t start, stop;
+    double t[2];
+    unsigned int i = 0;
+    int ret = -1;
+
+    if (! (f[0] = fmt_compile(reply)) || ! (f[1] = fmt_compile(other)) ||
+        ! (f[2] = fmt_compile("%2$s %1$s")) ) goto _end;
+
+    a = string_fmt(NULL, reply, -404, (size_t) 1234, 4000000000U,
+                   -9000000000LL, "Server", 4, "concrete", NULL);
+    b = string_fmt_compiled(NULL, f[0], -404, (size_t) 1234, 4000000000U,
+                            -9000000000LL, "Server", 4, "concrete", NULL);
+
+    if (! a || ! b || SIZE(a) != SIZE(b) || strcmp(DATA(a), DATA(b))) {
+        printf("(!) Formatting with a compiled format: FAILURE\n");
+        goto _end;
+    }
+
+    string_fmt(a, other, -3.14159, "ab", 255, 'z', 5, 42, 2, 2.5, "xyz");
+    string_fmt_compiled(b, f[1], -3.14159, "ab", 255, 'z', 5, 42, 2, 2.5,
+                        "xyz");
+
+    if (SIZE(a) != SIZE(b) || strcmp(DATA(a), DATA(b))) {
+        printf("(!) Formatting conversions with a compiled format: FAILURE\n");
+        goto _end;
+    }
+
+    /* positional arguments go through m_vsnprintf() */
+    string_catfmt_compiled(b, f[2], "world", "hello");
+
+    if (strcmp(DATA(b) + SIZE(a), "hello world")) {
+        printf("(!) Formatting positional arguments: FAILURE\n");
+        goto _end;
+    } else printf("(*) Formatting with compiled formats \"%s\": SUCCESS\n",
+                  DATA(b));
+
+    start = clock();
+    for (i = 0; i < 200000; i ++)
+        string_fmt(a, reply, 200, (size_t) i, i, (long long) i * 3,
+                   "Server", 8, "concrete");
+    stop = clock();
+    t[0] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (i = 0; i < 200000; i ++)
+        string_fmt_compiled(b, f[0], 200, (size_t) i, i, (long long) i * 3,
+                            "Server", 8, "concrete");
+    stop = clock();
+    t[1] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+    if (strcmp(DATA(a), DATA(b))) {
+        printf("(!) Formatting with a compiled format: FAILURE\n");
+        goto _end;
+    }
+
+    printf("(*) Formatting with a compiled format: SUCCESS "
+           "(%.3f s, %.3f s parsing each time)\n", t[1], t[0]);
+
+    /* a failed append keeps the string, a failed overwrite empties it */
+    if (! (c = string_encaps(buffer, 8)) ) goto _end;
+
+    if (string_catfmt_compiled(c, f[1], -3.14159, "ab", 255, 'z', 5, 42, 2,
+                               2.5, "xyz") || SIZE(c) != 8 ||
+        strcmp(DATA(c), "previous") ||
+        string_fmt_compiled(c, f[1], -3.14159, "ab", 255, 'z', 5, 42, 2,
+                            2.5, "xyz") || SIZE(c) || *DATA(c)) {
+        printf("(!) Failing to format with a compiled format: FAILURE\n");
+        goto _end;
+    } else printf("(*) Failing to format with a compiled format: SUCCESS\n");
+
+    ret = 0;
+
+_end:
+    fmt_free(f[0]); fmt_free(f[1]); fmt_free(f[2]);
+    string_free(a); string_free(b); string_free(c);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_float(void)
+{
+    const char *formats[] = { "%.17g", "%.6f", "%.3e", "%g", "%.2f" };
+    char a[512], b[512], digits[FLOAT_DIGITS + 1];
+    uint64_t bits = 0x9E3779B97F4A7C15ULL, r = 0;
+    double d = 0, e = 0, values[10000];
+    clock_t start, stop;
+    char *end[2] = { NULL, NULL };
+    double t[2] = { 0, 0 };
+    unsigned int i = 0, j = 0;
+    int n = 0, decpt = 0;
+
+    for (i = 0; i < 200000; i ++) {
+        /* random bit patterns, and values with a few decimals */
+        bits ^= bits << 13; bits ^= bits >> 7; bits ^= bits << 17;
+        if (i & 1) memcpy(& d, & bits, sizeof(d));
+        else d = (double) (int64_t) (bits % 2000000001) / 1000 - 1000000;
+        if (! isfinite(d)) continue;
+        if (i < sizeof(values) / sizeof(*values)) values[i] = d;
+
+        /* the shortest digits read back to the same bits */
+        if ( (n = float_dtoa(d, 0, 0, digits, & decpt)) ) {
+            snprintf(a, sizeof(a), "%s0.%se%i", (d < 0) ? "-" : "", digits,
+                     decpt);
+            e = float_strtod(a, NULL);
+            if (memcmp(& d, & e, sizeof(d))) {
+                printf("(!) Shortest digits of %.17g \"%s\": FAILURE\n", d, a);
+                return -1;
+            }
+        }
+
+        /* the fast paths agree with the C library to the last bit */
+        j = i % (sizeof(formats) / sizeof(*formats));
+        m_snprintf(a, sizeof(a), formats[j], d);
+        snprintf(b, sizeof(b), formats[j], d);
+        if (strcmp(a, b)) {
+            printf("(!) Formatting %s \"%s\" != \"%s\": FAILURE\n",
+                   formats[j], a, b);
+            return -1;
+        }
+
+        snprintf(a, sizeof(a), "%.*g", (int) (i % 17) + 1, d);
+        d = float_strtod(a, & end[0]); e = strtod(a, & end[1]);
+        if (memcmp(& d, & e, sizeof(d)) || end[0] != end[1]) {
+            printf("(!) Parsing \"%s\" %.17g != %.17g: FAILURE\n", a, d, e);
+            return -1;
+        }
+
+        r = bits % 1000000000000000000ULL;
+        snprintf(a, sizeof(a), "%" PRIu64 "e%i", r, (int) (i % 700) - 350);
+        m_snscanf(a, strlen(a), "%lf", & d); e = strtod(a, NULL);
+        if (memcmp(& d, & e, sizeof(d))) {
+            printf("(!) Scanning \"%s\" %.17g != %.17g: FAILURE\n", a, d, e);
+            return -1;
+        }
+    }
+
+    printf("(*) Round-tripping doubles bit for bit: SUCCESS\n");
+
+    start = clock();
+    for (j = 0; j < 20; j ++)
+        for (i = 0; i < sizeof(values) / sizeof(*values); i ++)
+            m_snprintf(a, sizeof(a), "%.17g", values[i]);
+    stop = clock();
+    t[0] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (j = 0; j < 20; j ++)
+        for (i = 0; i < sizeof(values) / sizeof(*values); i ++)
+            snprintf(a, sizeof(a), "%.17g", values[i]);
+    stop = clock();
+    t[1] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+    printf("(*) Formatting 200000 doubles: SUCCESS (%.3f s, %.3f s with the "
+           "C library)\n", t[0], t[1]);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_codecs(void)
+{
+    const char *vectors[] = { "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==",
+                              "Zm9vYmE=", "Zm9vYmFy" };
+    const int engines[] = { STRING_SEARCH_SCALAR, STRING_SEARCH_SSE2,
+                            STRING_SEARCH_AVX2 };
+    m_string *a = NULL, *b = NULL, *c = NULL, *ref = NULL;
+    char *data = NULL, *url = NULL;
+    clock_t start, stop;
+    double t[2][2];
+    size_t i = 0, j = 0, len = 1 << 20;
+    int e = 0, ret = -1;
+
+    for (i = 1; i < sizeof(vectors) / sizeof(*vectors); i ++) {
+        a = string_b64s("foobar", i, 0);
+        if (! a || strcmp(DATA(a), vectors[i]) || SIZE(a) != strlen(vectors[i]))
+            goto _fail;
+        a = string_free(a);
+    }
+
+    if (! (data = malloc(len)) ) goto _end;
+    for (i = 0; i < len; i ++) data[i] = (char) (i * 2654435761U >> 13);
+
+    /* every engine must produce the output of the scalar code */
+    for (e = 0; e < 3; e ++) {
+        if (string_search_engine(engines[e]) == -1) continue;
+
+        for (i = 1; i < 300; i += 7) {
+            a = string_b64s(data + i, i * 13, (i & 1) ? 72 : 0);
+            b = string_deb64(a);
+            c = string_dup(a);
+            if (! b || SIZE(b) != i * 13 || memcmp(DATA(b), data + i, SIZE(b)) ||
+                string_deb64_inplace(c) == -1 || SIZE(c) != SIZE(b) ||
+                memcmp(DATA(c), DATA(b), SIZE(b)))
+                goto _fail;
+
+            string_search_engine(STRING_SEARCH_SCALAR);
+            ref = string_b64s(data + i, i * 13, (i & 1) ? 72 : 0);
+            string_search_engine(engines[e]);
+            if (! ref || SIZE(ref) != SIZE(a) || memcmp(DATA(ref), DATA(a), SIZE(a)))
+                goto _fail;
+
+            a = string_free(a); b = string_free(b); c = string_free(c);
+            ref = string_free(ref);
+
+            a = string_b58s(data + i, i);
+            b = string_deb58(a);
+            if (! b || SIZE(b) != i || memcmp(DATA(b), data + i, i)) goto _fail;
+            a = string_free(a); b = string_free(b);
+
+            #ifdef _ENABLE_HTTP
+            if (! (url = string_rawurlencode(data + i, i * 3, 0)) ||
+                ! (a = string_alloc(url, strlen(url))) ||
+                string_urldecode(a) == -1 || SIZE(a) != i * 3 ||
+                memcmp(DATA(a), data + i, SIZE(a)))
+                goto _fail;
+            free(url); url = NULL; a = string_free(a);
+            #endif
+        }
+    }
+
+    /* nothing to decode */
+    if (! (c = string_alloc("", 0)) || string_deb64_inplace(c) != 0 || SIZE(c))
+        goto _fail;
+    c = string_free(c);
+
+    printf("(*) Base64, base58 and url encoding round trips: SUCCESS\n");
+
+    /* the scalar code against the best engine available */
+    for (e = 0; e < 2; e ++) {
+        string_search_engine((e) ? STRING_SEARCH_AUTO : STRING_SEARCH_SCALAR);
+
+        start = clock();
+        for (j = 0; j < 20; j ++)
+            a = string_free(string_b64s(data, len, 0));
+        stop = clock();
+        t[e][0] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+        a = string_b64s(data, len, 0);
+        start = clock();
+        for (j = 0; j < 20; j ++) b = string_free(string_deb64(a));
+        stop = clock();
+        t[e][1] = (double) (stop - start) / CLOCKS_PER_SEC;
+        a = string_free(a);
+    }
+
+    printf("(*) Base64 encoding and decoding of 20 MB: SUCCESS (%.3f s and "
+           "%.3f s, %.3f s and %.3f s scalar)\n", t[1][0], t[1][1], t[0][0],
+           t[0][1]);
+
+    ret = 0;
+    goto _end;
+
+_fail:
+    printf("(!) Base64, base58 and url encoding round trips: FAILURE\n");
+
+_end:
+    string_search_engine(STRING_SEARCH_AUTO);
+    string_free(a); string_free(b); string_free(c); string_free(ref);
+    free(url); free(data);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_digest(void)
+{
+    const char *vectors[][2] = {
+        { "a9993e364706816aba3e25717850c26c9cd0d89d", "abc" },
+        { "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+          "abc" },
+        { "e3069283", "123456789" },
+        { "44bc2cf5ad770999", "abc" }
+    };
+    const int engines[] = {
+        STRING_SEARCH_SCALAR, STRING_SEARCH_SSE2, STRING_SEARCH_AVX2
+    };
+    m_string_digest *d = NULL;
+    m_string *a = NULL, *b = NULL;
+    char *data = NULL;
+    clock_t start, stop;
+    double t[2][3];
+    size_t i = 0, j = 0, len = 1 << 24;
+    int e = 0, k = 0, ret = -1;
+
+    for (k = STRING_DIGEST_SHA1; k <= STRING_DIGEST_HASH64; k ++) {
+        if (! (d = string_digest_alloc(k)) || ! (a = string_alloc(NULL, 0)) ||
+            string_digest_write(d, vectors[k][1], strlen(vectors[k][1])) ||
+            string_digest_end(d, a) || strcmp(DATA(a), vectors[k][0]))
+            goto _fail;
+        d = string_digest_free(d); a = string_free(a);
+    }
+
+    if (! (data = malloc(len)) ) goto _end;
+    for (i = 0; i < len; i ++) data[i] = (char) (i * 2654435761U >> 11);
+
+    /* every engine must agree with the scalar code, however the data is fed */
+    for (k = STRING_DIGEST_SHA1; k <= STRING_DIGEST_HASH64; k ++) {
+        for (i = 0; i < 1000; i += 37) {
+            for (e = 0; e < 3; e ++) {
+                if (string_search_engine(engines[e]) == -1) continue;
+
+                if (! (d = string_digest_alloc(k)) ||
+                    ! (b = string_alloc(NULL, 0)))
+                    goto _fail;
+
+                for (j = 0; j < i; j += j % 70 + 1)
+                    string_digest_write(d, data + j, MIN(j % 70 + 1, i - j));
+                string_digest_end(d, b);
+
+                if (! e) { a = b; b = NULL; }
+                else if (string_cmp(a, b)) goto _fail;
+
+                d = string_digest_free(d); b = string_free(b);
+            }
+            a = string_free(a);
+        }
+    }
+
+    printf("(*) SHA-1, SHA-256, CRC32C and 64 bit hash: SUCCESS\n");
+
+    /* the scalar code against the best engine available */
+    for (e = 0; e < 2; e ++) {
+        string_search_engine((e) ? STRING_SEARCH_AUTO : STRING_SEARCH_SCALAR);
+
+        for (k = 0; k < 3; k ++) {
+            start = clock();
+            if (k == 0) a = string_sha1s(data, len);
+            else if (k == 1) a = string_sha256s(data, len);
+            else string_crc32c(0, data, len);
+            stop = clock();
+            a = string_free(a);
+            t[e][k] = (double) (stop - start) / CLOCKS_PER_SEC;
+        }
+    }
+
+    printf("(*) SHA-1, SHA-256 and CRC32C of 16 MB: SUCCESS (%.3f s, %.3f s "
+           "and %.3f s, %.3f s, %.3f s and %.3f s scalar)\n", t[1][0],
+           t[1][1], t[1][2], t[0][0], t[0][1], t[0][2]);
+
+    ret = 0;
+    goto _end;
+
+_fail:
+    printf("(!) SHA-1, SHA-256, CRC32C and 64 bit hash: FAILURE\n");
+
+_end:
+    string_search_engine(STRING_SEARCH_AUTO);
+    string_digest_free(d); string_free(a); string_free(b);
+    free(data);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_utf8(void)
+{
+    const struct { const char *data; size_t len, valid; } vectors[] = {
+        { "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80", 14, 14 },
+        { "\xc0\x80", 2, 0 },                 /* overlong NUL */
+        { "a\xe0\x80\xaf", 4, 1 },            /* overlong '/' */
+        { "ab\xed\xa0\x80", 5, 2 },           /* surrogate */
+        { "\xf4\x90\x80\x80", 4, 0 },         /* above U+10FFFF */
+        { "\xe2\x82", 2, 0 },                 /* truncated */
+        { "\xe2\x82\xac\x80", 4, 3 }          /* stray continuation */
+    };
+    const int engines[] = {
+        STRING_SEARCH_SCALAR, STRING_SEARCH_SSE2, STRING_SEARCH_AVX2
+    };
+    m_string *a = NULL;
+    char *data = NULL;
+    clock_t start, stop;
+    double t[3] = { 0.0, 0.0, 0.0 };
+    size_t i = 0, len = 1 << 24;
+    int e = 0, ret = -1;
+    #ifdef HAS_ICONV
+    char *out = NULL, *in = NULL, *o = NULL;
+    size_t inlen = 0, outlen = 0;
+    iconv_t conv;
+    #endif
+
+    if (! (data = malloc(len)) ) goto _end;
+
+    /* mostly ASCII text, with a two and a three byte character every 64 */
+    for (i = 0; i + 64 <= len; i += 64) {
+        memset(data + i, 'a' + (i >> 6) % 26, 59);
+        memcpy(data + i + 59, "\xc3\xa9\xe2\x82\xac", 5);
+    }
+
+    for (e = 0; e < 3; e ++) {
+        if (string_search_engine(engines[e]) == -1) continue;
+
+        for (i = 0; i < sizeof(vectors) / sizeof(*vectors); i ++) {
+            if (string_utf8_check(vectors[i].data, vectors[i].len) !=
+                vectors[i].valid)
+                goto _fail;
+        }
+
+        /* an error far in the data must be found by the vector code */
+        data[len - 100] = (char) 0xff;
+        if (string_utf8_check(data, len) != len - 100) goto _fail;
+        data[len - 100] = 'a';
+
+        start = clock();
+        if (string_utf8_check(data, len) != len) goto _fail;
+        stop = clock();
+        t[e] = (double) (stop - start) / CLOCKS_PER_SEC;
+    }
+
+    string_search_engine(STRING_SEARCH_AUTO);
+
+    printf("(*) UTF-8 validation of 16 MB: SUCCESS (%.3f s scalar, %.3f s "
+           "SSSE3, %.3f s AVX2)\n", t[0], t[1], t[2]);
+
+    #ifdef HAS_ICONV
+    /* round trips through the native conversions and through iconv */
+    if (! (a = string_alloc(data, 1 << 20)) ||
+        string_conv(a, "UTF-8", "UTF-16LE") == -1 ||
+        SIZE(a) != (1 << 20) / 64 * 122 ||
+        string_conv(a, "utf-16le", "UTF-8") == -1 ||
+        SIZE(a) != 1 << 20 || memcmp(DATA(a), data, SIZE(a)) ||
+        string_conv(a, "UTF-8", "WINDOWS-1252") == -1 ||
+        string_conv(a, "WINDOWS-1252", "ISO-8859-1") == 0 ||
+        string_conv(a, "WINDOWS-1252", "UTF-8") == -1 ||
+        SIZE(a) != 1 << 20 || memcmp(DATA(a), data, SIZE(a)) ||
+        string_conv(a, "UTF-8", "ISO-8859-1") == 0)
+        goto _fail;
+
+    a = string_free(a);
+
+    printf("(*) UTF-8, UTF-16 and Latin-1 conversions: SUCCESS\n");
+
+    /* the native conversion against iconv */
+    if (! (out = malloc(len * 2)) ) goto _end;
+
+    if ( (conv = iconv_open("UTF-16LE", "UTF-8")) == (iconv_t) -1) goto _end;
+    start = clock();
+    in = data; inlen = len; o = out; outlen = len * 2;
+    iconv(conv, & in, & inlen, & o, & outlen);
+    stop = clock();
+    t[0] = (double) (stop - start) / CLOCKS_PER_SEC;
+    iconv_close(conv);
+
+    start = clock();
+    if (string_convs(data, len, "UTF-8", out, len * 2, "UTF-16LE") == -1)
+        goto _fail;
+    stop = clock();
+    t[1] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+    printf("(*) UTF-8 to UTF-16 conversion of 16 MB: SUCCESS (%.3f s, %.3f s "
+           "with iconv)\n", t[1], t[0]);
+    #endif
+
+    ret = 0;
+    goto _end;
+
+_fail:
+    printf("(!) UTF-8 validation and conversions: FAILURE\n");
+
+_end:
+    string_search_engine(STRING_SEARCH_AUTO);
+    string_free(a); free(data);
+    #ifdef HAS_ICONV
+    free(out);
+    #endif
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_scan(void)
+{
+    const char frame[] = "\x43\x53\x00\x2a\x20\x0a\x00\x00\x00\x00\x00\x00"
+                         "\x00\x05hello\x7f";
+    const char *layout = "%bBhi%bBi%bbli%c%c";
+    m_scan *scan = NULL;
+    m_string *a = NULL, *b = NULL;
+    clock_t start, stop;
+    double t[2] = { 0.0, 0.0 };
+    char name[8], bad[sizeof(frame)], tail = 0;
+    short id = 0;
+    long l = 0;
+    int i = 0, k = 0, ret = -1;
+
+    if (! (scan = scan_compile("CS%bBhi%bbli%$bBhs%c")) ) goto _fail;
+
+    /* the bytes 0x20 and 0x0a are not text whitespaces */
+    if (! (a = string_alloc(frame, sizeof(frame) - 1)) ||
+        string_fetch_compiled(a, scan, & id, & l, sizeof(name), name,
+                              & tail) == -1 ||
+        id != 42 || l != 0x0a20 || strcmp(name, "hello") || tail != 0x7f ||
+        SIZE(a) != 0)
+        goto _fail;
+
+    a = string_free(a);
+
+    /* the string does not fit in the buffer, then in the frame */
+    if (! (a = string_alloc(frame, sizeof(frame) - 1)) ||
+        string_fetch_compiled(a, scan, & id, & l, (size_t) 4, name,
+                              & tail) != -1 || SIZE(a) != sizeof(frame) - 1)
+        goto _fail;
+
+    a = string_free(a);
+
+    memcpy(bad, frame, sizeof(bad)); bad[13] = 0x06;
+
+    if (! (a = string_alloc(bad, sizeof(bad) - 1)) ||
+        string_fetch_compiled(a, scan, & id, & l, sizeof(name), name,
+                              & tail) != -1 || errno != ENOMEM)
+        goto _fail;
+
+    a = string_free(a);
+    scan = scan_free(scan);
+
+    /* many small frames, against string_fetch_fmt() */
+    if (! (a = string_alloc(NULL, 1 << 20)) ||
+        ! (scan = scan_compile(layout)) )
+        goto _fail;
+
+    for (i = 0; i < (1 << 20) / 16; i ++)
+        string_catfmt(a, layout, i, i * 3, (long) i, 'y', 'z');
+
+    for (k = 0; k < 2; k ++) {
+        /* removing the head of an encapsulated buffer does not copy */
+        if (! (b = string_encaps(DATA(a), SIZE(a))) ) goto _fail;
+
+        start = clock();
+        while (SIZE(b)) {
+            if (k == 0 && string_fetch_compiled(b, scan, & id, & i, & l,
+                                                & tail, & tail) == -1)
+                goto _fail;
+            if (k == 1 && string_fetch_fmt(b, layout, & id, & i, & l,
+                                           & tail, & tail) == -1)
+                goto _fail;
+        }
+        stop = clock();
+        t[k] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+        b = string_free(b);
+
+        if (i != ((1 << 20) / 16 - 1) * 3 || l != i / 3 || tail != 'z')
+            goto _fail;
+    }
+
+    printf("(*) Compiled binary layouts: SUCCESS (%.3f s, %.3f s with "
+           "string_fetch_fmt)\n", t[0], t[1]);
+
+    ret = 0;
+    goto _end;
+
+_fail:
+    printf("(!) Compiled binary layouts: FAILURE\n");
+
+_end:
+    string_free(a); string_free(b);
+    scan_free(scan);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_case(void)
+{
+    const int engines[] = {
+        STRING_SEARCH_SCALAR, STRING_SEARCH_SSE2, STRING_SEARCH_AVX2
+    };
+    const char *mixed = "Content-Type: TEXT/html; charset=UTF-8 \xc9t\xe9 @[`{}";
+    const char *lower = "content-type: text/html; charset=utf-8 \xc9t\xe9 @[`{}";
+    m_string *a = NULL, *b = NULL;
+    clock_t start, stop;
+    double t[3] = { 0.0, 0.0, 0.0 };
+    char *data = NULL;
+    size_t i = 0, len = 1 << 24;
+    int e = 0, ret = -1;
+
+    if (! (data = malloc(len)) ) goto _end;
+
+    for (i = 0; i < len; i ++) data[i] = mixed[i % 48];
+
+    for (e = 0; e < 3; e ++) {
+        if (string_search_engine(engines[e]) == -1) continue;
+
+        if (! (a = string_alloc(mixed, 48)) || string_lower(a) == -1 ||
+            memcmp(DATA(a), lower, 48) || string_casecmps(a, mixed, 48) ||
+            string_upper(a) == -1 || string_casecmps(a, lower, 48) ||
+            ! (b = string_alloc(mixed, 40)) || string_casecmp(a, b) ||
+            string_casecmpn(mixed, lower, 48) ||
+            string_casecmpn("Accept", "accept-encoding", 7) >= 0 ||
+            string_casecmpn("@", "`", 1) >= 0 ||
+            string_casehash64(mixed, 48, 7) != string_hash64(lower, 48, 7))
+            goto _fail;
+
+        a = string_free(a); b = string_free(b);
+
+        /* a mismatch far in the data must be found by the vector code */
+        if (! (a = string_alloc(data, len)) ) goto _fail;
+
+        start = clock();
+        if (string_lower(a) == -1 || string_upper(a) == -1 ||
+            string_casecmps(a, data, len) || string_casecmpn(data + 48,
+            DATA(a), len - 48) != 0)
+            goto _fail;
+        stop = clock();
+        t[e] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+        data[len - 7] ^= 0x40;
+        if (string_casecmps(a, data, len) == 0) goto _fail;
+        data[len - 7] ^= 0x40;
+
+        a = string_free(a);
+    }
+
+    printf("(*) ASCII case folding and comparison of 16 MB: SUCCESS (%.3f s "
+           "scalar, %.3f s SSE2, %.3f s AVX2)\n", t[0], t[1], t[2]);
+
+    ret = 0;
+    goto _end;
+
+_fail:
+    printf("(!) ASCII case folding and comparison: FAILURE\n");
+
+_end:
+    string_search_engine(STRING_SEARCH_AUTO);
+    string_free(a); string_free(b);
+    free(data);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_zstream(void)
+{
+    const int codecs[] = {
+        #ifdef HAS_ZLIB
+        STRING_CODEC_DEFLATE, STRING_CODEC_GZIP, STRING_CODEC_RAW,
+        #endif
+        STRING_CODEC_LZ
+    };
+    m_string_zstream *c = NULL, *d = NULL;
+    m_string *data = NULL, *packed = NULL, *out = NULL;
+    clock_t start, stop;
+    double t = 0;
+    size_t i = 0, n = 0, chunk = 0;
+    unsigned int k = 0;
+    int ret = -1;
+
+    /* text like payload, with some noise which does not compress */
+    if (! (data = string_alloc(NULL, 0)) ) return -1;
+    for (i = 0; i < 30000; i ++)
+        string_catfmt(data, "{\"id\":%zu,\"name\":\"item %zu\",\"noise\":%u}\n",
+                      i, i % 97, (unsigned int) (i * 2654435761U));
+
+    for (k = 0; k < sizeof(codecs) / sizeof(*codecs); k ++) {
+        if (! (packed = string_alloc(NULL, 0)) ||
+            ! (out = string_alloc(NULL, 0)) ||
+            ! (c = string_compressor_alloc(codecs[k], 1)) ||
+            ! (d = string_decompressor_alloc(codecs[k])) ) goto _end;
+
+        /* feed uneven chunks, flushing now and then */
+        start = clock();
+        for (i = 0, chunk = 1; i < SIZE(data); i += n, chunk = chunk * 7 + 3) {
+            n = (SIZE(data) - i < chunk % 100000) ? SIZE(data) - i :
+                chunk % 100000;
+            if (string_zstream_write(c, DATA(data) + i, n, packed) == -1 ||
+                (chunk % 5 == 0 && string_zstream_flush(c, packed) == -1))
+                break;
+        }
+        if (i < SIZE(data) || string_zstream_end(c, packed) == -1) {
+            printf("(!) Compressing a stream (codec %i): FAILURE\n", codecs[k]);
+            goto _end;
+        }
+        stop = clock();
+        t = (double) (stop - start) / CLOCKS_PER_SEC;
+
+        for (i = 0, chunk = 1; i < SIZE(packed); i += n, chunk = chunk * 5 + 1) {
+            n = (SIZE(packed) - i < chunk % 7000) ? SIZE(packed) - i :
+                chunk % 7000;
+            if (string_zstream_write(d, DATA(packed) + i, n, out) == -1) break;
+        }
+        if (i < SIZE(packed) || string_zstream_end(d, out) == -1 ||
+            SIZE(out) != SIZE(data) || memcmp(DATA(out), DATA(data), SIZE(data))) {
+            printf("(!) Decompressing a stream (codec %i): FAILURE\n", codecs[k]);
+            goto _end;
+        }
+
+        printf("(*) Compressing a stream (codec %i): SUCCESS "
+               "(%zu to %zu bytes, %.3f s)\n", codecs[k], SIZE(data),
+               SIZE(packed), t);
+
+        /* truncated streams are detected */
+        c = string_zstream_free(c); d = string_zstream_free(d);
+        string_suppr(out, 0, SIZE(out));
+
+        if (! (d = string_decompressor_alloc(codecs[k])) ) goto _end;
+
+        if (string_zstream_write(d, DATA(packed), SIZE(packed) - 3, out) != -1
+            && string_zstream_end(d, out) != -1) {
+            printf("(!) Rejecting a truncated stream (codec %i): FAILURE\n",
+                   codecs[k]);
+            goto _end;
+        }
+
+        d = string_zstream_free(d);
+        packed = string_free(packed); out = string_free(out);
+    }
+
+    #ifdef HAS_ZLIB
+    /* one shot, without knowing the original size */
+    if (! (packed = string_compress(data)) ||
+        ! (out = string_uncompress(packed, 0)) || SIZE(out) != SIZE(data) ||
+        memcmp(DATA(out), DATA(data), SIZE(data))) {
+        printf("(!) Uncompressing a string of unknown size: FAILURE\n");
+        goto _end;
+    } else printf("(*) Uncompressing a string of unknown size: SUCCESS\n");
+    #endif
+
+    ret = 0;
+
+_end:
+    string_zstream_free(c); string_zstream_free(d);
+    string_free(data); string_free(packed); string_free(out);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+#if (_ENABLE_PCRE && HAS_PCRE)
+/* -------------------------------------------------------------------------- */
+
+static int test_regex(void)
+{
+    const char *pattern = "([a-z]+)=([0-9]+)";
+    m_string *s = NULL;
+    m_regex *r = NULL, *u = NULL;
+    clock_t start, stop;
+    double t[2];
+    unsigned int i = 0;
+    int ret = -1;
+
+    if (! (s = string_alloc("a=1;bb=22;ccc=333", 17)) ) return -1;
+
+    if (! (r = string_regex_alloc(pattern, strlen(pattern), PCRE_DOTALL)) ||
+        string_parse_regex(s, r) == -1 || PARTS(s) != 3 ||
+        PARTS(TOKEN(s, 2)) != 2 || TOKEN_SIZE(TOKEN(s, 2), 1) != 3 ||
+        memcmp(TOKEN_DATA(TOKEN(s, 2), 1), "333", 3)) {
+        printf("(!) Parsing with a compiled regex: FAILURE\n");
+        goto _end;
+    } else printf("(*) Parsing with a compiled regex: SUCCESS\n");
+
+    /* empty matches move forward */
+    if (string_parse(s, "x*", 2) == -1 || PARTS(s) != SIZE(s) + 1) {
+        printf("(!) Parsing empty matches: FAILURE\n");
+        goto _end;
+    }
+
+    start = clock();
+    for (i = 0; i < 20000; i ++) string_parse(s, pattern, strlen(pattern));
+    stop = clock();
+    t[0] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (i = 0; i < 20000; i ++) {
+        u = string_regex_alloc(pattern, strlen(pattern), PCRE_DOTALL);
+        string_parse_regex(s, u);
+        u = string_regex_free(u);
+    }
+    stop = clock();
+    t[1] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+    if (PARTS(s) != 3 || TOKEN_SIZE(TOKEN(s, 1), 0) != 2) {
+        printf("(!) Parsing with cached regexes: FAILURE\n");
+        goto _end;
+    }
+
+    printf("(*) Parsing with cached regexes: SUCCESS "
+           "(%.3f s, %.3f s compiling each time)\n", t[0], t[1]);
+
+    ret = 0;
+
+_end:
+    string_regex_free(r);
+    string_free(s);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+#ifdef _ENABLE_JSON
+/* -------------------------------------------------------------------------- */
+
+static int CALLBACK trace_init(int type, m_json_parser *ctx)
+{
+    if (ctx->key.current)
+        string_catfmt(ctx->context, "%.*s:", (int) ctx->key.len,
+                      ctx->key.current);
+    string_cats(ctx->context, (type == JSON_OBJECT) ? "{" : "[", 1);
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int CALLBACK trace_data(int type, const char *data, size_t len,
+                               m_json_parser *ctx)
+{
+    if (ctx->key.current)
+        string_catfmt(ctx->context, "%.*s:", (int) ctx->key.len,
+                      ctx->key.current);
+    string_catfmt(ctx->context, "%.*s,", (int) len, data);
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int CALLBACK trace_exit(int type, m_json_parser *ctx)
+{
+    string_cats(ctx->context, (type == JSON_OBJECT) ? "}" : "]", 1);
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_json_stream(const char *good, const char *json5,
+                            const char **bad, unsigned int bad_count)
+{
+    const char *expected = "{obj:{b:false,z:[,]}unicode:\\u611b,"
+                           "matrix:[[[1,2,][2,3,]]]empty:{}}";
+    m_json_parser ctx = { NULL, { NULL, 0 }, 0,
+                          trace_init, trace_data, trace_exit };
+    m_json_stream *js = NULL;
+    m_string *a = NULL, *b = NULL;
+    unsigned int i = 0, j = 0;
+    size_t len = strlen(good);
+    int ret = -1;
+
+    if (! (js = string_json_stream_alloc(JSON_STRICT, 0, & ctx)) ) return -1;
+
+    /* the whole document, then byte by byte */
+    a = string_alloc(NULL, 0); b = string_alloc(NULL, 0);
+
+    ctx.context = a;
+    string_json_stream_parse(js, good, len);
+    string_json_stream_end(js);
+
+    ctx.context = b;
+    for (i = 0; i < len; i ++) string_json_stream_parse(js, good + i, 1);
+
+    if (string_json_stream_end(js) == -1 || ! DATA(a) ||
+        strcmp(DATA(a), expected) || ! DATA(b) || strcmp(DATA(b), expected)) {
+        printf("(!) Parsing a JSON stream byte by byte: FAILURE\n");
+        goto _end;
+    } else printf("(*) Parsing a JSON stream byte by byte: SUCCESS\n");
+
+    /* incorrect JSON must be rejected whatever the chunks */
+    for (i = 0; i < bad_count; i ++) {
+        for (j = 0, len = strlen(bad[i]); j < len; j += 3)
+            if (string_json_stream_parse(js, bad[i] + j,
+                                         MIN(3, len - j)) == -1) break;
+
+        if (string_json_stream_end(js) != -1) {
+            printf("(!) Rejecting incorrect JSON stream %s: FAILURE\n", bad[i]);
+            goto _end;
+        }
+    }
+    printf("(*) Rejecting incorrect JSON streams: SUCCESS\n");
+
+    /* like json_checker, a stream without any value is incorrect */
+    string_json_stream_parse(js, " \r\n\t ", 5);
+
+    if (string_json_stream_end(js) != -1 || string_json_stream_end(js) != -1) {
+        printf("(!) Rejecting empty JSON streams: FAILURE\n");
+        goto _end;
+    } else printf("(*) Rejecting empty JSON streams: SUCCESS\n");
+
+    /* nesting is limited */
+    js = string_json_stream_free(js);
+    if (! (js = string_json_stream_alloc(JSON_QUIRKS, 4, NULL)) ) goto _end;
+
+    for (j = 0, len = strlen(json5); j < len; j += 5)
+        if (string_json_stream_parse(js, json5 + j, MIN(5, len - j)) == -1)
+            break;
+
+    if (string_json_stream_end(js) == -1 ||
+        string_json_stream_parse(js, "[[[[[]]]]]", 10) != -1) {
+        printf("(!) Parsing a JSON5 stream in QUIRKS mode: FAILURE\n");
+        goto _end;
+    } else printf("(*) Parsing a JSON5 stream in QUIRKS mode: SUCCESS\n");
+
+    ret = 0;
+
+_end:
+    string_json_stream_free(js);
+    string_free(a); string_free(b);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_json_scan(const char *good, const char **bad,
+                          unsigned int bad_count)
+{
+    m_json_parser ctx = { NULL, { NULL, 0 }, 0,
+                          trace_init, trace_data, trace_exit };
+    m_json_stream *js = NULL;
+    m_string *doc = NULL, *a = NULL, *b = NULL;
+    clock_t start, stop;
+    double t[2];
+    unsigned int i = 0;
+    int ret = -1, r = 0;
+
+    /* both parsers must report the same elements on a large document */
+    doc = string_alloc("[", 1);
+    for (i = 0; i < 20000; i ++)
+        string_catfmt(doc, "%s%s", (i) ? "," : "", good);
+    string_cats(doc, "]", 1);
+
+    a = string_alloc(NULL, 0); b = string_alloc(NULL, 0);
+
+    if (! (js = string_json_stream_alloc(JSON_STRICT, 0, & ctx)) ) goto _end;
+
+    ctx.context = a;
+    string_json_stream_parse(js, DATA(doc), SIZE(doc));
+    string_json_stream_end(js);
+
+    ctx.context = b;
+    r = string_scan_json(DATA(doc), SIZE(doc), JSON_STRICT, & ctx);
+
+    if (r || ! DATA(a) || ! DATA(b) || SIZE(a) != SIZE(b) ||
+        memcmp(DATA(a), DATA(b), SIZE(a))) {
+        printf("(!) Scanning JSON in two stages: FAILURE\n");
+        goto _end;
+    }
+
+    /* validation only */
+    js = string_json_stream_free(js);
+    if (! (js = string_json_stream_alloc(JSON_STRICT, 0, NULL)) ) goto _end;
+
+    start = clock();
+    string_json_stream_parse(js, DATA(doc), SIZE(doc));
+    string_json_stream_end(js);
+    stop = clock();
+    t[0] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    r = string_scan_json(DATA(doc), SIZE(doc), JSON_STRICT, NULL);
+    stop = clock();
+    t[1] = (double) (stop - start) / CLOCKS_PER_SEC;
+
+    printf("(*) Scanning JSON in two stages: SUCCESS "
+           "(%.3f s, %.3f s byte by byte)\n", t[1], t[0]);
+
+    /* incorrect JSON must be rejected */
+    for (i = 0; i < bad_count; i ++) {
+        if (string_scan_json(bad[i], strlen(bad[i]), JSON_STRICT, NULL) != -1) {
+            printf("(!) Rejecting incorrect JSON %s: FAILURE\n", bad[i]);
+            goto _end;
+        }
+    }
+    printf("(*) Rejecting incorrect JSON in two stages: SUCCESS\n");
+
+    /* a document without any value is incorrect in both modes */
+    if (string_scan_json("", 0, JSON_STRICT, NULL) != -1 ||
+        string_scan_json(" \r\n\t ", 5, JSON_STRICT, NULL) != -1 ||
+        string_scan_json(" \r\n\t ", 5, JSON_QUIRKS, NULL) != -1) {
+        printf("(!) Rejecting empty JSON in two stages: FAILURE\n");
+        goto _end;
+    } else printf("(*) Rejecting empty JSON in two stages: SUCCESS\n");
+
+    ret = 0;
+
+_end:
+    string_json_stream_free(js);
+    string_free(doc); string_free(a); string_free(b);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_json_doc(const char *good)
+{
+    const char *escaped = "{\"a\\/b\": 1, \"\\u0041\": 2, "
+                          "\"\\ud83d\\ude00\": 3}";
+    const char *unbalanced[] = {
+        "{\"a\":1}}", "[1]]", "[1] x", "{\"a\":[1}]", "[[1]", "{\"}\":1]"
+    };
+    m_string *s = NULL;
+    m_json_doc *doc = NULL;
+    m_json_path *path = NULL;
+    m_json_node *n = NULL;
+    int64_t i = 0;
+    double d = 0;
+    int ret = -1;
+
+    s = string_alloc(good, strlen(good));
+    if (! (doc = string_json_doc_alloc(s)) ) goto _end;
+
+    /* the values are slices of the source */
+    if (! (n = string_json_get(doc, "/obj/b")) || ! IS_PRIMITIVE(n) ||
+        DATA(n) < DATA(s) || DATA(n) >= DATA(s) + SIZE(s) ||
+        SIZE(n) != 5 || memcmp(DATA(n), "false", 5) ||
+        ! (n = string_json_get(doc, "/unicode")) || ! IS_STRING(n) ||
+        SIZE(n) != 6 || memcmp(DATA(n), "\\u611b", 6) ||
+        ! (n = string_json_get(doc, "/obj/z/0")) || ! IS_STRING(n) ||
+        SIZE(n) || string_json_get(doc, "/obj/z/1") ||
+        ! (n = string_json_get(doc, "/empty")) || ! IS_OBJECT(n) ||
+        string_json_next(doc, n, NULL) || n->parts ||
+        string_json_get(doc, "/missing") || string_json_get(doc, "/obj/b/c")) {
+        printf("(!) Looking JSON pointers up: FAILURE\n");
+        goto _end;
+    }
+
+    /* lazy numbers and compiled paths */
+    if (! (path = string_json_path_compile("/matrix/0/1/0")) ||
+        ! (n = string_json_lookup(doc, path)) ||
+        string_json_integer(n, & i) == -1 || i != 2 ||
+        string_json_number(n, & d) == -1 || d != 2.0 ||
+        string_json_get(doc, "/matrix/00")) {
+        printf("(!) Decoding JSON numbers: FAILURE\n");
+        goto _end;
+    }
+
+    doc = string_json_doc_free(doc);
+    string_free(s);
+
+    /* escaped pointers, and nothing is parsed past the requested values */
+    s = string_alloc("{\"a/b\": {\"~\": -1.5e2, \"n\": -9223372036854775808}, "
+                     "\"c\": [1, x]}", 62);
+    if (! (doc = string_json_doc_alloc(s)) ||
+        ! (n = string_json_get(doc, "/a~1b/~0")) ||
+        string_json_number(n, & d) == -1 || d != -150.0 ||
+        string_json_integer(n, & i) != -1 ||
+        ! (n = string_json_get(doc, "/a~1b/n")) ||
+        string_json_integer(n, & i) == -1 || i != INT64_MIN ||
+        ! (n = string_json_get(doc, "/c")) || HAS_ERROR(n) ||
+        ! string_json_get(doc, "/c/0") || string_json_get(doc, "/c/1") ||
+        ! HAS_ERROR(n)) {
+        printf("(!) Expanding JSON documents lazily: FAILURE\n");
+        goto _end;
+    }
+
+    printf("(*) Looking JSON pointers up in a lazy document: SUCCESS\n");
+
+    doc = string_json_doc_free(doc);
+    string_free(s);
+
+    /* the escaped keys are decoded */
+    s = string_alloc(escaped, strlen(escaped));
+    if (! (doc = string_json_doc_alloc(s)) ||
+        ! (n = string_json_child(doc, string_json_root(doc), "a/b", 3)) ||
+        string_json_integer(n, & i) == -1 || i != 1 ||
+        ! (n = string_json_get(doc, "/A")) ||
+        string_json_integer(n, & i) == -1 || i != 2 ||
+        ! (n = string_json_get(doc, "/\xf0\x9f\x98\x80")) ||
+        string_json_integer(n, & i) == -1 || i != 3 ||
+        string_json_get(doc, "/a\\/b") || string_json_get(doc, "/\\u0041")) {
+        printf("(!) Looking escaped JSON keys up: FAILURE\n");
+        goto _end;
+    } else printf("(*) Looking escaped JSON keys up: SUCCESS\n");
+
+    doc = string_json_doc_free(doc);
+    string_free(s);
+
+    /* the brackets must be balanced, without trailing tokens */
+    for (i = 0; i < 6; i ++) {
+        s = string_alloc(unbalanced[i], strlen(unbalanced[i]));
+        if ( (doc = string_json_doc_alloc(s)) ) {
+            printf("(!) Rejecting unbalanced JSON %s: FAILURE\n",
+                   unbalanced[i]);
+            goto _end;
+        }
+        s = string_free(s);
+    }
+
+    s = string_alloc(" [1] \n", 6);
+    if (! (doc = string_json_doc_alloc(s)) ) {
+        printf("(!) Rejecting unbalanced JSON: FAILURE\n");
+        goto _end;
+    } else printf("(*) Rejecting unbalanced JSON: SUCCESS\n");
+
+    ret = 0;
+
+_end:
+    string_json_path_free(path);
+    string_json_doc_free(doc);
+    string_free(s);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int test_writer(void)
+{
+    const char *json = "{\"id\":-9223372036854775808,\"name\":\"a\\\"b\\\\\\n"
+                       "\\u0001\xc3\xa9\",\"v\":[0.1,-2.5e-7,1e+21,null,true,"
+                       "{},[]]}";
+    const char *text = "plain,\"a,b\",\"say \"\"hi\"\"\",42,0.5\n,x\n";
+    m_string *s = NULL;
+    m_string_writer w;
+    uint64_t bits = 0;
+    double d = 0, r = 0;
+    unsigned int i = 0;
+    char *end = NULL;
+    int ret = -1;
+
+    s = string_alloc(NULL, 0);
+
+    string_writer_init(& w, s, ',');
+    string_json_begin_object(& w);
+    string_json_key(& w, "id", 2);
+    string_json_int(& w, INT64_MIN);
+    string_json_key(& w, "name", 4);
+    string_json_str(& w, "a\"b\\\n\x01\xc3\xa9", 8);
+    string_json_key(& w, "v", 1);
+    string_json_begin_array(& w);
+    string_json_double(& w, 0.1);
+    string_json_double(& w, -2.5e-7);
+    string_json_double(& w, 1e21);
+    string_json_double(& w, 0.0 / 0.0);
+    string_json_bool(& w, 1);
+    string_json_begin_object(& w); string_json_end(& w);
+    string_json_begin_array(& w); string_json_end(& w);
+    string_json_end(& w);
+
+    if (string_json_end(& w) == -1 || string_json_end(& w) != -1 ||
+        ! DATA(s) || strcmp(DATA(s), json) ||
+        string_scan_json(DATA(s), SIZE(s), JSON_STRICT, NULL) == -1) {
+        printf("(!) Writing JSON: FAILURE\n");
+        goto _end;
+    }
+
+    /* keys only in objects, values in objects only after their key */
+    string_suppr(s, 0, SIZE(s));
+    string_writer_init(& w, s, ',');
+
+    if (string_json_key(& w, "k", 1) != -1 ||
+        string_json_begin_array(& w) == -1 ||
+        string_json_key(& w, "k", 1) != -1 ||
+        string_json_end(& w) == -1 || strcmp(DATA(s), "[]")) {
+        printf("(!) Writing a JSON key outside of an object: FAILURE\n");
+        goto _end;
+    }
+
+    string_suppr(s, 0, SIZE(s));
+    string_writer_init(& w, s, ',');
+    string_json_begin_object(& w);
+    string_json_key(& w, "a", 1);
+    string_json_int(& w, 1);
+
+    if (string_json_str(& w, "x", 1) != -1 ||
+        string_json_null(& w) != -1 || string_json_begin_array(& w) != -1 ||
+        string_json_key(& w, "b", 1) == -1 ||
+        string_json_key(& w, "c", 1) != -1 || string_json_end(& w) != -1 ||
+        string_json_int(& w, 2) == -1 || string_json_end(& w) == -1 ||
+        strcmp(DATA(s), "{\"a\":1,\"b\":2}")) {
+        printf("(!) Writing a JSON value without its key: FAILURE\n");
+        goto _end;
+    }
+
+    string_suppr(s, 0, SIZE(s));
+    string_writer_init(& w, s, ',');
+    string_text_field(& w, "plain", 5);
+    string_text_field(& w, "a,b", 3);
+    string_text_field(& w, "say \"hi\"", 8);
+    string_text_int(& w, 42);
+    string_text_double(& w, 0.5);
+    string_text_end(& w);
+    string_text_field(& w, "", 0);
+    string_text_field(& w, "x", 1);
+    string_text_end(& w);
+
+    if (! DATA(s) || strcmp(DATA(s), text)) {
+        printf("(!) Writing delimited text: FAILURE\n");
+        goto _end;
+    }
+
+    /* the numbers must read back exactly */
+    for (i = 0; i < 10000; i ++) {
+        bits = ((uint64_t) rand() << 42) ^ ((uint64_t) rand() << 21) ^ rand();
+        memcpy(& d, & bits, sizeof(d));
+        if (d != d || d - d != 0) continue;
+
+        string_suppr(s, 0, SIZE(s));
+        string_writer_init(& w, s, ',');
+        string_json_double(& w, d);
+        r = strtod(DATA(s), & end);
+        if (r != d || *end) {
+            printf("(!) Writing JSON numbers (%s): FAILURE\n", DATA(s));
+            goto _end;
+        }
+    }
+
+    /* strtod() reports the subnormals with ERANGE */
+    errno = 0;
+
+    printf("(*) Writing JSON and delimited text: SUCCESS\n");
+
+    ret = 0;
+
+_end:
+    string_free(s);
+
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+#endif
+/* -------------------------------------------------------------------------- */
+
 int test_string(void)
 {
     const char *str = "这个服务器有没有问题";
@@ -210,6 +1725,11 @@ int test_string(void)
         printf("(!) Error!\n");
     print_tokens(z, 0);
     z = string_free(z);
+
+    if (test_json_stream(good_json, json5, bad, bad_json) == -1) return -1;
+    if (test_json_scan(good_json, bad, bad_json) == -1) return -1;
+    if (test_json_doc(good_json) == -1) return -1;
+    if (test_writer() == -1) return -1;
     #endif
 
     /* catch integer overflow */
@@ -259,6 +1779,12 @@ int test_string(void)
     printf("(*) Looking for \"a\"\n");
     string_parse(a, "a", strlen("a"));
     print_tokens(a, 0);
+
+    if (test_regex() == -1) {
+        w = string_free(w);
+        a = string_free(a);
+        return -1;
+    }
     #endif
 
     /* looking for "je" */
@@ -600,6 +2126,46 @@ int test_string(void)
     z = string_free(z);
     #endif
 
+    if (test_zstream() == -1) {
+        w = string_free(w);
+        return -1;
+    }
+
+    if (test_fmt_compiled() == -1) {
+        w = string_free(w);
+        return -1;
+    }
+
+    if (test_float() == -1) {
+        w = string_free(w);
+        return -1;
+    }
+
+    if (test_codecs() == -1) {
+        w = string_free(w);
+        return -1;
+    }
+
+    if (test_digest() == -1) {
+        w = string_free(w);
+        return -1;
+    }
+
+    if (test_utf8() == -1) {
+        w = string_free(w);
+        return -1;
+    }
+
+    if (test_scan() == -1) {
+        w = string_free(w);
+        return -1;
+    }
+
+    if (test_case() == -1) {
+        w = string_free(w);
+        return -1;
+    }
+
     w = string_free(w);
 
     /* test complex string generation */
@@ -637,6 +2203,27 @@ int test_string(void)
 
     z = string_free(z);
 
+    /* short strings share their allocation with the struct */
+    z = string_alloc("short", strlen("short"));
+
+    if (DATA(z) != (const char *) (z + 1) ||
+        ! string_cats(z, " strings are moved out when they grow",
+                      strlen(" strings are moved out when they grow")) ||
+        DATA(z) == (const char *) (z + 1) ||
+        strcmp(DATA(z), "short strings are moved out when they grow")) {
+        printf("(!) Growing a short string: FAILURE\n");
+        z = string_free(z);
+        return -1;
+    } else printf("(*) Growing a short string \"%s\": SUCCESS\n", DATA(z));
+
+    z = string_free(z);
+
+    printf("(-) Testing the substring search engines.\n");
+
+    if (test_search() == -1 || test_search_set() == -1 || test_cursor() == -1 ||
+        test_arena() == -1 || test_share() == -1)
+        return -1;
+
     setlocale(LC_CTYPE, "en_US.UTF8");
 
     return 0;